@@ -33,9 +33,61 @@
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <limits.h>
 #include "sds.h"
 #include "zmalloc.h"
 
+/* Return the size of the header of the given type. */
+static inline int sdsHdrSize(char type) {
+    switch(type&SDS_TYPE_MASK) {
+    case SDS_TYPE_8: return sizeof(struct sdshdr8);
+    case SDS_TYPE_16: return sizeof(struct sdshdr16);
+    case SDS_TYPE_32: return sizeof(struct sdshdr32);
+    case SDS_TYPE_64: return sizeof(struct sdshdr64);
+    }
+    return 0;
+}
+
+/* Return the smallest header type able to hold a buffer of 'size' bytes. */
+static inline char sdsReqType(size_t size) {
+    if (size < 1<<8) return SDS_TYPE_8;
+    if (size < 1<<16) return SDS_TYPE_16;
+#if (LONG_MAX == LLONG_MAX)
+    if (size < 1ll<<32) return SDS_TYPE_32;
+    return SDS_TYPE_64;
+#else
+    return SDS_TYPE_32;
+#endif
+}
+
+static inline void sdssetlen(sds s, size_t newlen) {
+    switch(s[-1]&SDS_TYPE_MASK) {
+    case SDS_TYPE_8: SDS_HDR(8,s)->len = newlen; break;
+    case SDS_TYPE_16: SDS_HDR(16,s)->len = newlen; break;
+    case SDS_TYPE_32: SDS_HDR(32,s)->len = newlen; break;
+    case SDS_TYPE_64: SDS_HDR(64,s)->len = newlen; break;
+    }
+}
+
+static inline size_t sdsalloc(const sds s) {
+    switch(s[-1]&SDS_TYPE_MASK) {
+    case SDS_TYPE_8: return SDS_HDR(8,s)->alloc;
+    case SDS_TYPE_16: return SDS_HDR(16,s)->alloc;
+    case SDS_TYPE_32: return SDS_HDR(32,s)->alloc;
+    case SDS_TYPE_64: return SDS_HDR(64,s)->alloc;
+    }
+    return 0;
+}
+
+static inline void sdssetalloc(sds s, size_t newlen) {
+    switch(s[-1]&SDS_TYPE_MASK) {
+    case SDS_TYPE_8: SDS_HDR(8,s)->alloc = newlen; break;
+    case SDS_TYPE_16: SDS_HDR(16,s)->alloc = newlen; break;
+    case SDS_TYPE_32: SDS_HDR(32,s)->alloc = newlen; break;
+    case SDS_TYPE_64: SDS_HDR(64,s)->alloc = newlen; break;
+    }
+}
+
 /* Create a new sds string with the content specified by the 'init' pointer
  * and 'initlen'.
  * If NULL is used for 'init' the string is initialized with zero bytes.
@@ -47,22 +99,30 @@
  *
  * You can print the string with printf() as there is an implicit \0 at the
  * end of the string. However the string is binary safe and can contain
- * \0 characters in the middle, as the length is stored in the sds header. */
+ * \0 characters in the middle, as the length is stored in the sds header.
+ *
+ * The header is the smallest one able to hold 'initlen': a string shorter
+ * than 256 bytes only uses 3 bytes of header. */
 sds sdsnewlen(const void *init, size_t initlen) {
-    struct sdshdr *sh;
+    char type = sdsReqType(initlen);
+    int hdrlen = sdsHdrSize(type);
+    void *sh;
+    sds s;
 
     if (init) {
-        sh = zmalloc(sizeof(struct sdshdr)+initlen+1);
+        sh = zmalloc(hdrlen+initlen+1);
     } else {
-        sh = zcalloc(sizeof(struct sdshdr)+initlen+1);
+        sh = zcalloc(hdrlen+initlen+1);
     }
     if (sh == NULL) return NULL;
-    sh->len = initlen;
-    sh->free = 0;
+    s = (char*)sh+hdrlen;
+    s[-1] = type;
+    sdssetlen(s,initlen);
+    sdssetalloc(s,initlen);
     if (initlen && init)
-        memcpy(sh->buf, init, initlen);
-    sh->buf[initlen] = '\0';
-    return (char*)sh->buf;
+        memcpy(s, init, initlen);
+    s[initlen] = '\0';
+    return s;
 }
 
 /* Create an empty (zero length) sds string. Even in this case the string
@@ -85,7 +145,7 @@ sds sdsdup(const sds s) {
 /* Free an sds string. No operation is performed if 's' is NULL. */
 void sdsfree(sds s) {
     if (s == NULL) return;
-    zfree(s-sizeof(struct sdshdr));
+    zfree(sdsAllocPtr(s));
 }
 
 /* Set the sds string length to the length as obtained with strlen(), so
@@ -103,10 +163,7 @@ void sdsfree(sds s) {
  * the output will be "6" as the string was modified but the logical length
  * remains 6 bytes. */
 void sdsupdatelen(sds s) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
-    int reallen = strlen(s);
-    sh->free += (sh->len-reallen);
-    sh->len = reallen;
+    sdssetlen(s,strlen(s));
 }
 
 /* Modify an sds string on-place to make it empty (zero length).
@@ -114,51 +171,87 @@ void sdsupdatelen(sds s) {
  * so that next append operations will not require allocations up to the
  * number of bytes previously available. */
 void sdsclear(sds s) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
-    sh->free += sh->len;
-    sh->len = 0;
-    sh->buf[0] = '\0';
+    sdssetlen(s,0);
+    s[0] = '\0';
 }
 
 /* Enlarge the free space at the end of the sds string so that the caller
  * is sure that after calling this function can overwrite up to addlen
  * bytes after the end of the string, plus one more byte for nul term.
+ *
+ * When the new buffer no longer fits the current header type the string
+ * is moved to a new allocation with a larger header.
  * 
  * Note: this does not change the *length* of the sds string as returned
  * by sdslen(), but only the free buffer space we have. */
 sds sdsMakeRoomFor(sds s, size_t addlen) {
-    struct sdshdr *sh, *newsh;
-    size_t free = sdsavail(s);
+    void *sh, *newsh;
+    size_t avail = sdsavail(s);
     size_t len, newlen;
+    char type, oldtype = s[-1] & SDS_TYPE_MASK;
+    int hdrlen;
 
-    if (free >= addlen) return s;
+    if (avail >= addlen) return s;
     len = sdslen(s);
-    sh = (void*) (s-(sizeof(struct sdshdr)));
+    sh = sdsAllocPtr(s);
     newlen = (len+addlen);
     if (newlen < SDS_MAX_PREALLOC)
         newlen *= 2;
     else
         newlen += SDS_MAX_PREALLOC;
-    newsh = zrealloc(sh, sizeof(struct sdshdr)+newlen+1);
-    if (newsh == NULL) return NULL;
 
-    newsh->free = newlen - len;
-    return newsh->buf;
+    type = sdsReqType(newlen);
+    hdrlen = sdsHdrSize(type);
+    if (oldtype == type) {
+        newsh = zrealloc(sh, hdrlen+newlen+1);
+        if (newsh == NULL) return NULL;
+        s = (char*)newsh+hdrlen;
+    } else {
+        /* The header grows, so the string must move forward: realloc()
+         * would copy it once, and we would have to move it again. */
+        newsh = zmalloc(hdrlen+newlen+1);
+        if (newsh == NULL) return NULL;
+        memcpy((char*)newsh+hdrlen, s, len+1);
+        zfree(sh);
+        s = (char*)newsh+hdrlen;
+        s[-1] = type;
+        sdssetlen(s,len);
+    }
+    sdssetalloc(s,newlen);
+    return s;
 }
 
 /* Reallocate the sds string so that it has no free space at the end. The
  * contained string remains not altered, but next concatenation operations
- * will require a reallocation.
+ * will require a reallocation. The header is shrunk as well when the
+ * length fits a smaller header type.
  *
  * After the call, the passed sds string is no longer valid and all the
  * references must be substituted with the new pointer returned by the call. */
 sds sdsRemoveFreeSpace(sds s) {
-    struct sdshdr *sh;
-
-    sh = (void*) (s-(sizeof(struct sdshdr)));
-    sh = zrealloc(sh, sizeof(struct sdshdr)+sh->len+1);
-    sh->free = 0;
-    return sh->buf;
+    void *sh, *newsh;
+    char type, oldtype = s[-1] & SDS_TYPE_MASK;
+    int hdrlen;
+    size_t len = sdslen(s);
+
+    sh = sdsAllocPtr(s);
+    type = sdsReqType(len);
+    hdrlen = sdsHdrSize(type);
+    if (oldtype == type) {
+        newsh = zrealloc(sh, hdrlen+len+1);
+        if (newsh == NULL) return NULL;
+        s = (char*)newsh+hdrlen;
+    } else {
+        newsh = zmalloc(hdrlen+len+1);
+        if (newsh == NULL) return NULL;
+        memcpy((char*)newsh+hdrlen, s, len+1);
+        zfree(sh);
+        s = (char*)newsh+hdrlen;
+        s[-1] = type;
+        sdssetlen(s,len);
+    }
+    sdssetalloc(s,len);
+    return s;
 }
 
 /* Return the total size of the allocation of the specifed sds string,
@@ -169,9 +262,13 @@ sds sdsRemoveFreeSpace(sds s) {
  * 4) The implicit null term.
  */
 size_t sdsAllocSize(sds s) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
+    return sdsHdrSize(s[-1])+sdsalloc(s)+1;
+}
 
-    return sizeof(*sh)+sh->len+sh->free+1;
+/* Return the pointer of the actual allocation, that is where the header
+ * starts. Useful to query the allocator with zmalloc_size(). */
+void *sdsAllocPtr(sds s) {
+    return (void*)(s-sdsHdrSize(s[-1]));
 }
 
 /* Increment the sds length and decrements the left free space at the
@@ -197,14 +294,14 @@ size_t sdsAllocSize(sds s) {
  * ... check for nread <= 0 and handle it ...
  * sdsIncrLen(s, nread);
  */
-void sdsIncrLen(sds s, int incr) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
+void sdsIncrLen(sds s, ssize_t incr) {
+    size_t len = sdslen(s);
 
-    assert(sh->free >= incr);
-    sh->len += incr;
-    sh->free -= incr;
-    assert(sh->free >= 0);
-    s[sh->len] = '\0';
+    assert((incr >= 0 && sdsavail(s) >= (size_t)incr) ||
+           (incr < 0 && len >= (size_t)(-incr)));
+    len += incr;
+    sdssetlen(s,len);
+    s[len] = '\0';
 }
 
 /* Grow the sds to have the specified length. Bytes that were not part of
@@ -213,19 +310,15 @@ void sdsIncrLen(sds s, int incr) {
  * if the specified length is smaller than the current length, no operation
  * is performed. */
 sds sdsgrowzero(sds s, size_t len) {
-    struct sdshdr *sh = (void*)(s-(sizeof(struct sdshdr)));
-    size_t totlen, curlen = sh->len;
+    size_t curlen = sdslen(s);
 
     if (len <= curlen) return s;
     s = sdsMakeRoomFor(s,len-curlen);
     if (s == NULL) return NULL;
 
     /* Make sure added region doesn't contain garbage */
-    sh = (void*)(s-(sizeof(struct sdshdr)));
     memset(s+curlen,0,(len-curlen+1)); /* also set trailing \0 byte */
-    totlen = sh->len+sh->free;
-    sh->len = len;
-    sh->free = totlen-sh->len;
+    sdssetlen(s,len);
     return s;
 }
 
@@ -235,15 +328,12 @@ sds sdsgrowzero(sds s, size_t len) {
  * After the call, the passed sds string is no longer valid and all the
  * references must be substituted with the new pointer returned by the call. */
 sds sdscatlen(sds s, const void *t, size_t len) {
-    struct sdshdr *sh;
     size_t curlen = sdslen(s);
 
     s = sdsMakeRoomFor(s,len);
     if (s == NULL) return NULL;
-    sh = (void*) (s-(sizeof(struct sdshdr)));
     memcpy(s+curlen, t, len);
-    sh->len = curlen+len;
-    sh->free = sh->free-len;
+    sdssetlen(s,curlen+len);
     s[curlen+len] = '\0';
     return s;
 }
@@ -267,19 +357,13 @@ sds sdscatsds(sds s, const sds t) {
 /* Destructively modify the sds string 's' to hold the specified binary
  * safe string pointed by 't' of length 'len' bytes. */
 sds sdscpylen(sds s, const char *t, size_t len) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
-    size_t totlen = sh->free+sh->len;
-
-    if (totlen < len) {
-        s = sdsMakeRoomFor(s,len-sh->len);
+    if (sdsalloc(s) < len) {
+        s = sdsMakeRoomFor(s,len-sdslen(s));
         if (s == NULL) return NULL;
-        sh = (void*) (s-(sizeof(struct sdshdr)));
-        totlen = sh->free+sh->len;
     }
     memcpy(s, t, len);
     s[len] = '\0';
-    sh->len = len;
-    sh->free = totlen-len;
+    sdssetlen(s,len);
     return s;
 }
 
@@ -353,7 +437,6 @@ sds sdscatprintf(sds s, const char *fmt, ...) {
  * Output will be just "Hello World".
  */
 sds sdstrim(sds s, const char *cset) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
     char *start, *end, *sp, *ep;
     size_t len;
 
@@ -362,10 +445,9 @@ sds sdstrim(sds s, const char *cset) {
     while(sp <= end && strchr(cset, *sp)) sp++;
     while(ep > start && strchr(cset, *ep)) ep--;
     len = (sp > ep) ? 0 : ((ep-sp)+1);
-    if (sh->buf != sp) memmove(sh->buf, sp, len);
-    sh->buf[len] = '\0';
-    sh->free = sh->free+(sh->len-len);
-    sh->len = len;
+    if (s != sp) memmove(s, sp, len);
+    s[len] = '\0';
+    sdssetlen(s,len);
     return s;
 }
 
@@ -383,10 +465,9 @@ sds sdstrim(sds s, const char *cset) {
  * Example:
  *
  * s = sdsnew("Hello World");
- * sdstrim(s,1,-1); => "ello Worl"
+ * sdsrange(s,1,-1); => "ello World"
  */
 void sdsrange(sds s, int start, int end) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
     size_t newlen, len = sdslen(s);
 
     if (len == 0) return;
@@ -409,22 +490,21 @@ void sdsrange(sds s, int start, int end) {
     } else {
         start = 0;
     }
-    if (start && newlen) memmove(sh->buf, sh->buf+start, newlen);
-    sh->buf[newlen] = 0;
-    sh->free = sh->free+(sh->len-newlen);
-    sh->len = newlen;
+    if (start && newlen) memmove(s, s+start, newlen);
+    s[newlen] = 0;
+    sdssetlen(s,newlen);
 }
 
 /* Apply tolower() to every character of the sds string 's'. */
 void sdstolower(sds s) {
-    int len = sdslen(s), j;
+    size_t len = sdslen(s), j;
 
     for (j = 0; j < len; j++) s[j] = tolower(s[j]);
 }
 
 /* Apply toupper() to every character of the sds string 's'. */
 void sdstoupper(sds s) {
-    int len = sdslen(s), j;
+    size_t len = sdslen(s), j;
 
     for (j = 0; j < len; j++) s[j] = toupper(s[j]);
 }
@@ -448,7 +528,7 @@ int sdscmp(const sds s1, const sds s2) {
     l2 = sdslen(s2);
     minlen = (l1 < l2) ? l1 : l2;
     cmp = memcmp(s1,s2,minlen);
-    if (cmp == 0) return l1-l2;
+    if (cmp == 0) return (l1 > l2) ? 1 : ((l1 < l2) ? -1 : 0);
     return cmp;
 }
 
@@ -777,7 +857,6 @@ sds sdsjoin(char **argv, int argc, char *sep) {
 
 int main(void) {
     {
-        struct sdshdr *sh;
         sds x = sdsnew("foo"), y;
 
         test_cond("Create a string and obtain the length",
@@ -811,32 +890,38 @@ int main(void) {
         test_cond("sdstrim() correctly trims characters",
             sdslen(x) == 4 && memcmp(x,"ciao\0",5) == 0)
 
-        y = sdsrange(sdsdup(x),1,1);
+        y = sdsdup(x);
+        sdsrange(y,1,1);
         test_cond("sdsrange(...,1,1)",
             sdslen(y) == 1 && memcmp(y,"i\0",2) == 0)
 
         sdsfree(y);
-        y = sdsrange(sdsdup(x),1,-1);
+        y = sdsdup(x);
+        sdsrange(y,1,-1);
         test_cond("sdsrange(...,1,-1)",
             sdslen(y) == 3 && memcmp(y,"iao\0",4) == 0)
 
         sdsfree(y);
-        y = sdsrange(sdsdup(x),-2,-1);
+        y = sdsdup(x);
+        sdsrange(y,-2,-1);
         test_cond("sdsrange(...,-2,-1)",
             sdslen(y) == 2 && memcmp(y,"ao\0",3) == 0)
 
         sdsfree(y);
-        y = sdsrange(sdsdup(x),2,1);
+        y = sdsdup(x);
+        sdsrange(y,2,1);
         test_cond("sdsrange(...,2,1)",
             sdslen(y) == 0 && memcmp(y,"\0",1) == 0)
 
         sdsfree(y);
-        y = sdsrange(sdsdup(x),1,100);
+        y = sdsdup(x);
+        sdsrange(y,1,100);
         test_cond("sdsrange(...,1,100)",
             sdslen(y) == 3 && memcmp(y,"iao\0",4) == 0)
 
         sdsfree(y);
-        y = sdsrange(sdsdup(x),100,100);
+        y = sdsdup(x);
+        sdsrange(y,100,100);
         test_cond("sdsrange(...,100,100)",
             sdslen(y) == 0 && memcmp(y,"\0",1) == 0)
 
@@ -859,21 +944,69 @@ int main(void) {
         test_cond("sdscmp(bar,bar)", sdscmp(x,y) < 0)
 
         {
-            int oldfree;
+            size_t oldfree;
 
+            sdsfree(y);
             sdsfree(x);
             x = sdsnew("0");
-            sh = (void*) (x-(sizeof(struct sdshdr)));
-            test_cond("sdsnew() free/len buffers", sh->len == 1 && sh->free == 0);
+            test_cond("sdsnew() free/len buffers",
+                sdslen(x) == 1 && sdsavail(x) == 0);
             x = sdsMakeRoomFor(x,1);
-            sh = (void*) (x-(sizeof(struct sdshdr)));
-            test_cond("sdsMakeRoomFor()", sh->len == 1 && sh->free > 0);
-            oldfree = sh->free;
+            test_cond("sdsMakeRoomFor()", sdslen(x) == 1 && sdsavail(x) > 0);
+            oldfree = sdsavail(x);
             x[1] = '1';
             sdsIncrLen(x,1);
             test_cond("sdsIncrLen() -- content", x[0] == '0' && x[1] == '1');
-            test_cond("sdsIncrLen() -- len", sh->len == 2);
-            test_cond("sdsIncrLen() -- free", sh->free == oldfree-1);
+            test_cond("sdsIncrLen() -- len", sdslen(x) == 2);
+            test_cond("sdsIncrLen() -- free", sdsavail(x) == oldfree-1);
+        }
+
+        {
+            /* Growing a string moves it to larger headers, removing the
+             * free space moves it back. */
+            int j, ok = 1;
+
+            sdsfree(x);
+            x = sdsempty();
+            test_cond("Empty strings use the 8 bit header",
+                (x[-1]&SDS_TYPE_MASK) == SDS_TYPE_8 &&
+                sdsAllocSize(x) == sizeof(struct sdshdr8)+1);
+            for (j = 0; j < 100000; j++) {
+                x = sdscatlen(x,"abcdefghij"+(j%10),1);
+                if (sdslen(x) != (size_t)j+1 || x[j] != 'a'+(j%10)) ok = 0;
+            }
+            test_cond("Appending one byte at a time across header types",
+                ok && (x[-1]&SDS_TYPE_MASK) == SDS_TYPE_32 &&
+                x[sdslen(x)] == '\0');
+            sdsrange(x,0,99);
+            x = sdsRemoveFreeSpace(x);
+            test_cond("sdsRemoveFreeSpace() shrinks the header",
+                (x[-1]&SDS_TYPE_MASK) == SDS_TYPE_8 &&
+                sdslen(x) == 100 && sdsavail(x) == 0 &&
+                memcmp(x,"abcdefghij",10) == 0 && x[100] == '\0');
+            x = sdsgrowzero(x,300);
+            test_cond("sdsgrowzero() moves to the 16 bit header",
+                (x[-1]&SDS_TYPE_MASK) == SDS_TYPE_16 &&
+                sdslen(x) == 300 && x[99] == 'j' && x[100] == 0 &&
+                x[299] == 0);
+            sdsIncrLen(x,-200);
+            test_cond("sdsIncrLen() with a negative increment",
+                sdslen(x) == 100 && x[100] == '\0');
+            sdsfree(x);
+        }
+
+        {
+            /* Header overhead of strings of typical key sizes, compared
+             * to the fixed 8 bytes header of two 32 bit fields. */
+            size_t lens[] = {8, 32, 200, 1000, 70000};
+            int j;
+
+            for (j = 0; j < 5; j++) {
+                x = sdsnewlen(NULL,lens[j]);
+                printf("%6zu bytes string: header %d bytes (was 8)\n",
+                    lens[j], (int)(sdsAllocSize(x)-lens[j]-1));
+                sdsfree(x);
+            }
         }
     }
     test_report()
@@ -35,23 +35,63 @@
 
 #include <sys/types.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 typedef char *sds;
 
-struct sdshdr {
-    int len;
-    int free;
+/* The headers are packed so that the flags byte is always right before the
+ * string, whatever the header type. 'alloc' is the size of the buffer
+ * excluding the header and the null term. */
+struct __attribute__ ((__packed__)) sdshdr8 {
+    uint8_t len;
+    uint8_t alloc;
+    unsigned char flags;
     char buf[];
 };
+struct __attribute__ ((__packed__)) sdshdr16 {
+    uint16_t len;
+    uint16_t alloc;
+    unsigned char flags;
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr32 {
+    uint32_t len;
+    uint32_t alloc;
+    unsigned char flags;
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr64 {
+    uint64_t len;
+    uint64_t alloc;
+    unsigned char flags;
+    char buf[];
+};
+
+#define SDS_TYPE_8  0
+#define SDS_TYPE_16 1
+#define SDS_TYPE_32 2
+#define SDS_TYPE_64 3
+#define SDS_TYPE_MASK 7
+#define SDS_HDR(T,s) ((struct sdshdr##T *)((s)-(sizeof(struct sdshdr##T))))
 
 static inline size_t sdslen(const sds s) {
-    struct sdshdr *sh = (void*)(s-(sizeof(struct sdshdr)));
-    return sh->len;
+    switch(s[-1]&SDS_TYPE_MASK) {
+    case SDS_TYPE_8: return SDS_HDR(8,s)->len;
+    case SDS_TYPE_16: return SDS_HDR(16,s)->len;
+    case SDS_TYPE_32: return SDS_HDR(32,s)->len;
+    case SDS_TYPE_64: return SDS_HDR(64,s)->len;
+    }
+    return 0;
 }
 
 static inline size_t sdsavail(const sds s) {
-    struct sdshdr *sh = (void*)(s-(sizeof(struct sdshdr)));
-    return sh->free;
+    switch(s[-1]&SDS_TYPE_MASK) {
+    case SDS_TYPE_8: return SDS_HDR(8,s)->alloc-SDS_HDR(8,s)->len;
+    case SDS_TYPE_16: return SDS_HDR(16,s)->alloc-SDS_HDR(16,s)->len;
+    case SDS_TYPE_32: return SDS_HDR(32,s)->alloc-SDS_HDR(32,s)->len;
+    case SDS_TYPE_64: return SDS_HDR(64,s)->alloc-SDS_HDR(64,s)->len;
+    }
+    return 0;
 }
 
 sds sdsnewlen(const void *init, size_t initlen);
@@ -93,8 +133,9 @@ sds sdsjoin(char **argv, int argc, char *sep);
 
 /* Low level functions exposed to the user API */
 sds sdsMakeRoomFor(sds s, size_t addlen);
-void sdsIncrLen(sds s, int incr);
+void sdsIncrLen(sds s, ssize_t incr);
 sds sdsRemoveFreeSpace(sds s);
 size_t sdsAllocSize(sds s);
+void *sdsAllocPtr(sds s);
 
 #endif
@@ -233,6 +233,7 @@ listIter *listGetIterator(list *list, int direction)
 /* Release the iterator memory */
 void listReleaseIterator(listIter *iter) {
     zfree(iter);
+}
 
 /* Create an iterator in the list private iterator structure
  *
@@ -40,6 +40,8 @@
 #include <sys/wait.h>
 
 void aofUpdateCurrentSize(void);
+void aofClosePipes(void);
+int aofManifestRewriteDone(char *tmpfile, int success);
 
 /* ----------------------------------------------------------------------------
  * AOF rewrite buffer implementation.
@@ -77,21 +79,57 @@ void aofRewriteBufferReset(void) {
     listSetFreeMethod(server.aof_rewrite_buf_blocks,zfree);
 }
 
-/* Return the current size of the AOF rerwite buffer. */
+/* Return the current size of the AOF rerwite buffer. Blocks at the head of
+ * the list may be partially consumed by aofChildWriteDiffData(), so we can't
+ * just count full blocks: every block is summed. */
 //返回缓冲区的大小
 unsigned long aofRewriteBufferSize(void) {
-    listNode *ln = listLast(server.aof_rewrite_buf_blocks);
-    aofrwblock *block = ln ? ln->value : NULL;
+    listNode *ln;
+    listIter li;
+    unsigned long size = 0;
 
-    if (block == NULL) return 0;
-	//除最后一个block,其他block占用的空间
-    unsigned long size =
-        (listLength(server.aof_rewrite_buf_blocks)-1) * AOF_RW_BUF_BLOCK_SIZE;
-	//加上最后一个block使用的空间
-    size += block->used;
+    listRewind(server.aof_rewrite_buf_blocks,&li);
+    while((ln = listNext(&li))) {
+        aofrwblock *block = listNodeValue(ln);
+        size += block->used;
+    }
     return size;
 }
 
+/* Event handler used to send data to the child process doing the AOF
+ * rewrite. We send pieces of our AOF differences buffer so that the final
+ * write when the child finishes the rewrite will be small. */
+//将重写缓冲区的内容通过管道发送给子进程
+void aofChildWriteDiffData(aeEventLoop *el, int fd, void *privdata, int mask) {
+    listNode *ln;
+    aofrwblock *block;
+    ssize_t nwritten;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(fd);
+    REDIS_NOTUSED(privdata);
+    REDIS_NOTUSED(mask);
+
+    while(1) {
+        ln = listFirst(server.aof_rewrite_buf_blocks);
+        block = ln ? ln->value : NULL;
+        //子进程要求停止发送，或者缓冲区已经没有数据
+        if (server.aof_stop_sending_diff || !block) {
+            aeDeleteFileEvent(server.el,server.aof_pipe_write_data_to_child,
+                              AE_WRITABLE);
+            return;
+        }
+        if (block->used > 0) {
+            nwritten = write(server.aof_pipe_write_data_to_child,
+                             block->buf,block->used);
+            if (nwritten <= 0) return;
+            memmove(block->buf,block->buf+nwritten,block->used-nwritten);
+            block->used -= nwritten;
+        }
+        //block已经发送完毕，从缓冲区中删除
+        if (block->used == 0) listDelNode(server.aof_rewrite_buf_blocks,ln);
+    }
+}
+
 /* Append data to the AOF rewrite buffer, allocating new blocks if needed. */
 //往缓冲区中添加新的数据
 void aofRewriteBufferAppend(unsigned char *s, unsigned long len) {
@@ -135,6 +173,14 @@ void aofRewriteBufferAppend(unsigned char *s, unsigned long len) {
             }
         }
     }
+
+    /* Install a file event to send data to the rewrite child if there is
+     * not one already. */
+    //安装发送数据给子进程的事件处理函数
+    if (aeGetFileEvents(server.el,server.aof_pipe_write_data_to_child) == 0) {
+        aeCreateFileEvent(server.el, server.aof_pipe_write_data_to_child,
+            AE_WRITABLE, aofChildWriteDiffData, NULL);
+    }
 }
 
 /* Write the buffer (possibly composed of multiple blocks) into the specified
@@ -176,6 +222,339 @@ void aof_background_fsync(int fd) {
     bioCreateBackgroundJob(REDIS_BIO_AOF_FSYNC,(void*)(long)fd,NULL,NULL);
 }
 
+/* ----------------------------------------------------------------------------
+ * AOF writer thread
+ *
+ * When "aof-threaded-write" is enabled the main thread no longer calls
+ * write(2) against the AOF. flushAppendOnlyFile() moves server.aof_buf into
+ * the queue of a dedicated writer thread and returns, so a busy disk can't
+ * block the event loop. Every time the writer wakes up it takes the whole
+ * queue at once (the two buffers are just swapped), so everything that
+ * accumulated while the previous write(2) or fsync(2) was in progress is
+ * committed with a single write and, with 'everysec', at most one fsync per
+ * second: this is our group commit.
+ *
+ * Back-pressure: when more than server.aof_writer_max_pending bytes are
+ * waiting to be written the main thread waits for the writer, so memory
+ * can't grow without bounds if the disk can't keep up. The time spent
+ * waiting is accounted in INFO as a stall.
+ *
+ * With 'appendfsync always' the main thread waits for its batch to be
+ * written and fsynced before returning, so the contract with the clients
+ * (acknowledged writes are on disk) is the same as without the thread.
+ * ------------------------------------------------------------------------- */
+
+static struct aofWriter {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;    /* Signaled by the main thread on new data. */
+    pthread_cond_t done;    /* Signaled by the writer after every batch. */
+    sds queue;              /* Data queued by the main thread. */
+    int fd;                 /* AOF fd the queued data belongs to. */
+    int policy;             /* AOF_FSYNC_* policy of the queued data. */
+    int nofsync;            /* Don't fsync: rewrite in progress. */
+    int busy;               /* Writer is processing a batch. */
+    int drop;               /* Main thread asks to drop the pending data. */
+    int unsynced;           /* Data written but not yet fsynced. */
+    size_t inflight;        /* Bytes of the batch not yet written. */
+    int err;                /* errno of the last failed write, or 0. */
+    time_t last_fsync;      /* UNIX time of last fsync() by the writer. */
+    unsigned long long queued_bytes;    /* Total bytes queued. */
+    unsigned long long committed_bytes; /* Total bytes committed according
+                                           to the fsync policy. */
+    unsigned long long batches;         /* Number of write(2) batches. */
+    size_t last_batch_bytes;            /* Size of the last batch. */
+    long long last_latency;             /* Write+fsync time of last batch. */
+    long long max_latency;              /* Max write+fsync time seen. */
+} aofw;
+
+void *aofWriterMain(void *arg);
+
+/* Initialize the writer state and spawn the writer thread. */
+//初始化aof写线程
+void aofWriterInit(void) {
+    pthread_attr_t attr;
+    size_t stacksize;
+
+    pthread_mutex_init(&aofw.lock,NULL);
+    pthread_cond_init(&aofw.work,NULL);
+    pthread_cond_init(&aofw.done,NULL);
+    aofw.queue = sdsempty();
+    aofw.fd = -1;
+    aofw.policy = server.aof_fsync;
+    aofw.nofsync = 0;
+    aofw.busy = 0;
+    aofw.drop = 0;
+    aofw.unsynced = 0;
+    aofw.inflight = 0;
+    aofw.err = 0;
+    aofw.last_fsync = time(NULL);
+    aofw.queued_bytes = 0;
+    aofw.committed_bytes = 0;
+    aofw.batches = 0;
+    aofw.last_batch_bytes = 0;
+    aofw.last_latency = 0;
+    aofw.max_latency = 0;
+
+    pthread_attr_init(&attr);
+    pthread_attr_getstacksize(&attr,&stacksize);
+    if (!stacksize) stacksize = 1; /* The world is full of Solaris Fixes */
+    while (stacksize < REDIS_THREAD_STACK_SIZE) stacksize *= 2;
+    pthread_attr_setstacksize(&attr, stacksize);
+    if (pthread_create(&aofw.thread,&attr,aofWriterMain,NULL) != 0) {
+        redisLog(REDIS_WARNING,"Fatal: Can't initialize the AOF writer thread.");
+        exit(1);
+    }
+}
+
+/* Body of the writer thread. The loop always starts with the lock held. */
+//aof写线程的主循环
+void *aofWriterMain(void *arg) {
+    sds batch = sdsempty();
+    sigset_t sigset;
+    REDIS_NOTUSED(arg);
+
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+
+    /* Block SIGALRM so we are sure that only the main thread will
+     * receive the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    if (pthread_sigmask(SIG_BLOCK, &sigset, NULL))
+        redisLog(REDIS_WARNING,
+            "Warning: can't mask SIGALRM in AOF writer thread: %s",
+            strerror(errno));
+
+    pthread_mutex_lock(&aofw.lock);
+    while(1) {
+        time_t now = time(NULL);
+        int fd, policy, nofsync, sync_due, synced = 0, err = 0;
+        size_t written = 0;
+        long long start, latency;
+
+        //主线程要求丢弃尚未写入的数据
+        if (aofw.drop) {
+            sdsclear(batch);
+            sdsclear(aofw.queue);
+            aofw.inflight = 0;
+            aofw.unsynced = 0;
+            aofw.err = 0;
+            aofw.drop = 0;
+            aofw.committed_bytes = aofw.queued_bytes;
+            pthread_cond_broadcast(&aofw.done);
+        }
+
+        sync_due = aofw.unsynced && !aofw.nofsync &&
+                   aofw.policy == AOF_FSYNC_EVERYSEC &&
+                   now > aofw.last_fsync;
+
+        if (sdslen(aofw.queue) == 0 && sdslen(batch) == 0 && !sync_due) {
+            if (aofw.unsynced && !aofw.nofsync &&
+                aofw.policy == AOF_FSYNC_EVERYSEC)
+            {
+                /* Data is on the file but not yet on disk: wake up in
+                 * time for the next fsync even if nothing else arrives. */
+                struct timespec ts;
+
+                ts.tv_sec = aofw.last_fsync+2;
+                ts.tv_nsec = 0;
+                pthread_cond_timedwait(&aofw.work,&aofw.lock,&ts);
+            } else {
+                pthread_cond_wait(&aofw.work,&aofw.lock);
+            }
+            continue;
+        }
+
+        /* Grab everything queued so far: this is the group commit. If the
+         * previous write failed 'batch' still holds what is left of it, and
+         * new data must go after it. */
+        //取出队列中所有数据，一次写入
+        if (sdslen(batch) == 0) {
+            sds tmp = batch;
+            batch = aofw.queue;
+            aofw.queue = tmp;
+        } else if (sdslen(aofw.queue)) {
+            batch = sdscatlen(batch,aofw.queue,sdslen(aofw.queue));
+            sdsclear(aofw.queue);
+        }
+        fd = aofw.fd;
+        policy = aofw.policy;
+        nofsync = aofw.nofsync;
+        aofw.inflight = sdslen(batch);
+        aofw.busy = 1;
+        pthread_mutex_unlock(&aofw.lock);
+
+        start = ustime();
+        while(written < sdslen(batch)) {
+            ssize_t nwritten = write(fd,batch+written,sdslen(batch)-written);
+
+            if (nwritten == -1) {
+                if (errno == EINTR) continue;
+                err = errno;
+                break;
+            } else if (nwritten == 0) {
+                err = ENOSPC;
+                break;
+            }
+            written += nwritten;
+        }
+        if (!err && !nofsync &&
+            (policy == AOF_FSYNC_ALWAYS ||
+             (policy == AOF_FSYNC_EVERYSEC && time(NULL) > aofw.last_fsync)))
+        {
+            aof_fsync(fd);
+            synced = 1;
+        }
+        latency = ustime()-start;
+        sdsrange(batch,written,-1);
+
+        pthread_mutex_lock(&aofw.lock);
+        if (written) {
+            aofw.batches++;
+            aofw.last_batch_bytes = written;
+            aofw.unsynced = 1;
+        }
+        if (synced) {
+            aofw.unsynced = 0;
+            aofw.last_fsync = time(NULL);
+        }
+        if (!err && (policy != AOF_FSYNC_ALWAYS || synced || nofsync))
+            aofw.committed_bytes += written;
+        aofw.last_latency = latency;
+        if (latency > aofw.max_latency) aofw.max_latency = latency;
+        aofw.inflight = sdslen(batch);
+        aofw.err = err;
+        aofw.busy = 0;
+        pthread_cond_broadcast(&aofw.done);
+
+        if (err) {
+            /* Retry in a second: the main thread will notice the error
+             * and stop accepting writes in the meantime. */
+            struct timespec ts;
+
+            ts.tv_sec = time(NULL)+1;
+            ts.tv_nsec = 0;
+            pthread_cond_timedwait(&aofw.work,&aofw.lock,&ts);
+        }
+    }
+    return NULL;
+}
+
+/* Copy the writer state into the server structure, so that INFO and the
+ * write-refusing logic of processCommand() can use it. Called with the
+ * writer lock held. */
+//将写线程的状态同步到server结构
+static void aofWriterUpdateStatus(void) {
+    server.stat_aof_writer_batches = aofw.batches;
+    server.stat_aof_writer_last_batch_bytes = aofw.last_batch_bytes;
+    server.stat_aof_writer_last_latency = aofw.last_latency;
+    server.stat_aof_writer_max_latency = aofw.max_latency;
+    server.stat_aof_writer_pending = sdslen(aofw.queue)+aofw.inflight;
+
+    if (aofw.err) {
+        if (server.aof_last_write_status == REDIS_OK) {
+            redisLog(REDIS_WARNING,"Error writing to the AOF file: %s",
+                strerror(aofw.err));
+        }
+        server.aof_last_write_status = REDIS_ERR;
+        server.aof_last_write_errno = aofw.err;
+    } else if (server.aof_last_write_status == REDIS_ERR &&
+               aofw.inflight == 0)
+    {
+        redisLog(REDIS_WARNING,
+            "AOF write error looks solved, Redis can write again.");
+        server.aof_last_write_status = REDIS_OK;
+    }
+}
+
+/* Queue the AOF buffer to the writer thread. This is the threaded
+ * counterpart of flushAppendOnlyFile(). */
+//将aof缓冲区交给写线程
+void aofWriterFlush(void) {
+    size_t len = sdslen(server.aof_buf);
+    unsigned long long target;
+
+    pthread_mutex_lock(&aofw.lock);
+    if (len) {
+        /* Back-pressure: wait for the writer if too much data is pending.
+         * If the writer is failing there is no point in waiting, writes are
+         * refused anyway until the error is cleared. */
+        //待写数据过多时等待写线程
+        if (sdslen(aofw.queue)+aofw.inflight >= server.aof_writer_max_pending &&
+            !aofw.err)
+        {
+            long long start = ustime();
+
+            while(sdslen(aofw.queue)+aofw.inflight >=
+                  server.aof_writer_max_pending && !aofw.err)
+            {
+                pthread_cond_wait(&aofw.done,&aofw.lock);
+            }
+            server.stat_aof_writer_stalls++;
+            server.stat_aof_writer_stall_time += ustime()-start;
+        }
+
+        if (sdslen(aofw.queue) == 0) {
+            sds tmp = aofw.queue;
+            aofw.queue = server.aof_buf;
+            server.aof_buf = tmp;
+        } else {
+            aofw.queue = sdscatlen(aofw.queue,server.aof_buf,len);
+            sdsclear(server.aof_buf);
+        }
+        aofw.fd = server.aof_fd;
+        aofw.policy = server.aof_fsync;
+        aofw.nofsync = server.aof_no_fsync_on_rewrite &&
+            (server.aof_child_pid != -1 || server.rdb_child_pid != -1);
+        aofw.queued_bytes += len;
+        server.aof_current_size += len;
+        pthread_cond_signal(&aofw.work);
+
+        /* With appendfsync always the reply can't be sent before the data
+         * is on disk: wait for the writer to commit our batch. */
+        //appendfsync always时，等待写线程将数据同步到设备
+        if (server.aof_fsync == AOF_FSYNC_ALWAYS) {
+            target = aofw.queued_bytes;
+            while(aofw.committed_bytes < target && !aofw.err)
+                pthread_cond_wait(&aofw.done,&aofw.lock);
+            if (aofw.err) {
+                redisLog(REDIS_WARNING,"Can't recover from AOF write error when the AOF fsync policy is 'always'. Exiting...");
+                exit(1);
+            }
+            server.aof_last_fsync = server.unixtime;
+        }
+    }
+    aofWriterUpdateStatus();
+    pthread_mutex_unlock(&aofw.lock);
+}
+
+/* Wait for the writer thread to write everything that was queued. This is
+ * needed before the AOF file descriptor is switched or closed.
+ *
+ * If the writer is failing, the pending data is dropped instead: the
+ * callers either have the same data in the rewritten AOF, or are shutting
+ * down / disabling the AOF where the non threaded code would lose it too. */
+//等待写线程写完所有数据
+void aofWriterDrain(void) {
+    pthread_mutex_lock(&aofw.lock);
+    while(aofw.busy || sdslen(aofw.queue) || aofw.inflight) {
+        if (aofw.err && !aofw.busy) {
+            redisLog(REDIS_WARNING,
+                "Dropping %zu bytes of AOF data the writer thread could not "
+                "write: %s", sdslen(aofw.queue)+aofw.inflight,
+                strerror(aofw.err));
+            aofw.drop = 1;
+            pthread_cond_signal(&aofw.work);
+        }
+        pthread_cond_wait(&aofw.done,&aofw.lock);
+    }
+    /* The fd may be closed by the caller: no delayed fsync against it. */
+    aofw.unsynced = 0;
+    aofWriterUpdateStatus();
+    pthread_mutex_unlock(&aofw.lock);
+}
+
 /* Called when the user switches from "appendonly yes" to "appendonly no"
  * at runtime using the CONFIG command. */
 //当用户使用config命令将模式从"appendonly yes" 改变到 "appendonly no"时调用
@@ -183,6 +562,7 @@ void stopAppendOnly(void) {
     redisAssert(server.aof_state != REDIS_AOF_OFF);
 	//清空缓冲区
     flushAppendOnlyFile(1);
+    aofWriterDrain();
 	//同步到设备
     aof_fsync(server.aof_fd);
 	//关闭aof文件描述符
@@ -202,9 +582,13 @@ void stopAppendOnly(void) {
             wait3(&statloc,0,NULL);
         /* reset the buffer accumulating changes while the child saves */
         aofRewriteBufferReset();
+        aofClosePipes();
         aofRemoveTempFile(server.aof_child_pid);
+        if (server.aof_rewrite_incr) aofManifestRewriteDone(NULL,0);
+        closeChildInfoPipe();
         server.aof_child_pid = -1;
         server.aof_rewrite_time_start = -1;
+        updateDictResizePolicy();
     }
 }
 
@@ -214,20 +598,29 @@ void stopAppendOnly(void) {
 int startAppendOnly(void) {
     server.aof_last_fsync = server.unixtime;
 	//创建新的aof文件
-    server.aof_fd = open(server.aof_filename,O_WRONLY|O_APPEND|O_CREAT,0644);
+    if (server.aof_use_manifest) {
+        /* The incremental file is opened when the rewrite starts. */
+        server.aof_fd = -1;
+    } else {
+        server.aof_fd = open(server.aof_filename,O_WRONLY|O_APPEND|O_CREAT,0644);
+    }
     redisAssert(server.aof_state == REDIS_AOF_OFF);
-    if (server.aof_fd == -1) {
+    if (server.aof_fd == -1 && !server.aof_use_manifest) {
         redisLog(REDIS_WARNING,"Redis needs to enable the AOF but can't open the append only file: %s",strerror(errno));
         return REDIS_ERR;
     }
+    /* We are switching on AOF, now wait for the rerwite to be complete
+     * in order to append data on disk. The state is set before the rewrite
+     * starts since in manifest mode it tells where the new incremental
+     * file must be recorded. */
+    server.aof_state = REDIS_AOF_WAIT_REWRITE;
     if (rewriteAppendOnlyFileBackground() == REDIS_ERR) {
-        close(server.aof_fd);
+        server.aof_state = REDIS_AOF_OFF;
+        if (server.aof_fd != -1) close(server.aof_fd);
+        server.aof_fd = -1;
         redisLog(REDIS_WARNING,"Redis needs to enable the AOF but can't trigger a background AOF rewrite operation. Check the above logs for more info about the error.");
         return REDIS_ERR;
     }
-    /* We correctly switched on AOF, now wait for the rerwite to be complete
-     * in order to append data on disk. */
-    server.aof_state = REDIS_AOF_WAIT_REWRITE;
     return REDIS_OK;
 }
 
@@ -255,6 +648,12 @@ void flushAppendOnlyFile(int force) {
     ssize_t nwritten;
     int sync_in_progress = 0;
 
+    /* The threaded writer takes care of the buffer in its own thread. */
+    if (server.aof_threaded_write) {
+        aofWriterFlush();
+        return;
+    }
+
     if (sdslen(server.aof_buf) == 0) return;
 
 	//检查后台任务进程有无尚未完成的REDIS_BIO_AOF_FSYNC任务
@@ -523,20 +922,364 @@ void feedAppendOnlyFile(struct redisCommand *cmd, int dictid, robj **argv, int a
      * of re-entering the event loop, so before the client will get a
      * positive reply about the operation performed. */
 	 //将保存了命令的buf添加到缓冲区
-    if (server.aof_state == REDIS_AOF_ON)
+    if (server.aof_state == REDIS_AOF_ON ||
+        (server.aof_use_manifest && server.aof_rewrite_incr))
         server.aof_buf = sdscatlen(server.aof_buf,buf,sdslen(buf));
 
     /* If a background append only file rewriting is in progress we want to
      * accumulate the differences between the child DB and the current one
      * in a buffer, so that when the child process will do its work we
-     * can append the differences to the new append only file. */
+     * can append the differences to the new append only file.
+     * With the manifest the writes already go to the incremental file
+     * opened when the rewrite started, so there is nothing to accumulate. */
 	 //如果存在重写子进程，将buf添加到重写缓冲区
-    if (server.aof_child_pid != -1)
+    if (server.aof_child_pid != -1 && !server.aof_use_manifest)
         aofRewriteBufferAppend((unsigned char*)buf,sdslen(buf));
 
     sdsfree(buf);
 }
 
+/* ----------------------------------------------------------------------------
+ * Multi part AOF
+ *
+ * When "aof-use-manifest" is enabled the append only file is no longer a
+ * single file replaced at every rewrite. It is a set of files listed in a
+ * small manifest file named after "appendfilename" plus ".manifest":
+ *
+ *   - at most one base file, produced by the last successful rewrite;
+ *   - a list of incremental files, containing the writes performed after
+ *     the base was created, oldest first.
+ *
+ * When a rewrite starts the parent switches to a new incremental file, so
+ * the writes performed while the child runs already end up in the file that
+ * will follow the new base: there is no rewrite buffer to accumulate and no
+ * diff to flush at the end. When the child is done its file becomes the new
+ * base, the manifest is atomically replaced (the only rename(2) performed,
+ * against a tiny file) and the files no longer referenced are released in
+ * a background thread.
+ *
+ * The manifest is a text file with one directive per line:
+ *
+ *   seq <last sequence number used for a file name>
+ *   base <file name>
+ *   incr <file name>
+ *
+ * Files are named <appendfilename>.<seq>.base.aof and
+ * <appendfilename>.<seq>.incr.aof, the base of a rewrite and the incremental
+ * file opened when it started sharing the same sequence number.
+ * ------------------------------------------------------------------------- */
+
+/* Return the name of the manifest file as a new sds string. */
+//返回manifest文件的名字
+sds aofManifestFileName(void) {
+    return sdscatprintf(sdsempty(),"%s.manifest",server.aof_filename);
+}
+
+/* Release the files names referenced by the manifest. */
+//清空manifest
+void aofManifestClear(aofManifest *am) {
+    if (am->base) sdsfree(am->base);
+    am->base = NULL;
+    if (am->incrs) listRelease(am->incrs);
+    am->incrs = listCreate();
+    listSetFreeMethod(am->incrs,(void (*)(void*)) sdsfree);
+}
+
+/* Load the manifest from disk into server.aof_manifest. Returns REDIS_ERR
+ * with errno set to ENOENT if there is no manifest at all. A manifest that
+ * can't be parsed is a fatal error. */
+//从硬盘读取manifest
+int aofManifestLoad(void) {
+    sds filename = aofManifestFileName();
+    FILE *fp = fopen(filename,"r");
+    char buf[1024];
+    int linenum = 0;
+
+    if (fp == NULL) {
+        sdsfree(filename);
+        return REDIS_ERR;
+    }
+    aofManifestClear(&server.aof_manifest);
+    server.aof_manifest.seq = 0;
+    while(fgets(buf,sizeof(buf),fp) != NULL) {
+        sds line = sdstrim(sdsnew(buf)," \t\r\n");
+        sds *argv;
+        int argc;
+
+        linenum++;
+        if (line[0] == '#' || line[0] == '\0') {
+            sdsfree(line);
+            continue;
+        }
+        argv = sdssplitargs(line,&argc);
+        sdsfree(line);
+        if (argv == NULL || argc != 2 || !pathIsBaseName(argv[1])) {
+            if (argv) sdsfreesplitres(argv,argc);
+            goto fmterr;
+        }
+        if (!strcasecmp(argv[0],"seq")) {
+            server.aof_manifest.seq = strtoll(argv[1],NULL,10);
+        } else if (!strcasecmp(argv[0],"base") &&
+                   server.aof_manifest.base == NULL)
+        {
+            server.aof_manifest.base = sdsdup(argv[1]);
+        } else if (!strcasecmp(argv[0],"incr")) {
+            listAddNodeTail(server.aof_manifest.incrs,sdsdup(argv[1]));
+        } else {
+            sdsfreesplitres(argv,argc);
+            goto fmterr;
+        }
+        sdsfreesplitres(argv,argc);
+    }
+    fclose(fp);
+    sdsfree(filename);
+    return REDIS_OK;
+
+fmterr:
+    redisLog(REDIS_WARNING,"Bad AOF manifest %s at line %d",filename,linenum);
+    exit(1);
+}
+
+/* Write the manifest 'am' on disk, replacing the old one atomically. */
+//将manifest写到硬盘
+int aofManifestPersist(aofManifest *am) {
+    sds filename = aofManifestFileName();
+    sds tmpfile = sdscatprintf(sdsempty(),"temp-%s",filename);
+    sds content = sdsempty();
+    listNode *ln;
+    listIter li;
+    int fd;
+
+    content = sdscatprintf(content,"seq %lld\n",am->seq);
+    if (am->base) content = sdscatprintf(content,"base %s\n",am->base);
+    listRewind(am->incrs,&li);
+    while((ln = listNext(&li)))
+        content = sdscatprintf(content,"incr %s\n",(char*)listNodeValue(ln));
+
+    fd = open(tmpfile,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if (fd == -1) goto werr;
+    if (write(fd,content,sdslen(content)) != (ssize_t)sdslen(content) ||
+        aof_fsync(fd) == -1)
+    {
+        close(fd);
+        unlink(tmpfile);
+        goto werr;
+    }
+    close(fd);
+    if (rename(tmpfile,filename) == -1) {
+        unlink(tmpfile);
+        goto werr;
+    }
+    sdsfree(filename);
+    sdsfree(tmpfile);
+    sdsfree(content);
+    return REDIS_OK;
+
+werr:
+    redisLog(REDIS_WARNING,"Error writing the AOF manifest %s: %s",
+        filename, strerror(errno));
+    sdsfree(filename);
+    sdsfree(tmpfile);
+    sdsfree(content);
+    return REDIS_ERR;
+}
+
+/* Return a new file name for the specified sequence number. */
+//根据序列号生成新的base或incr文件名
+sds aofManifestNewFileName(long long seq, int base) {
+    return sdscatprintf(sdsempty(),"%s.%lld.%s.aof",
+        server.aof_filename, seq, base ? "base" : "incr");
+}
+
+/* Remove a file no longer referenced by the manifest. The file is kept
+ * open while unlinked, so that the actual release of its blocks happens
+ * in the background thread calling close(2). */
+//在后台删除不再使用的aof文件
+void aofManifestDeleteFile(char *filename) {
+    int fd = open(filename,O_RDONLY|O_NONBLOCK);
+
+    if (unlink(filename) == -1 && errno != ENOENT) {
+        redisLog(REDIS_WARNING,"Can't remove old AOF file %s: %s",
+            filename, strerror(errno));
+    }
+    if (fd != -1) bioCreateBackgroundJob(REDIS_BIO_CLOSE_FILE,(void*)(long)fd,NULL,NULL);
+}
+
+/* Return the sum of the sizes of the files referenced by the manifest. */
+//返回manifest引用的所有文件的大小之和
+off_t aofManifestTotalSize(void) {
+    struct redis_stat sb;
+    listNode *ln;
+    listIter li;
+    off_t size = 0;
+
+    if (server.aof_manifest.base &&
+        redis_stat(server.aof_manifest.base,&sb) != -1) size += sb.st_size;
+    listRewind(server.aof_manifest.incrs,&li);
+    while((ln = listNext(&li))) {
+        if (redis_stat(listNodeValue(ln),&sb) != -1) size += sb.st_size;
+    }
+    return size;
+}
+
+/* Open the incremental file that will receive new writes, at startup
+ * or when AOF is turned on. A missing manifest is created: if an AOF
+ * written without manifest exists it is adopted as base file, so that
+ * switching an existing instance to the manifest requires no conversion. */
+//启动时打开用于写入的incr文件
+int aofManifestOpen(void) {
+    listNode *ln;
+
+    if (aofManifestLoad() == REDIS_ERR) {
+        struct redis_stat sb;
+
+        aofManifestClear(&server.aof_manifest);
+        server.aof_manifest.seq = 0;
+        if (redis_stat(server.aof_filename,&sb) != -1) {
+            redisLog(REDIS_NOTICE,"Using %s as base of the new AOF manifest",
+                server.aof_filename);
+            server.aof_manifest.base = sdsnew(server.aof_filename);
+        }
+    }
+
+    /* Append to the last incremental file if any, otherwise start one. */
+    ln = listLast(server.aof_manifest.incrs);
+    if (ln == NULL) {
+        server.aof_manifest.seq++;
+        listAddNodeTail(server.aof_manifest.incrs,
+            aofManifestNewFileName(server.aof_manifest.seq,0));
+        ln = listLast(server.aof_manifest.incrs);
+    }
+    server.aof_fd = open(listNodeValue(ln),O_WRONLY|O_APPEND|O_CREAT,0644);
+    if (server.aof_fd == -1) {
+        redisLog(REDIS_WARNING,"Can't open the append-only file %s: %s",
+            (char*)listNodeValue(ln), strerror(errno));
+        return REDIS_ERR;
+    }
+    return aofManifestPersist(&server.aof_manifest);
+}
+
+/* Called by rewriteAppendOnlyFileBackground() just before forking: switch
+ * the AOF to a new incremental file, so that everything written after the
+ * fork ends up in a file that will follow the base produced by the child.
+ *
+ * If the AOF is ON the new file is added to the manifest immediately, so
+ * the manifest on disk is always valid even if the rewrite fails. When we
+ * are waiting for the rewrite to turn the AOF on, the file is only added
+ * once the rewrite succeeded, since the old manifest may be stale. */
+//重写开始前，切换到新的incr文件
+int aofManifestStartRewrite(void) {
+    sds incr;
+    int newfd;
+
+    if (server.aof_state == REDIS_AOF_OFF) return REDIS_OK;
+
+    /* What we have in the buffer was executed before the fork, so it
+     * must go in the old file: the base will contain it as well. */
+    if (server.aof_fd != -1) {
+        flushAppendOnlyFile(1);
+        aofWriterDrain();
+        if (sdslen(server.aof_buf) != 0) {
+            redisLog(REDIS_WARNING,
+                "Can't start the AOF rewrite while the AOF can't be written.");
+            return REDIS_ERR;
+        }
+    }
+
+    incr = aofManifestNewFileName(server.aof_manifest.seq+1,0);
+    newfd = open(incr,O_WRONLY|O_APPEND|O_CREAT|O_TRUNC,0644);
+    if (newfd == -1) {
+        redisLog(REDIS_WARNING,"Can't open the new AOF file %s: %s",
+            incr, strerror(errno));
+        sdsfree(incr);
+        return REDIS_ERR;
+    }
+    server.aof_manifest.seq++;
+    if (server.aof_state == REDIS_AOF_ON) {
+        listAddNodeTail(server.aof_manifest.incrs,sdsdup(incr));
+        if (aofManifestPersist(&server.aof_manifest) == REDIS_ERR) {
+            listDelNode(server.aof_manifest.incrs,
+                listLast(server.aof_manifest.incrs));
+            close(newfd);
+            unlink(incr);
+            sdsfree(incr);
+            return REDIS_ERR;
+        }
+    }
+    if (server.aof_fd != -1)
+        bioCreateBackgroundJob(REDIS_BIO_CLOSE_FILE,(void*)(long)server.aof_fd,NULL,NULL);
+    server.aof_fd = newfd;
+    server.aof_selected_db = -1;
+    server.aof_rewrite_incr = incr;
+    return REDIS_OK;
+}
+
+/* Called when a rewrite terminated: on success the file produced by the
+ * child becomes the new base, followed by the incremental file opened when
+ * the rewrite started, and the files of the old manifest are deleted. */
+//重写结束后，更新manifest并删除旧的文件
+int aofManifestRewriteDone(char *tmpfile, int success) {
+    aofManifest old = server.aof_manifest;
+    aofManifest am;
+    listNode *ln;
+    listIter li;
+    sds incr = server.aof_rewrite_incr;
+
+    server.aof_rewrite_incr = NULL;
+    if (!success) goto err;
+
+    am.seq = old.seq;
+    am.base = aofManifestNewFileName(incr ? am.seq : ++am.seq,1);
+    am.incrs = listCreate();
+    listSetFreeMethod(am.incrs,(void (*)(void*)) sdsfree);
+    if (incr) listAddNodeTail(am.incrs,sdsdup(incr));
+
+    if (rename(tmpfile,am.base) == -1) {
+        redisLog(REDIS_WARNING,
+            "Error trying to rename the temporary AOF file: %s", strerror(errno));
+        goto err;
+    }
+    if (aofManifestPersist(&am) == REDIS_ERR) {
+        unlink(am.base);
+        goto err;
+    }
+
+    /* The new manifest is on disk: release the files it no longer uses. */
+    if (old.base && strcmp(old.base,am.base)) aofManifestDeleteFile(old.base);
+    listRewind(old.incrs,&li);
+    while((ln = listNext(&li))) {
+        if (incr && !strcmp(listNodeValue(ln),incr)) continue;
+        aofManifestDeleteFile(listNodeValue(ln));
+    }
+    if (old.base) sdsfree(old.base);
+    listRelease(old.incrs);
+    server.aof_manifest = am;
+    if (incr) sdsfree(incr);
+    redisLog(REDIS_NOTICE,"AOF manifest updated: base %s, %lu incremental file(s)",
+        am.base, listLength(am.incrs));
+    return REDIS_OK;
+
+err:
+    if (success) {
+        sdsfree(am.base);
+        listRelease(am.incrs);
+    }
+    /* While waiting for the rewrite to turn the AOF on, the new file was
+     * not added to the manifest: the next rewrite will cover it. */
+    ln = listLast(server.aof_manifest.incrs);
+    if (incr && (ln == NULL || strcmp(listNodeValue(ln),incr))) {
+        if (server.aof_fd != -1) {
+            aofWriterDrain();
+            close(server.aof_fd);
+            server.aof_fd = -1;
+            sdsclear(server.aof_buf);
+        }
+        unlink(incr);
+    }
+    if (incr) sdsfree(incr);
+    return REDIS_ERR;
+}
+
 /* ----------------------------------------------------------------------------
  * AOF loading
  * ------------------------------------------------------------------------- */
@@ -579,6 +1322,123 @@ void freeFakeClient(struct redisClient *c) {
     zfree(c);
 }
 
+/* -----------------------------------------------------------------------------
+ * AOF loading
+ *
+ * The file is read in large blocks into a single buffer, and the protocol is
+ * parsed in place: every argument is copied only once, directly into the
+ * string object passed to the command. The argv array of the fake client is
+ * reused from a command to the next, and the lookup of the command table is
+ * skipped when the same command is repeated, that is the common case.
+ * -------------------------------------------------------------------------- */
+
+#define REDIS_AOF_LOAD_BUFFER_SIZE (1024*1024)
+
+typedef struct aofLoadBuffer {
+    int fd;
+    char *buf;          /* Read buffer. */
+    size_t len;         /* Bytes in the buffer. */
+    size_t pos;         /* Parsing position in the buffer. */
+    off_t processed;    /* Bytes of the file parsed so far. */
+    int eof;            /* Set when read() returned 0. */
+} aofLoadBuffer;
+
+/* Make sure at least 'need' bytes (need <= buffer size) are available at
+ * lb->pos. Returns 1 on success, 0 on EOF, -1 on read error. */
+static int aofLoadFill(aofLoadBuffer *lb, size_t need) {
+    if (lb->len - lb->pos >= need) return 1;
+    /* Move the unparsed data at the start of the buffer. */
+    if (lb->pos) {
+        memmove(lb->buf,lb->buf+lb->pos,lb->len-lb->pos);
+        lb->len -= lb->pos;
+        lb->pos = 0;
+    }
+    while(lb->len < need) {
+        ssize_t nread;
+
+        if (lb->eof) return 0;
+        nread = read(lb->fd,lb->buf+lb->len,REDIS_AOF_LOAD_BUFFER_SIZE-lb->len);
+        if (nread == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (nread == 0) lb->eof = 1;
+        lb->len += nread;
+    }
+    return 1;
+}
+
+/* Parse a "<prefix><number>\r\n" line. Returns 1 on success, 0 on EOF,
+ * -1 on read error and -2 on format error. */
+static int aofLoadReadLine(aofLoadBuffer *lb, char prefix, long long *value) {
+    size_t avail = 0;
+    char *p, *nl;
+    long long v = 0;
+    int retval;
+
+    while(1) {
+        p = lb->buf+lb->pos;
+        avail = lb->len-lb->pos;
+        nl = memchr(p,'\n',avail);
+        if (nl) break;
+        /* Protocol lines are short: give up if there is no newline in the
+         * first 128 bytes, like the old fgets() based loader did. */
+        if (avail >= 128) return -2;
+        if ((retval = aofLoadFill(lb,avail+1)) != 1) return retval;
+    }
+    if (p[0] != prefix || nl-p < 2 || nl[-1] != '\r') return -2;
+    for (p++; p < nl-1; p++) {
+        if (*p < '0' || *p > '9') return -2;
+        v = v*10+(*p-'0');
+    }
+    *value = v;
+    lb->processed += (nl+1)-(lb->buf+lb->pos);
+    lb->pos = (nl+1)-lb->buf;
+    return 1;
+}
+
+/* Read a bulk argument of 'len' bytes followed by CRLF as a string object.
+ * Returns NULL on EOF or error, setting *err like aofLoadFill(). */
+static robj *aofLoadReadBulk(aofLoadBuffer *lb, size_t len, int *err) {
+    sds arg;
+
+    if (len+2 <= REDIS_AOF_LOAD_BUFFER_SIZE) {
+        if ((*err = aofLoadFill(lb,len+2)) != 1) return NULL;
+        arg = sdsnewlen(lb->buf+lb->pos,len);
+    } else {
+        /* Big argument: read it directly into the final string. */
+        size_t avail = lb->len-lb->pos, got;
+
+        arg = sdsnewlen(NULL,len);
+        if (avail > len) avail = len;
+        memcpy(arg,lb->buf+lb->pos,avail);
+        got = avail;
+        lb->len = lb->pos = 0;
+        while(got < len) {
+            ssize_t nread = read(lb->fd,arg+got,len-got);
+
+            if (nread <= 0) {
+                if (nread == -1 && errno == EINTR) continue;
+                *err = nread ? -1 : 0;
+                sdsfree(arg);
+                return NULL;
+            }
+            got += nread;
+        }
+        if ((*err = aofLoadFill(lb,2)) != 1) {
+            sdsfree(arg);
+            return NULL;
+        }
+        lb->pos += 2; /* Skip the CRLF. */
+        lb->processed += len+2;
+        return createObject(REDIS_STRING,arg);
+    }
+    /* Skip the argument and the CRLF. */
+    lb->pos += len+2;
+    lb->processed += len+2;
+    return createObject(REDIS_STRING,arg);
+}
+
 /* Replay the append log file. On success REDIS_OK is returned. On non fatal
  * error (the append only file is zero-length) REDIS_ERR is returned. On
  * fatal error an error message is logged and the program exists. */
@@ -588,7 +1448,11 @@ int loadAppendOnlyFile(char *filename) {
     FILE *fp = fopen(filename,"r");
     struct redis_stat sb;
     int old_aof_state = server.aof_state;
-    long loops = 0;
+    off_t last_progress = 0;
+    aofLoadBuffer lb;
+    robj **argv = NULL;
+    int argv_size = 0, retval = 1;
+    struct redisCommand *cmd = NULL;
 
     //aof文件大小为0,报错
     if (fp && redis_fstat(fileno(fp),&sb) != -1 && sb.st_size == 0) {
@@ -607,50 +1471,61 @@ int loadAppendOnlyFile(char *filename) {
      * to the same file we're about to read. */
     server.aof_state = REDIS_AOF_OFF;
 
+    lb.fd = fileno(fp);
+    lb.buf = zmalloc(REDIS_AOF_LOAD_BUFFER_SIZE);
+    lb.len = lb.pos = 0;
+    lb.processed = 0;
+    lb.eof = 0;
+#ifdef HAVE_FADVISE
+    posix_fadvise(lb.fd,0,0,POSIX_FADV_SEQUENTIAL);
+#endif
+
     fakeClient = createFakeClient();
     startLoading(fp);
 
     while(1) {
         int argc, j;
-        unsigned long len;
-        robj **argv;
-        char buf[128];
-        sds argsds;
-        struct redisCommand *cmd;
+        long long count;
 
         /* Serve the clients from time to time */
-        if (!(loops++ % 1000)) {
-            loadingProgress(ftello(fp));
+        if (lb.processed - last_progress >=
+            server.loading_process_events_interval_bytes)
+        {
+            last_progress = lb.processed;
+            loadingProgress(lb.processed);
             aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
         }
 
-        if (fgets(buf,sizeof(buf),fp) == NULL) {
-            if (feof(fp))
-                break;
-            else
-                goto readerr;
-        }
-        //取到命令参数数量
-        if (buf[0] != '*') goto fmterr;
-        argc = atoi(buf+1);
-        if (argc < 1) goto fmterr;
+        /* EOF here, between two commands, is the normal termination. */
+        if ((retval = aofLoadFill(&lb,1)) == 0) break;
+        if (retval == -1) goto readerr;
 
-        argv = zmalloc(sizeof(robj*)*argc);
+        //取到命令参数数量
+        if ((retval = aofLoadReadLine(&lb,'*',&count)) != 1) goto loaderr;
+        if (count < 1 || count > INT_MAX) goto fmterr;
+        argc = count;
+
+        /* Reuse the argv array if it is big enough. */
+        if (argc > argv_size) {
+            zfree(argv);
+            argv = zmalloc(sizeof(robj*)*argc);
+            argv_size = argc;
+        }
         for (j = 0; j < argc; j++) {
-            if (fgets(buf,sizeof(buf),fp) == NULL) goto readerr;
-            if (buf[0] != '$') goto fmterr;
-            //取到当前参数的长度
-            len = strtol(buf+1,NULL,10);
-            argsds = sdsnewlen(NULL,len);
-            //取到参数的内容
-            if (len && fread(argsds,len,1,fp) == 0) goto fmterr;
-            argv[j] = createObject(REDIS_STRING,argsds);
-            //跳过/r/n
-            if (fread(buf,2,1,fp) == 0) goto fmterr; /* discard CRLF */
+            //取到当前参数的长度和内容
+            if ((retval = aofLoadReadLine(&lb,'$',&count)) != 1)
+                goto loaderr;
+            if ((argv[j] = aofLoadReadBulk(&lb,count,&retval)) == NULL) {
+                /* A truncated argument is reported as a format error. */
+                if (retval == 0) retval = -2;
+                goto loaderr;
+            }
         }
 
-        /* Command lookup */
-        cmd = lookupCommand(argv[0]->ptr);
+        /* Command lookup, skipped if the command is the same as the
+         * previous one. */
+        if (cmd == NULL || strcasecmp(cmd->name,argv[0]->ptr))
+            cmd = lookupCommand(argv[0]->ptr);
         if (!cmd) {
             redisLog(REDIS_WARNING,"Unknown command '%s' reading the append only file", (char*)argv[0]->ptr);
             exit(1);
@@ -666,17 +1541,30 @@ int loadAppendOnlyFile(char *filename) {
         redisAssert((fakeClient->flags & REDIS_BLOCKED) == 0);
 
         /* Clean up. Command code may have changed argv/argc so we use the
-         * argv/argc of the client instead of the local variables. */
+         * argv/argc of the client instead of the local variables. If the
+         * vector was replaced the old one was already freed: adopt the new
+         * one as our reusable array. */
         for (j = 0; j < fakeClient->argc; j++)
             decrRefCount(fakeClient->argv[j]);
-        zfree(fakeClient->argv);
+        if (fakeClient->argv != argv) {
+            argv = fakeClient->argv;
+            argv_size = fakeClient->argc;
+        }
+        fakeClient->argv = NULL;
+        fakeClient->argc = 0;
     }
 
     /* This point can only be reached when EOF is reached without errors.
      * If the client is in the middle of a MULTI/EXEC, log error and quit. */
     //当正常读完aof文件，程序将到达这里
-    if (fakeClient->flags & REDIS_MULTI) goto readerr;
+    if (fakeClient->flags & REDIS_MULTI) {
+        retval = 0;
+        goto readerr;
+    }
 
+    loadingProgress(lb.processed);
+    zfree(argv);
+    zfree(lb.buf);
     fclose(fp);
     freeFakeClient(fakeClient);
     server.aof_state = old_aof_state;
@@ -685,8 +1573,10 @@ int loadAppendOnlyFile(char *filename) {
     server.aof_rewrite_base_size = server.aof_current_size;
     return REDIS_OK;
 
+loaderr:
+    if (retval == -2) goto fmterr;
 readerr:
-    if (feof(fp)) {
+    if (retval == 0) {
         redisLog(REDIS_WARNING,"Unexpected end of file reading the append only file");
     } else {
         redisLog(REDIS_WARNING,"Unrecoverable error reading the append only file: %s", strerror(errno));
@@ -697,6 +1587,31 @@ fmterr:
     exit(1);
 }
 
+/* Load the AOF: either the single configured file, or with the manifest
+ * the base file followed by every incremental file, in order. Returns
+ * REDIS_OK if at least one non empty file was loaded. */
+//装载aof文件，使用manifest时依次装载base和所有incr文件
+int loadAppendOnlyFiles(void) {
+    listNode *ln;
+    listIter li;
+    int retval = REDIS_ERR;
+
+    if (!server.aof_use_manifest)
+        return loadAppendOnlyFile(server.aof_filename);
+
+    if (server.aof_manifest.base &&
+        loadAppendOnlyFile(server.aof_manifest.base) == REDIS_OK)
+        retval = REDIS_OK;
+    listRewind(server.aof_manifest.incrs,&li);
+    while((ln = listNext(&li))) {
+        if (loadAppendOnlyFile(listNodeValue(ln)) == REDIS_OK)
+            retval = REDIS_OK;
+    }
+    aofUpdateCurrentSize();
+    server.aof_rewrite_base_size = server.aof_current_size;
+    return retval;
+}
+
 /* ----------------------------------------------------------------------------
  * AOF rewrite
  * ------------------------------------------------------------------------- */
@@ -722,16 +1637,16 @@ int rioWriteBulkObject(rio *r, robj *obj) {
 int rewriteListObject(rio *r, robj *key, robj *o) {
     long long count = 0, items = listTypeLength(o);
 
-    //list的编码是ziplist
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    //list的编码是listpack
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = o->ptr;
-        unsigned char *p = ziplistIndex(zl,0);
+        unsigned char *p = lpIndex(zl,0);
         unsigned char *vstr;
         unsigned int vlen;
         long long vlong;
 
         //遍历list的元素
-        while(ziplistGet(p,&vstr,&vlen,&vlong)) {
+        while(lpGet(p,&vstr,&vlen,&vlong)) {
             if (count == 0) {
                 int cmd_items = (items > REDIS_AOF_REWRITE_ITEMS_PER_CMD) ?
                     REDIS_AOF_REWRITE_ITEMS_PER_CMD : items;
@@ -747,7 +1662,7 @@ int rewriteListObject(rio *r, robj *key, robj *o) {
             } else {
                 if (rioWriteBulkLongLong(r,vlong) == 0) return 0;
             }
-            p = ziplistNext(zl,p);
+            p = lpNext(zl,p);
             if (++count == REDIS_AOF_REWRITE_ITEMS_PER_CMD) count = 0;
             items--;
         }
@@ -828,6 +1743,53 @@ int rewriteSetObject(rio *r, robj *key, robj *o) {
             items--;
         }
         dictReleaseIterator(di);
+    }
+    //编码是listpack
+    else if (o->encoding == REDIS_ENCODING_LISTPACK) {
+        unsigned char *p = lpFirst(o->ptr);
+        unsigned char *vstr;
+        unsigned int vlen;
+        long long vll;
+
+        while (p != NULL) {
+            if (count == 0) {
+                int cmd_items = (items > REDIS_AOF_REWRITE_ITEMS_PER_CMD) ?
+                    REDIS_AOF_REWRITE_ITEMS_PER_CMD : items;
+
+                if (rioWriteBulkCount(r,'*',2+cmd_items) == 0) return 0;
+                if (rioWriteBulkString(r,"SADD",4) == 0) return 0;
+                if (rioWriteBulkObject(r,key) == 0) return 0;
+            }
+            lpGet(p,&vstr,&vlen,&vll);
+            if (vstr) {
+                if (rioWriteBulkString(r,(char*)vstr,vlen) == 0) return 0;
+            } else {
+                if (rioWriteBulkLongLong(r,vll) == 0) return 0;
+            }
+            if (++count == REDIS_AOF_REWRITE_ITEMS_PER_CMD) count = 0;
+            items--;
+            p = lpNext(o->ptr,p);
+        }
+    }
+    //编码是roaring
+    else if (o->encoding == REDIS_ENCODING_ROARING) {
+        roaringIterator it;
+        int64_t llval;
+
+        roaringInitIterator(o->ptr,&it);
+        while (roaringNext(&it,&llval)) {
+            if (count == 0) {
+                int cmd_items = (items > REDIS_AOF_REWRITE_ITEMS_PER_CMD) ?
+                    REDIS_AOF_REWRITE_ITEMS_PER_CMD : items;
+
+                if (rioWriteBulkCount(r,'*',2+cmd_items) == 0) return 0;
+                if (rioWriteBulkString(r,"SADD",4) == 0) return 0;
+                if (rioWriteBulkObject(r,key) == 0) return 0;
+            }
+            if (rioWriteBulkLongLong(r,llval) == 0) return 0;
+            if (++count == REDIS_AOF_REWRITE_ITEMS_PER_CMD) count = 0;
+            items--;
+        }
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -840,40 +1802,27 @@ int rewriteSetObject(rio *r, robj *key, robj *o) {
 int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
     long long count = 0, items = zsetLength(o);
 
-    //编码是ziplist
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    //编码是zpack
+    if (o->encoding == REDIS_ENCODING_ZPACK) {
         unsigned char *zl = o->ptr;
-        unsigned char *eptr, *sptr;
         unsigned char *vstr;
         unsigned int vlen;
-        long long vll;
-        double score;
+        unsigned long rank, len = zpLength(zl);
 
-        eptr = ziplistIndex(zl,0);
-        redisAssert(eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
-        redisAssert(sptr != NULL);
-
-        while (eptr != NULL) {
-            redisAssert(ziplistGet(eptr,&vstr,&vlen,&vll));
-            score = zzlGetScore(sptr);
+        for (rank = 0; rank < len; rank++) {
+            vstr = zpGetMember(zl,rank,&vlen);
 
             if (count == 0) {
                 int cmd_items = (items > REDIS_AOF_REWRITE_ITEMS_PER_CMD) ?
                     REDIS_AOF_REWRITE_ITEMS_PER_CMD : items;
 
-                //开始先将ziplist长度+2, ZADD, key写到rio
+                //开始先将元素个数*2+2, ZADD, key写到rio
                 if (rioWriteBulkCount(r,'*',2+cmd_items*2) == 0) return 0;
                 if (rioWriteBulkString(r,"ZADD",4) == 0) return 0;
                 if (rioWriteBulkObject(r,key) == 0) return 0;
             }
-            if (rioWriteBulkDouble(r,score) == 0) return 0;
-            if (vstr != NULL) {
-                if (rioWriteBulkString(r,(char*)vstr,vlen) == 0) return 0;
-            } else {
-                if (rioWriteBulkLongLong(r,vll) == 0) return 0;
-            }
-            zzlNext(zl,&eptr,&sptr);
+            if (rioWriteBulkDouble(r,zpGetScore(zl,rank)) == 0) return 0;
+            if (rioWriteBulkString(r,(char*)vstr,vlen) == 0) return 0;
             if (++count == REDIS_AOF_REWRITE_ITEMS_PER_CMD) count = 0;
             items--;
         }
@@ -903,6 +1852,29 @@ int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
             items--;
         }
         dictReleaseIterator(di);
+    }
+    //编码是B+树，按顺序遍历叶子节点
+    else if (o->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = o->ptr;
+        zbtreeLeaf *l;
+        int j;
+
+        for (l = zs->zbt->head; l != NULL; l = l->next) {
+            for (j = 0; j < l->hdr.num; j++) {
+                if (count == 0) {
+                    int cmd_items = (items > REDIS_AOF_REWRITE_ITEMS_PER_CMD) ?
+                        REDIS_AOF_REWRITE_ITEMS_PER_CMD : items;
+
+                    if (rioWriteBulkCount(r,'*',2+cmd_items*2) == 0) return 0;
+                    if (rioWriteBulkString(r,"ZADD",4) == 0) return 0;
+                    if (rioWriteBulkObject(r,key) == 0) return 0;
+                }
+                if (rioWriteBulkDouble(r,l->score[j]) == 0) return 0;
+                if (rioWriteBulkObject(r,l->obj[j]) == 0) return 0;
+                if (++count == REDIS_AOF_REWRITE_ITEMS_PER_CMD) count = 0;
+                items--;
+            }
+        }
     } else {
         redisPanic("Unknown sorted zset encoding");
     }
@@ -917,12 +1889,12 @@ int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
  * The function returns 0 on error, non-zero on success. */
 //将给定hash迭代器指向的元素的key或者value写到rio中
 static int rioWriteHashIteratorCursor(rio *r, hashTypeIterator *hi, int what) {
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             return rioWriteBulkString(r, (char*)vstr, vlen);
         } else {
@@ -971,6 +1943,22 @@ int rewriteHashObject(rio *r, robj *key, robj *o) {
     return 1;
 }
 
+/* This function is called by the child rewriting the AOF file to read
+ * the difference accumulated from the parent into a buffer, that is
+ * concatenated at the end of the rewrite. */
+//子进程从管道中读取父进程发送的差异数据
+ssize_t aofReadDiffFromParent(void) {
+    char buf[65536]; /* Default pipe buffer size on most Linux systems. */
+    ssize_t nread, total = 0;
+
+    while ((nread =
+            read(server.aof_pipe_read_data_from_parent,buf,sizeof(buf))) > 0) {
+        server.aof_child_diff = sdscatlen(server.aof_child_diff,buf,nread);
+        total += nread;
+    }
+    return total;
+}
+
 /* Write a sequence of commands able to fully rebuild the dataset into
  * "filename". Used both by REWRITEAOF and BGREWRITEAOF.
  *
@@ -987,6 +1975,9 @@ int rewriteAppendOnlyFile(char *filename) {
     char tmpfile[256];
     int j;
     long long now = mstime();
+    char byte;
+    size_t processed = 0;
+    long long keys = 0;
 
     /* Note that we have to use a different temp name here compared to the
      * one used by rewriteAppendOnlyFileBackground() function. */
@@ -998,8 +1989,9 @@ int rewriteAppendOnlyFile(char *filename) {
         return REDIS_ERR;
     }
 
+    server.aof_child_diff = sdsempty();
     //使用临时文件的fp初始化rio
-    rioInitWithFile(&aof,fp);
+    rioInitWithFd(&aof,fileno(fp));
     if (server.aof_rewrite_incremental_fsync)
     	//设置rio进行的autosync参数，即写进多少数据后会调用fsync
         rioSetAutoSync(&aof,REDIS_AOF_AUTOSYNC_BYTES);
@@ -1011,6 +2003,7 @@ int rewriteAppendOnlyFile(char *filename) {
         if (dictSize(d) == 0) continue;
         di = dictGetSafeIterator(d);
         if (!di) {
+            rioFreeFd(&aof);
             fclose(fp);
             return REDIS_ERR;
         }
@@ -1026,6 +2019,7 @@ int rewriteAppendOnlyFile(char *filename) {
             sds keystr;
             robj key, *o;
             long long expiretime;
+            int lazy;
 
             keystr = dictGetKey(de);
             o = dictGetVal(de);
@@ -1037,6 +2031,12 @@ int rewriteAppendOnlyFile(char *filename) {
             //如果key过期了，跳过
             if (expiretime != -1 && expiretime < now) continue;
 
+            /* Values of a lazily loaded RDB are loaded in a temporary
+             * object, the dataset is not modified. */
+            //惰性载入的值先载入到临时对象
+            lazy = o->encoding == REDIS_ENCODING_LAZY;
+            if (lazy) o = rdbLoadLazyObject(o);
+
             /* Save the key and associated value */
             //根据key的类型，调用不同函数将命令写到rio中
             if (o->type == REDIS_STRING) {
@@ -1057,6 +2057,7 @@ int rewriteAppendOnlyFile(char *filename) {
             } else {
                 redisPanic("Unknown object type");
             }
+            if (lazy) decrRefCount(o);
             /* Save the expire time */
             //存在key的过期时间，将它以pexpireat命令写到rio
             if (expiretime != -1) {
@@ -1065,14 +2066,77 @@ int rewriteAppendOnlyFile(char *filename) {
                 if (rioWriteBulkObject(&aof,&key) == 0) goto werr;
                 if (rioWriteBulkLongLong(&aof,expiretime) == 0) goto werr;
             }
+            /* Read some diff from the parent from time to time. */
+            //每写入10k数据，从父进程读取一次差异数据
+            if (!server.aof_use_manifest &&
+                aof.processed_bytes > processed+1024*10)
+            {
+                processed = aof.processed_bytes;
+                aofReadDiffFromParent();
+            }
+            /* Let the parent know how the COW size is growing. */
+            if ((++keys & 1023) == 0) sendChildInfoProgress();
         }
         dictReleaseIterator(di);
+        di = NULL;
+    }
+
+    /* Do an initial slow fsync here while the parent is still sending
+     * data, in order to make the next final fsync faster. */
+    if (rioFdSync(&aof) == 0) goto werr;
+
+    /* With the manifest the parent sends no diff: the new base is ready. */
+    if (server.aof_use_manifest) goto done;
+
+    /* Read again a few times to get more data from the parent.
+     * We can't read forever (the server may receive data from clients
+     * faster than it is able to send data to the child), so we try to read
+     * some more data in a loop as soon as there is a good chance more data
+     * will come. If it looks like we are wasting time, we abort (this
+     * happens after 20 ms without new data). */
+    //在1秒内继续从父进程读取差异数据，连续20ms没有新数据时停止
+    int nodata = 0;
+    long long start = mstime();
+    while(mstime()-start < 1000 && nodata < 20) {
+        if (aeWait(server.aof_pipe_read_data_from_parent, AE_READABLE, 1) <= 0)
+        {
+            nodata++;
+            continue;
+        }
+        nodata = 0; /* Start counting from zero, we stop on N *contiguous*
+                       timeouts. */
+        aofReadDiffFromParent();
     }
 
+    /* Ask the master to stop sending diffs. */
+    //通知父进程停止发送差异数据
+    if (write(server.aof_pipe_write_ack_to_parent,"!",1) != 1) goto werr;
+    if (anetNonBlock(NULL,server.aof_pipe_read_ack_from_parent) != ANET_OK)
+        goto werr;
+    /* We read the ACK from the server using a 5 seconds timeout. Normally
+     * it should reply ASAP, but just in case we lose its reply, we are sure
+     * the child will eventually get terminated. */
+    //等待父进程的确认
+    if (syncRead(server.aof_pipe_read_ack_from_parent,&byte,1,5000) != 1 ||
+        byte != '!') goto werr;
+    redisLog(REDIS_NOTICE,"Parent agreed to stop sending diffs. Finalizing AOF...");
+
+    /* Read the final diff if any. */
+    aofReadDiffFromParent();
+
+    /* Write the received diff to the file. */
+    //将收到的差异数据写到临时文件
+    redisLog(REDIS_NOTICE,
+        "Concatenating %.2f MB of AOF diff received from parent.",
+        (double) sdslen(server.aof_child_diff) / (1024*1024));
+    if (rioWrite(&aof,server.aof_child_diff,sdslen(server.aof_child_diff)) == 0)
+        goto werr;
+
+done:
     /* Make sure data will not remain on the OS's output buffers */
     //清空缓冲区并且同步到硬盘
-    if (fflush(fp) == EOF) goto werr;
-    if (aof_fsync(fileno(fp)) == -1) goto werr;
+    if (rioFdSync(&aof) == 0) goto werr;
+    rioFreeFd(&aof);
     if (fclose(fp) == EOF) goto werr;
 
     /* Use RENAME to make sure the DB file is changed atomically only
@@ -1088,6 +2152,7 @@ int rewriteAppendOnlyFile(char *filename) {
 
 werr:
     //处理出错
+    if (aof.io.fd.buf) rioFreeFd(&aof);
     fclose(fp);
     unlink(tmpfile);
     redisLog(REDIS_WARNING,"Write error writing append only file on disk: %s", strerror(errno));
@@ -1095,16 +2160,106 @@ werr:
     return REDIS_ERR;
 }
 
+/* ----------------------------------------------------------------------------
+ * AOF rewrite pipes for IPC
+ * -------------------------------------------------------------------------- */
+
+/* This event handler is called when the AOF rewriting child sends us a
+ * single '!' char to signal we should stop sending buffer diffs. The
+ * parent sends a '!' as well to acknowledge. */
+//子进程要求父进程停止发送差异数据时调用
+void aofChildPipeReadable(aeEventLoop *el, int fd, void *privdata, int mask) {
+    char byte;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(privdata);
+    REDIS_NOTUSED(mask);
+
+    if (read(fd,&byte,1) == 1 && byte == '!') {
+        redisLog(REDIS_NOTICE,"AOF rewrite child asks to stop sending diffs.");
+        server.aof_stop_sending_diff = 1;
+        if (write(server.aof_pipe_write_ack_to_child,"!",1) != 1) {
+            /* If we can't send the ack, inform the user, but don't try again
+             * since in the other side the children will use a timeout if the
+             * kernel can't buffer our write, or, the children was
+             * terminated. */
+            redisLog(REDIS_WARNING,"Can't send ACK to AOF child: %s",
+                strerror(errno));
+        }
+    }
+    /* Remove the handler since this can be called only one time during a
+     * rewrite. */
+    aeDeleteFileEvent(server.el,server.aof_pipe_read_ack_from_child,AE_READABLE);
+}
+
+/* Create the pipes used for parent - child process IPC during rewrite.
+ * We have a data pipe used to send AOF incremental diffs to the child,
+ * and two other pipes used by the children to signal it finished with
+ * the rewrite so no more data should be written, and another for the
+ * parent to acknowledge it understood this new condition. */
+//创建重写期间父子进程通信用的管道
+int aofCreatePipes(void) {
+    int fds[6] = {-1, -1, -1, -1, -1, -1};
+    int j;
+
+    if (pipe(fds) == -1) goto error; /* parent -> children data. */
+    if (pipe(fds+2) == -1) goto error; /* children -> parent ack. */
+    if (pipe(fds+4) == -1) goto error; /* parent -> children ack. */
+    /* Parent -> children data is non blocking. */
+    if (anetNonBlock(NULL,fds[0]) != ANET_OK) goto error;
+    if (anetNonBlock(NULL,fds[1]) != ANET_OK) goto error;
+    if (aeCreateFileEvent(server.el, fds[2], AE_READABLE, aofChildPipeReadable, NULL) == AE_ERR) goto error;
+
+    server.aof_pipe_write_data_to_child = fds[1];
+    server.aof_pipe_read_data_from_parent = fds[0];
+    server.aof_pipe_write_ack_to_parent = fds[3];
+    server.aof_pipe_read_ack_from_child = fds[2];
+    server.aof_pipe_write_ack_to_child = fds[5];
+    server.aof_pipe_read_ack_from_parent = fds[4];
+    server.aof_stop_sending_diff = 0;
+    return REDIS_OK;
+
+error:
+    redisLog(REDIS_WARNING,"Error opening /setting AOF rewrite IPC pipes: %s",
+        strerror(errno));
+    for (j = 0; j < 6; j++) if(fds[j] != -1) close(fds[j]);
+    return REDIS_ERR;
+}
+
+//关闭重写期间使用的管道
+void aofClosePipes(void) {
+    if (server.aof_pipe_read_ack_from_child == -1) return; /* No pipes. */
+    aeDeleteFileEvent(server.el,server.aof_pipe_read_ack_from_child,AE_READABLE);
+    aeDeleteFileEvent(server.el,server.aof_pipe_write_data_to_child,AE_WRITABLE);
+    close(server.aof_pipe_write_data_to_child);
+    close(server.aof_pipe_read_data_from_parent);
+    close(server.aof_pipe_write_ack_to_parent);
+    close(server.aof_pipe_read_ack_from_child);
+    close(server.aof_pipe_write_ack_to_child);
+    close(server.aof_pipe_read_ack_from_parent);
+    server.aof_pipe_write_data_to_child = -1;
+    server.aof_pipe_read_data_from_parent = -1;
+    server.aof_pipe_write_ack_to_parent = -1;
+    server.aof_pipe_read_ack_from_child = -1;
+    server.aof_pipe_write_ack_to_child = -1;
+    server.aof_pipe_read_ack_from_parent = -1;
+}
+
+/* ----------------------------------------------------------------------------
+ * AOF background rewrite
+ * ------------------------------------------------------------------------- */
+
 /* This is how rewriting of the append only file in background works:
  *
  * 1) The user calls BGREWRITEAOF
  * 2) Redis calls this function, that forks():
  *    2a) the child rewrite the append only file in a temp file.
- *    2b) the parent accumulates differences in server.aof_rewrite_buf.
- * 3) When the child finished '2a' exists.
+ *    2b) the parent accumulates differences in server.aof_rewrite_buf and
+ *        streams them to the child over a pipe while it is running.
+ * 3) When the child finished '2a', it asks the parent to stop sending
+ *    diffs, appends what it received, and exits.
  * 4) The parent will trap the exit code, if it's OK, will append the
- *    data accumulated into server.aof_rewrite_buf into the temp file, and
- *    finally will rename(2) the temp file in the actual file name.
+ *    residual data accumulated into server.aof_rewrite_buf into the temp
+ *    file, and finally will rename(2) the temp file in the actual file name.
  *    The the new file is reopened as the new append only file. Profit!
  */
 //将重写aof以子进程的方式完成
@@ -1113,6 +2268,12 @@ int rewriteAppendOnlyFileBackground(void) {
     long long start;
 
     if (server.aof_child_pid != -1) return REDIS_ERR;
+    if (server.aof_use_manifest) {
+        if (aofManifestStartRewrite() != REDIS_OK) return REDIS_ERR;
+    } else {
+        if (aofCreatePipes() != REDIS_OK) return REDIS_ERR;
+    }
+    openChildInfoPipe();
     start = ustime();
     if ((childpid = fork()) == 0) {
     	//子进程
@@ -1120,12 +2281,13 @@ int rewriteAppendOnlyFileBackground(void) {
 
         /* Child */
         closeListeningSockets(0);
+        childInfoStart(CHILD_INFO_TYPE_AOF);
         //设置程序的名字
         redisSetProcTitle("redis-aof-rewrite");
         snprintf(tmpfile,256,"temp-rewriteaof-bg-%d.aof", (int) getpid());
         //调用rewriteAppendOnlyFile重写aof
         if (rewriteAppendOnlyFile(tmpfile) == REDIS_OK) {
-            size_t private_dirty = zmalloc_get_private_dirty();
+            size_t private_dirty = sendChildInfo();
 
             if (private_dirty) {
                 redisLog(REDIS_NOTICE,
@@ -1146,6 +2308,9 @@ int rewriteAppendOnlyFileBackground(void) {
             redisLog(REDIS_WARNING,
                 "Can't rewrite append only file in background: fork: %s",
                 strerror(errno));
+            aofClosePipes();
+            closeChildInfoPipe();
+            if (server.aof_rewrite_incr) aofManifestRewriteDone(NULL,0);
             return REDIS_ERR;
         }
         redisLog(REDIS_NOTICE,
@@ -1195,6 +2360,10 @@ void aofRemoveTempFile(pid_t childpid) {
 void aofUpdateCurrentSize(void) {
     struct redis_stat sb;
 
+    if (server.aof_use_manifest) {
+        server.aof_current_size = aofManifestTotalSize();
+        return;
+    }
     if (redis_fstat(server.aof_fd,&sb) == -1) {
         redisLog(REDIS_WARNING,"Unable to obtain the AOF file length. stat: %s",
             strerror(errno));
@@ -1220,6 +2389,19 @@ void backgroundRewriteDoneHandler(int exitcode, int bysignal) {
         //打开重写的临时文件
         snprintf(tmpfile,256,"temp-rewriteaof-bg-%d.aof",
             (int)server.aof_child_pid);
+
+        /* With the manifest the writes performed during the rewrite are
+         * already in the incremental file that follows the new base. */
+        if (server.aof_use_manifest) {
+            if (aofManifestRewriteDone(tmpfile,1) == REDIS_ERR) goto cleanup;
+            aofUpdateCurrentSize();
+            server.aof_rewrite_base_size = server.aof_current_size;
+            server.aof_lastbgrewrite_status = REDIS_OK;
+            redisLog(REDIS_NOTICE, "Background AOF rewrite finished successfully");
+            if (server.aof_state == REDIS_AOF_WAIT_REWRITE)
+                server.aof_state = REDIS_AOF_ON;
+            goto cleanup;
+        }
         newfd = open(tmpfile,O_WRONLY|O_APPEND);
         if (newfd == -1) {
             redisLog(REDIS_WARNING,
@@ -1236,7 +2418,7 @@ void backgroundRewriteDoneHandler(int exitcode, int bysignal) {
         }
 
         redisLog(REDIS_NOTICE,
-            "Parent diff successfully flushed to the rewritten AOF (%lu bytes)", aofRewriteBufferSize());
+            "Residual parent diff successfully flushed to the rewritten AOF (%.2f MB)", (double) aofRewriteBufferSize() / (1024*1024));
 
         /* The only remaining thing to do is to rename the temporary file to
          * the configured file and switch the file descriptor used to do AOF
@@ -1277,6 +2459,10 @@ void backgroundRewriteDoneHandler(int exitcode, int bysignal) {
             oldfd = -1; /* We'll set this to the current AOF filedes later. */
         }
 
+        /* Make sure the writer thread no longer references the old AOF
+         * file descriptor before we switch to the new one. */
+        aofWriterDrain();
+
         /* Rename the temporary file. This will not unlink the target file if
          * it exists, because we reference it with "oldfd". */
         //将临时文件改为aof文件的名字
@@ -1338,6 +2524,10 @@ void backgroundRewriteDoneHandler(int exitcode, int bysignal) {
     }
 
 cleanup:
+    /* Release the incremental file of a manifest rewrite that failed. */
+    if (server.aof_use_manifest && server.aof_rewrite_incr)
+        aofManifestRewriteDone(NULL,0);
+    aofClosePipes();
     aofRewriteBufferReset();
     aofRemoveTempFile(server.aof_child_pid);
     server.aof_child_pid = -1;
@@ -89,10 +89,6 @@ struct bio_job {
 
 void *bioProcessBackgroundJobs(void *arg);
 
-/* Make sure we have enough stack to perform all the things we do in the
- * main thread. */
-#define REDIS_THREAD_STACK_SIZE (1024*1024*4)
-
 /* Initialize the background system, spawning the thread. */
 //初始化后台任务所需的上下文
 void bioInit(void) {
@@ -198,6 +194,9 @@ void *bioProcessBackgroundJobs(void *arg) {
         } else if (type == REDIS_BIO_AOF_FSYNC) {
         	//操作是fsync
             aof_fsync((long)job->arg1);
+        } else if (type == REDIS_BIO_SNAPSHOT_WRITE) {
+        	//操作是写入不需要fork的快照
+            snapshotProcessJob(job->arg1,job->arg2,job->arg3);
         } else {
             redisPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
@@ -45,9 +45,14 @@ time_t bioOlderJobOfType(int type);
 //杀死线程，目前redis只有在崩溃时才调用该函数
 void bioKillThreads(void);
 
+/* Make sure we have enough stack to perform all the things we do in the
+ * main thread. */
+#define REDIS_THREAD_STACK_SIZE (1024*1024*4)
+
 /* Background job opcodes */
-//目前有两种类型的任务，一是close操作，二是fsync操作。
-//这两种操作都花费大量时间，为了不阻塞主进程，将其以线程形式在后台执行
+//目前有三种类型的任务，一是close操作，二是fsync操作，三是不需要fork的快照的写入。
+//这些操作都花费大量时间，为了不阻塞主进程，将其以线程形式在后台执行
 #define REDIS_BIO_CLOSE_FILE    0 /* Deferred close(2) syscall. */
 #define REDIS_BIO_AOF_FSYNC     1 /* Deferred AOF fsync. */
-#define REDIS_BIO_NUM_OPS       2
+#define REDIS_BIO_SNAPSHOT_WRITE 2 /* Fork-less snapshot writes. */
+#define REDIS_BIO_NUM_OPS       3
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2013, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+#include <unistd.h>
+
+/* -----------------------------------------------------------------------------
+ * Child info pipe
+ *
+ * Before forking a BGSAVE or BGREWRITEAOF child the parent opens a pipe that
+ * the child uses to report how much memory was duplicated by copy on write
+ * (the private dirty bytes of the child address space). The child sends an
+ * update about once per second while it runs and a final one when done, so
+ * that INFO can show the current COW size of the running child and the size
+ * reached by the last BGSAVE / AOF rewrite.
+ *
+ * The messages are small fixed size structures, so they are written
+ * atomically into the pipe and can't be mixed.
+ * -------------------------------------------------------------------------- */
+
+#define CHILD_INFO_MAGIC 0xC17DDA7A12345678LL
+#define CHILD_INFO_PROGRESS_PERIOD 1000 /* Milliseconds between updates. */
+
+typedef struct childInfoData {
+    int process_type;       /* CHILD_INFO_TYPE_* */
+    size_t cow_size;        /* Private dirty bytes of the child. */
+    unsigned long long magic;
+} childInfoData;
+
+static long long child_info_last_send = 0;
+
+/* Open the pipe, called by the parent before forking. The read side is non
+ * blocking as the parent polls it from serverCron(). On error the pipe is
+ * just not used: COW reporting is not worth failing a BGSAVE. */
+//在fork前创建子进程汇报信息用的管道
+void openChildInfoPipe(void) {
+    closeChildInfoPipe();
+    if (pipe(server.child_info_pipe) == -1) {
+        redisLog(REDIS_WARNING,"Can't open the child info pipe: %s",
+            strerror(errno));
+        server.child_info_pipe[0] = server.child_info_pipe[1] = -1;
+        return;
+    }
+    if (anetNonBlock(NULL,server.child_info_pipe[0]) != ANET_OK) {
+        closeChildInfoPipe();
+        return;
+    }
+    server.stat_current_cow_bytes = 0;
+}
+
+void closeChildInfoPipe(void) {
+    if (server.child_info_pipe[0] != -1) close(server.child_info_pipe[0]);
+    if (server.child_info_pipe[1] != -1) close(server.child_info_pipe[1]);
+    server.child_info_pipe[0] = server.child_info_pipe[1] = -1;
+}
+
+/* Called by the child just after fork(). Remembers what kind of child we
+ * are and stops the dict code from moving entries around: the child only
+ * reads the dataset, and every rehashing step would copy shared pages. */
+//子进程fork后调用, 禁止子进程内的dict resize和rehash
+void childInfoStart(int ptype) {
+    server.child_info_type = ptype;
+    child_info_last_send = mstime();
+    if (server.child_info_pipe[0] != -1) {
+        close(server.child_info_pipe[0]);
+        server.child_info_pipe[0] = -1;
+    }
+    updateDictResizePolicy();
+}
+
+/* Send the current private dirty size to the parent, and return it. Only
+ * children started with childInfoStart() send anything, otherwise zero is
+ * returned. */
+//子进程将当前copy-on-write的内存大小发给父进程
+size_t sendChildInfo(void) {
+    childInfoData data;
+
+    if (server.child_info_type == CHILD_INFO_TYPE_NONE) return 0;
+    memset(&data,0,sizeof(data));
+    data.process_type = server.child_info_type;
+    data.cow_size = zmalloc_get_private_dirty();
+    data.magic = CHILD_INFO_MAGIC;
+    if (server.child_info_pipe[1] != -1 &&
+        write(server.child_info_pipe[1],&data,sizeof(data)) != sizeof(data))
+    {
+        /* Nothing to do on error, the parent will just miss an update. */
+    }
+    child_info_last_send = mstime();
+    return data.cow_size;
+}
+
+/* Like sendChildInfo() but rate limited, to be called from the loops of the
+ * child. Reading /proc/self/smaps is not cheap with big datasets. */
+void sendChildInfoProgress(void) {
+    if (server.child_info_type == CHILD_INFO_TYPE_NONE) return;
+    if (mstime()-child_info_last_send < CHILD_INFO_PROGRESS_PERIOD) return;
+    sendChildInfo();
+}
+
+/* Read the pending reports in the parent, keeping the most recent one. When
+ * the child is gone the done handlers copy the value into the per-type
+ * stats. */
+//父进程读取子进程发来的信息
+void receiveChildInfo(void) {
+    childInfoData data;
+
+    if (server.child_info_pipe[0] == -1) return;
+    while (read(server.child_info_pipe[0],&data,sizeof(data)) == sizeof(data)) {
+        if (data.magic != CHILD_INFO_MAGIC) continue;
+        server.stat_current_cow_bytes = data.cow_size;
+    }
+}
@@ -274,6 +274,29 @@ void loadServerConfigFromString(char *config) {
                 goto loaderr;
             }
             resizeReplicationBacklog(size);
+        } else if (!strcasecmp(argv[0],"repl-backlog-disk-size") && argc == 2) {
+            long long size = memtoll(argv[1],NULL);
+            if (size < 0) {
+                err = "repl-backlog-disk-size can't be negative.";
+                goto loaderr;
+            }
+            resizeReplicationBacklogDisk(size);
+        } else if (!strcasecmp(argv[0],"repl-transfer-rate-limit") &&
+                   argc == 2)
+        {
+            server.repl_transfer_rate_limit = memtoll(argv[1],NULL);
+            if (server.repl_transfer_rate_limit < 0) {
+                err = "repl-transfer-rate-limit can't be negative.";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"repl-transfer-slave-rate-limit") &&
+                   argc == 2)
+        {
+            server.repl_transfer_slave_rate_limit = memtoll(argv[1],NULL);
+            if (server.repl_transfer_slave_rate_limit < 0) {
+                err = "repl-transfer-slave-rate-limit can't be negative.";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"repl-backlog-ttl") && argc == 2) {
             server.repl_backlog_time_limit = atoi(argv[1]);
             if (server.repl_backlog_time_limit < 0) {
@@ -302,6 +325,18 @@ void loadServerConfigFromString(char *config) {
             if ((server.activerehashing = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"cow-aware-child") && argc == 2) {
+            if ((server.cow_aware_child = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"rdb-forkless-snapshot") && argc == 2) {
+            if ((server.rdb_forkless = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"rdb-lazy-load") && argc == 2) {
+            if ((server.rdb_lazy_load = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"daemonize") && argc == 2) {
             if ((server.daemonize = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -358,6 +393,22 @@ void loadServerConfigFromString(char *config) {
             if ((server.aof_rewrite_incremental_fsync = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"aof-use-manifest") && argc == 2) {
+            if ((server.aof_use_manifest = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"aof-threaded-write") && argc == 2) {
+            if ((server.aof_threaded_write = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"aof-writer-max-pending") &&
+                   argc == 2)
+        {
+            server.aof_writer_max_pending = memtoll(argv[1],NULL);
+            if (server.aof_writer_max_pending == 0) {
+                err = "aof-writer-max-pending must be greater than zero";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"requirepass") && argc == 2) {
             if (strlen(argv[1]) > REDIS_AUTHPASS_MAX_LEN) {
                 err = "Password is longer than REDIS_AUTHPASS_MAX_LEN";
@@ -384,10 +435,36 @@ void loadServerConfigFromString(char *config) {
             server.list_max_ziplist_value = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"set-max-intset-entries") && argc == 2) {
             server.set_max_intset_entries = memtoll(argv[1], NULL);
+        } else if (!strcasecmp(argv[0],"set-max-listpack-entries") && argc == 2) {
+            server.set_max_listpack_entries = memtoll(argv[1], NULL);
+        } else if (!strcasecmp(argv[0],"set-max-listpack-value") && argc == 2) {
+            server.set_max_listpack_value = memtoll(argv[1], NULL);
+        } else if (!strcasecmp(argv[0],"set-large-int-encoding") && argc == 2) {
+            if (!strcasecmp(argv[1],"hashtable")) {
+                server.set_large_int_encoding = REDIS_ENCODING_HT;
+            } else if (!strcasecmp(argv[1],"roaring")) {
+                server.set_large_int_encoding = REDIS_ENCODING_ROARING;
+            } else {
+                err = "Invalid set large int encoding, must be hashtable or roaring";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"zset-max-ziplist-entries") && argc == 2) {
             server.zset_max_ziplist_entries = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"zset-max-ziplist-value") && argc == 2) {
             server.zset_max_ziplist_value = memtoll(argv[1], NULL);
+        } else if (!strcasecmp(argv[0],"zset-large-encoding") && argc == 2) {
+            if (!strcasecmp(argv[1],"skiplist")) {
+                server.zset_large_encoding = REDIS_ENCODING_SKIPLIST;
+            } else if (!strcasecmp(argv[1],"btree")) {
+                server.zset_large_encoding = REDIS_ENCODING_BTREE;
+            } else {
+                err = "Invalid zset large encoding, must be skiplist or btree";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"encoding-downgrade") && argc == 2) {
+            if ((server.encoding_downgrade = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"hll-sparse-max-bytes") && argc == 2) {
             server.hll_sparse_max_bytes = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"rename-command") && argc == 3) {
@@ -665,6 +742,17 @@ void configSetCommand(redisClient *c) {
 
         if (yn == -1) goto badfmt;
         server.aof_rewrite_incremental_fsync = yn;
+    } else if (!strcasecmp(c->argv[2]->ptr,"aof-threaded-write")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+        /* Make sure nothing is left in the writer queue when switching
+         * back to writes performed by the main thread. */
+        if (yn == 0 && server.aof_threaded_write) aofWriterDrain();
+        server.aof_threaded_write = yn;
+    } else if (!strcasecmp(c->argv[2]->ptr,"aof-writer-max-pending")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll <= 0) goto badfmt;
+        server.aof_writer_max_pending = ll;
     } else if (!strcasecmp(c->argv[2]->ptr,"save")) {
         int vlen, j;
         sds *v = sdssplitlen(o->ptr,sdslen(o->ptr)," ",1,&vlen);
@@ -729,9 +817,38 @@ void configSetCommand(redisClient *c) {
     } else if (!strcasecmp(c->argv[2]->ptr,"set-max-intset-entries")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
         server.set_max_intset_entries = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"set-max-listpack-entries")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.set_max_listpack_entries = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"set-max-listpack-value")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.set_max_listpack_value = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"set-large-int-encoding")) {
+        /* Only sets converted from now on are affected. */
+        if (!strcasecmp(o->ptr,"hashtable")) {
+            server.set_large_int_encoding = REDIS_ENCODING_HT;
+        } else if (!strcasecmp(o->ptr,"roaring")) {
+            server.set_large_int_encoding = REDIS_ENCODING_ROARING;
+        } else {
+            goto badfmt;
+        }
     } else if (!strcasecmp(c->argv[2]->ptr,"zset-max-ziplist-entries")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
         server.zset_max_ziplist_entries = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"zset-large-encoding")) {
+        /* Only sorted sets created or converted from now on are affected. */
+        if (!strcasecmp(o->ptr,"skiplist")) {
+            server.zset_large_encoding = REDIS_ENCODING_SKIPLIST;
+        } else if (!strcasecmp(o->ptr,"btree")) {
+            server.zset_large_encoding = REDIS_ENCODING_BTREE;
+        } else {
+            goto badfmt;
+        }
+    } else if (!strcasecmp(c->argv[2]->ptr,"encoding-downgrade")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+        server.encoding_downgrade = yn;
     } else if (!strcasecmp(c->argv[2]->ptr,"zset-max-ziplist-value")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
         server.zset_max_ziplist_value = ll;
@@ -819,6 +936,15 @@ void configSetCommand(redisClient *c) {
     } else if (!strcasecmp(c->argv[2]->ptr,"repl-backlog-size")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll <= 0) goto badfmt;
         resizeReplicationBacklog(ll);
+    } else if (!strcasecmp(c->argv[2]->ptr,"repl-backlog-disk-size")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        resizeReplicationBacklogDisk(ll);
+    } else if (!strcasecmp(c->argv[2]->ptr,"repl-transfer-rate-limit")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.repl_transfer_rate_limit = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"repl-transfer-slave-rate-limit")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.repl_transfer_slave_rate_limit = ll;
     } else if (!strcasecmp(c->argv[2]->ptr,"repl-backlog-ttl")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
         server.repl_backlog_time_limit = ll;
@@ -833,6 +959,22 @@ void configSetCommand(redisClient *c) {
 
         if (yn == -1) goto badfmt;
         server.rdb_compression = yn;
+    } else if (!strcasecmp(c->argv[2]->ptr,"cow-aware-child")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+        server.cow_aware_child = yn;
+        updateDictResizePolicy();
+    } else if (!strcasecmp(c->argv[2]->ptr,"rdb-forkless-snapshot")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+        server.rdb_forkless = yn;
+    } else if (!strcasecmp(c->argv[2]->ptr,"rdb-lazy-load")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+        server.rdb_lazy_load = yn;
     } else if (!strcasecmp(c->argv[2]->ptr,"notify-keyspace-events")) {
         int flags = keyspaceEventsStringToFlags(o->ptr);
 
@@ -925,6 +1067,8 @@ void configGetCommand(redisClient *c) {
             server.aof_rewrite_perc);
     config_get_numerical_field("auto-aof-rewrite-min-size",
             server.aof_rewrite_min_size);
+    config_get_numerical_field("aof-writer-max-pending",
+            server.aof_writer_max_pending);
     config_get_numerical_field("hash-max-ziplist-entries",
             server.hash_max_ziplist_entries);
     config_get_numerical_field("hash-max-ziplist-value",
@@ -935,6 +1079,10 @@ void configGetCommand(redisClient *c) {
             server.list_max_ziplist_value);
     config_get_numerical_field("set-max-intset-entries",
             server.set_max_intset_entries);
+    config_get_numerical_field("set-max-listpack-entries",
+            server.set_max_listpack_entries);
+    config_get_numerical_field("set-max-listpack-value",
+            server.set_max_listpack_value);
     config_get_numerical_field("zset-max-ziplist-entries",
             server.zset_max_ziplist_entries);
     config_get_numerical_field("zset-max-ziplist-value",
@@ -952,6 +1100,9 @@ void configGetCommand(redisClient *c) {
     config_get_numerical_field("repl-ping-slave-period",server.repl_ping_slave_period);
     config_get_numerical_field("repl-timeout",server.repl_timeout);
     config_get_numerical_field("repl-backlog-size",server.repl_backlog_size);
+    config_get_numerical_field("repl-backlog-disk-size",server.repl_backlog_disk_size);
+    config_get_numerical_field("repl-transfer-rate-limit",server.repl_transfer_rate_limit);
+    config_get_numerical_field("repl-transfer-slave-rate-limit",server.repl_transfer_slave_rate_limit);
     config_get_numerical_field("repl-backlog-ttl",server.repl_backlog_time_limit);
     config_get_numerical_field("maxclients",server.maxclients);
     config_get_numerical_field("watchdog-period",server.watchdog_period);
@@ -973,10 +1124,18 @@ void configGetCommand(redisClient *c) {
     config_get_bool_field("rdbcompression", server.rdb_compression);
     config_get_bool_field("rdbchecksum", server.rdb_checksum);
     config_get_bool_field("activerehashing", server.activerehashing);
+    config_get_bool_field("cow-aware-child", server.cow_aware_child);
+    config_get_bool_field("encoding-downgrade", server.encoding_downgrade);
+    config_get_bool_field("rdb-forkless-snapshot", server.rdb_forkless);
+    config_get_bool_field("rdb-lazy-load", server.rdb_lazy_load);
     config_get_bool_field("repl-disable-tcp-nodelay",
             server.repl_disable_tcp_nodelay);
     config_get_bool_field("aof-rewrite-incremental-fsync",
             server.aof_rewrite_incremental_fsync);
+    config_get_bool_field("aof-threaded-write",
+            server.aof_threaded_write);
+    config_get_bool_field("aof-use-manifest",
+            server.aof_use_manifest);
 
     /* Everything we can't handle with macros follows. */
 
@@ -995,6 +1154,16 @@ void configGetCommand(redisClient *c) {
         addReplyBulkCString(c,buf);
         matches++;
     }
+    if (stringmatch(pattern,"set-large-int-encoding",0)) {
+        addReplyBulkCString(c,"set-large-int-encoding");
+        addReplyBulkCString(c,strEncoding(server.set_large_int_encoding));
+        matches++;
+    }
+    if (stringmatch(pattern,"zset-large-encoding",0)) {
+        addReplyBulkCString(c,"zset-large-encoding");
+        addReplyBulkCString(c,strEncoding(server.zset_large_encoding));
+        matches++;
+    }
     if (stringmatch(pattern,"maxmemory-policy",0)) {
         char *s;
 
@@ -1695,6 +1864,9 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"repl-ping-slave-period",server.repl_ping_slave_period,REDIS_REPL_PING_SLAVE_PERIOD);
     rewriteConfigNumericalOption(state,"repl-timeout",server.repl_timeout,REDIS_REPL_TIMEOUT);
     rewriteConfigBytesOption(state,"repl-backlog-size",server.repl_backlog_size,REDIS_DEFAULT_REPL_BACKLOG_SIZE);
+    rewriteConfigBytesOption(state,"repl-backlog-disk-size",server.repl_backlog_disk_size,REDIS_DEFAULT_REPL_BACKLOG_DISK_SIZE);
+    rewriteConfigBytesOption(state,"repl-transfer-rate-limit",server.repl_transfer_rate_limit,REDIS_DEFAULT_REPL_TRANSFER_RATE_LIMIT);
+    rewriteConfigBytesOption(state,"repl-transfer-slave-rate-limit",server.repl_transfer_slave_rate_limit,REDIS_DEFAULT_REPL_TRANSFER_RATE_LIMIT);
     rewriteConfigBytesOption(state,"repl-backlog-ttl",server.repl_backlog_time_limit,REDIS_DEFAULT_REPL_BACKLOG_TIME_LIMIT);
     rewriteConfigYesNoOption(state,"repl-disable-tcp-nodelay",server.repl_disable_tcp_nodelay,REDIS_DEFAULT_REPL_DISABLE_TCP_NODELAY);
     rewriteConfigNumericalOption(state,"slave-priority",server.slave_priority,REDIS_DEFAULT_SLAVE_PRIORITY);
@@ -1731,13 +1903,30 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"list-max-ziplist-entries",server.list_max_ziplist_entries,REDIS_LIST_MAX_ZIPLIST_ENTRIES);
     rewriteConfigNumericalOption(state,"list-max-ziplist-value",server.list_max_ziplist_value,REDIS_LIST_MAX_ZIPLIST_VALUE);
     rewriteConfigNumericalOption(state,"set-max-intset-entries",server.set_max_intset_entries,REDIS_SET_MAX_INTSET_ENTRIES);
+    rewriteConfigNumericalOption(state,"set-max-listpack-entries",server.set_max_listpack_entries,REDIS_SET_MAX_LISTPACK_ENTRIES);
+    rewriteConfigNumericalOption(state,"set-max-listpack-value",server.set_max_listpack_value,REDIS_SET_MAX_LISTPACK_VALUE);
+    rewriteConfigEnumOption(state,"set-large-int-encoding",server.set_large_int_encoding,
+        "hashtable", REDIS_ENCODING_HT,
+        "roaring", REDIS_ENCODING_ROARING,
+        NULL, REDIS_DEFAULT_SET_LARGE_INT_ENCODING);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-entries",server.zset_max_ziplist_entries,REDIS_ZSET_MAX_ZIPLIST_ENTRIES);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-value",server.zset_max_ziplist_value,REDIS_ZSET_MAX_ZIPLIST_VALUE);
+    rewriteConfigEnumOption(state,"zset-large-encoding",server.zset_large_encoding,
+        "skiplist", REDIS_ENCODING_SKIPLIST,
+        "btree", REDIS_ENCODING_BTREE,
+        NULL, REDIS_DEFAULT_ZSET_LARGE_ENCODING);
+    rewriteConfigYesNoOption(state,"encoding-downgrade",server.encoding_downgrade,REDIS_DEFAULT_ENCODING_DOWNGRADE);
     rewriteConfigNumericalOption(state,"hll-sparse-max-bytes",server.hll_sparse_max_bytes,REDIS_DEFAULT_HLL_SPARSE_MAX_BYTES);
     rewriteConfigYesNoOption(state,"activerehashing",server.activerehashing,REDIS_DEFAULT_ACTIVE_REHASHING);
+    rewriteConfigYesNoOption(state,"cow-aware-child",server.cow_aware_child,REDIS_DEFAULT_COW_AWARE_CHILD);
+    rewriteConfigYesNoOption(state,"rdb-forkless-snapshot",server.rdb_forkless,REDIS_DEFAULT_RDB_FORKLESS);
+    rewriteConfigYesNoOption(state,"rdb-lazy-load",server.rdb_lazy_load,REDIS_DEFAULT_RDB_LAZY_LOAD);
     rewriteConfigClientoutputbufferlimitOption(state);
     rewriteConfigNumericalOption(state,"hz",server.hz,REDIS_DEFAULT_HZ);
     rewriteConfigYesNoOption(state,"aof-rewrite-incremental-fsync",server.aof_rewrite_incremental_fsync,REDIS_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC);
+    rewriteConfigYesNoOption(state,"aof-threaded-write",server.aof_threaded_write,REDIS_DEFAULT_AOF_THREADED_WRITE);
+    rewriteConfigYesNoOption(state,"aof-use-manifest",server.aof_use_manifest,REDIS_DEFAULT_AOF_USE_MANIFEST);
+    rewriteConfigBytesOption(state,"aof-writer-max-pending",server.aof_writer_max_pending,REDIS_DEFAULT_AOF_WRITER_MAX_PENDING);
     if (server.sentinel_mode) rewriteConfigSentinelOption(state);
 
     /* Step 3: remove all the orphaned lines in the old file, that is, lines
@@ -105,6 +105,18 @@
 #define rdb_fsync_range(fd,off,size) fsync(fd)
 #endif
 
+/* Check if we can use sendfile() to send the RDB file to slaves without
+ * copying it in user space. */
+#ifdef __linux__
+#define HAVE_SENDFILE 1
+#endif
+
+/* Check if we can use posix_fadvise() to drop already synced data from the
+ * page cache and to hint sequential reads. */
+#ifdef __linux__
+#define HAVE_FADVISE 1
+#endif
+
 /* Check if we can use setproctitle().
  * BSD systems have support for it, we provide an implementation for
  * Linux and osx. */
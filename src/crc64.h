@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+void crc64_init(void);
 uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l);
+uint64_t crc64_combine(uint64_t crc1, uint64_t crc2, uint64_t len2);
 
 #endif
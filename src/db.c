@@ -44,6 +44,17 @@ robj *lookupKey(redisDb *db, robj *key) {
     if (de) {
         robj *val = dictGetVal(de);
 
+        /* Values of a lazily loaded RDB are loaded on first access. */
+        //值还在映射的rdb文件中, 先将它载入内存
+        if (val->encoding == REDIS_ENCODING_LAZY) {
+            robj *lazy = val;
+
+            val = rdbLoadLazyObject(lazy);
+            dictSetVal(db->dict,de,val);
+            decrRefCount(lazy);
+            server.stat_rdb_lazy_loaded++;
+        }
+
         /* Update the access time for the ageing algorithm.
          * Don't do it if we have a saving child, as this will trigger
          * a copy on write madness. */
@@ -69,6 +80,8 @@ robj *lookupKeyRead(redisDb *db, robj *key) {
 
 robj *lookupKeyWrite(redisDb *db, robj *key) {
     expireIfNeeded(db,key);
+    /* The caller may modify the value in place. */
+    if (server.rdb_forkless_in_progress) snapshotKeyWillChange(db,key);
     return lookupKey(db,key);
 }
 
@@ -93,6 +106,7 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
     int retval = dictAdd(db->dict, copy, val);
 
     redisAssertWithInfo(NULL,key,retval == REDIS_OK);
+    if (server.rdb_forkless_in_progress) snapshotKeyAdded(db,key);
  }
 
 /* Overwrite an existing key with a new value. Incrementing the reference
@@ -104,6 +118,7 @@ void dbOverwrite(redisDb *db, robj *key, robj *val) {
     struct dictEntry *de = dictFind(db->dict,key->ptr);
     
     redisAssertWithInfo(NULL,key,de != NULL);
+    if (server.rdb_forkless_in_progress) snapshotKeyWillChange(db,key);
     dictReplace(db->dict, key->ptr, val);
 }
 
@@ -156,6 +171,7 @@ robj *dbRandomKey(redisDb *db) {
 
 /* Delete a key, value, and associated expiration entry if any, from the DB */
 int dbDelete(redisDb *db, robj *key) {
+    if (server.rdb_forkless_in_progress) snapshotKeyWillChange(db,key);
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
     if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
@@ -195,6 +211,7 @@ int dbDelete(redisDb *db, robj *key) {
  */
 robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o) {
     redisAssert(o->type == REDIS_STRING);
+    if (server.rdb_forkless_in_progress) snapshotKeyWillChange(db,key);
     if (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW) {
         robj *decoded = getDecodedObject(o);
         o = createStringObject(decoded->ptr, sdslen(decoded->ptr));
@@ -208,6 +225,11 @@ long long emptyDb(void(callback)(void*)) {
     int j;
     long long removed = 0;
 
+    /* The snapshot pins the dictionaries we are going to reset. */
+    if (server.rdb_forkless_in_progress) {
+        redisLog(REDIS_WARNING,"Keyspace emptied: fork-less snapshot aborted.");
+        snapshotAbort(0);
+    }
     for (j = 0; j < server.dbnum; j++) {
         removed += dictSize(server.db[j].dict);
         dictEmpty(server.db[j].dict,callback);
@@ -247,6 +269,10 @@ void signalFlushedDb(int dbid) {
 void flushdbCommand(redisClient *c) {
     server.dirty += dictSize(c->db->dict);
     signalFlushedDb(c->db->id);
+    if (server.rdb_forkless_in_progress) {
+        redisLog(REDIS_WARNING,"DB flushed: fork-less snapshot aborted.");
+        snapshotAbort(0);
+    }
     dictEmpty(c->db->dict,NULL);
     dictEmpty(c->db->expires,NULL);
     addReply(c,shared.ok);
@@ -369,7 +395,7 @@ void scanCallback(void *privdata, const dictEntry *de) {
     } else if (o->type == REDIS_ZSET) {
         key = dictGetKey(de);
         incrRefCount(key);
-        val = createStringObjectFromLongDouble(*(double*)dictGetVal(de));
+        val = createStringObjectFromLongDouble(zsetDictGetScore(o,de));
     } else {
         redisPanic("Type not handled in SCAN callback.");
     }
@@ -381,14 +407,15 @@ void scanCallback(void *privdata, const dictEntry *de) {
 /* Try to parse a SCAN cursor stored at object 'o':
  * if the cursor is valid, store it as unsigned integer into *cursor and
  * returns REDIS_OK. Otherwise return REDIS_ERR and send an error to the
- * client. */
-int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long *cursor) {
+ * client. The cursor is 64 bits wide even where a long is 32 bits, since
+ * the cursor of roaring encoded sets is a 64 bit value. */
+int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long long *cursor) {
     char *eptr;
 
-    /* Use strtoul() because we need an *unsigned* long, so
+    /* Use strtoull() because we need an *unsigned* long long, so
      * getLongLongFromObject() does not cover the whole cursor space. */
     errno = 0;
-    *cursor = strtoul(o->ptr, &eptr, 10);
+    *cursor = strtoull(o->ptr, &eptr, 10);
     if (isspace(((char*)o->ptr)[0]) || eptr[0] != '\0' || errno == ERANGE)
     {
         addReplyError(c, "invalid cursor");
@@ -408,7 +435,7 @@ int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long *cursor) {
  *
  * In the case of a Hash object the function returns both the field and value
  * of every element on the Hash. */
-void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
+void scanGenericCommand(redisClient *c, robj *o, unsigned long long cursor) {
     int rv;
     int i, j;
     char buf[REDIS_LONGSTR_SIZE];
@@ -460,11 +487,12 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
 
     /* Step 2: Iterate the collection.
      *
-     * Note that if the object is encoded with a ziplist, intset, or any other
+     * Note that if the object is encoded with a listpack, intset, or any other
      * representation that is not a hash table, we are sure that it is also
      * composed of a small number of elements. So to avoid taking state we
      * just return everything inside the object in a single call, setting the
-     * cursor to zero to signal the end of the iteration. */
+     * cursor to zero to signal the end of the iteration. Roarings can be big,
+     * but they are ordered: the cursor is the next value to return. */
 
     /* Handle the case of a hash table. */
     ht = NULL;
@@ -475,7 +503,8 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
     } else if (o->type == REDIS_HASH && o->encoding == REDIS_ENCODING_HT) {
         ht = o->ptr;
         count *= 2; /* We return key / value for this type. */
-    } else if (o->type == REDIS_ZSET && o->encoding == REDIS_ENCODING_SKIPLIST) {
+    } else if (o->type == REDIS_ZSET && (o->encoding == REDIS_ENCODING_SKIPLIST ||
+                                         o->encoding == REDIS_ENCODING_BTREE)) {
         zset *zs = o->ptr;
         ht = zs->dict;
         count *= 2; /* We return key / value for this type. */
@@ -483,6 +512,9 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
 
     if (ht) {
         void *privdata[2];
+        /* Hash table cursors always fit an unsigned long. */
+        //hash table的cursor总是可以用unsigned long表示
+        unsigned long htcursor = cursor;
 
         /* We pass two pointers to the callback: the list to which it will
          * add new elements, and the object containing the dictionary so that
@@ -490,27 +522,57 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
         privdata[0] = keys;
         privdata[1] = o;
         do {
-            cursor = dictScan(ht, cursor, scanCallback, privdata);
-        } while (cursor && listLength(keys) < count);
-    } else if (o->type == REDIS_SET) {
+            htcursor = dictScan(ht, htcursor, scanCallback, privdata);
+        } while (htcursor && listLength(keys) < count);
+        cursor = htcursor;
+    } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_INTSET) {
         int pos = 0;
         int64_t ll;
 
         while(intsetGet(o->ptr,pos++,&ll))
             listAddNodeTail(keys,createStringObjectFromLongLong(ll));
         cursor = 0;
-    } else if (o->type == REDIS_HASH || o->type == REDIS_ZSET) {
-        unsigned char *p = ziplistIndex(o->ptr,0);
+    } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_ROARING) {
+        /* The sign bit of the value is flipped so that the cursor of the
+         * smallest possible value is 0, and values map to cursors in order. */
+        //roaring是有序的, cursor为下一个要返回的值
+        roaringIterator it;
+        int64_t ll;
+
+        roaringInitIterator(o->ptr,&it);
+        if (cursor) roaringSeekIterator(&it,(int64_t)(cursor ^ (1ULL<<63)));
+        cursor = 0;
+        while (roaringNext(&it,&ll)) {
+            if (listLength(keys) == (unsigned long)count) {
+                cursor = (unsigned long long)ll ^ (1ULL<<63);
+                break;
+            }
+            listAddNodeTail(keys,createStringObjectFromLongLong(ll));
+        }
+    } else if (o->type == REDIS_ZSET) {
+        unsigned long rank, len = zpLength(o->ptr);
+        unsigned char *vstr;
+        unsigned int vlen;
+
+        for (rank = 0; rank < len; rank++) {
+            vstr = zpGetMember(o->ptr,rank,&vlen);
+            listAddNodeTail(keys,createStringObject((char*)vstr,vlen));
+            listAddNodeTail(keys,
+                createStringObjectFromLongDouble(zpGetScore(o->ptr,rank)));
+        }
+        cursor = 0;
+    } else if (o->type == REDIS_HASH || o->type == REDIS_SET) {
+        unsigned char *p = lpIndex(o->ptr,0);
         unsigned char *vstr;
         unsigned int vlen;
         long long vll;
 
         while(p) {
-            ziplistGet(p,&vstr,&vlen,&vll);
+            lpGet(p,&vstr,&vlen,&vll);
             listAddNodeTail(keys,
                 (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
                                  createStringObjectFromLongLong(vll));
-            p = ziplistNext(o->ptr,p);
+            p = lpNext(o->ptr,p);
         }
         cursor = 0;
     } else {
@@ -565,7 +627,7 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
 
     /* Step 4: Reply to the client. */
     addReplyMultiBulkLen(c, 2);
-    rv = snprintf(buf, sizeof(buf), "%lu", cursor);
+    rv = snprintf(buf, sizeof(buf), "%llu", cursor);
     redisAssert(rv < sizeof(buf));
     addReplyBulkCBuffer(c, buf, rv);
 
@@ -584,7 +646,7 @@ cleanup:
 
 /* The SCAN command completely relies on scanGenericCommand. */
 void scanCommand(redisClient *c) {
-    unsigned long cursor;
+    unsigned long long cursor;
     if (parseScanCursorOrReply(c,c->argv[1],&cursor) == REDIS_ERR) return;
     scanGenericCommand(c,NULL,cursor);
 }
@@ -742,6 +804,8 @@ int removeExpire(redisDb *db, robj *key) {
     /* An expire may only be removed if there is a corresponding entry in the
      * main dict. Otherwise, the key will never be freed. */
     redisAssertWithInfo(NULL,key,dictFind(db->dict,key->ptr) != NULL);
+    if (server.rdb_forkless_in_progress && dictSize(db->expires))
+        snapshotKeyWillChange(db,key);
     return dictDelete(db->expires,key->ptr) == DICT_OK;
 }
 
@@ -751,6 +815,7 @@ void setExpire(redisDb *db, robj *key, long long when) {
     /* Reuse the sds from the main dict in the expire dict */
     kde = dictFind(db->dict,key->ptr);
     redisAssertWithInfo(NULL,key,kde != NULL);
+    if (server.rdb_forkless_in_progress) snapshotKeyWillChange(db,key);
     de = dictReplaceRaw(db->expires,dictGetKey(kde));
     dictSetSignedIntegerVal(de,when);
 }
@@ -1004,20 +1069,32 @@ int *renameGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys,
     }
 }
 
-int *zunionInterGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags) {
+/* The input keys of ZUNIONSTORE / ZINTERSTORE and ZUNION / ZINTER /
+ * ZINTERCARD follow the numkeys argument at argv[pos]. */
+static int *zunionInterGenericGetKeys(robj **argv, int argc, int pos, int *numkeys) {
     int i, num, *keys;
-    REDIS_NOTUSED(cmd);
-    REDIS_NOTUSED(flags);
 
-    num = atoi(argv[2]->ptr);
+    num = atoi(argv[pos]->ptr);
     /* Sanity check. Don't return any key if the command is going to
      * reply with syntax error. */
-    if (num > (argc-3)) {
+    if (num > (argc-pos-1)) {
         *numkeys = 0;
         return NULL;
     }
     keys = zmalloc(sizeof(int)*num);
-    for (i = 0; i < num; i++) keys[i] = 3+i;
+    for (i = 0; i < num; i++) keys[i] = pos+1+i;
     *numkeys = num;
     return keys;
 }
+
+int *zunionInterGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags) {
+    REDIS_NOTUSED(cmd);
+    REDIS_NOTUSED(flags);
+    return zunionInterGenericGetKeys(argv,argc,2,numkeys);
+}
+
+int *zunionInterNoStoreGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags) {
+    REDIS_NOTUSED(cmd);
+    REDIS_NOTUSED(flags);
+    return zunionInterGenericGetKeys(argv,argc,1,numkeys);
+}
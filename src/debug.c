@@ -124,7 +124,9 @@ void computeDatasetDigest(unsigned char *final) {
         redisDb *db = server.db+j;
 
         if (dictSize(db->dict) == 0) continue;
-        di = dictGetIterator(db->dict);
+        /* Safe iterator: getExpire() looks the key up again, and that may
+         * perform a rehashing step if the dictionary is being rehashed. */
+        di = dictGetSafeIterator(db->dict);
 
         /* hash the DB id, so the same dataset moved in a different
          * DB will lead to a different digest */
@@ -138,6 +140,7 @@ void computeDatasetDigest(unsigned char *final) {
             sds key;
             robj *keyobj, *o;
             long long expiretime;
+            int lazy;
 
             memset(digest,0,20); /* This key-val digest */
             key = dictGetKey(de);
@@ -147,6 +150,9 @@ void computeDatasetDigest(unsigned char *final) {
             mixDigest(digest,key,sdslen(key));
 
             o = dictGetVal(de);
+            /* Don't touch the dataset: use a temporary copy of lazy values. */
+            lazy = o->encoding == REDIS_ENCODING_LAZY;
+            if (lazy) o = rdbLoadLazyObject(o);
 
             //添加key的类型到digest中
             aux = htonl(o->type);
@@ -185,35 +191,20 @@ void computeDatasetDigest(unsigned char *final) {
             else if (o->type == REDIS_ZSET) {
                 unsigned char eledigest[20];
 
-                if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+                if (o->encoding == REDIS_ENCODING_ZPACK) {
                     unsigned char *zl = o->ptr;
-                    unsigned char *eptr, *sptr;
                     unsigned char *vstr;
                     unsigned int vlen;
-                    long long vll;
-                    double score;
+                    unsigned long rank, len = zpLength(zl);
 
-                    eptr = ziplistIndex(zl,0);
-                    redisAssert(eptr != NULL);
-                    sptr = ziplistNext(zl,eptr);
-                    redisAssert(sptr != NULL);
-
-                    while (eptr != NULL) {
-                        redisAssert(ziplistGet(eptr,&vstr,&vlen,&vll));
-                        score = zzlGetScore(sptr);
+                    for (rank = 0; rank < len; rank++) {
+                        vstr = zpGetMember(zl,rank,&vlen);
 
                         memset(eledigest,0,20);
-                        if (vstr != NULL) {
-                            mixDigest(eledigest,vstr,vlen);
-                        } else {
-                            ll2string(buf,sizeof(buf),vll);
-                            mixDigest(eledigest,buf,strlen(buf));
-                        }
-
-                        snprintf(buf,sizeof(buf),"%.17g",score);
+                        mixDigest(eledigest,vstr,vlen);
+                        snprintf(buf,sizeof(buf),"%.17g",zpGetScore(zl,rank));
                         mixDigest(eledigest,buf,strlen(buf));
                         xorDigest(digest,eledigest,20);
-                        zzlNext(zl,&eptr,&sptr);
                     }
                 } else if (o->encoding == REDIS_ENCODING_SKIPLIST) {
                     zset *zs = o->ptr;
@@ -231,6 +222,20 @@ void computeDatasetDigest(unsigned char *final) {
                         xorDigest(digest,eledigest,20);
                     }
                     dictReleaseIterator(di);
+                } else if (o->encoding == REDIS_ENCODING_BTREE) {
+                    zset *zs = o->ptr;
+                    zbtreeLeaf *l;
+                    int j;
+
+                    for (l = zs->zbt->head; l != NULL; l = l->next) {
+                        for (j = 0; j < l->hdr.num; j++) {
+                            snprintf(buf,sizeof(buf),"%.17g",l->score[j]);
+                            memset(eledigest,0,20);
+                            mixObjectDigest(eledigest,l->obj[j]);
+                            mixDigest(eledigest,buf,strlen(buf));
+                            xorDigest(digest,eledigest,20);
+                        }
+                    }
                 } else {
                     redisPanic("Unknown sorted set encoding");
                 }
@@ -257,6 +262,7 @@ void computeDatasetDigest(unsigned char *final) {
             } else {
                 redisPanic("Unknown object type");
             }
+            if (lazy) decrRefCount(o);
             /* If the key has an expire, add it to the mix */
             if (expiretime != -1) xorDigest(digest,"!!expire!!",10);
             /* We can finally xor the key-val digest to the final digest */
@@ -291,8 +297,14 @@ void debugCommand(redisClient *c) {
         redisLog(REDIS_WARNING,"DB reloaded by DEBUG RELOAD");
         addReply(c,shared.ok);
     } else if (!strcasecmp(c->argv[1]->ptr,"loadaof")) {
+        /* Make sure what we have in memory is on the file before loading
+         * it, the writer thread may still be holding some data. */
+        if (server.aof_state == REDIS_AOF_ON) {
+            flushAppendOnlyFile(1);
+            aofWriterDrain();
+        }
         emptyDb(NULL);
-        if (loadAppendOnlyFile(server.aof_filename) != REDIS_OK) {
+        if (loadAppendOnlyFiles() != REDIS_OK) {
             addReply(c,shared.err);
             return;
         }
@@ -318,6 +330,22 @@ void debugCommand(redisClient *c) {
             (void*)val, val->refcount,
             strenc, (long long) rdbSavedObjectLen(val),
             val->lru, estimateObjectIdleTime(val));
+    } else if (!strcasecmp(c->argv[1]->ptr,"reencode") && c->argc == 2) {
+        /* Convert every collection that fits the compact encodings back to
+         * them, replying with the number of converted keys. */
+        //将所有能使用紧凑编码的集合转换回紧凑编码
+        long long converted = 0;
+        int j;
+
+        for (j = 0; j < server.dbnum; j++) {
+            dictIterator *di = dictGetSafeIterator(server.db[j].dict);
+            dictEntry *de;
+
+            while ((de = dictNext(di)) != NULL)
+                converted += objectDowngrade(dictGetVal(de),1);
+            dictReleaseIterator(di);
+        }
+        addReplyLongLong(c,converted);
     } else if (!strcasecmp(c->argv[1]->ptr,"sdslen") && c->argc == 3) {
         dictEntry *de;
         robj *val;
@@ -334,12 +362,14 @@ void debugCommand(redisClient *c) {
             addReplyError(c,"Not an sds encoded string.");
         } else {
             addReplyStatusFormat(c,
-                "key_sds_len:%lld, key_sds_avail:%lld, "
-                "val_sds_len:%lld, val_sds_avail:%lld",
+                "key_sds_len:%lld, key_sds_avail:%lld, key_zmalloc:%lld, "
+                "val_sds_len:%lld, val_sds_avail:%lld, val_zmalloc:%lld",
                 (long long) sdslen(key),
                 (long long) sdsavail(key),
+                (long long) zmalloc_usable(sdsAllocPtr(key)),
                 (long long) sdslen(val->ptr),
-                (long long) sdsavail(val->ptr));
+                (long long) sdsavail(val->ptr),
+                (long long) zmalloc_usable(sdsAllocPtr(val->ptr)));
         }
     } else if (!strcasecmp(c->argv[1]->ptr,"populate") && c->argc == 3) {
         long keys, j;
@@ -447,7 +477,9 @@ void redisLogObjectDebugInfo(robj *o) {
     redisLog(REDIS_WARNING,"Object type: %d", o->type);
     redisLog(REDIS_WARNING,"Object encoding: %d", o->encoding);
     redisLog(REDIS_WARNING,"Object refcount: %d", o->refcount);
-    if (o->type == REDIS_STRING && o->encoding == REDIS_ENCODING_RAW) {
+    if (o->encoding == REDIS_ENCODING_LAZY) {
+        redisLog(REDIS_WARNING,"Object not yet loaded from the mapped RDB file");
+    } else if (o->type == REDIS_STRING && o->encoding == REDIS_ENCODING_RAW) {
         redisLog(REDIS_WARNING,"Object raw string len: %zu", sdslen(o->ptr));
         if (sdslen(o->ptr) < 4096) {
             sds repr = sdscatrepr(sdsempty(),o->ptr,sdslen(o->ptr));
@@ -58,6 +58,14 @@
 static int dict_can_resize = 1;
 static unsigned int dict_force_resize_ratio = 5;
 
+/* Using dictEnableRehashStep() / dictDisableRehashStep() the incremental
+ * rehashing performed by lookups and updates can be suspended as well, since
+ * every rehashing step moves entries around and dirties memory pages shared
+ * with a child process. As above, the step is still performed when the old
+ * table is so overloaded that dict_force_resize_ratio would allow a resize. */
+//是否允许在查找和更新时进行渐进式rehash
+static int dict_can_rehash_step = 1;
+
 /* -------------------------- private prototypes ---------------------------- */
 
 static int _dictExpandIfNeeded(dict *ht);
@@ -307,6 +315,8 @@ int dictRehashMilliseconds(dict *d, int ms) {
  * dictionary so that the hash table automatically migrates from H1 to H2
  * while it is actively used. */
 static void _dictRehashStep(dict *d) {
+    if (!dict_can_rehash_step && d->ht[0].size &&
+        d->ht[0].used/d->ht[0].size <= dict_force_resize_ratio) return;
     if (d->iterators == 0) dictRehash(d,1);
 }
 
@@ -898,6 +908,14 @@ void dictDisableResize(void) {
     dict_can_resize = 0;
 }
 
+void dictEnableRehashStep(void) {
+    dict_can_rehash_step = 1;
+}
+
+void dictDisableRehashStep(void) {
+    dict_can_rehash_step = 0;
+}
+
 #if 0
 
 /* The following is code that we don't use for Redis currently, but that is part
@@ -35,6 +35,15 @@
 #include "zmalloc.h"
 #include "endianconv.h"
 
+/* SIMD kernels are compiled with the target function attribute, so that the
+ * rest of the file does not require any special compiler flag, and they are
+ * selected at runtime according to the CPU features. */
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(INTSET_NO_SIMD) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define INTSET_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
 /* Note that these encodings are ordered, so:
  * INTSET_ENC_INT16 < INTSET_ENC_INT32 < INTSET_ENC_INT64. */
 //三种int的encoding
@@ -122,6 +131,128 @@ static intset *intsetResize(intset *is, uint32_t len) {
     return is;
 }
 
+/* Return the number of elements smaller than "value" in the range [lo,hi)
+ * of the intset, that is, the position of "value" within the range. Ranges
+ * of up to intsetLinearBytes bytes are scanned linearly with the fastest
+ * kernel supported by the CPU, larger ones are first narrowed down with a
+ * binary search. The scalar kernel is only used with a threshold of zero,
+ * since a scalar linear scan is never faster than the binary search.
+ *
+ * 返回intset中[lo,hi)范围内比value小的元素个数，即value在该范围中的位置。
+ * 范围不超过intsetLinearBytes字节时用CPU支持的最快的SIMD实现线性扫描，否则先二分查找缩小范围
+ * */
+typedef uint32_t intsetRankProc(intset *is, uint32_t lo, uint32_t hi, int64_t value);
+
+static intsetRankProc *intsetRank = NULL;
+static uint32_t intsetLinearBytes = 0;
+static const char *intsetKernelName = "scalar";
+
+static uint32_t intsetRankScalar(intset *is, uint32_t lo, uint32_t hi, int64_t value) {
+    uint32_t rank = 0;
+
+    while (lo < hi && _intsetGet(is,lo++) < value) rank++;
+    return rank;
+}
+
+#ifdef INTSET_SIMD_X86
+/* The SIMD kernels compare "value" with a whole register of elements at a
+ * time: the comparison mask has one bit set for every byte of the elements
+ * smaller than "value", so its population count divided by the element size
+ * is the number of smaller elements. Intsets are little endian like x86. */
+//SIMD实现：每次将value与一个寄存器中的所有元素比较，比较结果掩码中1的个数除以元素的字节数即为较小元素的个数
+__attribute__((target("sse4.2,popcnt")))
+static uint32_t intsetRankSSE(intset *is, uint32_t lo, uint32_t hi, int64_t value) {
+    uint8_t enc = intrev32ifbe(is->encoding);
+    uint32_t bits = 0, i = lo, step = 16/enc;
+    __m128i v, x;
+
+    if (enc == INTSET_ENC_INT16) v = _mm_set1_epi16((int16_t)value);
+    else if (enc == INTSET_ENC_INT32) v = _mm_set1_epi32((int32_t)value);
+    else v = _mm_set1_epi64x(value);
+
+    for (; i+step <= hi; i += step) {
+        x = _mm_loadu_si128((__m128i*)(is->contents+(size_t)i*enc));
+        if (enc == INTSET_ENC_INT16) x = _mm_cmpgt_epi16(v,x);
+        else if (enc == INTSET_ENC_INT32) x = _mm_cmpgt_epi32(v,x);
+        else x = _mm_cmpgt_epi64(v,x);
+        bits += __builtin_popcount(_mm_movemask_epi8(x));
+    }
+    return bits/enc + intsetRankScalar(is,i,hi,value);
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint32_t intsetRankAVX2(intset *is, uint32_t lo, uint32_t hi, int64_t value) {
+    uint8_t enc = intrev32ifbe(is->encoding);
+    uint32_t bits = 0, i = lo, step = 32/enc;
+    __m256i v, x;
+
+    if (enc == INTSET_ENC_INT16) v = _mm256_set1_epi16((int16_t)value);
+    else if (enc == INTSET_ENC_INT32) v = _mm256_set1_epi32((int32_t)value);
+    else v = _mm256_set1_epi64x(value);
+
+    for (; i+step <= hi; i += step) {
+        x = _mm256_loadu_si256((__m256i*)(is->contents+(size_t)i*enc));
+        if (enc == INTSET_ENC_INT16) x = _mm256_cmpgt_epi16(v,x);
+        else if (enc == INTSET_ENC_INT32) x = _mm256_cmpgt_epi32(v,x);
+        else x = _mm256_cmpgt_epi64(v,x);
+        bits += __builtin_popcount((unsigned int)_mm256_movemask_epi8(x));
+    }
+    return bits/enc + intsetRankScalar(is,i,hi,value);
+}
+#endif
+
+/* Select the rank kernel according to the CPU features. */
+//根据CPU支持的指令集选择实现
+static void intsetSelectKernel(void) {
+#ifdef INTSET_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        intsetRank = intsetRankAVX2;
+        intsetLinearBytes = 256;
+        intsetKernelName = "avx2";
+        return;
+    }
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) {
+        intsetRank = intsetRankSSE;
+        intsetLinearBytes = 128;
+        intsetKernelName = "sse4.2";
+        return;
+    }
+#endif
+    intsetRank = intsetRankScalar;
+    intsetLinearBytes = 0;
+    intsetKernelName = "scalar";
+}
+
+/* Search "value" in the range [lo,hi) of the intset, with the same return
+ * value of intsetSearch(). "pos" is always set. */
+//在intset的[lo,hi)范围中查找value，返回值与intsetSearch()相同
+static uint8_t intsetSearchRange(intset *is, uint32_t lo, uint32_t hi, int64_t value, uint32_t *pos) {
+    uint32_t mid, linear;
+    int64_t cur;
+
+    if (intsetRank == NULL) intsetSelectKernel();
+    linear = intsetLinearBytes/intrev32ifbe(is->encoding);
+
+    //使用二分法缩小查找范围
+    while (hi-lo > linear) {
+        mid = lo+(hi-lo)/2;
+        cur = _intsetGet(is,mid);
+        if (value > cur) {
+            lo = mid+1;
+        } else if (value < cur) {
+            hi = mid;
+        } else {
+            *pos = mid;
+            return 1;
+        }
+    }
+
+    //剩下的范围线性扫描
+    *pos = lo+intsetRank(is,lo,hi,value);
+    return *pos < hi && _intsetGet(is,*pos) == value;
+}
+
 /* Search for the position of "value". Return 1 when the value was found and
  * sets "pos" to the position of the value within the intset. Return 0 when
  * the value is not present in the intset and sets "pos" to the position
@@ -132,20 +263,20 @@ static intset *intsetResize(intset *is, uint32_t len) {
  * 如果没找到就返回0并且将pos的值设为value应该插入的位置
  * */
 static uint8_t intsetSearch(intset *is, int64_t value, uint32_t *pos) {
-    int min = 0, max = intrev32ifbe(is->length)-1, mid = -1;
-    int64_t cur = -1;
+    uint32_t len = intrev32ifbe(is->length), p;
+    uint8_t found;
 
     /* The value can never be found when the set is empty */
-    if (intrev32ifbe(is->length) == 0) {
+    if (len == 0) {
     	//空集时直接返回0
         if (pos) *pos = 0;
         return 0;
     } else {
         /* Check for the case where we know we cannot find the value,
          * but do know the insert position. */
-        if (value > _intsetGet(is,intrev32ifbe(is->length)-1)) {
+        if (value > _intsetGet(is,len-1)) {
         	//整数集为有序集，最后一个元素为最大的数，比它还大则说明value不在集合中
-            if (pos) *pos = intrev32ifbe(is->length);
+            if (pos) *pos = len;
             return 0;
         } else if (value < _intsetGet(is,0)) {
         	//第一个元素为最小值，比它小则说明value不在集合中
@@ -154,28 +285,29 @@ static uint8_t intsetSearch(intset *is, int64_t value, uint32_t *pos) {
         }
     }
 
-    //使用二分法查找元素
-    while(max >= min) {
-        mid = (min+max)/2;
-        cur = _intsetGet(is,mid);
-        if (value > cur) {
-            min = mid+1;
-        } else if (value < cur) {
-            max = mid-1;
-        } else {
-            break;
-        }
-    }
+    found = intsetSearchRange(is,0,len,value,&p);
+    if (pos) *pos = p;
+    return found;
+}
 
-    if (value == cur) {
-    	//找到元素，将pos设为mid
-        if (pos) *pos = mid;
-        return 1;
-    } else {
-    	//没找到元素，将pos设为min即该插入得位置
-        if (pos) *pos = min;
-        return 0;
-    }
+/* Search "value" starting from the position "*cur", that must not be after
+ * the position of "value". The distance from "*cur" is doubled until an
+ * element not smaller than "value" is found (galloping), then only the last
+ * range is searched. "*cur" is set to the position of "value", or to the
+ * position where it would be inserted, so looking up increasing values
+ * scans the intset just once, and skips quickly over long runs of elements
+ * that are not looked up.
+ *
+ * 从*cur位置开始查找value：与*cur的距离每次加倍，直到遇到不小于value的元素，再在最后的范围中查找。
+ * *cur被设为value的位置(或者应该插入的位置)，所以按递增顺序查找时整个intset只扫描一次
+ * */
+static uint8_t intsetGallop(intset *is, int64_t value, uint32_t *cur) {
+    uint32_t len = intrev32ifbe(is->length), lo = *cur, bound = 1, hi;
+
+    while (lo+bound < len && _intsetGet(is,lo+bound) < value) bound <<= 1;
+    hi = (lo+bound+1 < len) ? lo+bound+1 : len;
+    lo += bound/2;
+    return intsetSearchRange(is,lo,hi,value,cur);
 }
 
 /* Upgrades the intset to a larger encoding and inserts the given integer. */
@@ -304,6 +436,50 @@ uint8_t intsetFind(intset *is, int64_t value) {
     return valenc <= intrev32ifbe(is->encoding) && intsetSearch(is,value,NULL);
 }
 
+/* Return a new intset with the elements of sets[0] that are also members of
+ * all the other sets. Passing the smallest set first is faster. Every other
+ * set is galloped over with intsetGallop(), in the order of the elements, so
+ * the cost is about linear when the sets have similar sizes and about
+ * O(M*log(N/M)) when they are very different, instead of one binary search
+ * for every element of the smallest set.
+ *
+ * 返回一个新的intset，包含sets[0]中同时存在于其他所有集合中的元素。
+ * 对其他集合按元素顺序使用intsetGallop()查找，而不是对每个元素做一次二分查找
+ * */
+intset *intsetIntersect(intset **sets, unsigned long setnum) {
+    size_t bytes = intsetBlobLen(sets[0]);
+    intset *res = zmalloc(bytes);
+    uint32_t len, i, k, cur, islen;
+    unsigned long j;
+    uint8_t isenc;
+    int64_t value;
+
+    memcpy(res,sets[0],bytes);
+    len = intrev32ifbe(res->length);
+    for (j = 1; j < setnum && len > 0; j++) {
+        if (sets[j] == sets[0]) continue;
+        islen = intrev32ifbe(sets[j]->length);
+        isenc = intrev32ifbe(sets[j]->encoding);
+        cur = 0;
+
+        //只保留在sets[j]中也存在的元素
+        for (i = 0, k = 0; i < len && cur < islen; i++) {
+            value = _intsetGet(res,i);
+            if (_intsetValueEncoding(value) > isenc) {
+                /* Out of the range of sets[j]: the next values are also out
+                 * of range if positive, may be in range if negative. */
+                if (value > 0) break;
+                continue;
+            }
+            if (intsetGallop(sets[j],value,&cur)) _intsetSet(res,k++,value);
+        }
+        len = k;
+    }
+    res = intsetResize(res,len);
+    res->length = intrev32ifbe(len);
+    return res;
+}
+
 /* Return random member */
 int64_t intsetRandom(intset *is) {
 	//随机取到集中一个元素
@@ -335,6 +511,7 @@ size_t intsetBlobLen(intset *is) {
 
 #ifdef INTSET_TEST_MAIN
 #include <sys/time.h>
+#include <time.h>
 
 void intsetRepr(intset *is) {
     int i;
@@ -381,6 +558,18 @@ intset *createSet(int bits, int size) {
     return is;
 }
 
+/* Random value for the encoding 0 (int16), 1 (int32) or 2 (int64). The
+ * int32 and int64 values are always out of the range of smaller encodings,
+ * and both signs are used. */
+int64_t randomValue(int enc) {
+    int64_t v;
+
+    if (enc == 0) v = rand() % 30000;
+    else if (enc == 1) v = 40000 + rand() % 2000000000;
+    else v = ((int64_t)(rand() % 2000000000) << 20) + (1LL<<32);
+    return (rand() & 1) ? v : -v;
+}
+
 void checkConsistency(intset *is) {
     int i;
 
@@ -404,7 +593,7 @@ int main(int argc, char **argv) {
     uint8_t success;
     int i;
     intset *is;
-    sranddev();
+    srand(time(NULL));
 
     printf("Value encodings: "); {
         assert(_intsetValueEncoding(-32768) == INTSET_ENC_INT16);
@@ -516,6 +705,120 @@ int main(int argc, char **argv) {
         printf("%ld lookups, %ld element set, %lldusec\n",num,size,usec()-start);
     }
 
+    printf("SIMD search matches the scalar search: "); {
+        int k, j;
+        uint32_t p1, p2, lo, hi;
+        uint8_t f1, f2;
+        intsetRankProc *rank;
+
+        intsetSelectKernel();
+        rank = intsetRank;
+        for (k = 0; k < 3; k++) {
+            is = intsetNew();
+            for (j = 0; j < 1000; j++) is = intsetAdd(is,randomValue(k),NULL);
+            assert(intrev32ifbe(is->encoding) == (2U<<k));
+            for (j = 0; j < 100000; j++) {
+                int64_t v = randomValue(k);
+
+                lo = rand() % intrev32ifbe(is->length);
+                hi = lo + rand() % (intrev32ifbe(is->length)-lo+1);
+                assert(rank(is,lo,hi,v) == intsetRankScalar(is,lo,hi,v));
+                f1 = intsetSearchRange(is,lo,hi,v,&p1);
+                intsetRank = intsetRankScalar;
+                intsetLinearBytes = 0;
+                f2 = intsetSearchRange(is,lo,hi,v,&p2);
+                intsetSelectKernel();
+                assert(f1 == f2 && p1 == p2);
+            }
+            zfree(is);
+        }
+        printf("(%s kernel) ", intsetKernelName);
+        ok();
+    }
+
+    printf("Intersection: "); {
+        intset *sets[3], *res;
+        int j;
+        int64_t v;
+
+        sets[0] = createSet(12,200);
+        sets[1] = createSet(12,2000);
+        sets[2] = intsetAdd(createSet(12,2000),-100000,NULL);
+        res = intsetIntersect(sets,3);
+        checkConsistency(res);
+        assert(intrev32ifbe(res->encoding) == intrev32ifbe(sets[0]->encoding));
+        for (j = 0; j < 1<<12; j++) {
+            v = j;
+            assert(intsetFind(res,v) ==
+                   (intsetFind(sets[0],v) && intsetFind(sets[1],v) &&
+                    intsetFind(sets[2],v)));
+        }
+        zfree(res);
+        zfree(sets[0]); zfree(sets[1]); zfree(sets[2]);
+        ok();
+    }
+
+    printf("Benchmark lookups:\n"); {
+        long num = 1000000;
+        int sizes[] = {16, 512, 100000}, k, j, n;
+        int64_t *values = zmalloc(sizeof(int64_t)*num);
+        long long start, scalar;
+
+        for (k = 0; k < 3; k++) {
+            for (n = 0; n < 3; n++) {
+                is = intsetNew();
+                for (j = 0; j < sizes[n]; j++) is = intsetAdd(is,randomValue(k),NULL);
+                for (j = 0; j < num; j++) values[j] = randomValue(k);
+
+                intsetRank = intsetRankScalar;
+                intsetLinearBytes = 0;
+                start = usec();
+                for (j = 0; j < num; j++) intsetSearch(is,values[j],NULL);
+                scalar = usec()-start;
+                intsetSelectKernel();
+                start = usec();
+                for (j = 0; j < num; j++) intsetSearch(is,values[j],NULL);
+                printf("  int%d, %d elements, %ld lookups: scalar %lldusec, %s %lldusec\n",
+                    intrev32ifbe(is->encoding)*8,sizes[n],num,scalar,
+                    intsetKernelName,usec()-start);
+                zfree(is);
+            }
+        }
+        zfree(values);
+    }
+
+    printf("Benchmark intersection:\n"); {
+        int ratios[] = {1, 10, 1000}, r, j, rounds = 20;
+        long long start, probe, gallop;
+        intset *sets[2], *res;
+
+        for (r = 0; r < 3; r++) {
+            sets[0] = intsetNew();
+            sets[1] = intsetNew();
+            for (j = 0; j < 100000/ratios[r]; j++) sets[0] = intsetAdd(sets[0],((int64_t)rand()<<16^rand())&0x3fffffff,NULL);
+            for (j = 0; j < 100000; j++) sets[1] = intsetAdd(sets[1],((int64_t)rand()<<16^rand())&0x3fffffff,NULL);
+
+            /* The old way: look up every element of the smallest set. */
+            start = usec();
+            for (j = 0; j < rounds; j++) {
+                uint32_t i, k = 0;
+                int64_t v;
+                for (i = 0; intsetGet(sets[0],i,&v); i++) k += intsetFind(sets[1],v);
+            }
+            probe = usec()-start;
+            start = usec();
+            for (j = 0; j < rounds; j++) {
+                res = intsetIntersect(sets,2);
+                zfree(res);
+            }
+            gallop = usec()-start;
+            printf("  %u x %u elements: lookups %lldusec, intersect %lldusec\n",
+                intrev32ifbe(sets[0]->length),intrev32ifbe(sets[1]->length),
+                probe/rounds,gallop/rounds);
+            zfree(sets[0]); zfree(sets[1]);
+        }
+    }
+
     printf("Stress add+delete: "); {
         int i, v1, v2;
         is = intsetNew();
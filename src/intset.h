@@ -68,4 +68,7 @@ uint32_t intsetLen(intset *is);
 //返回整数集的字节数
 size_t intsetBlobLen(intset *is);
 
+//返回sets[0]中同时存在于其他所有集合中的元素组成的新intset
+intset *intsetIntersect(intset **sets, unsigned long setnum);
+
 #endif // __INTSET_H
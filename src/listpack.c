@@ -0,0 +1,923 @@
+/* The listpack is a compact list of strings and integers stored in a single
+ * allocation, like the ziplist it replaces. The difference is in how the
+ * list is traversed backward: a ziplist entry stores the length of the
+ * previous entry, so inserting or deleting an entry can change the size of
+ * the next entry header, that can change the size of the following one and
+ * so forth (cascading update, O(N^2) in the worst case). A listpack entry
+ * stores its own length at its end instead, so every entry is independent
+ * from the others and an insert or a delete only moves memory once.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * LISTPACK OVERALL LAYOUT:
+ * <total-bytes><num-elements><entry><entry>...<entry><end>
+ *
+ * <total-bytes> is a 32 bit unsigned integer holding the number of bytes
+ * used by the listpack, header and end byte included.
+ *
+ * <num-elements> is a 16 bit unsigned integer holding the number of entries.
+ * When the number of entries is 65535 or more the field is set to 65535 and
+ * the list must be traversed to know how many items it holds.
+ *
+ * <end> is a single byte special value, equal to 255.
+ *
+ * All the integers are represented in little endian byte order.
+ *
+ * LISTPACK ENTRIES:
+ * <encoding-type><element-data><element-total-bytes>
+ *
+ * The encoding type holds the kind of element and, for strings, the length
+ * of the string (or part of it):
+ *
+ * |0xxxxxxx| - 1 byte
+ *      Unsigned integer from 0 to 127, no element data.
+ * |10xxxxxx| - 1 byte
+ *      String value with length less than or equal to 63 bytes (6 bits).
+ * |110xxxxx|yyyyyyyy| - 2 bytes
+ *      Signed 13 bit integer, no element data.
+ * |1110xxxx|yyyyyyyy| - 2 bytes
+ *      String value with length less than or equal to 4095 bytes (12 bits).
+ * |11110000|aaaaaaaa|bbbbbbbb|cccccccc|dddddddd| - 5 bytes
+ *      String value with a 32 bit length.
+ * |11110001| - 1 byte
+ *      Integer encoded as int16_t (2 bytes).
+ * |11110010| - 1 byte
+ *      Integer encoded as 24 bit signed (3 bytes).
+ * |11110011| - 1 byte
+ *      Integer encoded as int32_t (4 bytes).
+ * |11110100| - 1 byte
+ *      Integer encoded as int64_t (8 bytes).
+ * |11111111| - End of listpack.
+ *
+ * <element-total-bytes> (backlen) is the length of the encoding type plus
+ * the element data, stored in 1 to 5 bytes to be read from right to left:
+ * every byte holds 7 bits of the length, starting from the least
+ * significant ones, and the high bit of a byte is set when more bytes
+ * follow on its left. Lengths up to 127 bytes use a single byte.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2014, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "zmalloc.h"
+#include "util.h"
+#include "listpack.h"
+#include "redisassert.h"
+
+#define LP_HDR_SIZE 6       /* 32 bit total len + 16 bit number of elements. */
+#define LP_HDR_NUMELE_UNKNOWN UINT16_MAX
+#define LP_MAX_INT_ENCODING_LEN 9
+#define LP_MAX_BACKLEN_SIZE 5
+#define LP_EOF 0xFF
+
+//插入元素的位置: 在p元素之前, 或者替换p元素
+#define LP_BEFORE 0
+#define LP_REPLACE 1
+
+#define LP_ENCODING_7BIT_UINT 0
+#define LP_ENCODING_7BIT_UINT_MASK 0x80
+#define LP_ENCODING_IS_7BIT_UINT(byte) (((byte)&LP_ENCODING_7BIT_UINT_MASK)==LP_ENCODING_7BIT_UINT)
+
+#define LP_ENCODING_6BIT_STR 0x80
+#define LP_ENCODING_6BIT_STR_MASK 0xC0
+#define LP_ENCODING_IS_6BIT_STR(byte) (((byte)&LP_ENCODING_6BIT_STR_MASK)==LP_ENCODING_6BIT_STR)
+
+#define LP_ENCODING_13BIT_INT 0xC0
+#define LP_ENCODING_13BIT_INT_MASK 0xE0
+#define LP_ENCODING_IS_13BIT_INT(byte) (((byte)&LP_ENCODING_13BIT_INT_MASK)==LP_ENCODING_13BIT_INT)
+
+#define LP_ENCODING_12BIT_STR 0xE0
+#define LP_ENCODING_12BIT_STR_MASK 0xF0
+#define LP_ENCODING_IS_12BIT_STR(byte) (((byte)&LP_ENCODING_12BIT_STR_MASK)==LP_ENCODING_12BIT_STR)
+
+#define LP_ENCODING_32BIT_STR 0xF0
+#define LP_ENCODING_16BIT_INT 0xF1
+#define LP_ENCODING_24BIT_INT 0xF2
+#define LP_ENCODING_32BIT_INT 0xF3
+#define LP_ENCODING_64BIT_INT 0xF4
+
+#define LP_ENCODING_6BIT_STR_LEN(p) ((p)[0] & 0x3F)
+#define LP_ENCODING_12BIT_STR_LEN(p) ((((p)[0] & 0xF) << 8) | (p)[1])
+#define LP_ENCODING_32BIT_STR_LEN(p) (((uint32_t)(p)[1]<<0) | \
+                                      ((uint32_t)(p)[2]<<8) | \
+                                      ((uint32_t)(p)[3]<<16) | \
+                                      ((uint32_t)(p)[4]<<24))
+
+//读写listpack头部的总字节数和元素个数
+#define lpGetTotalBytes(p) (((uint32_t)(p)[0]<<0) | \
+                            ((uint32_t)(p)[1]<<8) | \
+                            ((uint32_t)(p)[2]<<16) | \
+                            ((uint32_t)(p)[3]<<24))
+#define lpGetNumElements(p) (((uint32_t)(p)[4]<<0) | ((uint32_t)(p)[5]<<8))
+#define lpSetTotalBytes(p,v) do { \
+    (p)[0] = (v)&0xff; \
+    (p)[1] = ((v)>>8)&0xff; \
+    (p)[2] = ((v)>>16)&0xff; \
+    (p)[3] = ((v)>>24)&0xff; \
+} while(0)
+#define lpSetNumElements(p,v) do { \
+    (p)[4] = (v)&0xff; \
+    (p)[5] = ((v)>>8)&0xff; \
+} while(0)
+
+/* Encode the integer 'v' in 'intenc' using the smallest encoding able to
+ * represent it. Returns the number of bytes used. */
+//用能表示v的最小编码将整数写到intenc, 返回使用的字节数
+static unsigned long lpEncodeInteger(long long v, unsigned char *intenc) {
+    if (v >= 0 && v <= 127) {
+        intenc[0] = v;
+        return 1;
+    } else if (v >= -4096 && v <= 4095) {
+        if (v < 0) v = ((int64_t)1<<13)+v;
+        intenc[0] = (v>>8)|LP_ENCODING_13BIT_INT;
+        intenc[1] = v&0xff;
+        return 2;
+    } else if (v >= -32768 && v <= 32767) {
+        if (v < 0) v = ((int64_t)1<<16)+v;
+        intenc[0] = LP_ENCODING_16BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = v>>8;
+        return 3;
+    } else if (v >= -8388608 && v <= 8388607) {
+        if (v < 0) v = ((int64_t)1<<24)+v;
+        intenc[0] = LP_ENCODING_24BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = (v>>8)&0xff;
+        intenc[3] = v>>16;
+        return 4;
+    } else if (v >= -2147483648LL && v <= 2147483647LL) {
+        if (v < 0) v = ((int64_t)1<<32)+v;
+        intenc[0] = LP_ENCODING_32BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = (v>>8)&0xff;
+        intenc[3] = (v>>16)&0xff;
+        intenc[4] = v>>24;
+        return 5;
+    } else {
+        uint64_t uv = v;
+        int j;
+
+        intenc[0] = LP_ENCODING_64BIT_INT;
+        for (j = 0; j < 8; j++) intenc[1+j] = (uv>>(j*8))&0xff;
+        return 9;
+    }
+}
+
+/* Return the size of the header of a string of 'len' bytes. */
+static unsigned long lpEncodeStringHeaderSize(uint32_t len) {
+    if (len < 64) return 1;
+    else if (len < 4096) return 2;
+    else return 5;
+}
+
+/* Write the string 's' of 'len' bytes with its header in 'buf'. */
+//将字符串及其头部写到buf
+static void lpEncodeString(unsigned char *buf, unsigned char *s, uint32_t len) {
+    if (len < 64) {
+        buf[0] = len | LP_ENCODING_6BIT_STR;
+        memcpy(buf+1,s,len);
+    } else if (len < 4096) {
+        buf[0] = (len >> 8) | LP_ENCODING_12BIT_STR;
+        buf[1] = len & 0xff;
+        memcpy(buf+2,s,len);
+    } else {
+        buf[0] = LP_ENCODING_32BIT_STR;
+        buf[1] = len & 0xff;
+        buf[2] = (len >> 8) & 0xff;
+        buf[3] = (len >> 16) & 0xff;
+        buf[4] = (len >> 24) & 0xff;
+        memcpy(buf+5,s,len);
+    }
+}
+
+/* Store in 'buf' the backlen of an entry whose encoding and data use 'l'
+ * bytes. Returns the number of bytes used, 'buf' can be NULL to just get
+ * the size. */
+//将元素长度以从右向左读取的方式写到buf, 返回使用的字节数
+static unsigned long lpEncodeBacklen(unsigned char *buf, uint64_t l) {
+    if (l <= 127) {
+        if (buf) buf[0] = l;
+        return 1;
+    } else if (l < 16383) {
+        if (buf) {
+            buf[0] = l>>7;
+            buf[1] = (l&127)|128;
+        }
+        return 2;
+    } else if (l < 2097151) {
+        if (buf) {
+            buf[0] = l>>14;
+            buf[1] = ((l>>7)&127)|128;
+            buf[2] = (l&127)|128;
+        }
+        return 3;
+    } else if (l < 268435455) {
+        if (buf) {
+            buf[0] = l>>21;
+            buf[1] = ((l>>14)&127)|128;
+            buf[2] = ((l>>7)&127)|128;
+            buf[3] = (l&127)|128;
+        }
+        return 4;
+    } else {
+        if (buf) {
+            buf[0] = l>>28;
+            buf[1] = ((l>>21)&127)|128;
+            buf[2] = ((l>>14)&127)|128;
+            buf[3] = ((l>>7)&127)|128;
+            buf[4] = (l&127)|128;
+        }
+        return 5;
+    }
+}
+
+/* Decode the backlen whose last byte is pointed by 'p'. */
+//从p开始向左读取元素的长度
+static uint64_t lpDecodeBacklen(unsigned char *p) {
+    uint64_t val = 0;
+    uint64_t shift = 0;
+
+    do {
+        val |= (uint64_t)(p[0] & 127) << shift;
+        if (!(p[0] & 128)) break;
+        shift += 7;
+        p--;
+        assert(shift <= 28);
+    } while (1);
+    return val;
+}
+
+/* Return the number of bytes used by the encoding type and the element data
+ * of the entry pointed by 'p', the backlen excluded. */
+//返回p元素编码和数据占用的字节数, 不包括backlen
+static uint32_t lpCurrentEncodedSize(unsigned char *p) {
+    if (LP_ENCODING_IS_7BIT_UINT(p[0])) return 1;
+    if (LP_ENCODING_IS_6BIT_STR(p[0])) return 1+LP_ENCODING_6BIT_STR_LEN(p);
+    if (LP_ENCODING_IS_13BIT_INT(p[0])) return 2;
+    if (LP_ENCODING_IS_12BIT_STR(p[0])) return 2+LP_ENCODING_12BIT_STR_LEN(p);
+    switch(p[0]) {
+    case LP_ENCODING_16BIT_INT: return 3;
+    case LP_ENCODING_24BIT_INT: return 4;
+    case LP_ENCODING_32BIT_INT: return 5;
+    case LP_ENCODING_64BIT_INT: return 9;
+    case LP_ENCODING_32BIT_STR: return 5+LP_ENCODING_32BIT_STR_LEN(p);
+    case LP_EOF: return 1;
+    }
+    assert(NULL);
+    return 0;
+}
+
+/* Return a pointer to the entry following the one pointed by 'p'. */
+static unsigned char *lpSkip(unsigned char *p) {
+    unsigned long entrylen = lpCurrentEncodedSize(p);
+    entrylen += lpEncodeBacklen(NULL,entrylen);
+    return p+entrylen;
+}
+
+/* Create a new empty listpack. */
+//创建一个新的listpack
+unsigned char *lpNew(void) {
+    unsigned char *lp = zmalloc(LP_HDR_SIZE+1);
+    lpSetTotalBytes(lp,LP_HDR_SIZE+1);
+    lpSetNumElements(lp,0);
+    lp[LP_HDR_SIZE] = LP_EOF;
+    return lp;
+}
+
+/* Return the first entry, or NULL if the listpack is empty. */
+unsigned char *lpFirst(unsigned char *lp) {
+    unsigned char *p = lp+LP_HDR_SIZE;
+    return (p[0] == LP_EOF) ? NULL : p;
+}
+
+/* Return the entry following 'p', or NULL if 'p' is the last entry (or the
+ * end of the listpack). */
+//取到p的下一个元素
+unsigned char *lpNext(unsigned char *lp, unsigned char *p) {
+    ((void) lp);
+    if (p[0] == LP_EOF) return NULL;
+    p = lpSkip(p);
+    return (p[0] == LP_EOF) ? NULL : p;
+}
+
+/* Return the entry preceding 'p', or NULL if 'p' is the first entry. When
+ * 'p' points to the end of the listpack the last entry is returned. */
+//取到p的上一个元素, 只需要读取上一个元素尾部的backlen
+unsigned char *lpPrev(unsigned char *lp, unsigned char *p) {
+    uint64_t prevlen;
+
+    if (p-lp == LP_HDR_SIZE) return NULL;
+    p--; /* Seek the last byte of the previous entry backlen. */
+    prevlen = lpDecodeBacklen(p);
+    prevlen += lpEncodeBacklen(NULL,prevlen);
+    return p-prevlen+1;
+}
+
+/* Return the last entry, or NULL if the listpack is empty. */
+unsigned char *lpLast(unsigned char *lp) {
+    return lpPrev(lp,lp+lpGetTotalBytes(lp)-1);
+}
+
+/* Get the value of the entry pointed by 'p'. Strings are returned setting
+ * '*sval' and '*slen', integers setting '*sval' to NULL and '*lval' to the
+ * value. Returns 0 if 'p' is NULL or points to the end of the listpack. */
+//取到p元素中的值, p为空或者指向listpack结尾时返回0
+unsigned int lpGet(unsigned char *p, unsigned char **sval, unsigned int *slen, long long *lval) {
+    uint64_t uval, negstart, negmax;
+    int64_t val;
+
+    if (p == NULL || p[0] == LP_EOF) return 0;
+    if (sval) *sval = NULL;
+    if (LP_ENCODING_IS_7BIT_UINT(p[0])) {
+        negstart = UINT64_MAX; /* 7 bit ints are always positive. */
+        negmax = 0;
+        uval = p[0] & 0x7f;
+    } else if (LP_ENCODING_IS_6BIT_STR(p[0])) {
+        *slen = LP_ENCODING_6BIT_STR_LEN(p);
+        *sval = p+1;
+        return 1;
+    } else if (LP_ENCODING_IS_13BIT_INT(p[0])) {
+        uval = ((p[0]&0x1f)<<8) | p[1];
+        negstart = (uint64_t)1<<12;
+        negmax = 8191;
+    } else if (LP_ENCODING_IS_12BIT_STR(p[0])) {
+        *slen = LP_ENCODING_12BIT_STR_LEN(p);
+        *sval = p+2;
+        return 1;
+    } else if (p[0] == LP_ENCODING_16BIT_INT) {
+        uval = (uint64_t)p[1] | (uint64_t)p[2]<<8;
+        negstart = (uint64_t)1<<15;
+        negmax = UINT16_MAX;
+    } else if (p[0] == LP_ENCODING_24BIT_INT) {
+        uval = (uint64_t)p[1] | (uint64_t)p[2]<<8 | (uint64_t)p[3]<<16;
+        negstart = (uint64_t)1<<23;
+        negmax = UINT32_MAX>>8;
+    } else if (p[0] == LP_ENCODING_32BIT_INT) {
+        uval = (uint64_t)p[1] | (uint64_t)p[2]<<8 |
+               (uint64_t)p[3]<<16 | (uint64_t)p[4]<<24;
+        negstart = (uint64_t)1<<31;
+        negmax = UINT32_MAX;
+    } else if (p[0] == LP_ENCODING_64BIT_INT) {
+        int j;
+
+        uval = 0;
+        for (j = 8; j >= 1; j--) uval = (uval<<8) | p[j];
+        negstart = (uint64_t)1<<63;
+        negmax = UINT64_MAX;
+    } else if (p[0] == LP_ENCODING_32BIT_STR) {
+        *slen = LP_ENCODING_32BIT_STR_LEN(p);
+        *sval = p+5;
+        return 1;
+    } else {
+        assert(NULL);
+        return 0;
+    }
+
+    /* Values in the upper half of the range are negative numbers in two's
+     * complement representation. */
+    if (uval >= negstart) {
+        uval = negmax-uval;
+        val = uval;
+        val = -val-1;
+    } else {
+        val = uval;
+    }
+    *lval = val;
+    return 1;
+}
+
+/* Insert the string 's' before the entry 'p' (that can be the end of the
+ * listpack), or replace the entry 'p' with it when 'where' is LP_REPLACE.
+ * When 's' is NULL the entry 'p' is deleted. Strings that represent an
+ * integer are stored with an integer encoding.
+ *
+ * If 'newp' is not NULL it is set to the inserted entry, or in case of
+ * deletion to the entry that followed the deleted one. Only the entries
+ * after 'p' are moved in memory: no other entry is ever rewritten. */
+//在p之前插入s, 或者用s替换p, s为NULL时删除p。其他元素不需要修改, 不存在连锁更新
+static unsigned char *lpInsertGeneric(unsigned char *lp, unsigned char *p,
+                                      unsigned char *s, unsigned int slen,
+                                      int where, unsigned char **newp)
+{
+    unsigned char intenc[LP_MAX_INT_ENCODING_LEN];
+    unsigned char backlen[LP_MAX_BACKLEN_SIZE];
+    uint64_t old_bytes = lpGetTotalBytes(lp), new_bytes;
+    uint64_t enclen = 0, replaced_len = 0;
+    unsigned long backlen_size = 0;
+    unsigned long poff = p-lp;
+    uint32_t numele;
+    int isint = 0;
+    long long v;
+    unsigned char *dst;
+
+    if (s) {
+        if (slen <= 20 && string2ll((char*)s,slen,&v)) {
+            enclen = lpEncodeInteger(v,intenc);
+            isint = 1;
+        } else {
+            enclen = lpEncodeStringHeaderSize(slen)+slen;
+        }
+        backlen_size = lpEncodeBacklen(backlen,enclen);
+    }
+    if (where == LP_REPLACE) {
+        replaced_len = lpCurrentEncodedSize(p);
+        replaced_len += lpEncodeBacklen(NULL,replaced_len);
+    }
+    new_bytes = old_bytes+enclen+backlen_size-replaced_len;
+    assert(new_bytes <= UINT32_MAX);
+
+    /* Grow before moving the tail on the right, shrink after moving it on
+     * the left. */
+    if (new_bytes > old_bytes) lp = zrealloc(lp,new_bytes);
+    dst = lp+poff;
+    memmove(dst+enclen+backlen_size,dst+replaced_len,
+            old_bytes-poff-replaced_len);
+    if (new_bytes < old_bytes) {
+        lp = zrealloc(lp,new_bytes);
+        dst = lp+poff;
+    }
+
+    if (s) {
+        if (isint)
+            memcpy(dst,intenc,enclen);
+        else
+            lpEncodeString(dst,s,slen);
+        memcpy(dst+enclen,backlen,backlen_size);
+    }
+
+    lpSetTotalBytes(lp,new_bytes);
+    numele = lpGetNumElements(lp);
+    if (numele != LP_HDR_NUMELE_UNKNOWN) {
+        if (s == NULL)
+            numele--;
+        else if (where == LP_BEFORE)
+            numele++;
+        lpSetNumElements(lp,numele);
+    }
+    if (newp) *newp = dst;
+    return lp;
+}
+
+/* Insert 's' before the entry 'p'. When 'p' points to the end of the
+ * listpack the new entry is appended. */
+//在p元素前插入新的元素
+unsigned char *lpInsert(unsigned char *lp, unsigned char *p, unsigned char *s, unsigned int slen) {
+    return lpInsertGeneric(lp,p,s,slen,LP_BEFORE,NULL);
+}
+
+/* Push 's' at the head or at the tail of the listpack. */
+//在listpack的表头或者表尾（根据where）插入新的元素
+unsigned char *lpPush(unsigned char *lp, unsigned char *s, unsigned int slen, int where) {
+    unsigned char *p;
+
+    p = (where == LP_HEAD) ? lp+LP_HDR_SIZE : lp+lpGetTotalBytes(lp)-1;
+    return lpInsertGeneric(lp,p,s,slen,LP_BEFORE,NULL);
+}
+
+/* Replace the entry '*p' with 's'. '*p' is updated to point to the new
+ * entry. */
+//用新的值替换p元素, *p指向新的元素
+unsigned char *lpReplace(unsigned char *lp, unsigned char **p, unsigned char *s, unsigned int slen) {
+    return lpInsertGeneric(lp,*p,s,slen,LP_REPLACE,p);
+}
+
+/* Delete the entry '*p'. '*p' is updated to point to the entry that
+ * followed it, so that it's possible to delete while iterating. */
+//删除p元素, *p指向被删除元素的下一个元素
+unsigned char *lpDelete(unsigned char *lp, unsigned char **p) {
+    return lpInsertGeneric(lp,*p,NULL,0,LP_REPLACE,p);
+}
+
+/* Delete 'num' entries starting at the entry at 'index'. */
+//删除index处的元素开始的num个元素
+unsigned char *lpDeleteRange(unsigned char *lp, unsigned int index, unsigned int num) {
+    unsigned char *first, *p;
+    uint32_t bytes = lpGetTotalBytes(lp), numele;
+    unsigned int deleted = 0;
+
+    if (num == 0 || (first = lpIndex(lp,index)) == NULL) return lp;
+    p = first;
+    while (deleted < num && p[0] != LP_EOF) {
+        p = lpSkip(p);
+        deleted++;
+    }
+    memmove(first,p,(lp+bytes)-p);
+    bytes -= p-first;
+    lpSetTotalBytes(lp,bytes);
+    numele = lpGetNumElements(lp);
+    if (numele != LP_HDR_NUMELE_UNKNOWN)
+        lpSetNumElements(lp,numele-deleted);
+    return zrealloc(lp,bytes);
+}
+
+/* Return the number of entries. When the header does not hold the number
+ * the listpack is traversed, and the header updated if the number fits. */
+//返回listpack中元素个数
+unsigned int lpLength(unsigned char *lp) {
+    uint32_t numele = lpGetNumElements(lp);
+    unsigned char *p;
+    unsigned int count = 0;
+
+    if (numele != LP_HDR_NUMELE_UNKNOWN) return numele;
+    p = lp+LP_HDR_SIZE;
+    while (p[0] != LP_EOF) {
+        count++;
+        p = lpSkip(p);
+    }
+    if (count < LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,count);
+    return count;
+}
+
+/* Return the entry at 'index', negative indexes starting from the tail
+ * (-1 is the last entry). Returns NULL if the index is out of range. The
+ * listpack is traversed from the nearest side. */
+//根据index的值取到listpack中元素, 从离index较近的一端开始查找
+unsigned char *lpIndex(unsigned char *lp, int index) {
+    uint32_t numele = lpGetNumElements(lp);
+    unsigned char *p;
+    int forward = 1;
+
+    if (numele != LP_HDR_NUMELE_UNKNOWN) {
+        if (index < 0) index = (long)numele+index;
+        if (index < 0 || (uint32_t)index >= numele) return NULL;
+        if ((uint32_t)index > numele/2) {
+            forward = 0;
+            index = numele-1-index;
+        }
+    } else if (index < 0) {
+        forward = 0;
+        index = -index-1;
+    }
+
+    if (forward) {
+        p = lpFirst(lp);
+        while (index-- > 0 && p) p = lpNext(lp,p);
+    } else {
+        p = lpLast(lp);
+        while (index-- > 0 && p) p = lpPrev(lp,p);
+    }
+    return p;
+}
+
+/* Return 1 if the entry 'p' is equal to the string 's', 0 otherwise. */
+//比较p元素的值与s的值
+unsigned int lpCompare(unsigned char *p, unsigned char *s, unsigned int slen) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll, sll;
+
+    if (!lpGet(p,&vstr,&vlen,&vll)) return 0;
+    if (vstr) return vlen == slen && memcmp(vstr,s,slen) == 0;
+    /* Integer entries can only match strings that are integers too. */
+    if (slen <= 20 && string2ll((char*)s,slen,&sll)) return vll == sll;
+    return 0;
+}
+
+/* Find the entry equal to 'vstr' starting at 'p', comparing one entry and
+ * then skipping 'skip' entries (to only look at the fields of a hash for
+ * instance). Returns NULL if not found. */
+//找到p之后与vstr值一样的元素，每次比较后移动skip个元素
+unsigned char *lpFind(unsigned char *p, unsigned char *vstr, unsigned int vlen, unsigned int skip) {
+    int vencoding = 0; /* 0: unknown, 1: integer, 2: not an integer. */
+    long long vll = 0, ll;
+    unsigned char *s;
+    unsigned int slen;
+    unsigned int skipcnt = 0;
+
+    while (p && p[0] != LP_EOF) {
+        if (skipcnt == 0) {
+            lpGet(p,&s,&slen,&ll);
+            if (s) {
+                if (slen == vlen && memcmp(s,vstr,vlen) == 0) return p;
+            } else {
+                /* Parse the searched value only once, and only if there are
+                 * integer entries to compare it with. */
+                if (vencoding == 0)
+                    vencoding = (vlen <= 20 &&
+                                 string2ll((char*)vstr,vlen,&vll)) ? 1 : 2;
+                if (vencoding == 1 && ll == vll) return p;
+            }
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+        p = lpSkip(p);
+    }
+    return NULL;
+}
+
+/* Return the total number of bytes used by the listpack. */
+//返回listpack占用内存大小
+size_t lpBytes(unsigned char *lp) {
+    return lpGetTotalBytes(lp);
+}
+
+#ifdef LISTPACK_TEST_MAIN
+#include <sys/time.h>
+#include <time.h>
+#include "ziplist.h"
+
+/* Self test of the listpack against an array of strings holding the same
+ * elements, followed by a comparison with the ziplist on the workloads
+ * that trigger ziplist cascading updates. Build with make listpack-benchmark. */
+
+void _redisAssert(char *estr, char *file, int line) {
+    fprintf(stderr,"=== ASSERTION FAILED ===\n==> %s:%d '%s' is not true\n",
+        file,line,estr);
+}
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+#define TEST_MAX 600
+
+static volatile long long sink; /* Keeps the benchmark loops alive. */
+
+typedef struct {
+    char buf[8192];
+    unsigned int len;
+} testElement;
+
+static testElement model[TEST_MAX];
+static int modellen;
+
+/* Random element covering every encoding: integers around the limits of
+ * every integer encoding, numbers that are not stored as integers, and
+ * strings from empty up to more than 4096 bytes. */
+static void randomElement(testElement *e) {
+    static const long long limits[] = {
+        0, 127, 128, 4095, 4096, -4096, -4097, 32767, 32768, -32768, -32769,
+        8388607, 8388608, -8388608, -8388609, 2147483647LL, 2147483648LL,
+        -2147483648LL, -2147483649LL, LLONG_MAX, LLONG_MIN
+    };
+    unsigned int j;
+
+    switch(rand() % 6) {
+    case 0:
+        e->len = sprintf(e->buf,"%lld",
+            limits[rand()%(sizeof(limits)/sizeof(limits[0]))]+(rand()%3-1));
+        return;
+    case 1:
+        e->len = sprintf(e->buf,"%d",rand()-RAND_MAX/2);
+        return;
+    case 2:
+        e->len = sprintf(e->buf,"0%d",rand()%100); /* Not an integer. */
+        return;
+    case 3:
+        e->len = rand() % 64;
+        break;
+    case 4:
+        e->len = 64 + rand() % 4100;
+        break;
+    default:
+        e->len = 4090 + rand() % 100;
+        break;
+    }
+    for (j = 0; j < e->len; j++) e->buf[j] = 'a'+rand()%26;
+}
+
+static int elementEqual(unsigned char *p, testElement *e) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+    char buf[32];
+
+    if (!lpGet(p,&vstr,&vlen,&vll)) return 0;
+    if (vstr == NULL) {
+        vlen = sprintf(buf,"%lld",vll);
+        vstr = (unsigned char*)buf;
+    }
+    return vlen == e->len && memcmp(vstr,e->buf,vlen) == 0;
+}
+
+/* Check the listpack against the model in both directions. */
+static void verify(unsigned char *lp) {
+    unsigned char *p;
+    int j;
+
+    assert(lpLength(lp) == (unsigned)modellen);
+    for (j = 0, p = lpFirst(lp); j < modellen; j++, p = lpNext(lp,p))
+        assert(elementEqual(p,&model[j]));
+    assert(p == NULL);
+    for (j = modellen-1, p = lpLast(lp); j >= 0; j--, p = lpPrev(lp,p))
+        assert(elementEqual(p,&model[j]));
+    assert(p == NULL);
+    if (modellen) {
+        j = rand() % modellen;
+        assert(elementEqual(lpIndex(lp,j),&model[j]));
+        assert(elementEqual(lpIndex(lp,j-modellen),&model[j]));
+        assert(lpFind(lpFirst(lp),(unsigned char*)model[j].buf,
+                      model[j].len,0) != NULL);
+    }
+    assert(lpIndex(lp,modellen) == NULL);
+}
+
+static void stressTest(int iterations) {
+    unsigned char *lp = lpNew(), *p;
+    testElement e;
+    int j, k, n;
+
+    modellen = 0;
+    for (j = 0; j < iterations; j++) {
+        int op = rand() % 5;
+
+        if (modellen == TEST_MAX) op = 3;
+        randomElement(&e);
+        k = modellen ? rand() % modellen : 0;
+        switch(op) {
+        case 0: /* Push at head or tail. */
+            if (rand() % 2) {
+                lp = lpPush(lp,(unsigned char*)e.buf,e.len,LP_HEAD);
+                memmove(model+1,model,sizeof(testElement)*modellen);
+                model[0] = e;
+            } else {
+                lp = lpPush(lp,(unsigned char*)e.buf,e.len,LP_TAIL);
+                model[modellen] = e;
+            }
+            modellen++;
+            break;
+        case 1: /* Insert in the middle. */
+            p = modellen ? lpIndex(lp,k) : lpFirst(lp);
+            if (p == NULL) p = lp+lpBytes(lp)-1;
+            lp = lpInsert(lp,p,(unsigned char*)e.buf,e.len);
+            memmove(model+k+1,model+k,sizeof(testElement)*(modellen-k));
+            model[k] = e;
+            modellen++;
+            break;
+        case 2: /* Replace. */
+            if (!modellen) break;
+            p = lpIndex(lp,k);
+            lp = lpReplace(lp,&p,(unsigned char*)e.buf,e.len);
+            assert(elementEqual(p,&e));
+            model[k] = e;
+            break;
+        case 3: /* Delete. */
+            if (!modellen) break;
+            p = lpIndex(lp,k);
+            lp = lpDelete(lp,&p);
+            memmove(model+k,model+k+1,sizeof(testElement)*(modellen-k-1));
+            modellen--;
+            assert(k == modellen ? lpGet(p,NULL,NULL,NULL) == 0 :
+                                   elementEqual(p,&model[k]));
+            break;
+        case 4: /* Delete a range. */
+            if (!modellen) break;
+            n = rand() % 4;
+            if (n > modellen-k) n = modellen-k;
+            lp = lpDeleteRange(lp,k,n);
+            memmove(model+k,model+k+n,sizeof(testElement)*(modellen-k-n));
+            modellen -= n;
+            break;
+        }
+        if (j % 50 == 0) verify(lp);
+    }
+    verify(lp);
+    zfree(lp);
+}
+
+/* Insert at the head an entry of 'newlen' bytes in a list of 'num' entries
+ * of 'len' bytes, starting every time from a fresh copy of the list. With
+ * entries of 250 bytes and a new entry of 254 bytes or more this is the
+ * worst case of the ziplist: the header of every entry grows, one after the
+ * other (cascading update). */
+static void benchCascade(int num, int len, int newlen, int iterations) {
+    unsigned char *zl = ziplistNew(), *lp = lpNew(), *copy;
+    char buf[1024];
+    long long start, zltime = 0, lptime = 0;
+    size_t zlbytes, lpbytes;
+    int j;
+
+    memset(buf,'x',sizeof(buf));
+    for (j = 0; j < num; j++) {
+        zl = ziplistPush(zl,(unsigned char*)buf,len,ZIPLIST_TAIL);
+        lp = lpPush(lp,(unsigned char*)buf,len,LP_TAIL);
+    }
+    zlbytes = ziplistBlobLen(zl);
+    lpbytes = lpBytes(lp);
+
+    for (j = 0; j < iterations; j++) {
+        copy = zmalloc(zlbytes);
+        memcpy(copy,zl,zlbytes);
+        start = usec();
+        copy = ziplistPush(copy,(unsigned char*)buf,newlen,ZIPLIST_HEAD);
+        zltime += usec()-start;
+        zfree(copy);
+
+        copy = zmalloc(lpbytes);
+        memcpy(copy,lp,lpbytes);
+        start = usec();
+        copy = lpPush(copy,(unsigned char*)buf,newlen,LP_HEAD);
+        lptime += usec()-start;
+        zfree(copy);
+    }
+
+    printf("%4d x %3d bytes, insert %3d bytes at head: "
+           "ziplist %7.2f usec/op, listpack %5.2f usec/op\n",
+           num,len,newlen,(double)zltime/iterations,
+           (double)lptime/iterations);
+    zfree(zl);
+    zfree(lp);
+}
+
+/* Push/pop at both ends and random access, like the ziplist stress test. */
+static void benchAccess(int num, int iterations) {
+    unsigned char *zl = ziplistNew(), *lp = lpNew(), *p, *vstr;
+    unsigned int vlen;
+    long long vll, start, zltime, lptime;
+    char buf[32];
+    int j, len;
+
+    for (j = 0; j < num; j++) {
+        len = sprintf(buf,(j & 1) ? "%d" : "field:%d",j);
+        zl = ziplistPush(zl,(unsigned char*)buf,len,ZIPLIST_TAIL);
+        lp = lpPush(lp,(unsigned char*)buf,len,LP_TAIL);
+    }
+
+    start = usec();
+    for (j = 0; j < iterations; j++) {
+        zl = ziplistPush(zl,(unsigned char*)"quux",4,j&1);
+        zl = ziplistDeleteRange(zl,(j&1) ? num : 0,1);
+        p = ziplistIndex(zl,j%num);
+        ziplistGet(p,&vstr,&vlen,&vll);
+        sink += vlen;
+        p = ziplistFind(ziplistIndex(zl,0),(unsigned char*)"field:4",7,1);
+        sink += (p != NULL);
+    }
+    zltime = usec()-start;
+
+    start = usec();
+    for (j = 0; j < iterations; j++) {
+        lp = lpPush(lp,(unsigned char*)"quux",4,j&1);
+        lp = lpDeleteRange(lp,(j&1) ? num : 0,1);
+        p = lpIndex(lp,j%num);
+        lpGet(p,&vstr,&vlen,&vll);
+        sink += vlen;
+        p = lpFind(lpFirst(lp),(unsigned char*)"field:4",7,1);
+        sink += (p != NULL);
+    }
+    lptime = usec()-start;
+
+    printf("%4d entries, push+pop+index+find: ziplist %6.2f usec/op "
+           "(%zu bytes), listpack %6.2f usec/op (%zu bytes)\n",
+           num,(double)zltime/iterations,ziplistBlobLen(zl),
+           (double)lptime/iterations,lpBytes(lp));
+    zfree(zl);
+    zfree(lp);
+}
+
+int main(int argc, char **argv) {
+    int j;
+
+    /* If an argument is given, use it as the random seed. */
+    srand(argc == 2 ? atoi(argv[1]) : time(NULL));
+
+    printf("Stress test: ");
+    fflush(stdout);
+    for (j = 0; j < 200; j++) stressTest(1000);
+    printf("ok\n\n");
+
+    benchCascade(128,250,254,10000);
+    benchCascade(512,250,254,2000);
+    benchCascade(512,250,100,2000);
+    benchCascade(512,40,64,20000);
+    printf("\n");
+    benchAccess(16,200000);
+    benchAccess(128,100000);
+    benchAccess(512,20000);
+    return 0;
+}
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2014, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _LISTPACK_H
+#define _LISTPACK_H
+
+#define LP_HEAD 0
+#define LP_TAIL 1
+
+/**
+ * listpack是取代ziplist的紧凑列表。每个元素在尾部保存自身的长度(backlen),
+ * 插入和删除不会引起连锁更新。接口与ziplist保持一致, 具体解释参照.c文件中的注释。
+ */
+
+//创建一个新的listpack
+unsigned char *lpNew(void);
+
+//在listpack的表头或者表尾（根据where）插入新的元素
+unsigned char *lpPush(unsigned char *lp, unsigned char *s, unsigned int slen, int where);
+
+//根据index的值取到listpack中元素
+unsigned char *lpIndex(unsigned char *lp, int index);
+
+//取到第一个元素
+unsigned char *lpFirst(unsigned char *lp);
+
+//取到最后一个元素
+unsigned char *lpLast(unsigned char *lp);
+
+//取到p的下一个元素
+unsigned char *lpNext(unsigned char *lp, unsigned char *p);
+
+//取到p的上一个元素
+unsigned char *lpPrev(unsigned char *lp, unsigned char *p);
+
+//取到p元素中的值
+unsigned int lpGet(unsigned char *p, unsigned char **sval, unsigned int *slen, long long *lval);
+
+//在p元素前插入新的元素
+unsigned char *lpInsert(unsigned char *lp, unsigned char *p, unsigned char *s, unsigned int slen);
+
+//用新的值替换p元素
+unsigned char *lpReplace(unsigned char *lp, unsigned char **p, unsigned char *s, unsigned int slen);
+
+//从listpack中删除p元素
+unsigned char *lpDelete(unsigned char *lp, unsigned char **p);
+
+//删除index处的元素开始的num个元素
+unsigned char *lpDeleteRange(unsigned char *lp, unsigned int index, unsigned int num);
+
+//比较p元素的值与s的值
+unsigned int lpCompare(unsigned char *p, unsigned char *s, unsigned int slen);
+
+//找到p之后与vstr值一样的元素，每次比较后移动skip个元素
+unsigned char *lpFind(unsigned char *p, unsigned char *vstr, unsigned int vlen, unsigned int skip);
+
+//返回listpack中元素个数
+unsigned int lpLength(unsigned char *lp);
+
+//返回listpack占用内存大小
+size_t lpBytes(unsigned char *lp);
+
+#endif /* _LISTPACK_H */
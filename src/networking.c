@@ -39,7 +39,7 @@ static void setProtocolError(redisClient *c, int pos);
  * returned pointer), so we use this helper function. */
 //计算sds占用的内存大小
 size_t zmalloc_size_sds(sds s) {
-    return zmalloc_size(s-sizeof(struct sdshdr));
+    return zmalloc_size(sdsAllocPtr(s));
 }
 
 //将robj的引用数加1
@@ -99,6 +99,12 @@ redisClient *createClient(int fd) {
     c->repl_ack_off = 0;
     c->repl_ack_time = 0;
     c->slave_listening_port = 0;
+    c->ref_repl_buf_node = NULL;
+    c->ref_block_pos = 0;
+    c->repl_disk_off = -1;
+    c->repldb_window_start = 0;
+    c->repldb_window_bytes = 0;
+    c->repldb_throttled = 0;
     c->reply = listCreate();
     c->reply_bytes = 0;
     c->obuf_soft_limit_reached_time = 0;
@@ -145,8 +151,31 @@ int prepareClientToWrite(redisClient *c) {
     return REDIS_OK;
 }
 
+/* Create the object of a new node of the reply list holding 's'. The
+ * buffer has room for a whole REDIS_REPLY_CHUNK_BYTES chunk (rounded up to
+ * the allocator size class), so that the replies that follow are appended
+ * without reallocating it again and again. */
+//创建响应队列的新节点, 预先分配一个chunk的空间
+static robj *createReplyChunkObject(char *s, size_t len) {
+    size_t size = (len > REDIS_REPLY_CHUNK_BYTES) ? len : REDIS_REPLY_CHUNK_BYTES;
+    sds buf = sdsMakeRoomForNonGreedy(sdsempty(),size);
+
+    return createObject(REDIS_STRING,sdscatlen(buf,s,len));
+}
+
+/* Return true if 'len' bytes can be appended to the last object of the
+ * reply list: the result must not exceed a chunk, unless it fits in the
+ * free space of a buffer owned by the list. */
+//判断是否可以将len字节添加到响应队列的尾元素后面
+static int replyTailHasRoom(robj *tail, size_t len) {
+    if (tail->ptr == NULL) return 0;
+    if (sdslen(tail->ptr)+len <= REDIS_REPLY_CHUNK_BYTES) return 1;
+    return tail->refcount == 1 && sdsavail(tail->ptr) >= len;
+}
+
 /* Create a duplicate of the last object in the reply list when
- * it is not exclusively owned by the reply list. */
+ * it is not exclusively owned by the reply list. The duplicate is
+ * created to append more replies to it, so it is a whole chunk. */
 //复制响应表中最后一项的值
 robj *dupLastObjectIfNeeded(list *reply) {
     robj *new, *cur;
@@ -155,7 +184,7 @@ robj *dupLastObjectIfNeeded(list *reply) {
     ln = listLast(reply);
     cur = listNodeValue(ln);
     if (cur->refcount > 1) {
-        new = dupStringObject(cur);
+        new = createReplyChunkObject(cur->ptr,sdslen(cur->ptr));
         decrRefCount(cur);
         listNodeValue(ln) = new;
     }
@@ -201,9 +230,7 @@ void _addReplyObjectToList(redisClient *c, robj *o) {
         tail = listNodeValue(listLast(c->reply));
 
         /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
-            sdslen(tail->ptr)+sdslen(o->ptr) <= REDIS_REPLY_CHUNK_BYTES)
-        {
+        if (replyTailHasRoom(tail,sdslen(o->ptr))) {
         	//如果新的响应加上列尾元素的响应的长度小于REDIS_REPLY_CHUNK_BYTES，
         	//将新响应的内容添加到列尾元素的响应内容后面
             c->reply_bytes -= zmalloc_size_sds(tail->ptr);
@@ -239,9 +266,7 @@ void _addReplySdsToList(redisClient *c, sds s) {
         tail = listNodeValue(listLast(c->reply));
 
         /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
-            sdslen(tail->ptr)+sdslen(s) <= REDIS_REPLY_CHUNK_BYTES)
-        {
+        if (replyTailHasRoom(tail,sdslen(s))) {
         	 //可以添加到尾元素的内容后面
             c->reply_bytes -= zmalloc_size_sds(tail->ptr);
             tail = dupLastObjectIfNeeded(c->reply);
@@ -263,7 +288,7 @@ void _addReplyStringToList(redisClient *c, char *s, size_t len) {
     if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
 
     if (listLength(c->reply) == 0) {
-        robj *o = createStringObject(s,len);
+        robj *o = createReplyChunkObject(s,len);
 
         listAddNodeTail(c->reply,o);
         c->reply_bytes += zmalloc_size_sds(o->ptr);
@@ -271,15 +296,13 @@ void _addReplyStringToList(redisClient *c, char *s, size_t len) {
         tail = listNodeValue(listLast(c->reply));
 
         /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
-            sdslen(tail->ptr)+len <= REDIS_REPLY_CHUNK_BYTES)
-        {
+        if (replyTailHasRoom(tail,len)) {
             c->reply_bytes -= zmalloc_size_sds(tail->ptr);
             tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,s,len);
             c->reply_bytes += zmalloc_size_sds(tail->ptr);
         } else {
-            robj *o = createStringObject(s,len);
+            robj *o = createReplyChunkObject(s,len);
 
             listAddNodeTail(c->reply,o);
             c->reply_bytes += zmalloc_size_sds(o->ptr);
@@ -595,6 +618,9 @@ void copyClientOutputBuffer(redisClient *dst, redisClient *src) {
     memcpy(dst->buf,src->buf,src->bufpos);
     dst->bufpos = src->bufpos;
     dst->reply_bytes = src->reply_bytes;
+    /* Slaves also share the position inside the replication buffer. */
+    if (src->ref_repl_buf_node)
+        replBufferAttachSlave(dst,src->ref_repl_buf_node,src->ref_block_pos);
 }
 
 
@@ -790,6 +816,7 @@ void freeClient(redisClient *c) {
     if (c->flags & REDIS_SLAVE) {
         if (c->replstate == REDIS_REPL_SEND_BULK && c->repldbfd != -1)
             close(c->repldbfd);
+        replBufferDetachSlave(c);
         list *l = (c->flags & REDIS_MONITOR) ? server.monitors : server.slaves;
         ln = listSearchKey(l,c);
         redisAssert(ln != NULL);
@@ -905,6 +932,15 @@ void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
             (server.maxmemory == 0 ||
              zmalloc_used_memory() < server.maxmemory)) break;
     }
+    /* Online slaves receive the replication stream directly from the shared
+     * replication buffer once their own output buffers are empty. */
+    //从服务器的复制流直接从共享复制缓冲区发送
+    if ((c->ref_repl_buf_node || c->repl_disk_off != -1) &&
+        c->replstate == REDIS_REPL_ONLINE &&
+        c->bufpos == 0 && listLength(c->reply) == 0 && nwritten != -1)
+    {
+        nwritten = writeReplBufferToSlave(c,&totwritten);
+    }
     if (nwritten == -1) {
         if (errno == EAGAIN) {
             nwritten = 0;
@@ -924,7 +960,9 @@ void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     }
 
     //所有响应都写完，从事件驱动程序中删除文件事件
-    if (c->bufpos == 0 && listLength(c->reply) == 0) {
+    if (c->bufpos == 0 && listLength(c->reply) == 0 &&
+        replBufferSlavePending(c) == 0 && c->repl_disk_off == -1)
+    {
         c->sentlen = 0;
         aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
 
@@ -1547,7 +1585,8 @@ void rewriteClientCommandArgument(redisClient *c, int i, robj *newval) {
 unsigned long getClientOutputBufferMemoryUsage(redisClient *c) {
     unsigned long list_item_size = sizeof(listNode)+sizeof(robj);
 
-    return c->reply_bytes + (list_item_size*listLength(c->reply));
+    return c->reply_bytes + (list_item_size*listLength(c->reply)) +
+           replBufferSlavePending(c);
 }
 
 /* Get the class of a client, used in order to enforce limits to different
@@ -1635,7 +1674,8 @@ int checkClientOutputBufferLimits(redisClient *c) {
 //如果保存响应使用内存超过规定的，将客户端以异步方式销毁
 void asyncCloseClientOnOutputBufferLimitReached(redisClient *c) {
     redisAssert(c->reply_bytes < ULONG_MAX-(1024*64));
-    if (c->reply_bytes == 0 || c->flags & REDIS_CLOSE_ASAP) return;
+    if ((c->reply_bytes == 0 && c->ref_repl_buf_node == NULL) ||
+        c->flags & REDIS_CLOSE_ASAP) return;
     if (checkClientOutputBufferLimits(c)) {
         sds client = getClientInfoString(c);
 
@@ -1659,7 +1699,7 @@ void flushSlavesOutputBuffers(void) {
         events = aeGetFileEvents(server.el,slave->fd);
         if (events & AE_WRITABLE &&
             slave->replstate == REDIS_REPL_ONLINE &&
-            listLength(slave->reply))
+            (listLength(slave->reply) || replBufferSlavePending(slave)))
         {
             sendReplyToClient(server.el,slave->fd,slave,0);
         }
@@ -47,7 +47,7 @@ robj *createObject(int type, void *ptr) {
 
 //创建一个基于sds的redis object
 robj *createStringObject(char *ptr, size_t len) {
-    return createObject( ,sdsnewlen(ptr,len));
+    return createObject(REDIS_STRING,sdsnewlen(ptr,len));
 }
 
 //给定long long型的整数value,创建一个redis object
@@ -116,11 +116,19 @@ robj *createListObject(void) {
     return o;
 }
 
-//创建一个类型是list编码是ziplist的redis object
-robj *createZiplistObject(void) {
-    unsigned char *zl = ziplistNew();
+//创建一个类型是list编码是listpack的redis object
+robj *createListpackObject(void) {
+    unsigned char *zl = lpNew();
     robj *o = createObject(REDIS_LIST,zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+    o->encoding = REDIS_ENCODING_LISTPACK;
+    return o;
+}
+
+//创建一个类型是set编码是roaring的redis object
+robj *createSetRoaringObject(void) {
+    roaring *r = roaringNew();
+    robj *o = createObject(REDIS_SET,r);
+    o->encoding = REDIS_ENCODING_ROARING;
     return o;
 }
 
@@ -140,11 +148,19 @@ robj *createIntsetObject(void) {
     return o;
 }
 
-//创建一个类型是hash编码是ziplist的redis object
+//创建一个类型是set编码是listpack的redis object
+robj *createSetListpackObject(void) {
+    unsigned char *lp = lpNew();
+    robj *o = createObject(REDIS_SET,lp);
+    o->encoding = REDIS_ENCODING_LISTPACK;
+    return o;
+}
+
+//创建一个类型是hash编码是listpack的redis object
 robj *createHashObject(void) {
-    unsigned char *zl = ziplistNew();
+    unsigned char *zl = lpNew();
     robj *o = createObject(REDIS_HASH, zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+    o->encoding = REDIS_ENCODING_LISTPACK;
     return o;
 }
 
@@ -155,16 +171,39 @@ robj *createZsetObject(void) {
 
     zs->dict = dictCreate(&zsetDictType,NULL);
     zs->zsl = zslCreate();
+    zs->zbt = NULL;
     o = createObject(REDIS_ZSET,zs);
     o->encoding = REDIS_ENCODING_SKIPLIST;
     return o;
 }
 
-//创建一个类型是zset编码是ziplist的redis object
-robj *createZsetZiplistObject(void) {
-    unsigned char *zl = ziplistNew();
+//创建一个类型是zset编码是B+树的redis object
+robj *createZsetBtreeObject(void) {
+    zset *zs = zmalloc(sizeof(*zs));
+    robj *o;
+
+    zs->dict = dictCreate(&zsetDictType,NULL);
+    zs->zsl = NULL;
+    zs->zbt = zbtreeCreate();
+    o = createObject(REDIS_ZSET,zs);
+    o->encoding = REDIS_ENCODING_BTREE;
+    return o;
+}
+
+/* Create a sorted set using the encoding selected for big sorted sets by
+ * the zset-large-encoding option. */
+//根据zset-large-encoding配置创建skiplist或B+树编码的zset
+robj *createZsetLargeObject(void) {
+    if (server.zset_large_encoding == REDIS_ENCODING_BTREE)
+        return createZsetBtreeObject();
+    return createZsetObject();
+}
+
+//创建一个类型是zset编码是zpack的redis object
+robj *createZsetZpackObject(void) {
+    unsigned char *zl = zpNew();
     robj *o = createObject(REDIS_ZSET,zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+    o->encoding = REDIS_ENCODING_ZPACK;
     return o;
 }
 
@@ -181,7 +220,7 @@ void freeListObject(robj *o) {
     case REDIS_ENCODING_LINKEDLIST:
         listRelease((list*) o->ptr);
         break;
-    case REDIS_ENCODING_ZIPLIST:
+    case REDIS_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
     default:
@@ -196,8 +235,12 @@ void freeSetObject(robj *o) {
         dictRelease((dict*) o->ptr);
         break;
     case REDIS_ENCODING_INTSET:
+    case REDIS_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
+    case REDIS_ENCODING_ROARING:
+        roaringFree(o->ptr);
+        break;
     default:
         redisPanic("Unknown set encoding type");
     }
@@ -213,7 +256,13 @@ void freeZsetObject(robj *o) {
         zslFree(zs->zsl);
         zfree(zs);
         break;
-    case REDIS_ENCODING_ZIPLIST:
+    case REDIS_ENCODING_BTREE:
+        zs = o->ptr;
+        dictRelease(zs->dict);
+        zbtreeFree(zs->zbt);
+        zfree(zs);
+        break;
+    case REDIS_ENCODING_ZPACK:
         zfree(o->ptr);
         break;
     default:
@@ -227,7 +276,7 @@ void freeHashObject(robj *o) {
     case REDIS_ENCODING_HT:
         dictRelease((dict*) o->ptr);
         break;
-    case REDIS_ENCODING_ZIPLIST:
+    case REDIS_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
     default:
@@ -245,6 +294,14 @@ void incrRefCount(robj *o) {
 void decrRefCount(robj *o) {
     if (o->refcount <= 0) redisPanic("decrRefCount against refcount <= 0");
     if (o->refcount == 1) {
+        /* Lazy values point inside the mmap()ed RDB file: nothing to free
+         * but the object itself. */
+        //惰性载入的值指向映射的rdb文件, 只需要释放对象本身
+        if (o->encoding == REDIS_ENCODING_LAZY) {
+            rdbLazyObjectReleased();
+            zfree(o);
+            return;
+        }
         switch(o->type) {
         case REDIS_STRING: freeStringObject(o); break;
         case REDIS_LIST: freeListObject(o); break;
@@ -620,13 +677,96 @@ char *strEncoding(int encoding) {
     case REDIS_ENCODING_INT: return "int";
     case REDIS_ENCODING_HT: return "hashtable";
     case REDIS_ENCODING_LINKEDLIST: return "linkedlist";
-    case REDIS_ENCODING_ZIPLIST: return "ziplist";
+    case REDIS_ENCODING_LISTPACK: return "listpack";
+    case REDIS_ENCODING_ZPACK: return "zpack";
     case REDIS_ENCODING_INTSET: return "intset";
     case REDIS_ENCODING_SKIPLIST: return "skiplist";
+    case REDIS_ENCODING_BTREE: return "btree";
+    case REDIS_ENCODING_ROARING: return "roaring";
+    case REDIS_ENCODING_LAZY: return "lazy";
     default: return "unknown";
     }
 }
 
+/* Convert a collection that shrank back to its compact encoding, if it is
+ * at most 1/ratio of the compact limits. Returns 1 if the object was
+ * converted. DEBUG REENCODE uses a ratio of 1, producing the same encodings
+ * as loading the dataset again. */
+//如果集合缩小到紧凑编码限制的1/ratio以下, 将其转换回紧凑编码
+int objectDowngrade(robj *o, int ratio) {
+    //延迟加载的值还没有被解码
+    if (o->encoding == REDIS_ENCODING_LAZY) return 0;
+    switch(o->type) {
+    case REDIS_LIST: return listTypeTryDowngrade(o,ratio);
+    case REDIS_SET: return setTypeTryDowngrade(o,ratio);
+    case REDIS_ZSET: return zsetTryDowngrade(o,ratio);
+    case REDIS_HASH: return hashTypeTryDowngrade(o,ratio);
+    default: return 0;
+    }
+}
+
+/* Return true if a collection that had 'oldsize' elements before the command
+ * and has 'size' elements now should be checked for the conversion to the
+ * compact encoding with limits 'entries' and 'value': the command made it
+ * cross 'entries', or it is already small enough and the command removed or
+ * overwrote an element longer than 'value' ('removedlen'), that may have been
+ * the one keeping it in the large encoding. */
+//判断集合是否需要检查能否转换回紧凑编码: 大小刚刚跨过entries,
+//或者大小已经不超过entries且删除/覆盖的元素长度超过value
+static int downgradeWorthTrying(unsigned long oldsize, unsigned long size,
+                                size_t removedlen, unsigned long entries,
+                                size_t value)
+{
+    if (size > entries) return 0;
+    return oldsize > entries || removedlen > value;
+}
+
+/* Called by the commands removing or overwriting elements of a collection
+ * that still exists, with the size the collection had before the command
+ * and the length of the longest element removed or overwritten (0 when it
+ * is not known), see the encoding-downgrade option. Checking the elements
+ * is O(N), so it is only attempted when the collection crosses
+ * 1/REDIS_DOWNGRADE_RATIO of the entries limit, or when it is already
+ * below it and a long element went away: a collection kept in the large
+ * encoding by a long element is not scanned again by every removal, while
+ * it is still converted once that element is removed. */
+//删除或覆盖元素的命令调用, oldsize是命令执行前集合的大小,
+//removedlen是被删除或覆盖的最长元素的长度
+void tryObjectDowngrade(robj *o, unsigned long oldsize, size_t removedlen) {
+    int ratio = REDIS_DOWNGRADE_RATIO, attempt = 0;
+    unsigned long size;
+
+    if (!server.encoding_downgrade) return;
+    if (o->encoding == REDIS_ENCODING_LAZY) return;
+    switch(o->type) {
+    case REDIS_LIST:
+        attempt = downgradeWorthTrying(oldsize,listTypeLength(o),removedlen,
+            server.list_max_ziplist_entries/ratio,
+            server.list_max_ziplist_value);
+        break;
+    case REDIS_SET:
+        size = setTypeSize(o);
+        attempt = downgradeWorthTrying(oldsize,size,removedlen,
+                      server.set_max_intset_entries/ratio,
+                      server.set_max_listpack_value) ||
+                  downgradeWorthTrying(oldsize,size,removedlen,
+                      server.set_max_listpack_entries/ratio,
+                      server.set_max_listpack_value);
+        break;
+    case REDIS_ZSET:
+        attempt = downgradeWorthTrying(oldsize,zsetLength(o),removedlen,
+            server.zset_max_ziplist_entries/ratio,
+            server.zset_max_ziplist_value);
+        break;
+    case REDIS_HASH:
+        attempt = downgradeWorthTrying(oldsize,hashTypeLength(o),removedlen,
+            server.hash_max_ziplist_entries/ratio,
+            server.hash_max_ziplist_value);
+        break;
+    }
+    if (attempt) objectDowngrade(o,ratio);
+}
+
 /* Given an object returns the min number of seconds the object was never
  * requested, using an approximated LRU algorithm. */
 unsigned long estimateObjectIdleTime(robj *o) {
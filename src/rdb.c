@@ -39,6 +39,7 @@
 #include <sys/wait.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 //将p的内容直接写到rio中
 static int rdbWriteRaw(rio *rdb, void *p, size_t len) {
@@ -493,15 +494,118 @@ int rdbLoadDoubleValue(rio *rdb, double *val) {
     }
 }
 
+/* The following functions skip RDB encoded data without decoding it. They
+ * only work with memory rio streams (see rioInitWithMemory()) and return
+ * -1 if the data is truncated or malformed, 0 otherwise. */
+//跳过len个字节, 只用于基于内存的rio
+static int rdbSkipRaw(rio *rdb, size_t len) {
+    if (rdb->io.memory.len - rdb->io.memory.pos < len) return -1;
+    rdb->io.memory.pos += len;
+    return 0;
+}
+
+/* Skip a string saved with rdbSaveRawString(). */
+//跳过一个字符串, 不做解压和解码
+static int rdbSkipString(rio *rdb) {
+    int isencoded;
+    uint32_t len, clen;
+
+    if ((len = rdbLoadLen(rdb,&isencoded)) == REDIS_RDB_LENERR) return -1;
+    if (!isencoded) return rdbSkipRaw(rdb,len);
+    switch(len) {
+    case REDIS_RDB_ENC_INT8: return rdbSkipRaw(rdb,1);
+    case REDIS_RDB_ENC_INT16: return rdbSkipRaw(rdb,2);
+    case REDIS_RDB_ENC_INT32: return rdbSkipRaw(rdb,4);
+    case REDIS_RDB_ENC_LZF:
+        if ((clen = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return -1;
+        if (rdbLoadLen(rdb,NULL) == REDIS_RDB_LENERR) return -1;
+        return rdbSkipRaw(rdb,clen);
+    default:
+        return -1;
+    }
+}
+
+/* Skip a double saved with rdbSaveDoubleValue(). */
+static int rdbSkipDoubleValue(rio *rdb) {
+    unsigned char len;
+
+    if (rioRead(rdb,&len,1) == 0) return -1;
+    if (len >= 253) return 0; /* NaN and infinities have no payload. */
+    return rdbSkipRaw(rdb,len);
+}
+
+/* Skip a value of the specified RDB type. */
+//跳过给定rdb类型的值
+static int rdbSkipObject(int rdbtype, rio *rdb) {
+    uint32_t len, j;
+
+    switch(rdbtype) {
+    case REDIS_RDB_TYPE_STRING:
+    case REDIS_RDB_TYPE_HASH_ZIPMAP:
+    case REDIS_RDB_TYPE_LIST_ZIPLIST:
+    case REDIS_RDB_TYPE_SET_INTSET:
+    case REDIS_RDB_TYPE_ZSET_ZIPLIST:
+    case REDIS_RDB_TYPE_HASH_ZIPLIST:
+    case REDIS_RDB_TYPE_LIST_LISTPACK:
+    case REDIS_RDB_TYPE_ZSET_LISTPACK:
+    case REDIS_RDB_TYPE_HASH_LISTPACK:
+    case REDIS_RDB_TYPE_ZSET_ZPACK:
+    case REDIS_RDB_TYPE_SET_LISTPACK:
+    case REDIS_RDB_TYPE_SET_ROARING:
+        /* Encoded types are saved as a single string blob. */
+        return rdbSkipString(rdb);
+    case REDIS_RDB_TYPE_LIST:
+    case REDIS_RDB_TYPE_SET:
+    case REDIS_RDB_TYPE_ZSET:
+    case REDIS_RDB_TYPE_HASH:
+        if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return -1;
+        for (j = 0; j < len; j++) {
+            if (rdbSkipString(rdb) == -1) return -1;
+            if (rdbtype == REDIS_RDB_TYPE_ZSET &&
+                rdbSkipDoubleValue(rdb) == -1) return -1;
+            if (rdbtype == REDIS_RDB_TYPE_HASH &&
+                rdbSkipString(rdb) == -1) return -1;
+        }
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/* Lazy objects point to the type byte of their entry inside the mapped RDB
+ * file, that is followed by the key and then by the value. Return a pointer
+ * to the value payload and set '*len' to its length. */
+//返回惰性对象在映射文件中的值的位置和长度
+static unsigned char *rdbLazyObjectPayload(robj *o, size_t *len) {
+    unsigned char *p = o->ptr;
+    off_t start;
+    int rdbtype;
+    rio rdb;
+
+    rioInitWithMemory(&rdb,p,server.rdb_lazy_map+server.rdb_lazy_map_size-p);
+    rdbtype = rdbLoadType(&rdb);
+    /* The entry was already validated by rdbLoadLazy(). */
+    if (rdbSkipString(&rdb) == -1) redisPanic("Corrupted lazy RDB entry");
+    start = rioTell(&rdb);
+    if (rdbSkipObject(rdbtype,&rdb) == -1)
+        redisPanic("Corrupted lazy RDB entry");
+    *len = rioTell(&rdb)-start;
+    return p+start;
+}
+
 /* Save the object type of object "o". */
 //保存robj的type字段到rdb
 int rdbSaveObjectType(rio *rdb, robj *o) {
+    /* Lazy objects keep the type they had in the mapped file. */
+    if (o->encoding == REDIS_ENCODING_LAZY)
+        return rdbSaveType(rdb,*(unsigned char*)o->ptr);
+
     switch (o->type) {
     case REDIS_STRING:
         return rdbSaveType(rdb,REDIS_RDB_TYPE_STRING);
     case REDIS_LIST:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_ZIPLIST);
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_LISTPACK);
         else if (o->encoding == REDIS_ENCODING_LINKEDLIST)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST);
         else
@@ -509,20 +613,25 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
     case REDIS_SET:
         if (o->encoding == REDIS_ENCODING_INTSET)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_SET_INTSET);
+        else if (o->encoding == REDIS_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_SET_LISTPACK);
+        else if (o->encoding == REDIS_ENCODING_ROARING)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_SET_ROARING);
         else if (o->encoding == REDIS_ENCODING_HT)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_SET);
         else
             redisPanic("Unknown set encoding");
     case REDIS_ZSET:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET_ZIPLIST);
-        else if (o->encoding == REDIS_ENCODING_SKIPLIST)
+        if (o->encoding == REDIS_ENCODING_ZPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET_ZPACK);
+        else if (o->encoding == REDIS_ENCODING_SKIPLIST ||
+                 o->encoding == REDIS_ENCODING_BTREE)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET);
         else
             redisPanic("Unknown sorted set encoding");
     case REDIS_HASH:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_ZIPLIST);
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_LISTPACK);
         else if (o->encoding == REDIS_ENCODING_HT)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH);
         else
@@ -548,16 +657,26 @@ int rdbLoadObjectType(rio *rdb) {
 int rdbSaveObject(rio *rdb, robj *o) {
     int n, nwritten = 0;
 
+    /* A value never accessed since the lazy load is copied as it is from
+     * the mapped file, without loading it. */
+    //惰性对象直接从映射的文件复制原始字节
+    if (o->encoding == REDIS_ENCODING_LAZY) {
+        size_t len;
+        unsigned char *p = rdbLazyObjectPayload(o,&len);
+
+        return rdbWriteRaw(rdb,p,len);
+    }
+
     if (o->type == REDIS_STRING) {
         /* Save a string value */
         if ((n = rdbSaveStringObject(rdb,o)) == -1) return -1;
         nwritten += n;
     } else if (o->type == REDIS_LIST) {
         /* Save a list value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
-            //将ziplist的整块内存写到rdb中
+            //将listpack的整块内存写到rdb中
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
         } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
@@ -602,44 +721,78 @@ int rdbSaveObject(rio *rdb, robj *o) {
             //将intset的整块内存写到rdb中
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
+        } else if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
+            //将listpack的整块内存写到rdb中
+            if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
+            nwritten += n;
+        } else if (o->encoding == REDIS_ENCODING_ROARING) {
+            /* The containers are not contiguous in memory: the roaring is
+             * serialized into a single blob. */
+            //将roaring序列化后写到rdb中
+            size_t l = roaringSerializedLen(o->ptr);
+            unsigned char *buf = zmalloc(l);
+
+            roaringSerialize(o->ptr,buf);
+            n = rdbSaveRawString(rdb,buf,l);
+            zfree(buf);
+            if (n == -1) return -1;
+            nwritten += n;
         } else {
             redisPanic("Unknown set encoding");
         }
     } else if (o->type == REDIS_ZSET) {
         /* Save a sorted set value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
-            //将ziplist的整块内存写到rdb中
+        if (o->encoding == REDIS_ENCODING_ZPACK) {
+            size_t l = zpBytes((unsigned char*)o->ptr);
+            //将zpack的整块内存写到rdb中
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
         } else if (o->encoding == REDIS_ENCODING_SKIPLIST) {
             zset *zs = o->ptr;
-            dictIterator *di = dictGetIterator(zs->dict);
-            dictEntry *de;
+            zskiplistNode *ln;
 
             //保存zset的长度
-            if ((n = rdbSaveLen(rdb,dictSize(zs->dict))) == -1) return -1;
+            if ((n = rdbSaveLen(rdb,zs->zsl->length)) == -1) return -1;
             nwritten += n;
 
-            //保存zset中每个元素的值和score
-            while((de = dictNext(di)) != NULL) {
-                robj *eleobj = dictGetKey(de);
-                double *score = dictGetVal(de);
-
-                if ((n = rdbSaveStringObject(rdb,eleobj)) == -1) return -1;
+            /* The elements are saved in order walking the skiplist, so the
+             * skiplist can be rebuilt in linear time on loading. */
+            //按顺序遍历skiplist保存每个元素的值和score，加载时可以线性时间重建
+            for (ln = zs->zsl->header->level[0].forward; ln; ln = ln->level[0].forward) {
+                if ((n = rdbSaveStringObject(rdb,ln->obj)) == -1) return -1;
                 nwritten += n;
-                if ((n = rdbSaveDoubleValue(rdb,*score)) == -1) return -1;
+                if ((n = rdbSaveDoubleValue(rdb,ln->score)) == -1) return -1;
                 nwritten += n;
             }
-            dictReleaseIterator(di);
+        } else if (o->encoding == REDIS_ENCODING_BTREE) {
+            zset *zs = o->ptr;
+            zbtreeLeaf *l;
+            int j;
+
+            /* Same format of the skiplist encoding, but the elements are
+             * saved in order walking the leaves, so loading the sorted set
+             * into a B+tree only appends elements. */
+            //与skiplist的格式相同，但按顺序遍历叶子节点保存元素
+            if ((n = rdbSaveLen(rdb,zs->zbt->length)) == -1) return -1;
+            nwritten += n;
+
+            for (l = zs->zbt->head; l != NULL; l = l->next) {
+                for (j = 0; j < l->hdr.num; j++) {
+                    if ((n = rdbSaveStringObject(rdb,l->obj[j])) == -1) return -1;
+                    nwritten += n;
+                    if ((n = rdbSaveDoubleValue(rdb,l->score[j])) == -1) return -1;
+                    nwritten += n;
+                }
+            }
         } else {
             redisPanic("Unknown sorted set encoding");
         }
     } else if (o->type == REDIS_HASH) {
         /* Save a hash value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
-            //将ziplist的整块内存写到rdb中
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
+            //将listpack的整块内存写到rdb中
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
 
@@ -709,6 +862,46 @@ int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val,
     return 1;
 }
 
+/* Save an AUX field: the opcode followed by the key and value strings. */
+static int rdbSaveAuxField(rio *rdb, char *key, char *val, size_t vlen) {
+    if (rdbSaveType(rdb,REDIS_RDB_OPCODE_AUX) == -1) return -1;
+    if (rdbSaveRawString(rdb,(unsigned char*)key,strlen(key)) == -1) return -1;
+    if (rdbSaveRawString(rdb,(unsigned char*)val,vlen) == -1) return -1;
+    return 1;
+}
+
+static int rdbSaveAuxFieldLongLong(rio *rdb, char *key, long long val) {
+    char buf[REDIS_LONGSTR_SIZE];
+    int vlen = ll2string(buf,sizeof(buf),val);
+
+    return rdbSaveAuxField(rdb,key,buf,vlen);
+}
+
+/* When this instance is a slave, save the run id of the master and the
+ * replication offset the saved dataset corresponds to, so that after a
+ * restart the slave can try a partial resynchronization instead of a full
+ * one. Nothing is saved when the offset is not known exactly, that is when
+ * the master client is in the middle of a command or of a transaction.
+ * Returns -1 on write error. */
+//如果本服务器是从服务器，将主服务器的run id和复制偏移量写进rdb
+int rdbSaveReplicationInfo(rio *rdb) {
+    redisClient *m = server.master ? server.master : server.cached_master;
+    long long offset;
+
+    if (m == NULL || m->multibulklen || m->argc || m->flags & REDIS_MULTI)
+        return 0;
+
+    /* The query buffer holds data already counted in the offset that was
+     * not processed yet: it is not part of the dataset. */
+    offset = m->reploff - sdslen(m->querybuf);
+    if (rdbSaveAuxField(rdb,"repl-id",m->replrunid,
+                        strlen(m->replrunid)) == -1) return -1;
+    if (rdbSaveAuxFieldLongLong(rdb,"repl-offset",offset) == -1) return -1;
+    if (rdbSaveAuxFieldLongLong(rdb,"repl-stream-db",m->db->id) == -1)
+        return -1;
+    return 1;
+}
+
 /* Save the DB on disk. Return REDIS_ERR on error, REDIS_OK on success */
 //将服务器的数据以rdb形式保存到硬盘中给定文件
 int rdbSave(char *filename) {
@@ -718,6 +911,7 @@ int rdbSave(char *filename) {
     char magic[10];
     int j;
     long long now = mstime();
+    long long keys = 0;
     FILE *fp;
     rio rdb;
     uint64_t cksum;
@@ -732,12 +926,16 @@ int rdbSave(char *filename) {
     }
 
     //用临时文件初始化rio
-    rioInitWithFile(&rdb,fp);
+    rioInitWithFd(&rdb,fileno(fp));
+    /* Sync incrementally so that the written data can be dropped from the
+     * page cache while we go, instead of all at once at the end. */
+    rioSetAutoSync(&rdb,REDIS_AOF_AUTOSYNC_BYTES);
     if (server.rdb_checksum)
         rdb.update_cksum = rioGenericUpdateChecksum;
     snprintf(magic,sizeof(magic),"REDIS%04d",REDIS_RDB_VERSION);
     //将rdb版本号写进rdb
     if (rdbWriteRaw(&rdb,magic,9) == -1) goto werr;
+    if (rdbSaveReplicationInfo(&rdb) == -1) goto werr;
 
     //遍历所有db
     for (j = 0; j < server.dbnum; j++) {
@@ -746,6 +944,7 @@ int rdbSave(char *filename) {
         if (dictSize(d) == 0) continue;
         di = dictGetSafeIterator(d);
         if (!di) {
+            rioFreeFd(&rdb);
             fclose(fp);
             return REDIS_ERR;
         }
@@ -766,6 +965,8 @@ int rdbSave(char *filename) {
             expire = getExpire(db,&key);
             //将key的类型名字和值写到rdb中
             if (rdbSaveKeyValuePair(&rdb,&key,o,expire,now) == -1) goto werr;
+            /* Let the parent know how the COW size is growing. */
+            if ((++keys & 1023) == 0) sendChildInfoProgress();
         }
         dictReleaseIterator(di);
     }
@@ -783,8 +984,8 @@ int rdbSave(char *filename) {
 
     /* Make sure data will not remain on the OS's output buffers */
     //将缓冲区内容写到文件，同步到硬盘
-    if (fflush(fp) == EOF) goto werr;
-    if (fsync(fileno(fp)) == -1) goto werr;
+    if (rioFdSync(&rdb) == 0) goto werr;
+    rioFreeFd(&rdb);
     if (fclose(fp) == EOF) goto werr;
 
     /* Use RENAME to make sure the DB file is changed atomically only
@@ -802,6 +1003,7 @@ int rdbSave(char *filename) {
     return REDIS_OK;
 
 werr:
+    if (rdb.io.fd.buf) rioFreeFd(&rdb);
     fclose(fp);
     unlink(tmpfile);
     redisLog(REDIS_WARNING,"Write error saving DB on disk: %s", strerror(errno));
@@ -817,9 +1019,17 @@ int rdbSaveBackground(char *filename) {
     //已经存在子进程了，报错
     if (server.rdb_child_pid != -1) return REDIS_ERR;
 
+    /* Whoever needs a forked BGSAVE (for instance a slave waiting for the
+     * payload) wins over a fork-less snapshot in progress. */
+    if (server.rdb_forkless_in_progress) {
+        redisLog(REDIS_NOTICE,"Fork-less snapshot aborted to start BGSAVE.");
+        snapshotAbort(0);
+    }
+
     server.dirty_before_bgsave = server.dirty;
     server.lastbgsave_try = time(NULL);
 
+    openChildInfoPipe();
     start = ustime();
     if ((childpid = fork()) == 0) {
     	//子进程
@@ -827,12 +1037,13 @@ int rdbSaveBackground(char *filename) {
 
         /* Child */
         closeListeningSockets(0);
+        childInfoStart(CHILD_INFO_TYPE_RDB);
         //设置子进程程序名字
         redisSetProcTitle("redis-rdb-bgsave");
         //将数据以rdb形式保存
         retval = rdbSave(filename);
         if (retval == REDIS_OK) {
-            size_t private_dirty = zmalloc_get_private_dirty();
+            size_t private_dirty = sendChildInfo();
 
             if (private_dirty) {
                 redisLog(REDIS_NOTICE,
@@ -846,6 +1057,7 @@ int rdbSaveBackground(char *filename) {
     	//父进程
         server.stat_fork_time = ustime()-start;
         if (childpid == -1) {
+            closeChildInfoPipe();
             server.lastbgsave_status = REDIS_ERR;
             redisLog(REDIS_WARNING,"Can't save in background: fork: %s",
                 strerror(errno));
@@ -870,6 +1082,63 @@ void rdbRemoveTempFile(pid_t childpid) {
 
 /* Load a Redis object of the specified type from the specified file.
  * On success a newly allocated object is returned, otherwise NULL. */
+/* Convert a ziplist loaded from an RDB file saved before version 8 into a
+ * listpack, freeing the ziplist. */
+//将旧版本rdb文件中的ziplist转化为listpack
+static unsigned char *rdbZiplistToListpack(unsigned char *zl) {
+    unsigned char *lp = lpNew();
+    unsigned char *p = ziplistIndex(zl,0), *vstr;
+    unsigned int vlen;
+    long long vll;
+    char buf[32];
+
+    while (ziplistGet(p,&vstr,&vlen,&vll)) {
+        if (vstr == NULL) {
+            vlen = ll2string(buf,sizeof(buf),vll);
+            vstr = (unsigned char*)buf;
+        }
+        lp = lpPush(lp,vstr,vlen,LP_TAIL);
+        p = ziplistNext(zl,p);
+    }
+    zfree(zl);
+    return lp;
+}
+
+/* Convert a sorted set saved as a listpack of (member,score) pairs, before
+ * RDB version 9, into a zpack, freeing the listpack. */
+//将旧版本rdb文件中保存zset的listpack转化为zpack
+static unsigned char *rdbListpackToZpack(unsigned char *lp) {
+    unsigned char *zp = zpNew();
+    unsigned char *eptr = lpFirst(lp), *sptr, *vstr, *sstr;
+    unsigned int vlen, slen;
+    long long vll, sll;
+    char buf[32], sbuf[128];
+    double score;
+
+    while (eptr != NULL) {
+        sptr = lpNext(lp,eptr);
+        redisAssert(sptr != NULL);
+        redisAssert(lpGet(eptr,&vstr,&vlen,&vll));
+        redisAssert(lpGet(sptr,&sstr,&slen,&sll));
+        if (vstr == NULL) {
+            vlen = ll2string(buf,sizeof(buf),vll);
+            vstr = (unsigned char*)buf;
+        }
+        if (sstr != NULL) {
+            memcpy(sbuf,sstr,slen);
+            sbuf[slen] = '\0';
+            score = strtod(sbuf,NULL);
+        } else {
+            score = sll;
+        }
+        /* Elements are already ordered, just append them. */
+        zp = zpInsert(zp,zpLength(zp),vstr,vlen,score);
+        eptr = lpNext(lp,sptr);
+    }
+    zfree(lp);
+    return zp;
+}
+
 //从rdb中读取给定类型的robj
 robj *rdbLoadObject(int rdbtype, rio *rdb) {
     robj *o, *ele, *dec;
@@ -890,7 +1159,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         if (len > server.list_max_ziplist_entries) {
             o = createListObject();
         } else {
-            o = createZiplistObject();
+            o = createListpackObject();
         }
 
         /* Load every single element of the list */
@@ -898,17 +1167,17 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         while(len--) {
             if ((ele = rdbLoadEncodedStringObject(rdb)) == NULL) return NULL;
 
-            /* If we are using a ziplist and the value is too big, convert
+            /* If we are using a listpack and the value is too big, convert
              * the object to a real list. */
-            //正在用ziplist，但是元素的值ziplist无法保存，则将list转化为adlist来表示
-            if (o->encoding == REDIS_ENCODING_ZIPLIST &&
+            //正在用listpack，但是元素的值listpack无法保存，则将list转化为adlist来表示
+            if (o->encoding == REDIS_ENCODING_LISTPACK &&
                 ele->encoding == REDIS_ENCODING_RAW &&
                 sdslen(ele->ptr) > server.list_max_ziplist_value)
                     listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
 
-            if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+            if (o->encoding == REDIS_ENCODING_LISTPACK) {
                 dec = getDecodedObject(ele);
-                o->ptr = ziplistPush(o->ptr,dec->ptr,sdslen(dec->ptr),REDIS_TAIL);
+                o->ptr = lpPush(o->ptr,dec->ptr,sdslen(dec->ptr),LP_TAIL);
                 decrRefCount(dec);
                 decrRefCount(ele);
             } else {
@@ -921,8 +1190,12 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
     	//取出set的长度
         if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
 
-        /* Use a regular set when there are too many entries. */
-        if (len > server.set_max_intset_entries) {
+        /* Use a roaring or a regular set when there are too many entries. */
+        if (len > server.set_max_intset_entries &&
+            server.set_large_int_encoding == REDIS_ENCODING_ROARING) {
+            /* Converted to a regular set at the first non integer. */
+            o = createSetRoaringObject();
+        } else if (len > server.set_max_intset_entries) {
             o = createSetObject();
             /* It's faster to expand the dict to the right size asap in order
              * to avoid rehashing */
@@ -943,6 +1216,15 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 /* Fetch integer value from element */
                 if (isObjectRepresentableAsLongLong(ele,&llval) == REDIS_OK) {
                     o->ptr = intsetAdd(o->ptr,llval,NULL);
+                } else if (len <= server.set_max_listpack_entries) {
+                    setTypeConvert(o,REDIS_ENCODING_LISTPACK);
+                } else {
+                    setTypeConvert(o,REDIS_ENCODING_HT);
+                    dictExpand(o->ptr,len);
+                }
+            } else if (o->encoding == REDIS_ENCODING_ROARING) {
+                if (isObjectRepresentableAsLongLong(ele,&llval) == REDIS_OK) {
+                    roaringAdd(o->ptr,llval);
                 } else {
                     setTypeConvert(o,REDIS_ENCODING_HT);
                     dictExpand(o->ptr,len);
@@ -950,8 +1232,12 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
             }
 
             /* This will also be called when the set was just converted
-             * to regular hash table encoded set */
-            if (o->encoding == REDIS_ENCODING_HT) {
+             * to a listpack or to a regular hash table encoded set */
+            if (o->encoding == REDIS_ENCODING_LISTPACK) {
+                /* Converted to a hash table if the element is too long. */
+                setTypeAdd(o,ele);
+                decrRefCount(ele);
+            } else if (o->encoding == REDIS_ENCODING_HT) {
                 dictAdd((dict*)o->ptr,ele,NULL);
             } else {
                 decrRefCount(ele);
@@ -961,19 +1247,23 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         /* Read list/set value */
         size_t zsetlen;
         size_t maxelelen = 0;
-        zset *zs;
+        zslBulk bulk;
 
         //取出zset的大小
         if ((zsetlen = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
-        o = createZsetObject();
-        zs = o->ptr;
+        o = createZsetLargeObject();
+
+        /* Elements are saved in order, so they are appended. Files written
+         * by older versions are not ordered, and the bulk loader falls back
+         * to normal inserts at the first element out of order. */
+        //元素是按顺序保存的，批量追加；旧版本的文件无序，此时退化为普通的插入
+        zsetBulkInit(o,&bulk);
 
         /* Load every single element of the list/set */
-        //取出每个元素加到skiplist和dict中
+        //取出每个元素加到skiplist(或B+树)和dict中
         while(zsetlen--) {
             robj *ele;
             double score;
-            zskiplistNode *znode;
 
             if ((ele = rdbLoadEncodedStringObject(rdb)) == NULL) return NULL;
             ele = tryObjectEncoding(ele);
@@ -984,16 +1274,16 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 sdslen(ele->ptr) > maxelelen)
                     maxelelen = sdslen(ele->ptr);
 
-            znode = zslInsert(zs->zsl,score,ele);
-            dictAdd(zs->dict,ele,&znode->score);
-            incrRefCount(ele); /* added to skiplist */
+            zsetBulkAdd(o,&bulk,score,ele);
+            decrRefCount(ele);
         }
+        zsetBulkFinish(o,&bulk);
 
-        /* Convert *after* loading, since sorted sets are not stored ordered. */
-        //如果skiplist中的元素数量没有超过阀值，转化为ziplist来表示
+        /* Convert *after* loading, once the length of the elements is known. */
+        //如果skiplist中的元素数量没有超过阀值，转化为zpack来表示
         if (zsetLength(o) <= server.zset_max_ziplist_entries &&
             maxelelen <= server.zset_max_ziplist_value)
-                zsetConvert(o,REDIS_ENCODING_ZIPLIST);
+                zsetConvert(o,REDIS_ENCODING_ZPACK);
     } else if (rdbtype == REDIS_RDB_TYPE_HASH) {
         size_t len;
         int ret;
@@ -1009,9 +1299,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         if (len > server.hash_max_ziplist_entries)
             hashTypeConvert(o, REDIS_ENCODING_HT);
 
-        /* Load every field and value into the ziplist */
-        //将所有元素取出加到ziplist中
-        while (o->encoding == REDIS_ENCODING_ZIPLIST && len > 0) {
+        /* Load every field and value into the listpack */
+        //将所有元素取出加到listpack中
+        while (o->encoding == REDIS_ENCODING_LISTPACK && len > 0) {
             robj *field, *value;
 
             len--;
@@ -1023,11 +1313,11 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
             if (value == NULL) return NULL;
             redisAssert(field->encoding == REDIS_ENCODING_RAW);
 
-            /* Add pair to ziplist */
-            o->ptr = ziplistPush(o->ptr, field->ptr, sdslen(field->ptr), ZIPLIST_TAIL);
-            o->ptr = ziplistPush(o->ptr, value->ptr, sdslen(value->ptr), ZIPLIST_TAIL);
+            /* Add pair to listpack */
+            o->ptr = lpPush(o->ptr, field->ptr, sdslen(field->ptr), LP_TAIL);
+            o->ptr = lpPush(o->ptr, value->ptr, sdslen(value->ptr), LP_TAIL);
             /* Convert to hash table if size threshold is exceeded */
-            //如果值不是ziplist能够保存的，转化为hash table来保存
+            //如果值不是listpack能够保存的，转化为hash table来保存
             if (sdslen(field->ptr) > server.hash_max_ziplist_value ||
                 sdslen(value->ptr) > server.hash_max_ziplist_value)
             {
@@ -1067,7 +1357,12 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                rdbtype == REDIS_RDB_TYPE_LIST_ZIPLIST ||
                rdbtype == REDIS_RDB_TYPE_SET_INTSET   ||
                rdbtype == REDIS_RDB_TYPE_ZSET_ZIPLIST ||
-               rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST)
+               rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST ||
+               rdbtype == REDIS_RDB_TYPE_LIST_LISTPACK ||
+               rdbtype == REDIS_RDB_TYPE_ZSET_LISTPACK ||
+               rdbtype == REDIS_RDB_TYPE_HASH_LISTPACK ||
+               rdbtype == REDIS_RDB_TYPE_ZSET_ZPACK ||
+               rdbtype == REDIS_RDB_TYPE_SET_LISTPACK)
     {
     	//对于原来就是用内存数据结构的集合，以string的方式读出
         robj *aux = rdbLoadStringObject(rdb);
@@ -1087,11 +1382,11 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         //更正robj的类型码
         switch(rdbtype) {
             case REDIS_RDB_TYPE_HASH_ZIPMAP:
-                /* Convert to ziplist encoded hash. This must be deprecated
+                /* Convert to listpack encoded hash. This must be deprecated
                  * when loading dumps created by Redis 2.4 gets deprecated. */
-            	//zipmap在2.4后就过时了，将其转化为ziplist
+            	//zipmap在2.4后就过时了，将其转化为listpack
                 {
-                    unsigned char *zl = ziplistNew();
+                    unsigned char *lp = lpNew();
                     unsigned char *zi = zipmapRewind(o->ptr);
                     unsigned char *fstr, *vstr;
                     unsigned int flen, vlen;
@@ -1100,14 +1395,14 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     while ((zi = zipmapNext(zi, &fstr, &flen, &vstr, &vlen)) != NULL) {
                         if (flen > maxlen) maxlen = flen;
                         if (vlen > maxlen) maxlen = vlen;
-                        zl = ziplistPush(zl, fstr, flen, ZIPLIST_TAIL);
-                        zl = ziplistPush(zl, vstr, vlen, ZIPLIST_TAIL);
+                        lp = lpPush(lp, fstr, flen, LP_TAIL);
+                        lp = lpPush(lp, vstr, vlen, LP_TAIL);
                     }
 
                     zfree(o->ptr);
-                    o->ptr = zl;
+                    o->ptr = lp;
                     o->type = REDIS_HASH;
-                    o->encoding = REDIS_ENCODING_ZIPLIST;
+                    o->encoding = REDIS_ENCODING_LISTPACK;
 
                     if (hashTypeLength(o) > server.hash_max_ziplist_entries ||
                         maxlen > server.hash_max_ziplist_value)
@@ -1117,26 +1412,44 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 }
                 break;
             case REDIS_RDB_TYPE_LIST_ZIPLIST:
+            case REDIS_RDB_TYPE_LIST_LISTPACK:
+                if (rdbtype == REDIS_RDB_TYPE_LIST_ZIPLIST)
+                    o->ptr = rdbZiplistToListpack(o->ptr);
                 o->type = REDIS_LIST;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
-                if (ziplistLen(o->ptr) > server.list_max_ziplist_entries)
+                o->encoding = REDIS_ENCODING_LISTPACK;
+                if (lpLength(o->ptr) > server.list_max_ziplist_entries)
                     listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
                 break;
             case REDIS_RDB_TYPE_SET_INTSET:
                 o->type = REDIS_SET;
                 o->encoding = REDIS_ENCODING_INTSET;
                 if (intsetLen(o->ptr) > server.set_max_intset_entries)
+                    setTypeConvert(o,server.set_large_int_encoding);
+                break;
+            case REDIS_RDB_TYPE_SET_LISTPACK:
+                o->type = REDIS_SET;
+                o->encoding = REDIS_ENCODING_LISTPACK;
+                if (lpLength(o->ptr) > server.set_max_listpack_entries)
                     setTypeConvert(o,REDIS_ENCODING_HT);
                 break;
             case REDIS_RDB_TYPE_ZSET_ZIPLIST:
+            case REDIS_RDB_TYPE_ZSET_LISTPACK:
+            case REDIS_RDB_TYPE_ZSET_ZPACK:
+                if (rdbtype == REDIS_RDB_TYPE_ZSET_ZIPLIST)
+                    o->ptr = rdbZiplistToListpack(o->ptr);
+                if (rdbtype != REDIS_RDB_TYPE_ZSET_ZPACK)
+                    o->ptr = rdbListpackToZpack(o->ptr);
                 o->type = REDIS_ZSET;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
+                o->encoding = REDIS_ENCODING_ZPACK;
                 if (zsetLength(o) > server.zset_max_ziplist_entries)
-                    zsetConvert(o,REDIS_ENCODING_SKIPLIST);
+                    zsetConvert(o,server.zset_large_encoding);
                 break;
             case REDIS_RDB_TYPE_HASH_ZIPLIST:
+            case REDIS_RDB_TYPE_HASH_LISTPACK:
+                if (rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST)
+                    o->ptr = rdbZiplistToListpack(o->ptr);
                 o->type = REDIS_HASH;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
+                o->encoding = REDIS_ENCODING_LISTPACK;
                 if (hashTypeLength(o) > server.hash_max_ziplist_entries)
                     hashTypeConvert(o, REDIS_ENCODING_HT);
                 break;
@@ -1144,6 +1457,24 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 redisPanic("Unknown encoding");
                 break;
         }
+    } else if (rdbtype == REDIS_RDB_TYPE_SET_ROARING) {
+        /* Roarings are serialized in their own format, that is validated
+         * while loading it. */
+        //roaring以序列化后的格式保存, 读出时检查格式
+        robj *aux = rdbLoadStringObject(rdb);
+        roaring *r;
+
+        if (aux == NULL) return NULL;
+        r = roaringDeserialize(aux->ptr,sdslen(aux->ptr));
+        decrRefCount(aux);
+        if (r == NULL) return NULL;
+
+        /* Small sets become intsets, and big ones regular sets if roarings
+         * are no longer enabled. */
+        o = setTypeFromRoaring(r);
+        if (o->encoding == REDIS_ENCODING_ROARING &&
+            server.set_large_int_encoding != REDIS_ENCODING_ROARING)
+            setTypeConvert(o,server.set_large_int_encoding);
     } else {
         redisPanic("Unknown object type");
     }
@@ -1159,6 +1490,8 @@ void startLoading(FILE *fp) {
     /* Load the DB */
     server.loading = 1;
     server.loading_start_time = time(NULL);
+    server.loading_start_us = ustime();
+    server.loading_loaded_bytes = 0;
     if (fstat(fileno(fp), &sb) == -1) {
         server.loading_total_bytes = 1; /* just to avoid division by zero */
     } else {
@@ -1177,6 +1510,8 @@ void loadingProgress(off_t pos) {
 /* Loading finished */
 void stopLoading(void) {
     server.loading = 0;
+    server.loading_last_duration = (ustime()-server.loading_start_us)/1000;
+    server.loading_last_bytes = server.loading_total_bytes;
 }
 
 /* Track loading progress in order to serve client's from time to time
@@ -1198,6 +1533,34 @@ void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
     }
 }
 
+/* Load an AUX field, remembering the replication info and skipping the
+ * fields we don't understand. Returns -1 on read error. */
+//读取一个辅助字段
+static int rdbLoadAuxField(rio *rdb) {
+    robj *auxkey, *auxval;
+
+    if ((auxkey = rdbLoadStringObject(rdb)) == NULL) return -1;
+    if ((auxval = rdbLoadStringObject(rdb)) == NULL) {
+        decrRefCount(auxkey);
+        return -1;
+    }
+    if (!strcasecmp(auxkey->ptr,"repl-id") &&
+        sdslen(auxval->ptr) == REDIS_RUN_ID_SIZE)
+    {
+        memcpy(server.rdb_repl_runid,auxval->ptr,REDIS_RUN_ID_SIZE+1);
+    } else if (!strcasecmp(auxkey->ptr,"repl-offset")) {
+        server.rdb_repl_offset = strtoll(auxval->ptr,NULL,10);
+    } else if (!strcasecmp(auxkey->ptr,"repl-stream-db")) {
+        server.rdb_repl_stream_db = atoi(auxval->ptr);
+    } else {
+        redisLog(REDIS_DEBUG,"Unrecognized RDB AUX field: '%s'",
+            (char*)auxkey->ptr);
+    }
+    decrRefCount(auxkey);
+    decrRefCount(auxval);
+    return 0;
+}
+
 //从rdb文件中读取数据,创建成key保存在服务器
 int rdbLoad(char *filename) {
     uint32_t dbid;
@@ -1212,7 +1575,7 @@ int rdbLoad(char *filename) {
     if ((fp = fopen(filename,"r")) == NULL) return REDIS_ERR;
 
     //用rdb文件初始化rio
-    rioInitWithFile(&rdb,fp);
+    rioInitWithFd(&rdb,fileno(fp));
     rdb.update_cksum = rdbLoadProgressCallback;
     rdb.max_processing_chunk = server.loading_process_events_interval_bytes;
     //读取文件最开始9个字节
@@ -1220,6 +1583,7 @@ int rdbLoad(char *filename) {
     buf[9] = '\0';
     //不是REDIS开头，报错
     if (memcmp(buf,"REDIS",5) != 0) {
+        rioFreeFd(&rdb);
         fclose(fp);
         redisLog(REDIS_WARNING,"Wrong signature trying to load DB from file");
         errno = EINVAL;
@@ -1229,12 +1593,17 @@ int rdbLoad(char *filename) {
     //rdb版本不对，报错
     rdbver = atoi(buf+5);
     if (rdbver < 1 || rdbver > REDIS_RDB_VERSION) {
+        rioFreeFd(&rdb);
         fclose(fp);
         redisLog(REDIS_WARNING,"Can't handle RDB format version %d",rdbver);
         errno = EINVAL;
         return REDIS_ERR;
     }
 
+    server.rdb_repl_runid[0] = '\0';
+    server.rdb_repl_offset = -1;
+    server.rdb_repl_stream_db = 0;
+
     //初始化参数
     startLoading(fp);
     while(1) {
@@ -1275,6 +1644,13 @@ int rdbLoad(char *filename) {
             db = server.db+dbid;
             continue;
         }
+
+        /* AUX fields: remember the replication info, skip the others. */
+        //读取辅助字段
+        if (type == REDIS_RDB_OPCODE_AUX) {
+            if (rdbLoadAuxField(&rdb) == -1) goto eoferr;
+            continue;
+        }
         /* Read key */
         //取到key的名字
         if ((key = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
@@ -1317,8 +1693,180 @@ int rdbLoad(char *filename) {
         }
     }
 
+    rioFreeFd(&rdb);
+    fclose(fp);
+    stopLoading();
+    return REDIS_OK;
+
+eoferr: /* unexpected end of file is handled here with a fatal exit */
+    redisLog(REDIS_WARNING,"Short read or OOM loading DB. Unrecoverable error, aborting now.");
+    exit(1);
+    return REDIS_ERR; /* Just to avoid warning */
+}
+
+/* ----------------------------- Lazy loading -------------------------------
+ * When rdb-lazy-load is enabled the RDB file is mmap()ed at startup and only
+ * the keys and the expires are loaded: every value is a REDIS_ENCODING_LAZY
+ * object pointing to its entry inside the mapping, and it is loaded with
+ * rdbLoadObject() the first time the key is looked up. Values never touched
+ * are copied byte by byte from the mapping when saving the RDB file.
+ *
+ * The mapping is released when no lazy value references it anymore. Since
+ * Redis replaces the RDB file with rename(2) the mapped file is never
+ * modified while we use it, but other processes truncating it in place would
+ * make the server crash with SIGBUS on the next access.
+ * ------------------------------------------------------------------------- */
+
+/* Map the RDB file and load the keys, leaving the values in the mapping.
+ * The checksum is not verified since values are not read at all. */
+//映射rdb文件, 只载入键和过期时间, 值在第一次访问时才载入
+int rdbLoadLazy(char *filename) {
+    uint32_t dbid;
+    int type, rdbver;
+    redisDb *db = server.db+0;
+    long long expiretime, now = mstime();
+    off_t last_progress = 0;
+    unsigned char *map;
+    char buf[10];
+    struct stat sb;
+    FILE *fp;
+    rio rdb;
+
+    if ((fp = fopen(filename,"r")) == NULL) return REDIS_ERR;
+    if (fstat(fileno(fp),&sb) == -1 || sb.st_size < 9) {
+        fclose(fp);
+        errno = EINVAL;
+        return REDIS_ERR;
+    }
+    map = mmap(NULL,sb.st_size,PROT_READ,MAP_PRIVATE,fileno(fp),0);
+    if (map == MAP_FAILED) {
+        redisLog(REDIS_WARNING,"Unable to mmap() the RDB file, "
+                               "loading it in memory: %s", strerror(errno));
+        fclose(fp);
+        return rdbLoad(filename);
+    }
+    /* Keys are scanned sequentially, values are accessed in random order. */
+    madvise(map,sb.st_size,MADV_SEQUENTIAL);
+
+    rioInitWithMemory(&rdb,map,sb.st_size);
+    rdb.io.memory.pos = 9;
+    if (memcmp(map,"REDIS",5) != 0) {
+        munmap(map,sb.st_size);
+        fclose(fp);
+        redisLog(REDIS_WARNING,"Wrong signature trying to load DB from file");
+        errno = EINVAL;
+        return REDIS_ERR;
+    }
+    memcpy(buf,map,9);
+    buf[9] = '\0';
+    rdbver = atoi(buf+5);
+    if (rdbver < 1 || rdbver > REDIS_RDB_VERSION) {
+        munmap(map,sb.st_size);
+        fclose(fp);
+        redisLog(REDIS_WARNING,"Can't handle RDB format version %d",rdbver);
+        errno = EINVAL;
+        return REDIS_ERR;
+    }
+
+    server.rdb_repl_runid[0] = '\0';
+    server.rdb_repl_offset = -1;
+    server.rdb_repl_stream_db = 0;
+    server.rdb_lazy_map = map;
+    server.rdb_lazy_map_size = sb.st_size;
+
+    startLoading(fp);
+    while(1) {
+        robj *key, *val;
+        unsigned char *entry;
+        expiretime = -1;
+
+        if (server.loading_process_events_interval_bytes &&
+            rioTell(&rdb)-last_progress >=
+            (off_t)server.loading_process_events_interval_bytes)
+        {
+            updateCachedTime();
+            loadingProgress(rioTell(&rdb));
+            aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
+            last_progress = rioTell(&rdb);
+        }
+
+        if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
+        if (type == REDIS_RDB_OPCODE_EXPIRETIME) {
+            if ((expiretime = rdbLoadTime(&rdb)) == -1) goto eoferr;
+            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
+            expiretime *= 1000;
+        } else if (type == REDIS_RDB_OPCODE_EXPIRETIME_MS) {
+            if ((expiretime = rdbLoadMillisecondTime(&rdb)) == -1) goto eoferr;
+            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
+        }
+
+        if (type == REDIS_RDB_OPCODE_EOF)
+            break;
+
+        if (type == REDIS_RDB_OPCODE_SELECTDB) {
+            if ((dbid = rdbLoadLen(&rdb,NULL)) == REDIS_RDB_LENERR)
+                goto eoferr;
+            if (dbid >= (unsigned)server.dbnum) {
+                redisLog(REDIS_WARNING,"FATAL: Data file was created with a Redis server configured to handle more than %d databases. Exiting\n", server.dbnum);
+                exit(1);
+            }
+            db = server.db+dbid;
+            continue;
+        }
+
+        if (type == REDIS_RDB_OPCODE_AUX) {
+            if (rdbLoadAuxField(&rdb) == -1) goto eoferr;
+            continue;
+        }
+        if (!rdbIsObjectType(type)) goto eoferr;
+
+        /* Remember where the entry starts (its type byte), load the key
+         * and skip the value. */
+        //记录条目的起始位置(类型字节), 载入key并跳过值
+        entry = map+rioTell(&rdb)-1;
+        if ((key = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
+        if (rdbSkipObject(type,&rdb) == -1) {
+            decrRefCount(key);
+            goto eoferr;
+        }
+        if (server.masterhost == NULL && expiretime != -1 && expiretime < now) {
+            decrRefCount(key);
+            continue;
+        }
+
+        switch(type) {
+        case REDIS_RDB_TYPE_STRING: val = createObject(REDIS_STRING,entry); break;
+        case REDIS_RDB_TYPE_LIST:
+        case REDIS_RDB_TYPE_LIST_ZIPLIST:
+        case REDIS_RDB_TYPE_LIST_LISTPACK: val = createObject(REDIS_LIST,entry); break;
+        case REDIS_RDB_TYPE_SET:
+        case REDIS_RDB_TYPE_SET_INTSET:
+        case REDIS_RDB_TYPE_SET_LISTPACK:
+        case REDIS_RDB_TYPE_SET_ROARING: val = createObject(REDIS_SET,entry); break;
+        case REDIS_RDB_TYPE_ZSET:
+        case REDIS_RDB_TYPE_ZSET_ZIPLIST:
+        case REDIS_RDB_TYPE_ZSET_LISTPACK:
+        case REDIS_RDB_TYPE_ZSET_ZPACK: val = createObject(REDIS_ZSET,entry); break;
+        default: val = createObject(REDIS_HASH,entry); break;
+        }
+        val->encoding = REDIS_ENCODING_LAZY;
+        server.rdb_lazy_keys++;
+
+        dbAdd(db,key,val);
+        if (expiretime != -1) setExpire(db,key,expiretime);
+        decrRefCount(key);
+    }
+    madvise(map,sb.st_size,MADV_RANDOM);
     fclose(fp);
     stopLoading();
+    redisLog(REDIS_NOTICE,"RDB file mapped, %lld values will be loaded on "
+                          "first access (checksum not verified)",
+                          server.rdb_lazy_keys);
+    if (server.rdb_lazy_keys == 0) {
+        munmap(map,sb.st_size);
+        server.rdb_lazy_map = NULL;
+        server.rdb_lazy_map_size = 0;
+    }
     return REDIS_OK;
 
 eoferr: /* unexpected end of file is handled here with a fatal exit */
@@ -1327,6 +1875,37 @@ eoferr: /* unexpected end of file is handled here with a fatal exit */
     return REDIS_ERR; /* Just to avoid warning */
 }
 
+/* Load the value of the lazy object 'o' from the mapping and return it as
+ * a new object. The caller is responsible of replacing 'o' with it. */
+//从映射的rdb文件中载入惰性对象的值, 返回新的对象
+robj *rdbLoadLazyObject(robj *o) {
+    unsigned char *p = o->ptr;
+    int rdbtype;
+    robj *val;
+    rio rdb;
+
+    rioInitWithMemory(&rdb,p,server.rdb_lazy_map+server.rdb_lazy_map_size-p);
+    rdbtype = rdbLoadType(&rdb);
+    if (rdbSkipString(&rdb) == -1 ||
+        (val = rdbLoadObject(rdbtype,&rdb)) == NULL)
+    {
+        redisPanic("Corrupted lazy RDB entry");
+    }
+    val->lru = o->lru;
+    return val;
+}
+
+/* Called by decrRefCount() when a lazy object is freed: once no value
+ * references the mapping anymore it is released. */
+//惰性对象被释放时调用, 没有惰性对象时解除文件映射
+void rdbLazyObjectReleased(void) {
+    if (--server.rdb_lazy_keys > 0 || server.rdb_lazy_map == NULL) return;
+    munmap(server.rdb_lazy_map,server.rdb_lazy_map_size);
+    server.rdb_lazy_map = NULL;
+    server.rdb_lazy_map_size = 0;
+    redisLog(REDIS_NOTICE,"All the lazy values were loaded, RDB file unmapped");
+}
+
 /* A background saving child (BGSAVE) terminated its work. Handle this. */
 //在后台进程完成保存rdb后的处理函数
 void backgroundSaveDoneHandler(int exitcode, int bysignal) {
@@ -1358,7 +1937,7 @@ void backgroundSaveDoneHandler(int exitcode, int bysignal) {
 
 //save命令的实现
 void saveCommand(redisClient *c) {
-    if (server.rdb_child_pid != -1) {
+    if (server.rdb_child_pid != -1 || server.rdb_forkless_in_progress) {
         addReplyError(c,"Background save already in progress");
         return;
     }
@@ -1371,8 +1950,14 @@ void saveCommand(redisClient *c) {
 
 //bgsave命令的实现
 void bgsaveCommand(redisClient *c) {
-    if (server.rdb_child_pid != -1) {
+    if (server.rdb_child_pid != -1 || server.rdb_forkless_in_progress) {
         addReplyError(c,"Background save already in progress");
+    } else if (server.rdb_forkless) {
+        /* No child is involved, so an AOF rewrite is not a problem. */
+        if (snapshotStart(server.rdb_filename) == REDIS_OK)
+            addReplyStatus(c,"Background saving started");
+        else
+            addReply(c,shared.err);
     } else if (server.aof_child_pid != -1) {
         addReplyError(c,"Can't BGSAVE while AOF log rewriting is in progress");
     } else if (rdbSaveBackground(server.rdb_filename) == REDIS_OK) {
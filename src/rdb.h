@@ -38,7 +38,7 @@
 
 /* The current RDB version. When the format changes in a way that is no longer
  * backward compatible this number gets incremented. */
-#define REDIS_RDB_VERSION 6
+#define REDIS_RDB_VERSION 11
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -81,11 +81,25 @@
 #define REDIS_RDB_TYPE_SET_INTSET    11
 #define REDIS_RDB_TYPE_ZSET_ZIPLIST  12
 #define REDIS_RDB_TYPE_HASH_ZIPLIST  13
+/* Listpack encoded objects (RDB version 8). The ziplist types above are
+ * still loaded, converting the payload into a listpack. */
+#define REDIS_RDB_TYPE_LIST_LISTPACK 14
+#define REDIS_RDB_TYPE_ZSET_LISTPACK 15
+#define REDIS_RDB_TYPE_HASH_LISTPACK 16
+/* Zpack encoded sorted sets (RDB version 9). */
+#define REDIS_RDB_TYPE_ZSET_ZPACK    17
+/* Listpack encoded sets (RDB version 10). */
+#define REDIS_RDB_TYPE_SET_LISTPACK  18
+/* Roaring encoded sets (RDB version 11). */
+#define REDIS_RDB_TYPE_SET_ROARING   19
 
 /* Test if a type is an object type. */
-#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 13))
+#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 19))
 
-/* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
+/* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType).
+ * AUX fields (RDB version 7) are key/value string pairs carrying information
+ * about the saved instance, fields that are not understood are skipped. */
+#define REDIS_RDB_OPCODE_AUX        250
 #define REDIS_RDB_OPCODE_EXPIRETIME_MS 252
 #define REDIS_RDB_OPCODE_EXPIRETIME 253
 #define REDIS_RDB_OPCODE_SELECTDB   254
@@ -127,6 +141,9 @@ void rdbRemoveTempFile(pid_t childpid);
 //将服务器的数据以rdb形式保存到硬盘中给定文件
 int rdbSave(char *filename);
 
+//将复制信息以辅助字段的形式写进rdb
+int rdbSaveReplicationInfo(rio *rdb);
+
 //将一个robj对象保存到rdb中
 int rdbSaveObject(rio *rdb, robj *o);
 
@@ -148,4 +165,13 @@ int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val, long long expiretime, lo
 //从rdb读出redis string object
 robj *rdbLoadStringObject(rio *rdb);
 
+//映射rdb文件, 只载入键, 值在第一次访问时才载入
+int rdbLoadLazy(char *filename);
+
+//返回惰性对象载入后的新对象
+robj *rdbLoadLazyObject(robj *o);
+
+//惰性对象被释放时调用, 没有惰性对象时解除文件映射
+void rdbLazyObjectReleased(void);
+
 #endif
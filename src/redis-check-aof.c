@@ -146,27 +146,12 @@ off_t process(FILE *fp) {
     return pos;
 }
 
-int main(int argc, char **argv) {
-    char *filename;
-    int fix = 0;
-
-    if (argc < 2) {
-        printf("Usage: %s [--fix] <file.aof>\n", argv[0]);
-        exit(1);
-    } else if (argc == 2) {
-        filename = argv[1];
-    } else if (argc == 3) {
-        if (strcmp(argv[1],"--fix") != 0) {
-            printf("Invalid argument: %s\n", argv[1]);
-            exit(1);
-        }
-        filename = argv[2];
-        fix = 1;
-    } else {
-        printf("Invalid arguments\n");
-        exit(1);
-    }
-
+/* Check a single AOF file, truncating the invalid tail if 'fix' is true.
+ * Returns 1 if the file is valid or was fixed, 0 otherwise. Files that are
+ * not the last of a manifest can't be fixed: truncating them would make
+ * the following files apply on top of a different dataset. Empty files are
+ * only accepted inside a manifest, where incremental files often are. */
+int checkFile(char *filename, int fix, int fixable, int allow_empty) {
     FILE *fp = fopen(filename,"r+");
     if (fp == NULL) {
         printf("Cannot open file: %s\n", filename);
@@ -181,16 +166,22 @@ int main(int argc, char **argv) {
 
     off_t size = sb.st_size;
     if (size == 0) {
+        fclose(fp);
+        if (allow_empty) {
+            printf("AOF %s is empty\n", filename);
+            return 1;
+        }
         printf("Empty file: %s\n", filename);
         exit(1);
     }
 
+    error[0] = '\0';
     off_t pos = process(fp);
     off_t diff = size-pos;
     printf("AOF analyzed: size=%lld, ok_up_to=%lld, diff=%lld\n",
         (long long) size, (long long) pos, (long long) diff);
     if (diff > 0) {
-        if (fix) {
+        if (fix && fixable) {
             char buf[2];
             printf("This will shrink the AOF from %lld bytes, with %lld bytes, to %lld bytes\n",(long long)size,(long long)diff,(long long)pos);
             printf("Continue? [y/N]: ");
@@ -206,13 +197,96 @@ int main(int argc, char **argv) {
                 printf("Successfully truncated AOF\n");
             }
         } else {
+            if (fix) printf("Only the last file of a manifest can be fixed\n");
             printf("AOF is not valid\n");
-            exit(1);
+            fclose(fp);
+            return 0;
         }
     } else {
         printf("AOF is valid\n");
     }
 
     fclose(fp);
+    return 1;
+}
+
+/* Check every file listed by an AOF manifest, in the order Redis loads
+ * them. The file names are relative to the directory of the manifest. */
+int checkManifest(char *filename, int fix) {
+    FILE *fp = fopen(filename,"r");
+    char line[1024], dir[1024], path[2048], *files[1024], *p;
+    int numfiles = 0, j, valid = 1;
+    char *base = NULL;
+
+    if (fp == NULL) {
+        printf("Cannot open manifest: %s\n", filename);
+        exit(1);
+    }
+    snprintf(dir,sizeof(dir),"%s",filename);
+    if ((p = strrchr(dir,'/')) != NULL) p[1] = '\0'; else dir[0] = '\0';
+
+    while(fgets(line,sizeof(line),fp) != NULL) {
+        char kind[16], name[1024];
+
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (sscanf(line,"%15s %1023s",kind,name) != 2) {
+            printf("Invalid manifest line: %s", line);
+            exit(1);
+        }
+        if (!strcmp(kind,"seq")) continue;
+        snprintf(path,sizeof(path),"%s%s",dir,name);
+        if (!strcmp(kind,"base") && base == NULL) {
+            base = strdup(path);
+        } else if (!strcmp(kind,"incr") && numfiles < 1024) {
+            files[numfiles++] = strdup(path);
+        } else {
+            printf("Invalid manifest line: %s", line);
+            exit(1);
+        }
+    }
+    fclose(fp);
+
+    if (base) {
+        printf("Checking base file %s\n", base);
+        if (!checkFile(base,fix,numfiles == 0,1)) valid = 0;
+        free(base);
+    }
+    for (j = 0; j < numfiles; j++) {
+        printf("Checking incremental file %s\n", files[j]);
+        if (!checkFile(files[j],fix,j == numfiles-1,1)) valid = 0;
+        free(files[j]);
+    }
+    printf("AOF manifest %s\n", valid ? "is valid" : "is not valid");
+    return valid;
+}
+
+int main(int argc, char **argv) {
+    char *filename;
+    int fix = 0;
+    size_t len;
+
+    if (argc < 2) {
+        printf("Usage: %s [--fix] <file.aof|file.manifest>\n", argv[0]);
+        exit(1);
+    } else if (argc == 2) {
+        filename = argv[1];
+    } else if (argc == 3) {
+        if (strcmp(argv[1],"--fix") != 0) {
+            printf("Invalid argument: %s\n", argv[1]);
+            exit(1);
+        }
+        filename = argv[2];
+        fix = 1;
+    } else {
+        printf("Invalid arguments\n");
+        exit(1);
+    }
+
+    len = strlen(filename);
+    if (len > 9 && !strcmp(filename+len-9,".manifest")) {
+        if (!checkManifest(filename,fix)) exit(1);
+    } else {
+        if (!checkFile(filename,fix,1,0)) exit(1);
+    }
     return 0;
 }
@@ -53,6 +53,12 @@
 #define REDIS_SET_INTSET 11
 #define REDIS_ZSET_ZIPLIST 12
 #define REDIS_HASH_ZIPLIST 13
+#define REDIS_LIST_LISTPACK 14
+#define REDIS_ZSET_LISTPACK 15
+#define REDIS_HASH_LISTPACK 16
+#define REDIS_ZSET_ZPACK 17
+#define REDIS_SET_LISTPACK 18
+#define REDIS_SET_ROARING 19
 
 /* Objects encoding. Some kind of objects like Strings and Hashes can be
  * internally represented in multiple ways. The 'encoding' field of the object
@@ -63,6 +69,7 @@
 #define REDIS_ENCODING_HT 3     /* Encoded as a hash table */
 
 /* Object types only used for dumping to disk */
+#define REDIS_AUX 250
 #define REDIS_EXPIRETIME_MS 252
 #define REDIS_EXPIRETIME 253
 #define REDIS_SELECTDB 254
@@ -146,8 +153,9 @@ int checkType(unsigned char t) {
     /* In case a new object type is added, update the following 
      * condition as necessary. */
     return
-        (t >= REDIS_HASH_ZIPMAP && t <= REDIS_HASH_ZIPLIST) ||
+        (t >= REDIS_HASH_ZIPMAP && t <= REDIS_SET_ROARING) ||
         t <= REDIS_HASH ||
+        t == REDIS_AUX ||
         t >= REDIS_EXPIRETIME_MS;
 }
 
@@ -180,7 +188,7 @@ int processHeader() {
     }
 
     dump_version = (int)strtol(buf + 5, NULL, 10);
-    if (dump_version < 1 || dump_version > 6) {
+    if (dump_version < 1 || dump_version > 11) {
         ERROR("Unknown RDB format version: %d\n", dump_version);
     }
     return dump_version;
@@ -431,6 +439,12 @@ int loadPair(entry *e) {
     case REDIS_SET_INTSET:
     case REDIS_ZSET_ZIPLIST:
     case REDIS_HASH_ZIPLIST:
+    case REDIS_LIST_LISTPACK:
+    case REDIS_ZSET_LISTPACK:
+    case REDIS_HASH_LISTPACK:
+    case REDIS_ZSET_ZPACK:
+    case REDIS_SET_LISTPACK:
+    case REDIS_SET_ROARING:
         if (!processStringObject(NULL)) {
             SHIFT_ERROR(offset, "Error reading entry value");
             return 0;
@@ -505,6 +519,11 @@ entry loadEntry() {
             SHIFT_ERROR(offset[1], "Database number out of range (%d)", length);
             return e;
         }
+    } else if (e.type == REDIS_AUX) {
+        if (!processStringObject(NULL) || !processStringObject(NULL)) {
+            SHIFT_ERROR(offset[1], "Error reading AUX field");
+            return e;
+        }
     } else if (e.type == REDIS_EOF) {
         if (positions[level].offset < positions[level].size) {
             SHIFT_ERROR(offset[0], "Unexpected EOF");
@@ -752,6 +771,7 @@ int main(int argc, char **argv) {
     /* Object types only used for dumping to disk */
     sprintf(types[REDIS_EXPIRETIME], "EXPIRETIME");
     sprintf(types[REDIS_SELECTDB], "SELECTDB");
+    sprintf(types[REDIS_AUX], "AUX");
     sprintf(types[REDIS_EOF], "EOF");
 
     /* Double constants initialization */
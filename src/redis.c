@@ -30,6 +30,7 @@
 #include "redis.h"
 #include "slowlog.h"
 #include "bio.h"
+#include "crc64.h"
 
 #include <time.h>
 #include <signal.h>
@@ -171,6 +172,9 @@ struct redisCommand redisCommandTable[] = {
     {"zremrangebylex",zremrangebylexCommand,4,"w",0,NULL,1,1,1,0,0},
     {"zunionstore",zunionstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0},
     {"zinterstore",zinterstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0},
+    {"zunion",zunionCommand,-3,"r",0,zunionInterNoStoreGetKeys,0,0,0,0,0},
+    {"zinter",zinterCommand,-3,"r",0,zunionInterNoStoreGetKeys,0,0,0,0,0},
+    {"zintercard",zinterCardCommand,-3,"r",0,zunionInterNoStoreGetKeys,0,0,0,0,0},
     {"zrange",zrangeCommand,-4,"r",0,NULL,1,1,1,0,0},
     {"zrangebyscore",zrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0},
     {"zrevrangebyscore",zrevrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0},
@@ -554,7 +558,7 @@ dictType commandTableDictType = {
     NULL                       /* val destructor */
 };
 
-/* Hash type hash table (note that small hashes are represented with ziplists) */
+/* Hash type hash table (note that small hashes are represented with listpacks) */
 dictType hashDictType = {
     dictEncObjHash,             /* hash function */
     NULL,                       /* key dup */
@@ -634,10 +638,23 @@ int incrementallyRehash(int dbid) {
  * for dict.c to resize the hash tables accordingly to the fact we have o not
  * running childs. */
 void updateDictResizePolicy(void) {
-    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1)
+    int child = server.rdb_child_pid != -1 || server.aof_child_pid != -1 ||
+                server.child_info_type != CHILD_INFO_TYPE_NONE;
+
+    if (!child) {
         dictEnableResize();
-    else
+        dictEnableRehashStep();
+    } else {
         dictDisableResize();
+        /* Incremental rehashing performed by lookups and updates dirties
+         * pages as well: in COW aware mode suspend it while a child is
+         * alive (or, in the child itself, for its whole life). */
+        //COW感知模式下, 有子进程时暂停渐进式rehash
+        if (server.cow_aware_child)
+            dictDisableRehashStep();
+        else
+            dictEnableRehashStep();
+    }
 }
 
 /* ======================= Cron: called every 100 ms ======================== */
@@ -931,7 +948,9 @@ void databasesCron(void) {
     /* Perform hash tables rehashing if needed, but only if there are no
      * other processes saving the DB on disk. Otherwise rehashing is bad
      * as will cause a lot of copy-on-write of memory pages. */
-    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1) {
+    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1 &&
+        !server.rdb_forkless_in_progress)
+    {
         /* We use global counters so if we stop the computation at a given
          * DB we'll be able to start from the successive in the next
          * cron loop iteration. */
@@ -1081,21 +1100,31 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
         int statloc;
         pid_t pid;
 
+        //读取子进程汇报的copy-on-write内存大小
+        receiveChildInfo();
         if ((pid = wait3(&statloc,WNOHANG,NULL)) != 0) {
             int exitcode = WEXITSTATUS(statloc);
             int bysignal = 0;
             
             if (WIFSIGNALED(statloc)) bysignal = WTERMSIG(statloc);
 
+            /* Collect the final report sent just before exiting. */
+            receiveChildInfo();
             if (pid == server.rdb_child_pid) {
                 backgroundSaveDoneHandler(exitcode,bysignal);
+                if (!bysignal && exitcode == 0)
+                    server.stat_rdb_cow_bytes = server.stat_current_cow_bytes;
             } else if (pid == server.aof_child_pid) {
                 backgroundRewriteDoneHandler(exitcode,bysignal);
+                if (!bysignal && exitcode == 0)
+                    server.stat_aof_cow_bytes = server.stat_current_cow_bytes;
             } else {
                 redisLog(REDIS_WARNING,
                     "Warning, detected child with unmatched pid: %ld",
                     (long)pid);
             }
+            closeChildInfoPipe();
+            server.stat_current_cow_bytes = 0;
             updateDictResizePolicy();
         }
     } else {
@@ -1108,7 +1137,8 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
              * the given amount of seconds, and if the latest bgsave was
              * successful or if, in case of an error, at least
              * REDIS_BGSAVE_RETRY_DELAY seconds already elapsed. */
-            if (server.dirty >= sp->changes &&
+            if (!server.rdb_forkless_in_progress &&
+                server.dirty >= sp->changes &&
                 server.unixtime-server.lastsave > sp->seconds &&
                 (server.unixtime-server.lastbgsave_try >
                  REDIS_BGSAVE_RETRY_DELAY ||
@@ -1116,7 +1146,10 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
             {
                 redisLog(REDIS_NOTICE,"%d changes in %d seconds. Saving...",
                     sp->changes, (int)sp->seconds);
-                rdbSaveBackground(server.rdb_filename);
+                if (server.rdb_forkless)
+                    snapshotStart(server.rdb_filename);
+                else
+                    rdbSaveBackground(server.rdb_filename);
                 break;
             }
          }
@@ -1334,6 +1367,15 @@ void initServerConfig() {
     server.aof_selected_db = -1; /* Make sure the first time will not match */
     server.aof_flush_postponed_start = 0;
     server.aof_rewrite_incremental_fsync = REDIS_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC;
+    server.aof_threaded_write = REDIS_DEFAULT_AOF_THREADED_WRITE;
+    server.aof_use_manifest = REDIS_DEFAULT_AOF_USE_MANIFEST;
+    server.aof_rewrite_incr = NULL;
+    server.aof_writer_max_pending = REDIS_DEFAULT_AOF_WRITER_MAX_PENDING;
+    server.stat_aof_writer_batches = 0;
+    server.stat_aof_writer_last_batch_bytes = 0;
+    server.stat_aof_writer_pending = 0;
+    server.stat_aof_writer_last_latency = 0;
+    server.stat_aof_writer_max_latency = 0;
     server.pidfile = zstrdup(REDIS_DEFAULT_PID_FILE);
     server.rdb_filename = zstrdup(REDIS_DEFAULT_RDB_FILENAME);
     server.aof_filename = zstrdup(REDIS_DEFAULT_AOF_FILENAME);
@@ -1342,6 +1384,13 @@ void initServerConfig() {
     server.rdb_checksum = REDIS_DEFAULT_RDB_CHECKSUM;
     server.stop_writes_on_bgsave_err = REDIS_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR;
     server.activerehashing = REDIS_DEFAULT_ACTIVE_REHASHING;
+    server.cow_aware_child = REDIS_DEFAULT_COW_AWARE_CHILD;
+    server.rdb_forkless = REDIS_DEFAULT_RDB_FORKLESS;
+    server.rdb_lazy_load = REDIS_DEFAULT_RDB_LAZY_LOAD;
+    server.rdb_lazy_map = NULL;
+    server.rdb_lazy_map_size = 0;
+    server.rdb_lazy_keys = 0;
+    server.stat_rdb_lazy_loaded = 0;
     server.notify_keyspace_events = 0;
     server.maxclients = REDIS_MAX_CLIENTS;
     server.bpop_blocked_clients = 0;
@@ -1353,8 +1402,13 @@ void initServerConfig() {
     server.list_max_ziplist_entries = REDIS_LIST_MAX_ZIPLIST_ENTRIES;
     server.list_max_ziplist_value = REDIS_LIST_MAX_ZIPLIST_VALUE;
     server.set_max_intset_entries = REDIS_SET_MAX_INTSET_ENTRIES;
+    server.set_max_listpack_entries = REDIS_SET_MAX_LISTPACK_ENTRIES;
+    server.set_max_listpack_value = REDIS_SET_MAX_LISTPACK_VALUE;
+    server.set_large_int_encoding = REDIS_DEFAULT_SET_LARGE_INT_ENCODING;
     server.zset_max_ziplist_entries = REDIS_ZSET_MAX_ZIPLIST_ENTRIES;
     server.zset_max_ziplist_value = REDIS_ZSET_MAX_ZIPLIST_VALUE;
+    server.zset_large_encoding = REDIS_DEFAULT_ZSET_LARGE_ENCODING;
+    server.encoding_downgrade = REDIS_DEFAULT_ENCODING_DOWNGRADE;
     server.hll_sparse_max_bytes = REDIS_DEFAULT_HLL_SPARSE_MAX_BYTES;
     server.shutdown_asap = 0;
     server.repl_ping_slave_period = REDIS_REPL_PING_SLAVE_PERIOD;
@@ -1366,6 +1420,8 @@ void initServerConfig() {
     server.lua_client = NULL;
     server.lua_timedout = 0;
     server.loading_process_events_interval_bytes = (1024*1024*2);
+    server.loading_last_duration = 0;
+    server.loading_last_bytes = 0;
 
     updateLRUClock();
     resetServerSaveParams();
@@ -1380,6 +1436,9 @@ void initServerConfig() {
     server.master = NULL;
     server.cached_master = NULL;
     server.repl_master_initial_offset = -1;
+    server.rdb_repl_runid[0] = '\0';
+    server.rdb_repl_offset = -1;
+    server.rdb_repl_stream_db = 0;
     server.repl_state = REDIS_REPL_NONE;
     server.repl_syncio_timeout = REDIS_REPL_SYNCIO_TIMEOUT;
     server.repl_serve_stale_data = REDIS_DEFAULT_SLAVE_SERVE_STALE_DATA;
@@ -1393,7 +1452,18 @@ void initServerConfig() {
     server.repl_backlog = NULL;
     server.repl_backlog_size = REDIS_DEFAULT_REPL_BACKLOG_SIZE;
     server.repl_backlog_histlen = 0;
-    server.repl_backlog_idx = 0;
+    server.repl_buffer_blocks = listCreate();
+    server.repl_buffer_mem = 0;
+    server.repl_backlog_disk_size = REDIS_DEFAULT_REPL_BACKLOG_DISK_SIZE;
+    server.repl_backlog_disk_fd = -1;
+    server.repl_backlog_disk_off = 0;
+    server.repl_backlog_disk_histlen = 0;
+    server.repl_transfer_rate_limit = REDIS_DEFAULT_REPL_TRANSFER_RATE_LIMIT;
+    server.repl_transfer_slave_rate_limit =
+        REDIS_DEFAULT_REPL_TRANSFER_RATE_LIMIT;
+    server.repl_transfer_window_start = 0;
+    server.repl_transfer_window_bytes = 0;
+    server.repl_transfer_pacing_timer = -1;
     server.repl_backlog_off = 0;
     server.repl_backlog_time_limit = REDIS_DEFAULT_REPL_BACKLOG_TIME_LIMIT;
     server.repl_no_slaves_since = time(NULL);
@@ -1586,6 +1656,14 @@ void resetServerStats(void) {
     server.stat_sync_full = 0;
     server.stat_sync_partial_ok = 0;
     server.stat_sync_partial_err = 0;
+    server.stat_encoding_upgrades = 0;
+    server.stat_encoding_downgrades = 0;
+    server.stat_repl_transfer_bytes = 0;
+    server.stat_repl_transfer_rate = 0;
+    server.stat_repl_transfer_last_bytes = 0;
+    server.stat_repl_transfer_last_time = mstime();
+    server.stat_aof_writer_stalls = 0;
+    server.stat_aof_writer_stall_time = 0;
     memset(server.ops_sec_samples,0,sizeof(server.ops_sec_samples));
     server.ops_sec_idx = 0;
     server.ops_sec_last_sample_time = mstime();
@@ -1657,6 +1735,26 @@ void initServer() {
     server.cronloops = 0;
     server.rdb_child_pid = -1;
     server.aof_child_pid = -1;
+    server.aof_pipe_write_data_to_child = -1;
+    server.aof_pipe_read_data_from_parent = -1;
+    server.aof_pipe_write_ack_to_parent = -1;
+    server.aof_pipe_read_ack_from_child = -1;
+    server.aof_pipe_write_ack_to_child = -1;
+    server.aof_pipe_read_ack_from_parent = -1;
+    server.aof_stop_sending_diff = 0;
+    server.child_info_pipe[0] = server.child_info_pipe[1] = -1;
+    server.child_info_type = CHILD_INFO_TYPE_NONE;
+    server.stat_current_cow_bytes = 0;
+    server.stat_rdb_cow_bytes = 0;
+    server.stat_aof_cow_bytes = 0;
+    server.rdb_forkless_in_progress = 0;
+    server.stat_forkless_snapshots = 0;
+    server.stat_forkless_start_time = 0;
+    server.stat_forkless_max_step = 0;
+    server.stat_forkless_keys = 0;
+    server.stat_forkless_preimages = 0;
+    server.stat_forkless_tracked_keys = 0;
+    server.stat_forkless_peak_pending = 0;
     aofRewriteBufferReset();
     server.aof_buf = sdsempty();
     server.lastsave = time(NULL); /* At startup we consider the DB saved. */
@@ -1696,7 +1794,15 @@ void initServer() {
         acceptUnixHandler,NULL) == AE_ERR) redisPanic("Unrecoverable error creating server.sofd file event.");
 
     /* Open the AOF file if needed. */
-    if (server.aof_state == REDIS_AOF_ON) {
+    aofManifestClear(&server.aof_manifest);
+    server.aof_manifest.seq = 0;
+    if (server.aof_use_manifest) {
+        if (server.aof_state == REDIS_AOF_ON) {
+            if (aofManifestOpen() == REDIS_ERR) exit(1);
+        } else {
+            aofManifestLoad();
+        }
+    } else if (server.aof_state == REDIS_AOF_ON) {
         server.aof_fd = open(server.aof_filename,
                                O_WRONLY|O_APPEND|O_CREAT,0644);
         if (server.aof_fd == -1) {
@@ -1720,6 +1826,7 @@ void initServer() {
     scriptingInit();
     slowlogInit();
     bioInit();
+    aofWriterInit();
 }
 
 /* Populates the Redis Command Table starting from the hard coded list
@@ -1892,6 +1999,9 @@ void call(redisClient *c, int flags) {
     c->cmd->proc(c);
     duration = ustime()-start;
     dirty = server.dirty-dirty;
+    /* Commands like DEBUG LOADAOF reset server.dirty: a negative delta
+     * must not cause the command to be propagated. */
+    if (dirty < 0) dirty = 0;
 
     /* When EVAL is called loading the AOF we don't want commands called
      * from Lua to go into the slowlog or to populate statistics. */
@@ -2137,6 +2247,10 @@ int prepareForShutdown(int flags) {
         kill(server.rdb_child_pid,SIGUSR1);
         rdbRemoveTempFile(server.rdb_child_pid);
     }
+    if (server.rdb_forkless_in_progress) {
+        redisLog(REDIS_WARNING,"There is a fork-less snapshot in progress. Aborting it!");
+        snapshotAbort(0);
+    }
     if (server.aof_state != REDIS_AOF_OFF) {
         /* Kill the AOF saving child as the AOF we already have may be longer
          * but contains the full dataset anyway. */
@@ -2147,6 +2261,7 @@ int prepareForShutdown(int flags) {
         }
         /* Append only file: fsync() the AOF and exit */
         redisLog(REDIS_NOTICE,"Calling fsync() on the AOF file.");
+        aofWriterDrain();
         aof_fsync(server.aof_fd);
     }
     if ((server.saveparamslen > 0 && !nosave) || save) {
@@ -2269,6 +2384,12 @@ void bytesToHuman(char *s, unsigned long long n) {
     }
 }
 
+/* Loading throughput in megabytes per second. */
+static double loadingRate(off_t bytes, long long ms) {
+    if (ms <= 0) ms = 1;
+    return (double)bytes*1000/ms/(1024*1024);
+}
+
 /* Create the string returned by the INFO command. This is decoupled
  * by the INFO command itself as we need to report the same information
  * on memory corruption problems. */
@@ -2418,14 +2539,17 @@ sds genRedisInfoString(char *section) {
             "aof_last_rewrite_time_sec:%jd\r\n"
             "aof_current_rewrite_time_sec:%jd\r\n"
             "aof_last_bgrewrite_status:%s\r\n"
-            "aof_last_write_status:%s\r\n",
+            "aof_last_write_status:%s\r\n"
+            "current_cow_size:%zu\r\n"
+            "rdb_last_cow_size:%zu\r\n"
+            "aof_last_cow_size:%zu\r\n",
             server.loading,
             server.dirty,
-            server.rdb_child_pid != -1,
+            server.rdb_child_pid != -1 || server.rdb_forkless_in_progress,
             (intmax_t)server.lastsave,
             (server.lastbgsave_status == REDIS_OK) ? "ok" : "err",
             (intmax_t)server.rdb_save_time_last,
-            (intmax_t)((server.rdb_child_pid == -1) ?
+            (intmax_t)((server.rdb_save_time_start == -1) ?
                 -1 : time(NULL)-server.rdb_save_time_start),
             server.aof_state != REDIS_AOF_OFF,
             server.aof_child_pid != -1,
@@ -2434,7 +2558,40 @@ sds genRedisInfoString(char *section) {
             (intmax_t)((server.aof_child_pid == -1) ?
                 -1 : time(NULL)-server.aof_rewrite_time_start),
             (server.aof_lastbgrewrite_status == REDIS_OK) ? "ok" : "err",
-            (server.aof_last_write_status == REDIS_OK) ? "ok" : "err");
+            (server.aof_last_write_status == REDIS_OK) ? "ok" : "err",
+            server.stat_current_cow_bytes,
+            server.stat_rdb_cow_bytes,
+            server.stat_aof_cow_bytes);
+
+        if (server.rdb_forkless || server.stat_forkless_snapshots) {
+            info = sdscatprintf(info,
+                "rdb_forkless_snapshot:%d\r\n"
+                "rdb_forkless_start_usec:%lld\r\n"
+                "rdb_forkless_max_step_usec:%lld\r\n"
+                "rdb_forkless_keys_saved:%lld\r\n"
+                "rdb_forkless_preimages:%lld\r\n"
+                "rdb_forkless_tracked_keys:%lld\r\n"
+                "rdb_forkless_pending_bytes:%zu\r\n"
+                "rdb_forkless_peak_pending_bytes:%zu\r\n",
+                server.rdb_forkless,
+                server.stat_forkless_start_time,
+                server.stat_forkless_max_step,
+                server.stat_forkless_keys,
+                server.stat_forkless_preimages,
+                server.stat_forkless_tracked_keys,
+                snapshotPendingBytes(),
+                server.stat_forkless_peak_pending);
+        }
+
+        if (server.rdb_lazy_load || server.stat_rdb_lazy_loaded) {
+            info = sdscatprintf(info,
+                "rdb_lazy_keys:%lld\r\n"
+                "rdb_lazy_loaded:%lld\r\n"
+                "rdb_lazy_mapped_bytes:%zu\r\n",
+                server.rdb_lazy_keys,
+                server.stat_rdb_lazy_loaded,
+                server.rdb_lazy_map_size);
+        }
 
         if (server.aof_state != REDIS_AOF_OFF) {
             info = sdscatprintf(info,
@@ -2452,6 +2609,32 @@ sds genRedisInfoString(char *section) {
                 aofRewriteBufferSize(),
                 bioPendingJobsOfType(REDIS_BIO_AOF_FSYNC),
                 server.aof_delayed_fsync);
+
+            if (server.aof_use_manifest) {
+                info = sdscatprintf(info,
+                    "aof_manifest_base:%s\r\n"
+                    "aof_manifest_incr_files:%lu\r\n",
+                    server.aof_manifest.base ? server.aof_manifest.base : "",
+                    listLength(server.aof_manifest.incrs));
+            }
+
+            if (server.aof_threaded_write) {
+                info = sdscatprintf(info,
+                    "aof_writer_pending_bytes:%zu\r\n"
+                    "aof_writer_batches:%llu\r\n"
+                    "aof_writer_last_batch_bytes:%zu\r\n"
+                    "aof_writer_last_latency_usec:%lld\r\n"
+                    "aof_writer_max_latency_usec:%lld\r\n"
+                    "aof_writer_stalls:%lld\r\n"
+                    "aof_writer_stall_time_usec:%lld\r\n",
+                    server.stat_aof_writer_pending,
+                    server.stat_aof_writer_batches,
+                    server.stat_aof_writer_last_batch_bytes,
+                    server.stat_aof_writer_last_latency,
+                    server.stat_aof_writer_max_latency,
+                    server.stat_aof_writer_stalls,
+                    server.stat_aof_writer_stall_time);
+            }
         }
 
         if (server.loading) {
@@ -2464,7 +2647,7 @@ sds genRedisInfoString(char *section) {
                    server.loading_total_bytes) * 100;
 
             elapsed = server.unixtime-server.loading_start_time;
-            if (elapsed == 0) {
+            if (elapsed == 0 || server.loading_loaded_bytes == 0) {
                 eta = 1; /* A fake 1 second figure if we don't have
                             enough info */
             } else {
@@ -2476,14 +2659,25 @@ sds genRedisInfoString(char *section) {
                 "loading_total_bytes:%llu\r\n"
                 "loading_loaded_bytes:%llu\r\n"
                 "loading_loaded_perc:%.2f\r\n"
-                "loading_eta_seconds:%jd\r\n",
+                "loading_eta_seconds:%jd\r\n"
+                "loading_rate_mbps:%.2f\r\n",
                 (intmax_t) server.loading_start_time,
                 (unsigned long long) server.loading_total_bytes,
                 (unsigned long long) server.loading_loaded_bytes,
                 perc,
-                (intmax_t)eta
+                (intmax_t)eta,
+                loadingRate(server.loading_loaded_bytes,
+                    (ustime()-server.loading_start_us)/1000)
             );
         }
+
+        /* Throughput of the last RDB or AOF file loaded. */
+        info = sdscatprintf(info,
+            "loading_last_duration_ms:%lld\r\n"
+            "loading_last_rate_mbps:%.2f\r\n",
+            server.loading_last_duration,
+            loadingRate(server.loading_last_bytes,
+                server.loading_last_duration));
     }
 
     /* Stats */
@@ -2504,7 +2698,9 @@ sds genRedisInfoString(char *section) {
             "keyspace_misses:%lld\r\n"
             "pubsub_channels:%ld\r\n"
             "pubsub_patterns:%lu\r\n"
-            "latest_fork_usec:%lld\r\n",
+            "latest_fork_usec:%lld\r\n"
+            "encoding_upgrades:%lld\r\n"
+            "encoding_downgrades:%lld\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getOperationsPerSecond(),
@@ -2518,7 +2714,9 @@ sds genRedisInfoString(char *section) {
             server.stat_keyspace_misses,
             dictSize(server.pubsub_channels),
             listLength(server.pubsub_patterns),
-            server.stat_fork_time);
+            server.stat_fork_time,
+            server.stat_encoding_upgrades,
+            server.stat_encoding_downgrades);
     }
 
     /* Replication */
@@ -2631,12 +2829,24 @@ sds genRedisInfoString(char *section) {
             "repl_backlog_active:%d\r\n"
             "repl_backlog_size:%lld\r\n"
             "repl_backlog_first_byte_offset:%lld\r\n"
-            "repl_backlog_histlen:%lld\r\n",
+            "repl_backlog_histlen:%lld\r\n"
+            "repl_buffer_blocks:%lu\r\n"
+            "repl_buffer_memory:%zu\r\n"
+            "repl_backlog_disk_first_byte_offset:%lld\r\n"
+            "repl_backlog_disk_histlen:%lld\r\n"
+            "repl_transfer_bytes:%lld\r\n"
+            "repl_transfer_rate_kbps:%.2f\r\n",
             server.master_repl_offset,
             server.repl_backlog != NULL,
             server.repl_backlog_size,
             server.repl_backlog_off,
-            server.repl_backlog_histlen);
+            server.repl_backlog_histlen,
+            listLength(server.repl_buffer_blocks),
+            server.repl_buffer_mem,
+            server.repl_backlog_disk_off,
+            server.repl_backlog_disk_histlen,
+            server.stat_repl_transfer_bytes,
+            (float)server.stat_repl_transfer_rate/1024);
     }
 
     /* CPU */
@@ -2744,11 +2954,22 @@ int freeMemoryIfNeeded(void) {
         while((ln = listNext(&li))) {
             redisClient *slave = listNodeValue(ln);
             unsigned long obuf_bytes = getClientOutputBufferMemoryUsage(slave);
+
+            /* The shared replication buffer is accounted only once below. */
+            obuf_bytes -= replBufferSlavePending(slave);
             if (obuf_bytes > mem_used)
                 mem_used = 0;
             else
                 mem_used -= obuf_bytes;
         }
+        /* Blocks retained only because slaves did not read them yet are
+         * not part of the backlog, treat them like output buffers. */
+        //共享复制缓冲区中超出积压区大小的部分不计入已用内存
+        if (server.repl_buffer_mem > (size_t)server.repl_backlog_size) {
+            size_t extra = server.repl_buffer_mem - server.repl_backlog_size;
+
+            mem_used = (extra > mem_used) ? 0 : mem_used - extra;
+        }
     }
     if (server.aof_state != REDIS_AOF_OFF) {
         mem_used -= sdslen(server.aof_buf);
@@ -3015,12 +3236,15 @@ int checkForSentinelMode(int argc, char **argv) {
 void loadDataFromDisk(void) {
     long long start = ustime();
     if (server.aof_state == REDIS_AOF_ON) {
-        if (loadAppendOnlyFile(server.aof_filename) == REDIS_OK)
+        if (loadAppendOnlyFiles() == REDIS_OK)
             redisLog(REDIS_NOTICE,"DB loaded from append only file: %.3f seconds",(float)(ustime()-start)/1000000);
     } else {
-        if (rdbLoad(server.rdb_filename) == REDIS_OK) {
+        int retval = server.rdb_lazy_load ? rdbLoadLazy(server.rdb_filename) :
+                                            rdbLoad(server.rdb_filename);
+        if (retval == REDIS_OK) {
             redisLog(REDIS_NOTICE,"DB loaded from disk: %.3f seconds",
                 (float)(ustime()-start)/1000000);
+            replicationCacheMasterFromRdb();
         } else if (errno != ENOENT) {
             redisLog(REDIS_WARNING,"Fatal error loading the DB: %s. Exiting.",strerror(errno));
             exit(1);
@@ -3055,6 +3279,7 @@ int main(int argc, char **argv) {
     setlocale(LC_COLLATE,"");
     zmalloc_enable_thread_safeness();
     zmalloc_set_oom_handler(redisOutOfMemoryHandler);
+    crc64_init();
     srand(time(NULL)^getpid());
     gettimeofday(&tv,NULL);
     dictSetHashFunctionSeed(tv.tv_sec^tv.tv_usec^getpid());
@@ -57,8 +57,11 @@
 #include "adlist.h"  /* Linked lists */
 #include "zmalloc.h" /* total memory usage aware version of malloc/free */
 #include "anet.h"    /* Networking the easy way */
-#include "ziplist.h" /* Compact list data structure */
+#include "ziplist.h" /* Compact list data structure, only read in old RDB files */
+#include "listpack.h" /* Compact list data structure */
+#include "zpack.h"    /* Compact sorted set data structure */
 #include "intset.h"  /* Compact integer set structure */
+#include "roaring.h" /* Compressed large integer set structure */
 #include "version.h" /* Version macro */
 #include "util.h"    /* Misc functions useful in many places */
 
@@ -98,6 +101,11 @@
 #define REDIS_DEFAULT_REPL_BACKLOG_SIZE (1024*1024)    /* 1mb */
 #define REDIS_DEFAULT_REPL_BACKLOG_TIME_LIMIT (60*60)  /* 1 hour */
 #define REDIS_REPL_BACKLOG_MIN_SIZE (1024*16)          /* 16k */
+#define REDIS_REPL_BUFFER_BLOCK_SIZE (1024*16)   /* Shared repl buffer block */
+#define REDIS_DEFAULT_REPL_BACKLOG_DISK_SIZE 0   /* Disk backlog disabled. */
+#define REDIS_REPL_TRANSFER_CHUNK (1024*256) /* RDB bytes sent per event. */
+#define REDIS_REPL_TRANSFER_WINDOW 100  /* Rate limits window, milliseconds. */
+#define REDIS_DEFAULT_REPL_TRANSFER_RATE_LIMIT 0 /* Unlimited. */
 #define REDIS_BGSAVE_RETRY_DELAY 5 /* Wait a few secs before trying again. */
 #define REDIS_DEFAULT_PID_FILE "/var/run/redis.pid"
 #define REDIS_DEFAULT_SYSLOG_IDENT "redis"
@@ -119,7 +127,13 @@
 #define REDIS_DEFAULT_AOF_FILENAME "appendonly.aof"
 #define REDIS_DEFAULT_AOF_NO_FSYNC_ON_REWRITE 0
 #define REDIS_DEFAULT_ACTIVE_REHASHING 1
+#define REDIS_DEFAULT_COW_AWARE_CHILD 1
+#define REDIS_DEFAULT_RDB_FORKLESS 0
+#define REDIS_DEFAULT_RDB_LAZY_LOAD 0
 #define REDIS_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC 1
+#define REDIS_DEFAULT_AOF_THREADED_WRITE 0
+#define REDIS_DEFAULT_AOF_USE_MANIFEST 0
+#define REDIS_DEFAULT_AOF_WRITER_MAX_PENDING (1024*1024*64) /* 64 MB */
 #define REDIS_DEFAULT_MIN_SLAVES_TO_WRITE 0
 #define REDIS_DEFAULT_MIN_SLAVES_MAX_LAG 10
 #define REDIS_IP_STR_LEN INET6_ADDRSTRLEN
@@ -183,9 +197,13 @@
 #define REDIS_ENCODING_HT 2      /* Encoded as hash table */
 #define REDIS_ENCODING_ZIPMAP 3  /* Encoded as zipmap */
 #define REDIS_ENCODING_LINKEDLIST 4 /* Encoded as regular linked list */
-#define REDIS_ENCODING_ZIPLIST 5 /* Encoded as ziplist */
+#define REDIS_ENCODING_LISTPACK 5 /* Encoded as listpack */
 #define REDIS_ENCODING_INTSET 6  /* Encoded as intset */
 #define REDIS_ENCODING_SKIPLIST 7  /* Encoded as skiplist */
+#define REDIS_ENCODING_LAZY 8  /* Not loaded yet, ptr is inside the mmap()ed RDB */
+#define REDIS_ENCODING_ZPACK 9  /* Encoded as zpack */
+#define REDIS_ENCODING_BTREE 10  /* Encoded as B+tree */
+#define REDIS_ENCODING_ROARING 11  /* Encoded as roaring bitmap */
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -313,8 +331,16 @@
 #define REDIS_LIST_MAX_ZIPLIST_ENTRIES 512
 #define REDIS_LIST_MAX_ZIPLIST_VALUE 64
 #define REDIS_SET_MAX_INTSET_ENTRIES 512
+#define REDIS_SET_MAX_LISTPACK_ENTRIES 128
+#define REDIS_SET_MAX_LISTPACK_VALUE 64
+#define REDIS_DEFAULT_SET_LARGE_INT_ENCODING REDIS_ENCODING_HT
 #define REDIS_ZSET_MAX_ZIPLIST_ENTRIES 128
 #define REDIS_ZSET_MAX_ZIPLIST_VALUE 64
+#define REDIS_DEFAULT_ZSET_LARGE_ENCODING REDIS_ENCODING_SKIPLIST
+#define REDIS_DEFAULT_ENCODING_DOWNGRADE 1
+/* Collections shrinking to 1/REDIS_DOWNGRADE_RATIO of the compact limits are
+ * converted back to the compact encoding. */
+#define REDIS_DOWNGRADE_RATIO 2
 
 /* HyperLogLog defines */
 #define REDIS_DEFAULT_HLL_SPARSE_MAX_BYTES 3000
@@ -461,6 +487,17 @@ typedef struct readyList {
     robj *key;
 } readyList;
 
+/* The replication stream is appended once to a list of blocks shared by the
+ * backlog and by all the slaves. Every reader holds a reference to the block
+ * containing the next byte it needs: blocks are released once no reader
+ * references them or an older block. */
+typedef struct replBufBlock {
+    int refcount;           /* Readers positioned inside this block. */
+    long long repl_offset;  /* Replication offset of the first byte. */
+    size_t size, used;
+    char buf[];
+} replBufBlock;
+
 /* With multiplexing we need to take per-client state.
  * Clients are taken in a liked list. */
 typedef struct redisClient {
@@ -489,11 +526,19 @@ typedef struct redisClient {
     int repldbfd;           /* replication DB file descriptor */
     off_t repldboff;        /* replication DB file offset */
     off_t repldbsize;       /* replication DB file size */
+    long long repldb_window_start; /* Start of the rate limit window, ms. */
+    long long repldb_window_bytes; /* RDB bytes sent in the window. */
+    int repldb_throttled;   /* Transfer paused because of rate limits. */
     long long reploff;      /* replication offset if this is our master */
     long long repl_ack_off; /* replication ack offset, if this is a slave */
     long long repl_ack_time;/* replication ack time, if this is a slave */
     char replrunid[REDIS_RUN_ID_SIZE+1]; /* master run id if this is a master */
     int slave_listening_port; /* As configured with: SLAVECONF listening-port */
+    listNode *ref_repl_buf_node; /* Slave: block of the shared replication
+                                    buffer holding the next byte to send. */
+    size_t ref_block_pos;   /* Slave: next byte to send inside that block. */
+    long long repl_disk_off; /* Slave: next offset to send from the disk
+                                backlog, -1 if not reading from disk. */
     multiState mstate;      /* MULTI/EXEC state */
     blockingState bpop;   /* blocking state */
     list *watched_keys;     /* Keys WATCHED for MULTI/EXEC CAS */
@@ -542,11 +587,67 @@ typedef struct zskiplist {
     int level;
 } zskiplist;
 
+/* Large sorted sets can also use a B+tree ordered by (score, member). Nodes
+ * are fat: a leaf keeps up to ZBTREE_LEAF_MAX elements in two parallel arrays,
+ * so a binary search or a range scan walks contiguous memory, and there is no
+ * per element allocation. Inner nodes store, for every child, the number of
+ * elements in its subtree (so that ranks are computed in O(log N)) and the
+ * smallest key of the subtree, that is used to route lookups. The separator
+ * of child 0 is never used and is always NULL. Separators hold a reference to
+ * the member object, so they remain valid after the element is deleted. */
+//B+树：叶子节点用两个数组存放score和成员，内部节点记录每个子树的元素个数和最小键
+#define ZBTREE_LEAF_MAX 62     /* A leaf is 1016 bytes, within 1024 bytes. */
+#define ZBTREE_INNER_MAX 64
+
+typedef struct zbtreeNode {
+    int leaf;   /* 1 for leaves, 0 for inner nodes. */
+    int num;    /* Elements in a leaf, children in an inner node. */
+} zbtreeNode;
+
+typedef struct zbtreeLeaf {
+    zbtreeNode hdr;
+    struct zbtreeLeaf *prev, *next;
+    double score[ZBTREE_LEAF_MAX];
+    robj *obj[ZBTREE_LEAF_MAX];
+} zbtreeLeaf;
+
+typedef struct zbtreeInner {
+    zbtreeNode hdr;
+    /* One spare slot is used while splitting. */
+    unsigned long size[ZBTREE_INNER_MAX+1];
+    double score[ZBTREE_INNER_MAX+1];
+    robj *obj[ZBTREE_INNER_MAX+1];
+    zbtreeNode *child[ZBTREE_INNER_MAX+1];
+} zbtreeInner;
+
+typedef struct zbtree {
+    zbtreeNode *root;
+    zbtreeLeaf *head, *tail;
+    unsigned long length;
+} zbtree;
+
+/* Position of an element inside the B+tree: its leaf and its slot. */
+typedef struct zbtreePos {
+    zbtreeLeaf *leaf;   /* NULL past the first or the last element. */
+    int idx;
+} zbtreePos;
+
+#define zbtreePosScore(p) ((p)->leaf->score[(p)->idx])
+#define zbtreePosObj(p) ((p)->leaf->obj[(p)->idx])
+
+/* The dictionary maps members to scores. With the skiplist encoding the value
+ * points to the score stored in the skiplist node, with the B+tree encoding
+ * elements move between nodes, so the score is stored in the entry itself. */
+//skiplist编码时dict的值指向节点中的score，B+树编码时score直接保存在dictEntry中
 typedef struct zset {
     dict *dict;
-    zskiplist *zsl;
+    zskiplist *zsl;     /* Only used by the skiplist encoding. */
+    zbtree *zbt;        /* Only used by the B+tree encoding. */
 } zset;
 
+#define zsetDictGetScore(zobj,de) ((zobj)->encoding == REDIS_ENCODING_BTREE ? \
+    dictGetDoubleVal(de) : *(double*)dictGetVal(de))
+
 typedef struct clientBufferLimitsConfig {
     unsigned long long hard_limit_bytes;
     unsigned long long soft_limit_bytes;
@@ -579,6 +680,13 @@ typedef struct redisOpArray {
     int numops;
 } redisOpArray;
 
+/* Files composing a multi part AOF, see the manifest section of aof.c. */
+typedef struct aofManifest {
+    sds base;               /* Base file produced by the last rewrite or NULL. */
+    list *incrs;            /* Incremental files (sds names), oldest first. */
+    long long seq;          /* Last sequence number used for a file name. */
+} aofManifest;
+
 /*-----------------------------------------------------------------------------
  * Global server state
  *----------------------------------------------------------------------------*/
@@ -620,6 +728,9 @@ struct redisServer {
     off_t loading_total_bytes;
     off_t loading_loaded_bytes;
     time_t loading_start_time;
+    long long loading_start_us;     /* Used to compute the loading rate. */
+    long long loading_last_duration; /* Duration of the last load, in ms. */
+    off_t loading_last_bytes;       /* Size of the last file loaded. */
     off_t loading_process_events_interval_bytes;
     /* Fast pointers to often looked up command */
     struct redisCommand *delCommand, *multiCommand, *lpushCommand, *lpopCommand,
@@ -638,6 +749,12 @@ struct redisServer {
     long long stat_sync_full;       /* Number of full resyncs with slaves. */
     long long stat_sync_partial_ok; /* Number of accepted PSYNC requests. */
     long long stat_sync_partial_err;/* Number of unaccepted PSYNC requests. */
+    long long stat_encoding_upgrades;   /* Compact to large conversions. */
+    long long stat_encoding_downgrades; /* Large to compact conversions. */
+    long long stat_repl_transfer_bytes; /* RDB bytes sent to slaves. */
+    long long stat_repl_transfer_rate;  /* Bytes/sec during the last second. */
+    long long stat_repl_transfer_last_bytes; /* Used to compute the rate. */
+    long long stat_repl_transfer_last_time;  /* Used to compute the rate. */
     list *slowlog;                  /* SLOWLOG list of commands */
     long long slowlog_entry_id;     /* SLOWLOG current entry ID */
     long long slowlog_log_slower_than; /* SLOWLOG time limit (to get logged) */
@@ -682,6 +799,28 @@ struct redisServer {
     int aof_rewrite_incremental_fsync;/* fsync incrementally while rewriting? */
     int aof_last_write_status;      /* REDIS_OK or REDIS_ERR */
     int aof_last_write_errno;       /* Valid if aof_last_write_status is ERR */
+    /* AOF pipes used to communicate between parent and child during rewrite. */
+    int aof_pipe_write_data_to_child;
+    int aof_pipe_read_data_from_parent;
+    int aof_pipe_write_ack_to_parent;
+    int aof_pipe_read_ack_from_child;
+    int aof_pipe_write_ack_to_child;
+    int aof_pipe_read_ack_from_parent;
+    int aof_stop_sending_diff;     /* If true stop sending accumulated diffs
+                                      to child process. */
+    sds aof_child_diff;             /* AOF diff accumulator child side. */
+    int aof_use_manifest;           /* Multi part AOF tracked by a manifest. */
+    aofManifest aof_manifest;       /* Files of the multi part AOF. */
+    sds aof_rewrite_incr;           /* Incr file opened by running rewrite. */
+    int aof_threaded_write;         /* Write the AOF from a dedicated thread. */
+    size_t aof_writer_max_pending;  /* Max bytes queued to the AOF writer. */
+    unsigned long long stat_aof_writer_batches; /* AOF writer write batches. */
+    size_t stat_aof_writer_last_batch_bytes; /* Size of last written batch. */
+    size_t stat_aof_writer_pending; /* Bytes queued but not yet written. */
+    long long stat_aof_writer_last_latency; /* Last batch write+fsync usec. */
+    long long stat_aof_writer_max_latency;  /* Max batch write+fsync usec. */
+    long long stat_aof_writer_stalls;       /* Back-pressure waits. */
+    long long stat_aof_writer_stall_time;   /* Usec spent in such waits. */
     /* RDB persistence */
     long long dirty;                /* Changes to DB from the last save */
     long long dirty_before_bgsave;  /* Used to restore dirty on failed BGSAVE */
@@ -697,6 +836,29 @@ struct redisServer {
     time_t rdb_save_time_start;     /* Current RDB save start time. */
     int lastbgsave_status;          /* REDIS_OK or REDIS_ERR */
     int stop_writes_on_bgsave_err;  /* Don't allow writes if can't BGSAVE */
+    /* Lazy loading of the RDB file at startup */
+    int rdb_lazy_load;              /* mmap() the RDB, load values on access. */
+    unsigned char *rdb_lazy_map;    /* Mapped RDB file, NULL if none. */
+    size_t rdb_lazy_map_size;       /* Size of the mapping. */
+    long long rdb_lazy_keys;        /* Values still pointing in the mapping. */
+    long long stat_rdb_lazy_loaded; /* Values loaded on first access. */
+    /* Copy on write accounting of persistence children */
+    int cow_aware_child;            /* Avoid dirtying pages shared with a child. */
+    int child_info_pipe[2];         /* Pipe used by the child to report info. */
+    int child_info_type;            /* In the child: CHILD_INFO_TYPE_* sent. */
+    size_t stat_current_cow_bytes;  /* Last COW size reported by running child. */
+    size_t stat_rdb_cow_bytes;      /* COW size of last successful BGSAVE. */
+    size_t stat_aof_cow_bytes;      /* COW size of last successful rewrite. */
+    /* Fork-less snapshots */
+    int rdb_forkless;               /* BGSAVE without forking. */
+    int rdb_forkless_in_progress;   /* A fork-less snapshot is running. */
+    long long stat_forkless_snapshots;      /* Number of snapshots started. */
+    long long stat_forkless_start_time;     /* Usec needed to start the last one. */
+    long long stat_forkless_max_step;       /* Longest cursor step in usec. */
+    long long stat_forkless_keys;           /* Keys saved so far. */
+    long long stat_forkless_preimages;      /* Keys saved before a write. */
+    long long stat_forkless_tracked_keys;   /* Keys in the skip sets. */
+    size_t stat_forkless_peak_pending;      /* Max bytes waiting for the writer. */
     /* Propagation of commands in AOF / replication */
     redisOpArray also_propagate;    /* Additional command to propagate. */
     /* Logging */
@@ -708,12 +870,26 @@ struct redisServer {
     int slaveseldb;                 /* Last SELECTed DB in replication output */
     long long master_repl_offset;   /* Global replication offset */
     int repl_ping_slave_period;     /* Master pings the slave every N seconds */
-    char *repl_backlog;             /* Replication backlog for partial syncs */
-    long long repl_backlog_size;    /* Backlog circular buffer size */
+    list *repl_buffer_blocks;       /* Shared replication buffer. */
+    size_t repl_buffer_mem;         /* Memory used by the blocks. */
+    listNode *repl_backlog;         /* First block of the replication backlog
+                                       for partial syncs, NULL if none. */
+    long long repl_backlog_size;    /* Min amount of history to retain. */
     long long repl_backlog_histlen; /* Backlog actual data length */
-    long long repl_backlog_idx;     /* Backlog circular buffer current offset */
     long long repl_backlog_off;     /* Replication offset of first byte in the
                                        backlog buffer. */
+    long long repl_backlog_disk_size;    /* Max history spilled to disk,
+                                            0 if the disk tier is disabled. */
+    int repl_backlog_disk_fd;            /* Disk backlog file, -1 if none. */
+    long long repl_backlog_disk_off;     /* Offset of first byte on disk. */
+    long long repl_backlog_disk_histlen; /* Bytes of history on disk. */
+    long long repl_transfer_rate_limit;  /* Max bytes/sec of RDB sent to all
+                                            the slaves, 0 = unlimited. */
+    long long repl_transfer_slave_rate_limit; /* Same, for every slave. */
+    long long repl_transfer_window_start; /* Global rate limit window. */
+    long long repl_transfer_window_bytes;
+    long long repl_transfer_pacing_timer; /* Time event resuming throttled
+                                             transfers, -1 if none. */
     time_t repl_backlog_time_limit; /* Time without slaves after the backlog
                                        gets released. */
     time_t repl_no_slaves_since;    /* We have no slaves since that time.
@@ -744,6 +920,11 @@ struct redisServer {
     int slave_priority;             /* Reported in INFO and used by Sentinel. */
     char repl_master_runid[REDIS_RUN_ID_SIZE+1];  /* Master run id for PSYNC. */
     long long repl_master_initial_offset;         /* Master PSYNC offset. */
+    /* Replication state read from the RDB file by rdbLoad(), used to
+     * partially resync with the master after a restart. */
+    char rdb_repl_runid[REDIS_RUN_ID_SIZE+1]; /* Empty if not available. */
+    long long rdb_repl_offset;      /* Offset the dataset corresponds to. */
+    int rdb_repl_stream_db;         /* DB selected by the replication stream. */
     /* Replication script cache. */
     dict *repl_scriptcache_dict;        /* SHA1 all slaves are aware of. */
     list *repl_scriptcache_fifo;        /* First in, first out LRU eviction. */
@@ -769,8 +950,13 @@ struct redisServer {
     size_t list_max_ziplist_entries;
     size_t list_max_ziplist_value;
     size_t set_max_intset_entries;
+    size_t set_max_listpack_entries;
+    size_t set_max_listpack_value;
+    int set_large_int_encoding;     /* HT or ROARING for big integer sets. */
     size_t zset_max_ziplist_entries;
     size_t zset_max_ziplist_value;
+    int zset_large_encoding;        /* SKIPLIST or BTREE for big sorted sets. */
+    int encoding_downgrade;         /* Convert shrunk collections back. */
     size_t hll_sparse_max_bytes;
     time_t unixtime;        /* Unix time sampled every cron cycle. */
     long long mstime;       /* Like 'unixtime' but with milliseconds resolution. */
@@ -853,7 +1039,7 @@ typedef struct {
 /* Structure for an entry while iterating over a list. */
 typedef struct {
     listTypeIterator *li;
-    unsigned char *zi;  /* Entry in ziplist */
+    unsigned char *zi;  /* Entry in listpack */
     listNode *ln;       /* Entry in linked list */
 } listTypeEntry;
 
@@ -863,6 +1049,9 @@ typedef struct {
     int encoding;
     int ii; /* intset iterator */
     dictIterator *di;
+    unsigned char *lpi; /* Next entry in listpack */
+    robj *lpele;        /* Current listpack element, owned by the iterator */
+    roaringIterator ri; /* roaring iterator */
 } setTypeIterator;
 
 /* Structure to hold hash iteration abstraction. Note that iteration over
@@ -916,6 +1105,7 @@ void freeClient(redisClient *c);
 void freeClientAsync(redisClient *c);
 void resetClient(redisClient *c);
 void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask);
+int prepareClientToWrite(redisClient *c);
 void addReply(redisClient *c, robj *obj);
 void *addDeferredMultiBulkLength(redisClient *c);
 void setDeferredMultiBulkLength(redisClient *c, void *node, long length);
@@ -977,6 +1167,7 @@ void listTypeInsert(listTypeEntry *entry, robj *value, int where);
 int listTypeEqual(listTypeEntry *entry, robj *o);
 void listTypeDelete(listTypeEntry *entry);
 void listTypeConvert(robj *subject, int enc);
+int listTypeTryDowngrade(robj *subject, int ratio);
 void unblockClientWaitingData(redisClient *c);
 void handleClientsBlockedOnLists(void);
 void popGenericCommand(redisClient *c, int where);
@@ -1011,12 +1202,16 @@ size_t stringObjectLen(robj *o);
 robj *createStringObjectFromLongLong(long long value);
 robj *createStringObjectFromLongDouble(long double value);
 robj *createListObject(void);
-robj *createZiplistObject(void);
+robj *createListpackObject(void);
 robj *createSetObject(void);
 robj *createIntsetObject(void);
+robj *createSetListpackObject(void);
+robj *createSetRoaringObject(void);
 robj *createHashObject(void);
 robj *createZsetObject(void);
-robj *createZsetZiplistObject(void);
+robj *createZsetZpackObject(void);
+robj *createZsetBtreeObject(void);
+robj *createZsetLargeObject(void);
 int getLongFromObjectOrReply(redisClient *c, robj *o, long *target, const char *msg);
 int checkType(redisClient *c, robj *o, int type);
 int getLongLongFromObjectOrReply(redisClient *c, robj *o, long long *target, const char *msg);
@@ -1025,6 +1220,8 @@ int getLongLongFromObject(robj *o, long long *target);
 int getLongDoubleFromObject(robj *o, long double *target);
 int getLongDoubleFromObjectOrReply(redisClient *c, robj *o, long double *target, const char *msg);
 char *strEncoding(int encoding);
+int objectDowngrade(robj *o, int ratio);
+void tryObjectDowngrade(robj *o, unsigned long oldsize, size_t removedlen);
 int compareStringObjects(robj *a, robj *b);
 int collateStringObjects(robj *a, robj *b);
 int equalStringObjects(robj *a, robj *b);
@@ -1042,7 +1239,9 @@ void updateSlavesWaitingBgsave(int bgsaveerr);
 void replicationCron(void);
 void replicationHandleMasterDisconnection(void);
 void replicationCacheMaster(redisClient *c);
+void replicationCacheMasterFromRdb(void);
 void resizeReplicationBacklog(long long newsize);
+void resizeReplicationBacklogDisk(long long newsize);
 void refreshGoodSlavesCount(void);
 void replicationScriptCacheInit(void);
 void replicationScriptCacheFlush(void);
@@ -1051,12 +1250,35 @@ int replicationScriptCacheExists(sds sha1);
 void replicationSetMaster(char *ip, int port);
 void replicationUnsetMaster(void);
 void replicationSendNewlineToMaster(void);
+void replBufferAttachSlave(redisClient *c, listNode *node, size_t pos);
+void replBufferDetachSlave(redisClient *c);
+long long replBufferSlavePending(redisClient *c);
+int writeReplBufferToSlave(redisClient *c, int *totwritten);
 
 /* Generic persistence functions */
 void startLoading(FILE *fp);
 void loadingProgress(off_t pos);
 void stopLoading(void);
 
+/* Child info pipe: copy on write reports from persistence children */
+#define CHILD_INFO_TYPE_NONE 0
+#define CHILD_INFO_TYPE_RDB 1
+#define CHILD_INFO_TYPE_AOF 2
+void openChildInfoPipe(void);
+void closeChildInfoPipe(void);
+void childInfoStart(int ptype);
+size_t sendChildInfo(void);
+void sendChildInfoProgress(void);
+void receiveChildInfo(void);
+
+/* Fork-less snapshots */
+int snapshotStart(char *filename);
+void snapshotAbort(int error);
+void snapshotKeyWillChange(redisDb *db, robj *key);
+void snapshotKeyAdded(redisDb *db, robj *key);
+void snapshotProcessJob(void *arg1, void *arg2, void *arg3);
+size_t snapshotPendingBytes(void);
+
 /* RDB persistence */
 #include "rdb.h"
 
@@ -1071,6 +1293,12 @@ int startAppendOnly(void);
 void backgroundRewriteDoneHandler(int exitcode, int bysignal);
 void aofRewriteBufferReset(void);
 unsigned long aofRewriteBufferSize(void);
+void aofWriterInit(void);
+void aofWriterDrain(void);
+int loadAppendOnlyFiles(void);
+void aofManifestClear(aofManifest *am);
+int aofManifestLoad(void);
+int aofManifestOpen(void);
 
 /* Sorted sets data type */
 
@@ -1086,17 +1314,39 @@ typedef struct {
     int minex, maxex; /* are min or max exclusive? */
 } zlexrangespec;
 
+/* State used to build a skiplist appending elements already sorted, see
+ * zslBulkInit(). The last node of every level is remembered together with
+ * its rank, so every append is O(1) without searching the insert position. */
+typedef struct {
+    zskiplist *zsl;
+    int sorted;       /* Set to 0 once an element arrives out of order. */
+    zskiplistNode *last[ZSKIPLIST_MAXLEVEL]; /* Last node at every level. */
+    unsigned long rank[ZSKIPLIST_MAXLEVEL];  /* Rank of the nodes above. */
+} zslBulk;
+
 zskiplist *zslCreate(void);
 void zslFree(zskiplist *zsl);
 zskiplistNode *zslInsert(zskiplist *zsl, double score, robj *obj);
+void zslBulkInit(zslBulk *bulk, zskiplist *zsl);
+zskiplistNode *zslBulkAppend(zslBulk *bulk, double score, robj *obj);
+void zslBulkFinish(zslBulk *bulk);
 unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score);
 int zslDelete(zskiplist *zsl, double score, robj *obj);
 zskiplistNode *zslFirstInRange(zskiplist *zsl, zrangespec *range);
-double zzlGetScore(unsigned char *sptr);
-void zzlNext(unsigned char *zl, unsigned char **eptr, unsigned char **sptr);
-void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr);
+zbtree *zbtreeCreate(void);
+void zbtreeFree(zbtree *zbt);
+void zbtreeInsert(zbtree *zbt, double score, robj *obj);
+int zbtreeDelete(zbtree *zbt, double score, robj *obj);
+void zbtreeGetElementByRank(zbtree *zbt, unsigned long rank, zbtreePos *pos);
+void zbtreeNext(zbtreePos *pos);
+void zbtreePrev(zbtreePos *pos);
 unsigned int zsetLength(robj *zobj);
 void zsetConvert(robj *zobj, int encoding);
+int zsetTryDowngrade(robj *zobj, int ratio);
+void zsetAddNew(robj *zobj, double score, robj *ele);
+void zsetBulkInit(robj *zobj, zslBulk *bulk);
+void zsetBulkAdd(robj *zobj, zslBulk *bulk, double score, robj *ele);
+void zsetBulkFinish(robj *zobj, zslBulk *bulk);
 
 /* Core functions */
 int freeMemoryIfNeeded(void);
@@ -1141,9 +1391,12 @@ robj *setTypeNextObject(setTypeIterator *si);
 int setTypeRandomElement(robj *setobj, robj **objele, int64_t *llele);
 unsigned long setTypeSize(robj *subject);
 void setTypeConvert(robj *subject, int enc);
+int setTypeTryDowngrade(robj *subject, int ratio);
+robj *setTypeFromRoaring(roaring *r);
 
 /* Hash data type */
 void hashTypeConvert(robj *o, int enc);
+int hashTypeTryDowngrade(robj *o, int ratio);
 void hashTypeTryConversion(robj *subject, robj **argv, int start, int end);
 void hashTypeTryObjectEncoding(robj *subject, robj **o1, robj **o2);
 robj *hashTypeGetObject(robj *o, robj *key);
@@ -1154,7 +1407,7 @@ unsigned long hashTypeLength(robj *o);
 hashTypeIterator *hashTypeInitIterator(robj *subject);
 void hashTypeReleaseIterator(hashTypeIterator *hi);
 int hashTypeNext(hashTypeIterator *hi);
-void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
+void hashTypeCurrentFromListpack(hashTypeIterator *hi, int what,
                                 unsigned char **vstr,
                                 unsigned int *vlen,
                                 long long *vll);
@@ -1205,8 +1458,8 @@ int selectDb(redisClient *c, int id);
 void signalModifiedKey(redisDb *db, robj *key);
 void signalFlushedDb(int dbid);
 unsigned int GetKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count);
-void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor);
-int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long *cursor);
+void scanGenericCommand(redisClient *c, robj *o, unsigned long long cursor);
+int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long long *cursor);
 
 /* API to get key arguments from commands */
 #define REDIS_GETKEYS_ALL 0
@@ -1216,6 +1469,7 @@ void getKeysFreeResult(int *result);
 int *noPreloadGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags);
 int *renameGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags);
 int *zunionInterGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags);
+int *zunionInterNoStoreGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags);
 
 /* Sentinel */
 void initSentinelConfig(void);
@@ -1348,6 +1602,9 @@ void hlenCommand(redisClient *c);
 void zremrangebyrankCommand(redisClient *c);
 void zunionstoreCommand(redisClient *c);
 void zinterstoreCommand(redisClient *c);
+void zunionCommand(redisClient *c);
+void zinterCommand(redisClient *c);
+void zinterCardCommand(redisClient *c);
 void zscanCommand(redisClient *c);
 void hkeysCommand(redisClient *c);
 void hvalsCommand(redisClient *c);
@@ -0,0 +1,3 @@
+#define REDIS_GIT_SHA1 "6157a1f6"
+#define REDIS_GIT_DIRTY "238"
+#define REDIS_BUILD_ID "vm-1792347353"
@@ -36,17 +36,173 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
 
 void replicationDiscardCachedMaster(void);
 void replicationResurrectCachedMaster(int newfd);
+void sendBulkToSlave(aeEventLoop *el, int fd, void *privdata, int mask);
 
 /* ---------------------------------- MASTER -------------------------------- */
 
+/* -----------------------------------------------------------------------------
+ * Shared replication buffer
+ *
+ * The replication stream is appended only once, to server.repl_buffer_blocks,
+ * a list of replBufBlock structures. The backlog and the slaves are readers
+ * of this list: server.repl_backlog is the oldest block retained for partial
+ * resynchronizations, while every slave references the block holding the
+ * next byte it has to receive (ref_repl_buf_node / ref_block_pos).
+ *
+ * Every block counts the readers positioned inside it, and the blocks at the
+ * head of the list are released as soon as nobody references them. This way
+ * the memory used does not grow with the number of slaves: a slave that is
+ * lagging just retains a few more blocks, and a partial resynchronization
+ * only needs to point the slave at the right block.
+ * -------------------------------------------------------------------------- */
+
+/* Append a new empty block, whose first byte is at 'repl_offset'. */
+//在共享复制缓冲区末尾添加一个新的块
+static listNode *createReplBufferBlock(size_t size, long long repl_offset) {
+    replBufBlock *b = zmalloc(sizeof(*b)+size);
+
+    b->refcount = 0;
+    b->repl_offset = repl_offset;
+    b->size = size;
+    b->used = 0;
+    listAddNodeTail(server.repl_buffer_blocks,b);
+    server.repl_buffer_mem += sizeof(*b)+size;
+    return listLast(server.repl_buffer_blocks);
+}
+
+/* Release the blocks at the head of the buffer no reader references. */
+//释放缓冲区头部没有被任何读者引用的块
+static void freeUnreferencedReplBufferBlocks(void) {
+    listNode *ln;
+
+    while((ln = listFirst(server.repl_buffer_blocks)) != NULL) {
+        replBufBlock *b = listNodeValue(ln);
+
+        if (b->refcount) break;
+        server.repl_buffer_mem -= sizeof(*b)+b->size;
+        zfree(b);
+        listDelNode(server.repl_buffer_blocks,ln);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * Disk backlog
+ *
+ * When repl-backlog-disk-size is not zero, the blocks leaving the in memory
+ * backlog are written to a file used as a circular buffer: the byte at the
+ * replication offset 'o' is stored at position o % repl_backlog_disk_size.
+ * The history on disk always ends where the memory backlog starts, so a
+ * partial resynchronization can be served for any offset starting from
+ * server.repl_backlog_disk_off: slaves first read the older part of the
+ * stream from the file, then continue from the shared buffer.
+ * -------------------------------------------------------------------------- */
+
+static void freeReplicationBacklogDisk(void) {
+    if (server.repl_backlog_disk_fd != -1)
+        close(server.repl_backlog_disk_fd);
+    server.repl_backlog_disk_fd = -1;
+    server.repl_backlog_disk_off = 0;
+    server.repl_backlog_disk_histlen = 0;
+}
+
+/* Create the file holding the disk backlog. It is unlinked ASAP since it
+ * is only accessed via the file descriptor, and must not survive us. */
+static int openReplicationBacklogDisk(void) {
+    char tmpfile[256];
+    int fd;
+
+    snprintf(tmpfile,sizeof(tmpfile),"temp-repl-backlog-%d.dat",
+        (int) getpid());
+    fd = open(tmpfile,O_RDWR|O_CREAT|O_TRUNC,0644);
+    if (fd == -1) {
+        redisLog(REDIS_WARNING,"Can't create the disk backlog file: %s",
+            strerror(errno));
+        return REDIS_ERR;
+    }
+    unlink(tmpfile);
+    server.repl_backlog_disk_fd = fd;
+    return REDIS_OK;
+}
+
+/* Append a block leaving the memory backlog to the disk backlog. */
+//将离开内存积压区的块写到磁盘积压区
+static void spillReplBufferBlock(replBufBlock *b) {
+    long long size = server.repl_backlog_disk_size;
+    long long offset = b->repl_offset;
+    char *p = b->buf;
+    size_t len = b->used;
+
+    if (size == 0 || len == 0) return;
+    if (server.repl_backlog_disk_fd == -1 &&
+        openReplicationBacklogDisk() == REDIS_ERR) return;
+    if (server.repl_backlog_disk_histlen == 0)
+        server.repl_backlog_disk_off = offset;
+
+    while(len) {
+        off_t pos = offset % size;
+        size_t thislen = size - pos;
+        ssize_t nwritten;
+
+        if (thislen > len) thislen = len;
+        nwritten = pwrite(server.repl_backlog_disk_fd,p,thislen,pos);
+        if (nwritten <= 0) {
+            redisLog(REDIS_WARNING,
+                "Error writing the disk backlog, history discarded: %s",
+                nwritten == -1 ? strerror(errno) : "short write");
+            freeReplicationBacklogDisk();
+            return;
+        }
+        offset += nwritten;
+        p += nwritten;
+        len -= nwritten;
+    }
+
+    /* Older data was overwritten if the ring is full. */
+    server.repl_backlog_disk_histlen += b->used;
+    if (server.repl_backlog_disk_histlen > size) {
+        server.repl_backlog_disk_off += server.repl_backlog_disk_histlen-size;
+        server.repl_backlog_disk_histlen = size;
+    }
+}
+
+/* Called when the user modifies repl-backlog-disk-size at runtime. The
+ * history on disk is discarded: slaves still reading it will be
+ * disconnected and will have to resync. */
+void resizeReplicationBacklogDisk(long long newsize) {
+    server.repl_backlog_disk_size = newsize;
+    freeReplicationBacklogDisk();
+}
+
+/* Move the backlog reference forward while the blocks after the first one
+ * are enough to retain server.repl_backlog_size bytes of history. */
+static void trimReplicationBacklog(void) {
+    listNode *next;
+
+    while((next = listNextNode(server.repl_backlog)) != NULL) {
+        replBufBlock *first = listNodeValue(server.repl_backlog);
+
+        if (server.repl_backlog_histlen - (long long)first->used <
+            server.repl_backlog_size) break;
+        spillReplBufferBlock(first);
+        first->refcount--;
+        ((replBufBlock*)listNodeValue(next))->refcount++;
+        server.repl_backlog = next;
+        server.repl_backlog_histlen -= first->used;
+    }
+    server.repl_backlog_off =
+        ((replBufBlock*)listNodeValue(server.repl_backlog))->repl_offset;
+    freeUnreferencedReplBufferBlocks();
+}
+
 void createReplicationBacklog(void) {
     redisAssert(server.repl_backlog == NULL);
-    server.repl_backlog = zmalloc(server.repl_backlog_size);
-    server.repl_backlog_histlen = 0;
-    server.repl_backlog_idx = 0;
+    redisAssert(listLength(server.repl_buffer_blocks) == 0);
     /* When a new backlog buffer is created, we increment the replication
      * offset by one to make sure we'll not be able to PSYNC with any
      * previous slave. This is needed because we avoid incrementing the
@@ -56,69 +212,65 @@ void createReplicationBacklog(void) {
     /* We don't have any data inside our buffer, but virtually the first
      * byte we have is the next byte that will be generated for the
      * replication stream. */
+    server.repl_backlog = createReplBufferBlock(REDIS_REPL_BUFFER_BLOCK_SIZE,
+        server.master_repl_offset+1);
+    ((replBufBlock*)listNodeValue(server.repl_backlog))->refcount++;
+    server.repl_backlog_histlen = 0;
     server.repl_backlog_off = server.master_repl_offset+1;
 }
 
 /* This function is called when the user modifies the replication backlog
- * size at runtime. It is up to the function to both update the
- * server.repl_backlog_size and to resize the buffer and setup it so that
- * it contains the same data as the previous one (possibly less data, but
- * the most recent bytes, or the same data and more free space in case the
- * buffer is enlarged). */
+ * size at runtime. Since the backlog is only a reference inside the shared
+ * replication buffer no data needs to be moved: when the backlog is enlarged
+ * the current history is retained, when it is reduced the oldest blocks are
+ * released. */
 void resizeReplicationBacklog(long long newsize) {
     if (newsize < REDIS_REPL_BACKLOG_MIN_SIZE)
         newsize = REDIS_REPL_BACKLOG_MIN_SIZE;
-    if (server.repl_backlog_size == newsize) return;
-
     server.repl_backlog_size = newsize;
-    if (server.repl_backlog != NULL) {
-        /* What we actually do is to flush the old buffer and realloc a new
-         * empty one. It will refill with new data incrementally.
-         * The reason is that copying a few gigabytes adds latency and even
-         * worse often we need to alloc additional space before freeing the
-         * old buffer. */
-        zfree(server.repl_backlog);
-        server.repl_backlog = zmalloc(server.repl_backlog_size);
-        server.repl_backlog_histlen = 0;
-        server.repl_backlog_idx = 0;
-        /* Next byte we have is... the next since the buffer is emtpy. */
-        server.repl_backlog_off = server.master_repl_offset+1;
-    }
+    if (server.repl_backlog != NULL) trimReplicationBacklog();
 }
 
 void freeReplicationBacklog(void) {
     redisAssert(listLength(server.slaves) == 0);
-    zfree(server.repl_backlog);
+    if (server.repl_backlog == NULL) return;
+    ((replBufBlock*)listNodeValue(server.repl_backlog))->refcount--;
     server.repl_backlog = NULL;
+    freeUnreferencedReplBufferBlocks();
+    redisAssert(listLength(server.repl_buffer_blocks) == 0);
+    freeReplicationBacklogDisk();
 }
 
-/* Add data to the replication backlog.
+/* Add data to the replication buffer, and so to the backlog.
  * This function also increments the global replication offset stored at
  * server.master_repl_offset, because there is no case where we want to feed
  * the backlog without incrementing the buffer. */
+//将数据添加到共享复制缓冲区，并更新复制偏移量
 void feedReplicationBacklog(void *ptr, size_t len) {
     unsigned char *p = ptr;
 
     server.master_repl_offset += len;
+    server.repl_backlog_histlen += len;
 
-    /* This is a circular buffer, so write as much data we can at every
-     * iteration and rewind the "idx" index if we reach the limit. */
+    /* Fill the last block, then append new ones as needed. */
     while(len) {
-        size_t thislen = server.repl_backlog_size - server.repl_backlog_idx;
+        replBufBlock *tail = listNodeValue(listLast(server.repl_buffer_blocks));
+        size_t thislen = tail->size - tail->used;
+
+        if (thislen == 0) {
+            size_t size = (len > REDIS_REPL_BUFFER_BLOCK_SIZE) ?
+                          len : REDIS_REPL_BUFFER_BLOCK_SIZE;
+
+            createReplBufferBlock(size,tail->repl_offset+tail->used);
+            continue;
+        }
         if (thislen > len) thislen = len;
-        memcpy(server.repl_backlog+server.repl_backlog_idx,p,thislen);
-        server.repl_backlog_idx += thislen;
-        if (server.repl_backlog_idx == server.repl_backlog_size)
-            server.repl_backlog_idx = 0;
+        memcpy(tail->buf+tail->used,p,thislen);
+        tail->used += thislen;
         len -= thislen;
         p += thislen;
-        server.repl_backlog_histlen += thislen;
     }
-    if (server.repl_backlog_histlen > server.repl_backlog_size)
-        server.repl_backlog_histlen = server.repl_backlog_size;
-    /* Set the offset of the first byte we have in the backlog. */
-    server.repl_backlog_off = server.master_repl_offset -
-                              server.repl_backlog_histlen + 1;
+    trimReplicationBacklog();
 }
 
 /* Wrapper for feedReplicationBacklog() that takes Redis string objects
@@ -138,11 +290,147 @@ void feedReplicationBacklogWithObject(robj *o) {
     feedReplicationBacklog(p,len);
 }
 
+/* Make the slave 'c' read the replication stream starting at 'pos' inside
+ * the block 'node', or from the end of the buffer if 'node' is NULL. */
+//让从服务器从共享复制缓冲区的给定位置开始读取复制流
+void replBufferAttachSlave(redisClient *c, listNode *node, size_t pos) {
+    replBufferDetachSlave(c);
+    if (node == NULL) {
+        node = listLast(server.repl_buffer_blocks);
+        pos = ((replBufBlock*)listNodeValue(node))->used;
+    }
+    ((replBufBlock*)listNodeValue(node))->refcount++;
+    c->ref_repl_buf_node = node;
+    c->ref_block_pos = pos;
+}
+
+void replBufferDetachSlave(redisClient *c) {
+    if (c->ref_repl_buf_node == NULL) return;
+    ((replBufBlock*)listNodeValue(c->ref_repl_buf_node))->refcount--;
+    c->ref_repl_buf_node = NULL;
+    c->ref_block_pos = 0;
+    freeUnreferencedReplBufferBlocks();
+}
+
+/* Attach the slave to the block of the memory backlog holding 'offset'. */
+static void replBufferAttachSlaveAtOffset(redisClient *c, long long offset) {
+    listNode *ln = server.repl_backlog;
+
+    while(1) {
+        replBufBlock *b = listNodeValue(ln);
+        listNode *next = listNextNode(ln);
+
+        if (next == NULL || offset < b->repl_offset+(long long)b->used) {
+            replBufferAttachSlave(c,ln,offset-b->repl_offset);
+            break;
+        }
+        ln = next;
+    }
+}
+
+/* Bytes of the replication stream the slave did not receive yet. */
+long long replBufferSlavePending(redisClient *c) {
+    replBufBlock *b;
+
+    if (c->ref_repl_buf_node == NULL) return 0;
+    b = listNodeValue(c->ref_repl_buf_node);
+    return server.master_repl_offset+1 - (b->repl_offset+c->ref_block_pos);
+}
+
+/* Send the slave the part of the stream that is only in the disk backlog.
+ * When the slave reaches the memory backlog it is attached to the shared
+ * buffer and c->repl_disk_off is set back to -1. */
+//将磁盘积压区中的数据写给从服务器
+static int writeReplBacklogDiskToSlave(redisClient *c, int *totwritten) {
+    char buf[REDIS_IOBUF_LEN];
+    int nwritten = 0;
+
+    while(c->repl_disk_off < server.repl_backlog_off) {
+        long long size = server.repl_backlog_disk_size;
+        off_t pos;
+        size_t len;
+        ssize_t nread;
+
+        /* The history the slave needs was overwritten or discarded. */
+        if (server.repl_backlog_disk_fd == -1 ||
+            c->repl_disk_off < server.repl_backlog_disk_off)
+        {
+            redisLog(REDIS_WARNING,"Slave fell behind the disk backlog "
+                                   "while catching up, closing it.");
+            freeClientAsync(c);
+            return 0;
+        }
+        pos = c->repl_disk_off % size;
+        len = server.repl_backlog_off - c->repl_disk_off;
+        if (len > sizeof(buf)) len = sizeof(buf);
+        if (len > (size_t)(size - pos)) len = size - pos;
+        nread = pread(server.repl_backlog_disk_fd,buf,len,pos);
+        if (nread <= 0) {
+            redisLog(REDIS_WARNING,"Error reading the disk backlog: %s",
+                nread == -1 ? strerror(errno) : "unexpected EOF");
+            freeClientAsync(c);
+            return 0;
+        }
+        nwritten = write(c->fd,buf,nread);
+        if (nwritten <= 0) return nwritten;
+        c->repl_disk_off += nwritten;
+        *totwritten += nwritten;
+        if (*totwritten > REDIS_MAX_WRITE_PER_EVENT &&
+            (server.maxmemory == 0 ||
+             zmalloc_used_memory() < server.maxmemory)) return nwritten;
+    }
+    replBufferAttachSlaveAtOffset(c,c->repl_disk_off);
+    c->repl_disk_off = -1;
+    return nwritten;
+}
+
+/* Write the replication stream from the shared buffer to the slave, called
+ * by sendReplyToClient() once the slave own output buffers are empty.
+ * Returns the result of the last write(2) performed, or 0 if there was
+ * nothing to write. */
+//将共享复制缓冲区中的数据写给从服务器
+int writeReplBufferToSlave(redisClient *c, int *totwritten) {
+    int nwritten = 0;
+
+    if (c->repl_disk_off != -1) {
+        nwritten = writeReplBacklogDiskToSlave(c,totwritten);
+        if (c->repl_disk_off != -1) return nwritten;
+    }
+
+    while(1) {
+        replBufBlock *b = listNodeValue(c->ref_repl_buf_node);
+
+        if (c->ref_block_pos == b->used) {
+            listNode *next = listNextNode(c->ref_repl_buf_node);
+
+            /* Block consumed: move to the next one, if any. */
+            if (next == NULL) break;
+            b->refcount--;
+            ((replBufBlock*)listNodeValue(next))->refcount++;
+            c->ref_repl_buf_node = next;
+            c->ref_block_pos = 0;
+            freeUnreferencedReplBufferBlocks();
+            continue;
+        }
+        nwritten = write(c->fd,b->buf+c->ref_block_pos,
+                         b->used-c->ref_block_pos);
+        if (nwritten <= 0) break;
+        c->ref_block_pos += nwritten;
+        *totwritten += nwritten;
+        /* Same fairness rule used by sendReplyToClient(). */
+        if (*totwritten > REDIS_MAX_WRITE_PER_EVENT &&
+            (server.maxmemory == 0 ||
+             zmalloc_used_memory() < server.maxmemory)) break;
+    }
+    return nwritten;
+}
+
 void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
     listNode *ln;
     listIter li;
     int j, len;
     char llstr[REDIS_LONGSTR_SIZE];
+    char aux[REDIS_LONGSTR_SIZE+3];
 
     /* If there aren't slaves, and there is no backlog buffer to populate,
      * we can return ASAP. */
@@ -168,67 +456,52 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
                 dictid_len, llstr));
         }
 
-        /* Add the SELECT command into the backlog. */
-        if (server.repl_backlog) feedReplicationBacklogWithObject(selectcmd);
-
-        /* Send it to slaves. */
-        listRewind(slaves,&li);
-        while((ln = listNext(&li))) {
-            redisClient *slave = ln->value;
-            addReply(slave,selectcmd);
-        }
+        /* Add the SELECT command into the replication buffer. */
+        feedReplicationBacklogWithObject(selectcmd);
 
         if (dictid < 0 || dictid >= REDIS_SHARED_SELECT_CMDS)
             decrRefCount(selectcmd);
     }
     server.slaveseldb = dictid;
 
-    /* Write the command to the replication backlog if any. */
-    if (server.repl_backlog) {
-        char aux[REDIS_LONGSTR_SIZE+3];
+    /* Write the command to the replication buffer. */
+    /* Add the multi bulk reply length. */
+    aux[0] = '*';
+    len = ll2string(aux+1,sizeof(aux)-1,argc);
+    aux[len+1] = '\r';
+    aux[len+2] = '\n';
+    feedReplicationBacklog(aux,len+3);
+
+    for (j = 0; j < argc; j++) {
+        long objlen = stringObjectLen(argv[j]);
 
-        /* Add the multi bulk reply length. */
-        aux[0] = '*';
-        len = ll2string(aux+1,sizeof(aux)-1,argc);
+        /* We need to feed the buffer with the object as a bulk reply
+         * not just as a plain string, so create the $..CRLF payload len
+         * ad add the final CRLF */
+        aux[0] = '$';
+        len = ll2string(aux+1,sizeof(aux)-1,objlen);
         aux[len+1] = '\r';
         aux[len+2] = '\n';
         feedReplicationBacklog(aux,len+3);
-
-        for (j = 0; j < argc; j++) {
-            long objlen = stringObjectLen(argv[j]);
-
-            /* We need to feed the buffer with the object as a bulk reply
-             * not just as a plain string, so create the $..CRLF payload len 
-             * ad add the final CRLF */
-            aux[0] = '$';
-            len = ll2string(aux+1,sizeof(aux)-1,objlen);
-            aux[len+1] = '\r';
-            aux[len+2] = '\n';
-            feedReplicationBacklog(aux,len+3);
-            feedReplicationBacklogWithObject(argv[j]);
-            feedReplicationBacklog(aux+len+1,2);
-        }
+        feedReplicationBacklogWithObject(argv[j]);
+        feedReplicationBacklog(aux+len+1,2);
     }
 
-    /* Write the command to every slave. */
+    /* Slaves referencing the buffer will receive the command from there:
+     * make sure the ones online have a write handler installed, and check
+     * the output buffer limits since the slave is lagging a bit more. */
     listRewind(slaves,&li);
     while((ln = listNext(&li))) {
         redisClient *slave = ln->value;
 
-        /* Don't feed slaves that are still waiting for BGSAVE to start */
-        if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_START) continue;
-
-        /* Feed slaves that are waiting for the initial SYNC (so these commands
-         * are queued in the output buffer until the initial SYNC completes),
-         * or are already in sync with the master. */
+        /* Slaves that are still waiting for BGSAVE to start don't
+         * reference the buffer yet. */
+        if (slave->ref_repl_buf_node == NULL) continue;
 
-        /* Add the multi bulk length. */
-        addReplyMultiBulkLen(slave,argc);
-
-        /* Finally any additional argument that was not stored inside the
-         * static buffer if any (from j to argc). */
-        for (j = 0; j < argc; j++)
-            addReplyBulk(slave,argv[j]);
+        if (slave->replstate == REDIS_REPL_ONLINE &&
+            !(aeGetFileEvents(server.el,slave->fd) & AE_WRITABLE))
+            prepareClientToWrite(slave);
+        asyncCloseClientOnOutputBufferLimitReached(slave);
     }
 }
 
@@ -273,56 +546,27 @@ void replicationFeedMonitors(redisClient *c, list *monitors, int dictid, robj **
     decrRefCount(cmdobj);
 }
 
-/* Feed the slave 'c' with the replication backlog starting from the
- * specified 'offset' up to the end of the backlog. */
+/* Make the slave 'c' continue the replication stream from the specified
+ * 'offset', that must be inside the backlog. Nothing is copied: the slave
+ * just references the block of the shared buffer holding that offset, or
+ * starts reading from the disk backlog if the offset is older than that.
+ * Returns the number of bytes the slave is going to receive. */
 long long addReplyReplicationBacklog(redisClient *c, long long offset) {
-    long long j, skip, len;
 
     redisLog(REDIS_DEBUG, "[PSYNC] Slave request offset: %lld", offset);
-
-    if (server.repl_backlog_histlen == 0) {
-        redisLog(REDIS_DEBUG, "[PSYNC] Backlog history len is zero");
-        return 0;
-    }
-
-    redisLog(REDIS_DEBUG, "[PSYNC] Backlog size: %lld",
-             server.repl_backlog_size);
     redisLog(REDIS_DEBUG, "[PSYNC] First byte: %lld",
              server.repl_backlog_off);
     redisLog(REDIS_DEBUG, "[PSYNC] History len: %lld",
              server.repl_backlog_histlen);
-    redisLog(REDIS_DEBUG, "[PSYNC] Current index: %lld",
-             server.repl_backlog_idx);
-
-    /* Compute the amount of bytes we need to discard. */
-    skip = offset - server.repl_backlog_off;
-    redisLog(REDIS_DEBUG, "[PSYNC] Skipping: %lld", skip);
-
-    /* Point j to the oldest byte, that is actaully our
-     * server.repl_backlog_off byte. */
-    j = (server.repl_backlog_idx +
-        (server.repl_backlog_size-server.repl_backlog_histlen)) %
-        server.repl_backlog_size;
-    redisLog(REDIS_DEBUG, "[PSYNC] Index of first byte: %lld", j);
-
-    /* Discard the amount of data to seek to the specified 'offset'. */
-    j = (j + skip) % server.repl_backlog_size;
-
-    /* Feed slave with data. Since it is a circular buffer we have to
-     * split the reply in two parts if we are cross-boundary. */
-    len = server.repl_backlog_histlen - skip;
-    redisLog(REDIS_DEBUG, "[PSYNC] Reply total length: %lld", len);
-    while(len) {
-        long long thislen =
-            ((server.repl_backlog_size - j) < len) ?
-            (server.repl_backlog_size - j) : len;
 
-        redisLog(REDIS_DEBUG, "[PSYNC] addReply() length: %lld", thislen);
-        addReplySds(c,sdsnewlen(server.repl_backlog + j, thislen));
-        len -= thislen;
-        j = 0;
+    if (offset < server.repl_backlog_off) {
+        c->repl_disk_off = offset;
+        prepareClientToWrite(c);
+        return server.master_repl_offset+1-offset;
     }
-    return server.repl_backlog_histlen - skip;
+    replBufferAttachSlaveAtOffset(c,offset);
+    prepareClientToWrite(c);
+    return replBufferSlavePending(c);
 }
 
 /* This function handles the PSYNC command from the point of view of a
@@ -355,7 +599,9 @@ int masterTryPartialResynchronization(redisClient *c) {
     if (getLongLongFromObjectOrReply(c,c->argv[2],&psync_offset,NULL) !=
        REDIS_OK) goto need_full_resync;
     if (!server.repl_backlog ||
-        psync_offset < server.repl_backlog_off ||
+        psync_offset < (server.repl_backlog_disk_histlen ?
+                        server.repl_backlog_disk_off :
+                        server.repl_backlog_off) ||
         psync_offset > (server.repl_backlog_off + server.repl_backlog_histlen))
     {
         redisLog(REDIS_NOTICE,
@@ -512,6 +758,12 @@ void syncCommand(redisClient *c) {
     listAddNodeTail(server.slaves,c);
     if (listLength(server.slaves) == 1 && server.repl_backlog == NULL)
         createReplicationBacklog();
+    /* The slave will receive everything written to the replication buffer
+     * from now on, once the RDB file is transferred. */
+    //从当前位置开始引用共享复制缓冲区
+    if (c->replstate == REDIS_REPL_WAIT_BGSAVE_END &&
+        c->ref_repl_buf_node == NULL)
+        replBufferAttachSlave(c,NULL,0);
     return;
 }
 
@@ -569,12 +821,93 @@ void replconfCommand(redisClient *c) {
     addReply(c,shared.ok);
 }
 
+/* Return how many RDB bytes can be sent to 'slave' right now without
+ * exceeding the per slave and global transfer rate limits. The limits are
+ * enforced over windows of REDIS_REPL_TRANSFER_WINDOW milliseconds. */
+static size_t replTransferAllowance(redisClient *slave, long long now) {
+    long long allowed = REDIS_REPL_TRANSFER_CHUNK, quota;
+
+    if (server.repl_transfer_slave_rate_limit) {
+        if (now - slave->repldb_window_start >= REDIS_REPL_TRANSFER_WINDOW) {
+            slave->repldb_window_start = now;
+            slave->repldb_window_bytes = 0;
+        }
+        quota = server.repl_transfer_slave_rate_limit *
+                REDIS_REPL_TRANSFER_WINDOW / 1000;
+        if (quota == 0) quota = 1;
+        quota -= slave->repldb_window_bytes;
+        if (quota < allowed) allowed = quota;
+    }
+    if (server.repl_transfer_rate_limit) {
+        if (now - server.repl_transfer_window_start >=
+            REDIS_REPL_TRANSFER_WINDOW)
+        {
+            server.repl_transfer_window_start = now;
+            server.repl_transfer_window_bytes = 0;
+        }
+        quota = server.repl_transfer_rate_limit *
+                REDIS_REPL_TRANSFER_WINDOW / 1000;
+        if (quota == 0) quota = 1;
+        quota -= server.repl_transfer_window_bytes;
+        if (quota < allowed) allowed = quota;
+    }
+    return (allowed > 0) ? allowed : 0;
+}
+
+/* Time event resuming the RDB transfers paused by the rate limits. It runs
+ * every few milliseconds while there are throttled slaves. */
+static int replTransferPacingCron(struct aeEventLoop *eventLoop, long long id,
+                                  void *clientData)
+{
+    listNode *ln;
+    listIter li;
+    long long now = mstime();
+    int throttled = 0;
+    REDIS_NOTUSED(eventLoop);
+    REDIS_NOTUSED(id);
+    REDIS_NOTUSED(clientData);
+
+    listRewind(server.slaves,&li);
+    while((ln = listNext(&li))) {
+        redisClient *slave = ln->value;
+
+        if (!slave->repldb_throttled) continue;
+        if (replTransferAllowance(slave,now) == 0) {
+            throttled++;
+            continue;
+        }
+        slave->repldb_throttled = 0;
+        if (aeCreateFileEvent(server.el,slave->fd,AE_WRITABLE,
+            sendBulkToSlave,slave) == AE_ERR) freeClientAsync(slave);
+    }
+    if (throttled) return 10;
+    server.repl_transfer_pacing_timer = -1;
+    return AE_NOMORE;
+}
+
+/* Stop sending the RDB to 'slave' until the rate limits allow it again. */
+static void replTransferThrottle(redisClient *slave) {
+    aeDeleteFileEvent(server.el,slave->fd,AE_WRITABLE);
+    slave->repldb_throttled = 1;
+    if (server.repl_transfer_pacing_timer == -1)
+        server.repl_transfer_pacing_timer = aeCreateTimeEvent(server.el,10,
+            replTransferPacingCron,NULL,NULL);
+}
+
 void sendBulkToSlave(aeEventLoop *el, int fd, void *privdata, int mask) {
     redisClient *slave = privdata;
     REDIS_NOTUSED(el);
     REDIS_NOTUSED(mask);
-    char buf[REDIS_IOBUF_LEN];
-    ssize_t nwritten, buflen;
+    ssize_t nwritten;
+    size_t len;
+
+    /* Respect the transfer rate limits. */
+    //根据传输速率限制计算本次可以发送的字节数
+    len = replTransferAllowance(slave,mstime());
+    if (len == 0) {
+        replTransferThrottle(slave);
+        return;
+    }
 
     if (slave->repldboff == 0) {
         /* Write the bulk write count before to transfer the DB. In theory here
@@ -593,15 +926,40 @@ void sendBulkToSlave(aeEventLoop *el, int fd, void *privdata, int mask) {
         }
         sdsfree(bulkcount);
     }
-    lseek(slave->repldbfd,slave->repldboff,SEEK_SET);
-    buflen = read(slave->repldbfd,buf,REDIS_IOBUF_LEN);
-    if (buflen <= 0) {
-        redisLog(REDIS_WARNING,"Read error sending DB to slave: %s",
-            (buflen == 0) ? "premature EOF" : strerror(errno));
-        freeClient(slave);
-        return;
+
+    if ((off_t)len > slave->repldbsize - slave->repldboff)
+        len = slave->repldbsize - slave->repldboff;
+
+#ifdef HAVE_SENDFILE
+    /* Let the kernel move the data from the page cache to the socket. */
+    {
+        off_t offset = slave->repldboff;
+
+        nwritten = sendfile(fd,slave->repldbfd,&offset,len);
+        if (nwritten == 0) {
+            redisLog(REDIS_WARNING,"Read error sending DB to slave: "
+                                   "premature EOF");
+            freeClient(slave);
+            return;
+        }
     }
-    if ((nwritten = write(fd,buf,buflen)) == -1) {
+#else
+    {
+        char buf[REDIS_IOBUF_LEN];
+        ssize_t buflen;
+
+        if (len > sizeof(buf)) len = sizeof(buf);
+        buflen = pread(slave->repldbfd,buf,len,slave->repldboff);
+        if (buflen <= 0) {
+            redisLog(REDIS_WARNING,"Read error sending DB to slave: %s",
+                (buflen == 0) ? "premature EOF" : strerror(errno));
+            freeClient(slave);
+            return;
+        }
+        nwritten = write(fd,buf,buflen);
+    }
+#endif
+    if (nwritten == -1) {
         if (errno != EAGAIN) {
             redisLog(REDIS_WARNING,"Write error sending DB to slave: %s",
                 strerror(errno));
@@ -609,6 +967,9 @@ void sendBulkToSlave(aeEventLoop *el, int fd, void *privdata, int mask) {
         }
         return;
     }
+    slave->repldb_window_bytes += nwritten;
+    server.repl_transfer_window_bytes += nwritten;
+    server.stat_repl_transfer_bytes += nwritten;
     slave->repldboff += nwritten;
     if (slave->repldboff == slave->repldbsize) {
         close(slave->repldbfd);
@@ -645,6 +1006,10 @@ void updateSlavesWaitingBgsave(int bgsaveerr) {
         if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_START) {
             startbgsave = 1;
             slave->replstate = REDIS_REPL_WAIT_BGSAVE_END;
+            /* The new BGSAVE starts now: reference the replication buffer
+             * from here and force a SELECT to be emitted. */
+            replBufferAttachSlave(slave,NULL,0);
+            server.slaveseldb = -1;
         } else if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_END) {
             struct redis_stat buf;
 
@@ -1380,6 +1745,30 @@ void replicationDiscardCachedMaster(void) {
     server.cached_master = NULL;
 }
 
+/* Create a cached master from the replication info loaded from the RDB file
+ * at startup, so that a slave that was restarted can try a partial
+ * resynchronization from the offset its dataset corresponds to. */
+//根据rdb中保存的复制信息创建缓存的主服务器
+void replicationCacheMasterFromRdb(void) {
+    redisClient *c;
+
+    if (server.masterhost == NULL || server.rdb_repl_runid[0] == '\0' ||
+        server.rdb_repl_offset < 0) return;
+
+    c = createClient(-1);
+    c->flags |= REDIS_MASTER;
+    c->authenticated = 1;
+    c->reploff = server.rdb_repl_offset;
+    memcpy(c->replrunid,server.rdb_repl_runid,sizeof(c->replrunid));
+    if (server.rdb_repl_stream_db >= 0 &&
+        server.rdb_repl_stream_db < server.dbnum)
+        selectDb(c,server.rdb_repl_stream_db);
+    server.cached_master = c;
+    redisLog(REDIS_NOTICE,
+        "Replication state loaded from RDB: master run id %s, offset %lld.",
+        c->replrunid, c->reploff);
+}
+
 /* Turn the cached master into the current master, using the file descriptor
  * passed as argument as the socket for the new master.
  *
@@ -1526,6 +1915,21 @@ int replicationScriptCacheExists(sds sha1) {
 
 /* Replication cron funciton, called 1 time per second. */
 void replicationCron(void) {
+    /* Update the RDB transfer rate reported by INFO. */
+    {
+        long long now = mstime();
+        long long elapsed = now - server.stat_repl_transfer_last_time;
+
+        if (elapsed > 0) {
+            server.stat_repl_transfer_rate =
+                (server.stat_repl_transfer_bytes -
+                 server.stat_repl_transfer_last_bytes)*1000/elapsed;
+            server.stat_repl_transfer_last_bytes =
+                server.stat_repl_transfer_bytes;
+            server.stat_repl_transfer_last_time = now;
+        }
+    }
+
     /* Non blocking connection timeout? */
     if (server.masterhost &&
         (server.repl_state == REDIS_REPL_CONNECTING ||
@@ -49,6 +49,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include "rio.h"
 #include "util.h"
 #include "crc64.h"
@@ -83,6 +85,31 @@ static off_t rioBufferTell(rio *r) {
     return r->io.buffer.pos;
 }
 
+/* Memory streams are read only: they are used to parse data that is
+ * already mapped in memory, like a mmap()ed RDB file. */
+//基于只读内存区的写函数, 总是失败
+static size_t rioMemoryWrite(rio *r, const void *buf, size_t len) {
+    REDIS_NOTUSED(r);
+    REDIS_NOTUSED(buf);
+    REDIS_NOTUSED(len);
+    return 0;
+}
+
+/* Returns 1 or 0 for success/failure. */
+//基于只读内存区的读函数
+static size_t rioMemoryRead(rio *r, void *buf, size_t len) {
+    if (r->io.memory.len - r->io.memory.pos < len)
+        return 0; /* not enough data to return len bytes. */
+    memcpy(buf,r->io.memory.ptr+r->io.memory.pos,len);
+    r->io.memory.pos += len;
+    return 1;
+}
+
+/* Returns read position in the memory area. */
+static off_t rioMemoryTell(rio *r) {
+    return r->io.memory.pos;
+}
+
 /* Returns 1 or 0 for success/failure. */
 //基于文件的写函数
 static size_t rioFileWrite(rio *r, const void *buf, size_t len) {
@@ -118,6 +145,133 @@ static off_t rioFileTell(rio *r) {
     return ftello(r->io.file.fp);
 }
 
+/* ----------------------- File descriptor backend ---------------------------
+ *
+ * Same contract as the FILE based backend, but the stdio buffering is
+ * replaced by a large private buffer: writes reach the kernel only in
+ * REDIS_RIO_FD_BUFSIZE units (so every write() but the last one is aligned
+ * to the buffer size), and reads are served from REDIS_RIO_FD_BUFSIZE
+ * sized read() calls.
+ *
+ * Since an RDB or a rewritten AOF is written (or loaded) exactly once, there
+ * is no point in keeping it in the page cache, where it would evict memory
+ * the live dataset needs. So the ranges already synced on disk (or already
+ * consumed when loading) are dropped with posix_fadvise(DONTNEED), and when
+ * reading the kernel is asked to read ahead sequentially.
+ *
+ * A rio of this kind is either used for writing or for reading, never for
+ * both. rioFdSync() must be called to flush the buffer before closing the
+ * file, and rioFreeFd() to release the buffer.
+ * ------------------------------------------------------------------------- */
+
+#define REDIS_RIO_FD_BUFSIZE (1024*1024)
+#define REDIS_RIO_FD_READAHEAD (REDIS_RIO_FD_BUFSIZE*8)
+
+/* Drop from the page cache the file range from the last dropped offset up
+ * to 'end'. The data must be already on disk or the call is a no-op for
+ * the dirty pages. */
+//将已经同步到硬盘(或已经读取过)的数据从page cache中丢弃
+static void rioFdDropCache(rio *r, off_t end) {
+#ifdef HAVE_FADVISE
+    if (end > r->io.fd.synced)
+        posix_fadvise(r->io.fd.fd,r->io.fd.synced,end-r->io.fd.synced,
+                      POSIX_FADV_DONTNEED);
+#endif
+    r->io.fd.synced = end;
+}
+
+/* Write the buffered data to the file, performing the auto sync if needed.
+ * Returns 1 or 0 for success/failure. */
+static int rioFdFlushBuffer(rio *r) {
+    char *p = r->io.fd.buf;
+    size_t len = r->io.fd.len;
+
+    while (len) {
+        ssize_t nwritten = write(r->io.fd.fd,p,len);
+
+        if (nwritten == -1) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        p += nwritten;
+        len -= nwritten;
+    }
+    r->io.fd.buffered += r->io.fd.len;
+    r->io.fd.len = 0;
+
+    if (r->io.fd.autosync &&
+        r->io.fd.buffered >= r->io.fd.autosync)
+    {
+        if (aof_fsync(r->io.fd.fd) == -1) return 0;
+        rioFdDropCache(r,r->io.fd.pos);
+        r->io.fd.buffered = 0;
+    }
+    return 1;
+}
+
+/* Returns 1 or 0 for success/failure. */
+//基于文件描述符的写函数, 数据先写到缓冲区, 缓冲区满了才调用write
+static size_t rioFdWrite(rio *r, const void *buf, size_t len) {
+    const char *p = buf;
+
+    while (len) {
+        size_t avail = REDIS_RIO_FD_BUFSIZE - r->io.fd.len;
+        size_t count = len < avail ? len : avail;
+
+        memcpy(r->io.fd.buf+r->io.fd.len,p,count);
+        r->io.fd.len += count;
+        r->io.fd.pos += count;
+        p += count;
+        len -= count;
+        if (r->io.fd.len == REDIS_RIO_FD_BUFSIZE &&
+            rioFdFlushBuffer(r) == 0) return 0;
+    }
+    return 1;
+}
+
+/* Returns 1 or 0 for success/failure. */
+//基于文件描述符的读函数, 每次从文件读取一整个缓冲区
+static size_t rioFdRead(rio *r, void *buf, size_t len) {
+    char *p = buf;
+
+    while (len) {
+        size_t avail = r->io.fd.len - r->io.fd.bufpos;
+        size_t count;
+
+        if (avail == 0) {
+            ssize_t nread;
+
+            /* What we consumed so far will not be read again. */
+            rioFdDropCache(r,r->io.fd.pos);
+            nread = read(r->io.fd.fd,r->io.fd.buf,REDIS_RIO_FD_BUFSIZE);
+            if (nread == -1) {
+                if (errno == EINTR) continue;
+                return 0;
+            }
+            if (nread == 0) return 0; /* Short read. */
+            r->io.fd.len = nread;
+            r->io.fd.bufpos = 0;
+#ifdef HAVE_FADVISE
+            posix_fadvise(r->io.fd.fd,r->io.fd.pos+nread,
+                          REDIS_RIO_FD_READAHEAD,POSIX_FADV_WILLNEED);
+#endif
+            continue;
+        }
+        count = len < avail ? len : avail;
+        memcpy(p,r->io.fd.buf+r->io.fd.bufpos,count);
+        r->io.fd.bufpos += count;
+        r->io.fd.pos += count;
+        p += count;
+        len -= count;
+    }
+    return 1;
+}
+
+/* Returns read/write position in file. */
+static off_t rioFdTell(rio *r) {
+    return r->io.fd.pos;
+}
+
 //基于缓存的io
 static const rio rioBufferIO = {
     rioBufferRead,
@@ -142,6 +296,30 @@ static const rio rioFileIO = {
     { { NULL, 0 } } /* union for io-specific vars */
 };
 
+//基于文件描述符的io
+static const rio rioFdIO = {
+    rioFdRead,
+    rioFdWrite,
+    rioFdTell,
+    NULL,           /* update_checksum */
+    0,              /* current checksum */
+    0,              /* bytes read or written */
+    0,              /* read/write chunk size */
+    { { NULL, 0 } } /* union for io-specific vars */
+};
+
+//基于只读内存区的io
+static const rio rioMemoryIO = {
+    rioMemoryRead,
+    rioMemoryWrite,
+    rioMemoryTell,
+    NULL,           /* update_checksum */
+    0,              /* current checksum */
+    0,              /* bytes read or written */
+    0,              /* read/write chunk size */
+    { { NULL, 0 } } /* union for io-specific vars */
+};
+
 //设置基于文件的io的文件描述符
 void rioInitWithFile(rio *r, FILE *fp) {
     *r = rioFileIO;
@@ -150,6 +328,46 @@ void rioInitWithFile(rio *r, FILE *fp) {
     r->io.file.autosync = 0;
 }
 
+/* Initialize a buffered rio on top of the file descriptor 'fd', starting
+ * at the current file offset. */
+//设置基于文件描述符的io, 分配大缓冲区并提示内核顺序访问
+void rioInitWithFd(rio *r, int fd) {
+    off_t offset = lseek(fd,0,SEEK_CUR);
+
+    *r = rioFdIO;
+    r->io.fd.fd = fd;
+    r->io.fd.buf = zmalloc(REDIS_RIO_FD_BUFSIZE);
+    r->io.fd.len = 0;
+    r->io.fd.bufpos = 0;
+    r->io.fd.pos = (offset == -1) ? 0 : offset;
+    r->io.fd.buffered = 0;
+    r->io.fd.autosync = 0;
+    r->io.fd.synced = r->io.fd.pos;
+#ifdef HAVE_FADVISE
+    posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+/* Flush the buffer, fsync the file and drop it from the page cache.
+ * Returns 1 or 0 for success/failure. */
+//将缓冲区写到文件并同步到硬盘
+int rioFdSync(rio *r) {
+    redisAssert(r->read == rioFdIO.read);
+    if (rioFdFlushBuffer(r) == 0) return 0;
+    if (fsync(r->io.fd.fd) == -1) return 0;
+    r->io.fd.buffered = 0;
+    rioFdDropCache(r,r->io.fd.pos);
+    return 1;
+}
+
+/* Release the buffer of a file descriptor rio. The descriptor itself is
+ * owned by the caller and is not closed. */
+void rioFreeFd(rio *r) {
+    redisAssert(r->read == rioFdIO.read);
+    zfree(r->io.fd.buf);
+    r->io.fd.buf = NULL;
+}
+
 //设置基于缓存的io的缓存区
 void rioInitWithBuffer(rio *r, sds s) {
     *r = rioBufferIO;
@@ -157,6 +375,15 @@ void rioInitWithBuffer(rio *r, sds s) {
     r->io.buffer.pos = 0;
 }
 
+/* Initialize a read only rio reading 'len' bytes starting at 'ptr'. */
+//设置基于只读内存区的io
+void rioInitWithMemory(rio *r, const void *ptr, size_t len) {
+    *r = rioMemoryIO;
+    r->io.memory.ptr = ptr;
+    r->io.memory.len = len;
+    r->io.memory.pos = 0;
+}
+
 /* This function can be installed both in memory and file streams when checksum
  * computation is needed. */
 //更新redis io内的checksum
@@ -176,6 +403,10 @@ void rioGenericUpdateChecksum(rio *r, const void *buf, size_t len) {
 
 //设置autosync值，当写的数据字节数超过autosync时，缓存区内数据将被写到文件并同步到设备
 void rioSetAutoSync(rio *r, off_t bytes) {
+    if (r->read == rioFdIO.read) {
+        r->io.fd.autosync = bytes;
+        return;
+    }
     redisAssert(r->read == rioFileIO.read);
     r->io.file.autosync = bytes;
 }
@@ -236,3 +467,144 @@ size_t rioWriteBulkDouble(rio *r, double d) {
     dlen = snprintf(dbuf,sizeof(dbuf),"%.17g",d);
     return rioWriteBulkString(r,dbuf,dlen);
 }
+
+#ifdef RIO_TEST_MAIN
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/* The benchmark is linked without debug.o. */
+void _redisAssert(char *estr, char *file, int line) {
+    fprintf(stderr,"ASSERTION FAILED %s:%d '%s'\n", file, line, estr);
+    exit(1);
+}
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Return how many bytes of the file are resident in the page cache. */
+static long long residentBytes(const char *filename) {
+    long long resident = 0;
+    long pagesize = sysconf(_SC_PAGESIZE);
+    unsigned char *vec;
+    struct stat sb;
+    size_t pages, j;
+    void *map;
+    int fd;
+
+    if ((fd = open(filename,O_RDONLY)) == -1) return -1;
+    if (fstat(fd,&sb) == -1 || sb.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL,sb.st_size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    pages = (sb.st_size+pagesize-1)/pagesize;
+    vec = zmalloc(pages);
+    if (mincore(map,sb.st_size,(void*)vec) == 0) {
+        for (j = 0; j < pages; j++)
+            if (vec[j] & 1) resident += pagesize;
+    }
+    zfree(vec);
+    munmap(map,sb.st_size);
+    return resident;
+}
+
+/* Write 'size' bytes in 'chunk' sized rioWrite() calls, the way the RDB
+ * and AOF rewrite code write many small objects. */
+static void benchWrite(const char *name, const char *filename, int usefd,
+                       long long size, size_t chunk)
+{
+    char *buf = zmalloc(chunk);
+    long long start, written = 0, elapsed;
+    FILE *fp = fopen(filename,"w");
+    rio r;
+
+    if (!fp) {
+        perror("fopen");
+        exit(1);
+    }
+    memset(buf,'x',chunk);
+    start = usec();
+    if (usefd) rioInitWithFd(&r,fileno(fp));
+    else rioInitWithFile(&r,fp);
+    rioSetAutoSync(&r,32*1024*1024);
+    r.update_cksum = rioGenericUpdateChecksum;
+    while (written < size) {
+        if (rioWrite(&r,buf,chunk) == 0) {
+            perror("rioWrite");
+            exit(1);
+        }
+        written += chunk;
+    }
+    if (usefd) {
+        rioFdSync(&r);
+        rioFreeFd(&r);
+    } else {
+        fflush(fp);
+        fsync(fileno(fp));
+    }
+    fclose(fp);
+    elapsed = usec()-start;
+    printf("write %-6s %8.2f MB/s, page cache after: %7.2f MB\n", name,
+        ((double)size/(1024*1024))/((double)elapsed/1000000),
+        (double)residentBytes(filename)/(1024*1024));
+    zfree(buf);
+}
+
+static void benchRead(const char *name, const char *filename, int usefd,
+                      long long size, size_t chunk)
+{
+    char *buf = zmalloc(chunk);
+    long long start, nread = 0, elapsed;
+    FILE *fp = fopen(filename,"r");
+    rio r;
+
+    if (!fp) {
+        perror("fopen");
+        exit(1);
+    }
+#ifdef HAVE_FADVISE
+    /* Start both backends from a cold cache. */
+    posix_fadvise(fileno(fp),0,0,POSIX_FADV_DONTNEED);
+#endif
+    start = usec();
+    if (usefd) rioInitWithFd(&r,fileno(fp));
+    else rioInitWithFile(&r,fp);
+    r.update_cksum = rioGenericUpdateChecksum;
+    while (nread < size) {
+        if (rioRead(&r,buf,chunk) == 0) {
+            perror("rioRead");
+            exit(1);
+        }
+        nread += chunk;
+    }
+    if (usefd) rioFreeFd(&r);
+    fclose(fp);
+    elapsed = usec()-start;
+    printf("read  %-6s %8.2f MB/s, page cache after: %7.2f MB\n", name,
+        ((double)size/(1024*1024))/((double)elapsed/1000000),
+        (double)residentBytes(filename)/(1024*1024));
+    zfree(buf);
+}
+
+int main(int argc, char **argv) {
+    const char *filename = argc > 1 ? argv[1] : "rio-benchmark.tmp";
+    long long size = (argc > 2 ? atoll(argv[2]) : 256)*1024*1024;
+    size_t chunk = argc > 3 ? (size_t)atoi(argv[3]) : 64;
+
+    printf("%lld MB in %zu bytes chunks on %s\n",
+        size/(1024*1024), chunk, filename);
+    benchWrite("stdio",filename,0,size,chunk);
+    benchRead("stdio",filename,0,size,chunk);
+    benchWrite("fd",filename,1,size,chunk);
+    benchRead("fd",filename,1,size,chunk);
+    unlink(filename);
+    return 0;
+}
+#endif
@@ -79,6 +79,21 @@ struct _rio {
             off_t buffered; /* Bytes written since last fsync. */ //当前缓存(未写到设备)的字节数
             off_t autosync; /* fsync after 'autosync' bytes written. */ //写了autosync字节后，要将数据写到设备
         } file;
+        struct {
+            int fd;         /* File descriptor. */
+            char *buf;      /* Large I/O buffer, see REDIS_RIO_FD_BUFSIZE. */
+            size_t len;     /* Valid bytes in buf. */
+            size_t bufpos;  /* Read cursor inside buf. */
+            off_t pos;      /* Logical read/write position in the file. */
+            off_t buffered; /* Bytes written since last fsync. */
+            off_t autosync; /* fsync after 'autosync' bytes written. */
+            off_t synced;   /* Bytes before this offset were dropped from the page cache. */
+        } fd; //基于文件描述符, 自带大缓冲区的io
+        struct {
+            const char *ptr; /* Read only memory, e.g. a mmap()ed file. */
+            size_t len;      /* Size of the memory area. */
+            off_t pos;       /* Current read position. */
+        } memory; //基于只读内存区的io
     } io;
 };
 
@@ -129,6 +144,12 @@ void rioInitWithFile(rio *r, FILE *fp);
 
 //设置基于缓存的io的缓存区
 void rioInitWithBuffer(rio *r, sds s);
+void rioInitWithMemory(rio *r, const void *ptr, size_t len);
+
+//设置基于文件描述符的io, 使用大缓冲区并且在同步后丢弃page cache
+void rioInitWithFd(rio *r, int fd);
+int rioFdSync(rio *r);
+void rioFreeFd(rio *r);
 
 //将参数以"*<count>\r\n"形式写到rio中
 size_t rioWriteBulkCount(rio *r, char prefix, int count);
@@ -0,0 +1,1148 @@
+/*
+ * Copyright (c) 2014, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Roaring bitmaps: compressed sets of 64 bit integers.
+ *
+ * Values are partitioned by their high 48 bits (value >> 16) into containers
+ * sorted by key. Every container stores the low 16 bits of its values in one
+ * of two ways:
+ *
+ * - An array container is a sorted array of uint16_t, used while the
+ *   container holds at most ROARING_ARRAY_MAX values (2 bytes per value).
+ * - A bitmap container is a bitmap of 65536 bits (8 kB), used for dense
+ *   chunks: less than 2 bytes per value above ROARING_ARRAY_MAX values, down
+ *   to one bit per value for a full chunk.
+ *
+ * A bitmap is converted back to an array only when it drops to half of
+ * ROARING_ARRAY_MAX values, so adding and removing a value around the limit
+ * does not convert the container every time.
+ *
+ * Lookups are a binary search over the container keys followed by a binary
+ * search in the array or a bit test. Intersections and unions work one
+ * container at a time: bitmaps are combined a 64 bit word at a time in loops
+ * the compiler can vectorize, arrays are merged. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "roaring.h"
+#include "zmalloc.h"
+#include "endianconv.h"
+
+#define ROARING_ARRAY_MAX 4096          /* Max values of an array container. */
+#define ROARING_ARRAY_MIN (ROARING_ARRAY_MAX/2) /* Bitmaps below become arrays. */
+#define ROARING_ARRAY_INITIAL 4         /* Initial slots of an array. */
+#define ROARING_BITMAP_WORDS 1024       /* 65536 bits. */
+#define ROARING_BITMAP_BYTES (ROARING_BITMAP_WORDS*sizeof(uint64_t))
+
+#define roaringIsBitmap(c) ((c)->alloc == 0)
+#define roaringKey(v) ((int64_t)(v) >> 16)
+#define roaringLow(v) ((uint16_t)((uint64_t)(v) & 0xffff))
+#define roaringValue(key,low) ((int64_t)(((uint64_t)(key) << 16) | (low)))
+
+/* -------------------------- Containers ------------------------------------ */
+
+/* Return the index of the first value >= low in the sorted array 'a'. */
+//在有序数组中找到第一个大于等于low的值的下标
+static uint32_t roaringArraySearch(uint16_t *a, uint32_t card, uint16_t low) {
+    uint32_t lo = 0, hi = card, mid;
+
+    while (lo < hi) {
+        mid = (lo+hi)/2;
+        if (a[mid] < low) lo = mid+1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+//位图中值的个数
+static uint32_t roaringBitmapCount(uint64_t *w) {
+    uint32_t j, card = 0;
+
+    for (j = 0; j < ROARING_BITMAP_WORDS; j++)
+        card += __builtin_popcountll(w[j]);
+    return card;
+}
+
+/* Write the values of the bitmap 'w' in order into 'a'. Returns the number of
+ * values written. */
+//将位图中的值按顺序写到数组a中
+static uint32_t roaringBitmapExtract(uint64_t *w, uint16_t *a) {
+    uint32_t j, n = 0;
+    uint64_t word;
+
+    for (j = 0; j < ROARING_BITMAP_WORDS; j++) {
+        word = w[j];
+        while (word) {
+            a[n++] = (j<<6) + __builtin_ctzll(word);
+            word &= word-1;
+        }
+    }
+    return n;
+}
+
+//将数组container转换为位图
+static void roaringArrayToBitmap(roaringContainer *c) {
+    uint64_t *w = zcalloc(ROARING_BITMAP_BYTES);
+    uint16_t *a = c->data;
+    uint32_t j;
+
+    for (j = 0; j < c->card; j++)
+        w[a[j]>>6] |= 1ULL << (a[j]&63);
+    zfree(a);
+    c->data = w;
+    c->alloc = 0;
+}
+
+//将位图container转换为数组
+static void roaringBitmapToArray(roaringContainer *c) {
+    uint16_t *a = zmalloc(sizeof(uint16_t)*c->card);
+
+    roaringBitmapExtract(c->data,a);
+    zfree(c->data);
+    c->data = a;
+    c->alloc = c->card;
+}
+
+//low是否在container中
+static int roaringContainerFind(roaringContainer *c, uint16_t low) {
+    if (roaringIsBitmap(c)) {
+        uint64_t *w = c->data;
+        return (w[low>>6] >> (low&63)) & 1;
+    } else {
+        uint16_t *a = c->data;
+        uint32_t j = roaringArraySearch(a,c->card,low);
+        return j < c->card && a[j] == low;
+    }
+}
+
+/* Add 'low' to the container. Returns 1 if added, 0 if already there. */
+//将low添加到container中, 数组满了时转换为位图
+static int roaringContainerAdd(roaringContainer *c, uint16_t low) {
+    uint64_t *w, bit;
+
+    if (!roaringIsBitmap(c)) {
+        uint16_t *a = c->data;
+        uint32_t j = roaringArraySearch(a,c->card,low);
+
+        if (j < c->card && a[j] == low) return 0;
+        if (c->card < ROARING_ARRAY_MAX) {
+            if (c->card == c->alloc) {
+                c->alloc *= 2;
+                if (c->alloc > ROARING_ARRAY_MAX) c->alloc = ROARING_ARRAY_MAX;
+                a = c->data = zrealloc(a,sizeof(uint16_t)*c->alloc);
+            }
+            memmove(a+j+1,a+j,sizeof(uint16_t)*(c->card-j));
+            a[j] = low;
+            c->card++;
+            return 1;
+        }
+        roaringArrayToBitmap(c);
+    }
+    w = c->data;
+    bit = 1ULL << (low&63);
+    if (w[low>>6] & bit) return 0;
+    w[low>>6] |= bit;
+    c->card++;
+    return 1;
+}
+
+/* Remove 'low' from the container. Returns 1 if removed, 0 if not found. The
+ * caller frees the container when it becomes empty. */
+//从container中删除low
+static int roaringContainerRemove(roaringContainer *c, uint16_t low) {
+    if (roaringIsBitmap(c)) {
+        uint64_t *w = c->data, bit = 1ULL << (low&63);
+
+        if (!(w[low>>6] & bit)) return 0;
+        w[low>>6] &= ~bit;
+        c->card--;
+        if (c->card <= ROARING_ARRAY_MIN) roaringBitmapToArray(c);
+    } else {
+        uint16_t *a = c->data;
+        uint32_t j = roaringArraySearch(a,c->card,low);
+
+        if (j == c->card || a[j] != low) return 0;
+        memmove(a+j,a+j+1,sizeof(uint16_t)*(c->card-j-1));
+        c->card--;
+        /* Give memory back when the array is mostly empty. */
+        if (c->card && c->alloc > ROARING_ARRAY_INITIAL && c->card < c->alloc/4) {
+            c->alloc /= 2;
+            c->data = zrealloc(a,sizeof(uint16_t)*c->alloc);
+        }
+    }
+    return 1;
+}
+
+/* Return the value of rank 'rank' (starting from 0) of the container. */
+//取到container中排名rank的值
+static uint16_t roaringContainerSelect(roaringContainer *c, uint32_t rank) {
+    uint64_t *w, word;
+    uint32_t j, count;
+
+    if (!roaringIsBitmap(c)) return ((uint16_t*)c->data)[rank];
+    w = c->data;
+    for (j = 0; ; j++) {
+        count = __builtin_popcountll(w[j]);
+        if (rank < count) break;
+        rank -= count;
+    }
+    word = w[j];
+    while (rank--) word &= word-1;
+    return (j<<6) + __builtin_ctzll(word);
+}
+
+//复制一个container
+static void roaringContainerDup(roaringContainer *dst, roaringContainer *src) {
+    size_t bytes = roaringIsBitmap(src) ? ROARING_BITMAP_BYTES :
+                                          sizeof(uint16_t)*src->card;
+
+    dst->key = src->key;
+    dst->card = src->card;
+    dst->alloc = roaringIsBitmap(src) ? 0 : src->card;
+    dst->data = zmalloc(bytes);
+    memcpy(dst->data,src->data,bytes);
+}
+
+/* Intersection of two containers with the same key into 'dst'. Returns the
+ * number of values of the intersection, 'dst' is only initialized when it is
+ * not zero. */
+//两个container的交集保存到dst中, 返回交集的元素个数
+static uint32_t roaringContainerAnd(roaringContainer *a, roaringContainer *b,
+                                    roaringContainer *dst)
+{
+    uint16_t *out, *aa, *ba;
+    uint32_t j, k, n = 0;
+
+    dst->key = a->key;
+    if (roaringIsBitmap(a) && roaringIsBitmap(b)) {
+        uint64_t *wa = a->data, *wb = b->data;
+        uint64_t *w = zmalloc(ROARING_BITMAP_BYTES);
+
+        for (j = 0; j < ROARING_BITMAP_WORDS; j++) w[j] = wa[j] & wb[j];
+        n = roaringBitmapCount(w);
+        if (n == 0) {
+            zfree(w);
+            return 0;
+        }
+        dst->card = n;
+        dst->alloc = 0;
+        dst->data = w;
+        if (n <= ROARING_ARRAY_MAX) roaringBitmapToArray(dst);
+        return n;
+    }
+
+    /* At least one array: the result can't be bigger than it. */
+    if (roaringIsBitmap(a)) {
+        roaringContainer *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    aa = a->data;
+    if (roaringIsBitmap(b)) {
+        uint64_t *w = b->data;
+
+        out = zmalloc(sizeof(uint16_t)*a->card);
+        for (j = 0; j < a->card; j++) {
+            out[n] = aa[j];
+            n += (w[aa[j]>>6] >> (aa[j]&63)) & 1;
+        }
+    } else {
+        ba = b->data;
+        out = zmalloc(sizeof(uint16_t)*(a->card < b->card ? a->card : b->card));
+        j = k = 0;
+        while (j < a->card && k < b->card) {
+            if (aa[j] < ba[k]) {
+                j++;
+            } else if (aa[j] > ba[k]) {
+                k++;
+            } else {
+                out[n++] = aa[j];
+                j++;
+                k++;
+            }
+        }
+    }
+    if (n == 0) {
+        zfree(out);
+        return 0;
+    }
+    dst->card = n;
+    dst->alloc = n;
+    dst->data = zrealloc(out,sizeof(uint16_t)*n);
+    return n;
+}
+
+/* Add to 'dst' all the values of 'src', a container with the same key. */
+//将src中的值合并到dst中
+static void roaringContainerOr(roaringContainer *dst, roaringContainer *src) {
+    uint64_t *w;
+    uint32_t j, k, n;
+
+    if (!roaringIsBitmap(dst) && !roaringIsBitmap(src) &&
+        dst->card + src->card <= ROARING_ARRAY_MAX)
+    {
+        uint16_t *da = dst->data, *sa = src->data;
+        uint16_t *out = zmalloc(sizeof(uint16_t)*(dst->card+src->card));
+
+        j = k = n = 0;
+        while (j < dst->card && k < src->card) {
+            if (da[j] < sa[k]) {
+                out[n++] = da[j++];
+            } else if (da[j] > sa[k]) {
+                out[n++] = sa[k++];
+            } else {
+                out[n++] = da[j++];
+                k++;
+            }
+        }
+        while (j < dst->card) out[n++] = da[j++];
+        while (k < src->card) out[n++] = sa[k++];
+        zfree(da);
+        dst->data = out;
+        dst->alloc = dst->card+src->card;
+        dst->card = n;
+        return;
+    }
+
+    /* The union has more than ROARING_ARRAY_MIN values: use a bitmap. */
+    if (!roaringIsBitmap(dst)) roaringArrayToBitmap(dst);
+    w = dst->data;
+    if (roaringIsBitmap(src)) {
+        uint64_t *ws = src->data;
+        for (j = 0; j < ROARING_BITMAP_WORDS; j++) w[j] |= ws[j];
+    } else {
+        uint16_t *sa = src->data;
+        for (j = 0; j < src->card; j++) w[sa[j]>>6] |= 1ULL << (sa[j]&63);
+    }
+    dst->card = roaringBitmapCount(w);
+}
+
+/* ---------------------------- Roaring ------------------------------------- */
+
+/* Create an empty roaring. */
+//创建一个新的roaring
+roaring *roaringNew(void) {
+    roaring *r = zmalloc(sizeof(*r));
+
+    r->card = 0;
+    r->len = 0;
+    r->alloc = 0;
+    r->containers = NULL;
+    r->tree = NULL;
+    r->treevalid = 0;
+    return r;
+}
+
+//释放roaring
+void roaringFree(roaring *r) {
+    uint32_t j;
+
+    for (j = 0; j < r->len; j++) zfree(r->containers[j].data);
+    zfree(r->containers);
+    zfree(r->tree);
+    zfree(r);
+}
+
+//复制一个roaring
+roaring *roaringDup(roaring *r) {
+    roaring *dup = roaringNew();
+    uint32_t j;
+
+    if (r->len) {
+        dup->containers = zmalloc(sizeof(roaringContainer)*r->len);
+        for (j = 0; j < r->len; j++)
+            roaringContainerDup(&dup->containers[j],&r->containers[j]);
+    }
+    dup->len = dup->alloc = r->len;
+    dup->card = r->card;
+    return dup;
+}
+
+/* roaringRandom() finds the container holding the element of a given rank
+ * with a Fenwick tree of the container cardinalities: tree[i] (1 based) is
+ * the sum of the cardinalities of the containers i-(i&-i) ... i-1, so that
+ * both a search by rank and the update of a cardinality are O(log N).
+ * Adding or removing a value updates the tree, creating or deleting a
+ * container invalidates it, and the next roaringRandom() builds it again
+ * reusing the same allocation. */
+
+//container被创建或者删除时树状数组失效
+static void roaringTreeInvalidate(roaring *r) {
+    r->treevalid = 0;
+}
+
+//在O(N)时间内构建树状数组
+static void roaringTreeBuild(roaring *r) {
+    uint32_t i, parent;
+
+    r->tree = zrealloc(r->tree,sizeof(uint64_t)*(r->len+1));
+    r->treevalid = 1;
+    r->tree[0] = 0;
+    for (i = 1; i <= r->len; i++) r->tree[i] = r->containers[i-1].card;
+    for (i = 1; i <= r->len; i++) {
+        parent = i + (i & -i);
+        if (parent <= r->len) r->tree[parent] += r->tree[i];
+    }
+}
+
+//第pos个container的基数变化了delta
+static void roaringTreeUpdate(roaring *r, uint32_t pos, int64_t delta) {
+    uint32_t i;
+
+    if (!r->treevalid) return;
+    for (i = pos+1; i <= r->len; i += i & -i) r->tree[i] += delta;
+}
+
+/* Return the index of the container holding the element of rank '*rank',
+ * and set '*rank' to the rank of the element inside the container. */
+//找到第rank个元素所在的container, rank被设为在container中的排名
+static uint32_t roaringTreeSelect(roaring *r, uint64_t *rank) {
+    uint32_t pos = 0, step = 1;
+
+    while (step <= r->len/2) step <<= 1;
+    for (; step; step >>= 1) {
+        if (pos+step <= r->len && r->tree[pos+step] <= *rank) {
+            pos += step;
+            *rank -= r->tree[pos];
+        }
+    }
+    return pos;
+}
+
+/* Search the container with the specified key. Returns 1 if found, and sets
+ * '*pos' to its index, or to the index where it should be inserted. */
+//找到key对应的container, 找不到时pos为应该插入的位置
+static int roaringSearch(roaring *r, int64_t key, uint32_t *pos) {
+    uint32_t lo = 0, hi = r->len, mid;
+
+    /* Values are often added in order: check the last container first. */
+    if (r->len && r->containers[r->len-1].key < key) {
+        *pos = r->len;
+        return 0;
+    }
+    while (lo < hi) {
+        mid = (lo+hi)/2;
+        if (r->containers[mid].key < key) lo = mid+1;
+        else hi = mid;
+    }
+    *pos = lo;
+    return lo < r->len && r->containers[lo].key == key;
+}
+
+//将container追加到末尾, 调用者保证key的顺序
+static void roaringAppend(roaring *r, roaringContainer *c) {
+    if (r->len == r->alloc) {
+        r->alloc = r->alloc ? r->alloc*2 : 1;
+        r->containers = zrealloc(r->containers,sizeof(roaringContainer)*r->alloc);
+    }
+    r->containers[r->len++] = *c;
+    r->card += c->card;
+    roaringTreeInvalidate(r);
+}
+
+//添加value, 成功添加返回1, 已经存在返回0
+int roaringAdd(roaring *r, int64_t value) {
+    roaringContainer *c;
+    uint32_t pos;
+
+    if (!roaringSearch(r,roaringKey(value),&pos)) {
+        /* Create an empty array container at 'pos'. */
+        if (r->len == r->alloc) {
+            r->alloc = r->alloc ? r->alloc*2 : 1;
+            r->containers = zrealloc(r->containers,sizeof(roaringContainer)*r->alloc);
+        }
+        memmove(r->containers+pos+1,r->containers+pos,
+                sizeof(roaringContainer)*(r->len-pos));
+        r->len++;
+        c = &r->containers[pos];
+        c->key = roaringKey(value);
+        c->card = 0;
+        c->alloc = ROARING_ARRAY_INITIAL;
+        c->data = zmalloc(sizeof(uint16_t)*c->alloc);
+        roaringTreeInvalidate(r);
+    }
+    if (!roaringContainerAdd(&r->containers[pos],roaringLow(value))) return 0;
+    r->card++;
+    roaringTreeUpdate(r,pos,1);
+    return 1;
+}
+
+//删除value, 成功删除返回1, 不存在返回0
+int roaringRemove(roaring *r, int64_t value) {
+    roaringContainer *c;
+    uint32_t pos;
+
+    if (!roaringSearch(r,roaringKey(value),&pos)) return 0;
+    c = &r->containers[pos];
+    if (!roaringContainerRemove(c,roaringLow(value))) return 0;
+    r->card--;
+    //container为空时删除它
+    if (c->card == 0) {
+        zfree(c->data);
+        memmove(r->containers+pos,r->containers+pos+1,
+                sizeof(roaringContainer)*(r->len-pos-1));
+        r->len--;
+        roaringTreeInvalidate(r);
+    } else {
+        roaringTreeUpdate(r,pos,-1);
+    }
+    return 1;
+}
+
+//value是否在集合中
+int roaringFind(roaring *r, int64_t value) {
+    uint32_t pos;
+
+    if (!roaringSearch(r,roaringKey(value),&pos)) return 0;
+    return roaringContainerFind(&r->containers[pos],roaringLow(value));
+}
+
+//返回集合的元素个数
+uint64_t roaringLen(roaring *r) {
+    return r->card;
+}
+
+/* Return a random element of a non empty roaring, in O(log N) once the
+ * tree of the container cardinalities is built. */
+//随机取到一个元素
+int64_t roaringRandom(roaring *r) {
+    uint64_t rank = (((uint64_t)rand() << 31) ^ (uint64_t)rand()) % r->card;
+    roaringContainer *c;
+
+    if (!r->treevalid) roaringTreeBuild(r);
+    c = &r->containers[roaringTreeSelect(r,&rank)];
+    return roaringValue(c->key,roaringContainerSelect(c,rank));
+}
+
+/* Return the memory used by the roaring, allocator overhead excluded. */
+//返回roaring占用的内存大小
+size_t roaringBytes(roaring *r) {
+    size_t bytes = sizeof(*r) + sizeof(roaringContainer)*r->alloc;
+    uint32_t j;
+
+    if (r->tree) bytes += sizeof(uint64_t)*(r->len+1);
+    for (j = 0; j < r->len; j++) {
+        roaringContainer *c = &r->containers[j];
+        bytes += roaringIsBitmap(c) ? ROARING_BITMAP_BYTES :
+                                      sizeof(uint16_t)*c->alloc;
+    }
+    return bytes;
+}
+
+/* ---------------------------- Iterator ------------------------------------ */
+
+//初始化迭代器, 从最小的元素开始
+void roaringInitIterator(roaring *r, roaringIterator *it) {
+    it->r = r;
+    it->ci = 0;
+    it->pos = 0;
+}
+
+/* Move the iterator to the first element >= value. */
+//将迭代器移动到第一个大于等于value的元素
+void roaringSeekIterator(roaringIterator *it, int64_t value) {
+    roaringContainer *c;
+    uint32_t pos;
+
+    if (roaringSearch(it->r,roaringKey(value),&pos)) {
+        c = &it->r->containers[pos];
+        it->ci = pos;
+        it->pos = roaringIsBitmap(c) ? roaringLow(value) :
+                  roaringArraySearch(c->data,c->card,roaringLow(value));
+    } else {
+        it->ci = pos;
+        it->pos = 0;
+    }
+}
+
+/* Store the current element in '*value' and move to the next one. Returns 0
+ * when there are no more elements. Elements are returned in order. */
+//取到迭代器的当前元素并移动到下一个, 元素按从小到大的顺序返回
+int roaringNext(roaringIterator *it, int64_t *value) {
+    roaring *r = it->r;
+
+    while (it->ci < r->len) {
+        roaringContainer *c = &r->containers[it->ci];
+
+        if (!roaringIsBitmap(c)) {
+            if (it->pos < c->card) {
+                *value = roaringValue(c->key,((uint16_t*)c->data)[it->pos++]);
+                return 1;
+            }
+        } else if (it->pos <= 0xffff) {
+            uint64_t *w = c->data;
+            uint32_t j = it->pos >> 6;
+            uint64_t word = w[j] & (~0ULL << (it->pos & 63));
+
+            while (word == 0 && ++j < ROARING_BITMAP_WORDS) word = w[j];
+            if (word) {
+                uint32_t low = (j<<6) + __builtin_ctzll(word);
+                it->pos = low+1;
+                *value = roaringValue(c->key,low);
+                return 1;
+            }
+        }
+        it->ci++;
+        it->pos = 0;
+    }
+    return 0;
+}
+
+/* -------------------------- Set operations -------------------------------- */
+
+//两个roaring的交集
+static roaring *roaringAnd(roaring *a, roaring *b) {
+    roaring *res = roaringNew();
+    roaringContainer c;
+    uint32_t j = 0, k = 0;
+
+    while (j < a->len && k < b->len) {
+        if (a->containers[j].key < b->containers[k].key) {
+            j++;
+        } else if (a->containers[j].key > b->containers[k].key) {
+            k++;
+        } else {
+            if (roaringContainerAnd(&a->containers[j],&b->containers[k],&c))
+                roaringAppend(res,&c);
+            j++;
+            k++;
+        }
+    }
+    return res;
+}
+
+/* Add all the elements of 'src' to 'dst'. */
+//将src的元素合并到dst中
+static void roaringOr(roaring *dst, roaring *src) {
+    roaringContainer *out, *c;
+    uint32_t j = 0, k = 0, n = 0;
+    uint64_t card = 0;
+
+    if (src->len == 0) return;
+    out = zmalloc(sizeof(roaringContainer)*(dst->len+src->len));
+    while (j < dst->len || k < src->len) {
+        c = &out[n++];
+        if (k == src->len ||
+            (j < dst->len && dst->containers[j].key < src->containers[k].key))
+        {
+            *c = dst->containers[j++];
+        } else if (j == dst->len ||
+                   src->containers[k].key < dst->containers[j].key)
+        {
+            roaringContainerDup(c,&src->containers[k++]);
+        } else {
+            roaringContainerOr(&dst->containers[j],&src->containers[k++]);
+            *c = dst->containers[j++];
+        }
+        card += c->card;
+    }
+    zfree(dst->containers);
+    dst->containers = out;
+    dst->alloc = dst->len+src->len;
+    dst->len = n;
+    dst->card = card;
+    roaringTreeInvalidate(dst);
+}
+
+/* Return a new roaring with the elements of sets[0] that are in all the other
+ * sets. Passing the sets from the smallest to the largest is faster. */
+//返回所有集合的交集组成的新roaring
+roaring *roaringIntersect(roaring **sets, unsigned long setnum) {
+    roaring *res, *tmp;
+    unsigned long j;
+
+    if (setnum == 1) return roaringDup(sets[0]);
+    res = roaringAnd(sets[0],sets[1]);
+    for (j = 2; j < setnum && res->card; j++) {
+        tmp = roaringAnd(res,sets[j]);
+        roaringFree(res);
+        res = tmp;
+    }
+    return res;
+}
+
+/* Return a new roaring with the elements of all the sets. */
+//返回所有集合的并集组成的新roaring
+roaring *roaringUnion(roaring **sets, unsigned long setnum) {
+    roaring *res = roaringDup(sets[0]);
+    unsigned long j;
+
+    for (j = 1; j < setnum; j++) roaringOr(res,sets[j]);
+    return res;
+}
+
+/* -------------------------- Serialization --------------------------------- */
+
+/* The serialized format is independent of the in memory one, all the
+ * integers are little endian:
+ *
+ * <len:uint32> then for every container <key:int64><card:uint32><payload>
+ *
+ * The payload is the 8192 bytes bitmap when card > ROARING_ARRAY_MAX, the
+ * sorted array of card uint16_t values otherwise. */
+
+//序列化后container的值占用的字节数
+static size_t roaringPayloadLen(uint32_t card) {
+    return card > ROARING_ARRAY_MAX ? ROARING_BITMAP_BYTES :
+                                      sizeof(uint16_t)*card;
+}
+
+//返回序列化后的字节数
+size_t roaringSerializedLen(roaring *r) {
+    size_t len = sizeof(uint32_t);
+    uint32_t j;
+
+    for (j = 0; j < r->len; j++)
+        len += sizeof(int64_t)+sizeof(uint32_t)+
+               roaringPayloadLen(r->containers[j].card);
+    return len;
+}
+
+//将roaring序列化到buf中
+void roaringSerialize(roaring *r, unsigned char *buf) {
+    unsigned char *p = buf;
+    uint32_t j, k, v32;
+    int64_t v64;
+
+    v32 = intrev32ifbe(r->len);
+    memcpy(p,&v32,sizeof(v32));
+    p += sizeof(v32);
+    for (j = 0; j < r->len; j++) {
+        roaringContainer *c = &r->containers[j];
+
+        v64 = c->key;
+        memrev64ifbe(&v64);
+        memcpy(p,&v64,sizeof(v64));
+        p += sizeof(v64);
+        v32 = intrev32ifbe(c->card);
+        memcpy(p,&v32,sizeof(v32));
+        p += sizeof(v32);
+
+        if (c->card > ROARING_ARRAY_MAX) {
+            /* Only bitmaps can hold so many values. */
+            memcpy(p,c->data,ROARING_BITMAP_BYTES);
+            for (k = 0; k < ROARING_BITMAP_WORDS; k++)
+                memrev64ifbe(p+k*sizeof(uint64_t));
+        } else {
+            if (roaringIsBitmap(c))
+                roaringBitmapExtract(c->data,(uint16_t*)p);
+            else
+                memcpy(p,c->data,sizeof(uint16_t)*c->card);
+            for (k = 0; k < c->card; k++)
+                memrev16ifbe(p+k*sizeof(uint16_t));
+        }
+        p += roaringPayloadLen(c->card);
+    }
+}
+
+/* Load a roaring serialized by roaringSerialize(). The input is validated:
+ * NULL is returned if it is truncated, if the containers are not sorted or
+ * if the cardinalities don't match the payloads. */
+//从buf中读出roaring, 格式错误时返回NULL
+roaring *roaringDeserialize(unsigned char *buf, size_t len) {
+    unsigned char *p = buf, *end = buf+len;
+    roaring *r = roaringNew();
+    roaringContainer c;
+    uint32_t num, j, k;
+
+    if (len < sizeof(uint32_t)) goto err;
+    memcpy(&num,p,sizeof(num));
+    num = intrev32ifbe(num);
+    p += sizeof(num);
+    for (j = 0; j < num; j++) {
+        if ((size_t)(end-p) < sizeof(int64_t)+sizeof(uint32_t)) goto err;
+        memcpy(&c.key,p,sizeof(c.key));
+        memrev64ifbe(&c.key);
+        p += sizeof(c.key);
+        memcpy(&c.card,p,sizeof(c.card));
+        c.card = intrev32ifbe(c.card);
+        p += sizeof(c.card);
+        if (c.card == 0 || c.card > 65536 ||
+            (size_t)(end-p) < roaringPayloadLen(c.card)) goto err;
+        if (r->len && r->containers[r->len-1].key >= c.key) goto err;
+        if (c.key < INT64_MIN>>16 || c.key > INT64_MAX>>16) goto err;
+
+        c.data = zmalloc(roaringPayloadLen(c.card));
+        memcpy(c.data,p,roaringPayloadLen(c.card));
+        p += roaringPayloadLen(c.card);
+        if (c.card > ROARING_ARRAY_MAX) {
+            uint64_t *w = c.data;
+
+            for (k = 0; k < ROARING_BITMAP_WORDS; k++) memrev64ifbe(w+k);
+            c.alloc = 0;
+            if (roaringBitmapCount(w) != c.card) {
+                zfree(w);
+                goto err;
+            }
+        } else {
+            uint16_t *a = c.data;
+
+            for (k = 0; k < c.card; k++) {
+                memrev16ifbe(a+k);
+                if (k && a[k-1] >= a[k]) {
+                    zfree(a);
+                    goto err;
+                }
+            }
+            c.alloc = c.card;
+        }
+        roaringAppend(r,&c);
+    }
+    if (p != end) goto err;
+    return r;
+
+err:
+    roaringFree(r);
+    return NULL;
+}
+
+#ifdef ROARING_TEST_MAIN
+#include <sys/time.h>
+#include <time.h>
+#include "intset.h"
+
+/* Self test of the roaring against a byte per value reference over a range
+ * of values, followed by memory and speed measures. Build with
+ * make roaring-benchmark. */
+
+#define assert(_e) ((_e)?(void)0:(_assert(#_e,__FILE__,__LINE__),exit(1)))
+void _assert(char *estr, char *file, int line) {
+    printf("\n\n=== ASSERTION FAILED ===\n");
+    printf("==> %s:%d '%s' is not true\n",file,line,estr);
+}
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+static volatile long long sink; /* Keeps the benchmark loops alive. */
+
+/* The reference covers TEST_RANGE values starting at TEST_BASE, across the
+ * zero so that negative keys are exercised too. */
+#define TEST_RANGE (1<<20)
+#define TEST_BASE (-(1LL<<19))
+
+/* Random value of the test range, dense in some chunks only. */
+static int64_t testValue(void) {
+    int64_t chunk = rand() % (TEST_RANGE>>16);
+
+    if (chunk % 3 == 0) return TEST_BASE + (chunk<<16) + rand() % 65536;
+    return TEST_BASE + (chunk<<16) + (rand() % 64) * 1024;
+}
+
+//检查roaring与参照数组中的元素是否一致
+static void verify(roaring *r, unsigned char *ref) {
+    roaringIterator it;
+    int64_t v, prev = INT64_MIN;
+    uint64_t count = 0;
+    long j;
+
+    roaringInitIterator(r,&it);
+    while (roaringNext(&it,&v)) {
+        assert(v >= TEST_BASE && v < TEST_BASE+TEST_RANGE);
+        assert(ref[v-TEST_BASE]);
+        assert(count == 0 || v > prev);
+        prev = v;
+        count++;
+    }
+    assert(count == roaringLen(r));
+    for (j = 0, count = 0; j < TEST_RANGE; j++) count += ref[j];
+    assert(count == roaringLen(r));
+}
+
+static roaring *randomRoaring(unsigned char *ref, long n) {
+    roaring *r = roaringNew();
+    int64_t v;
+
+    memset(ref,0,TEST_RANGE);
+    while (n--) {
+        v = testValue();
+        assert(roaringAdd(r,v) == !ref[v-TEST_BASE]);
+        ref[v-TEST_BASE] = 1;
+    }
+    return r;
+}
+
+int main(int argc, char **argv) {
+    unsigned char *ref = zmalloc(TEST_RANGE), *ref2 = zmalloc(TEST_RANGE);
+    roaring *r, *r2, *res, *sets[3];
+    int64_t v;
+    long j, k;
+    long long start;
+
+    (void)argc;
+    (void)argv;
+    srand(time(NULL));
+
+    printf("Add, remove and find against a reference: "); {
+        r = randomRoaring(ref,200000);
+        verify(r,ref);
+        for (j = 0; j < 400000; j++) {
+            v = testValue();
+            if (rand() % 2) {
+                assert(roaringRemove(r,v) == ref[v-TEST_BASE]);
+                ref[v-TEST_BASE] = 0;
+            } else {
+                assert(roaringFind(r,v) == ref[v-TEST_BASE]);
+            }
+        }
+        verify(r,ref);
+        /* Empty it completely to exercise the container removal. */
+        for (j = 0; j < TEST_RANGE; j++) {
+            assert(roaringRemove(r,TEST_BASE+j) == ref[j]);
+            ref[j] = 0;
+        }
+        assert(roaringLen(r) == 0 && r->len == 0);
+        roaringFree(r);
+        printf("OK\n");
+    }
+
+    printf("Extreme values: "); {
+        int64_t ext[] = {INT64_MIN, INT64_MIN+1, -65537, -65536, -1, 0, 1,
+                         65535, 65536, INT64_MAX-1, INT64_MAX};
+        int n = sizeof(ext)/sizeof(ext[0]);
+        roaringIterator it;
+
+        r = roaringNew();
+        for (j = n-1; j >= 0; j--) assert(roaringAdd(r,ext[j]));
+        for (j = 0; j < n; j++) assert(roaringFind(r,ext[j]));
+        assert(!roaringFind(r,2) && !roaringFind(r,INT64_MIN+2));
+        roaringInitIterator(r,&it);
+        for (j = 0; j < n; j++) assert(roaringNext(&it,&v) && v == ext[j]);
+        assert(!roaringNext(&it,&v));
+        roaringFree(r);
+        printf("OK\n");
+    }
+
+    printf("Iterator seek and random elements: "); {
+        roaringIterator it;
+        int64_t w;
+
+        r = randomRoaring(ref,100000);
+        for (j = 0; j < 1000; j++) {
+            v = TEST_BASE + rand() % TEST_RANGE;
+            roaringInitIterator(r,&it);
+            roaringSeekIterator(&it,v);
+            for (k = v-TEST_BASE; k < TEST_RANGE && !ref[k]; k++);
+            if (k == TEST_RANGE) {
+                assert(!roaringNext(&it,&w));
+            } else {
+                assert(roaringNext(&it,&w) && w == TEST_BASE+k);
+            }
+            v = roaringRandom(r);
+            assert(ref[v-TEST_BASE]);
+        }
+        /* Random elements stay right while the tree of the container
+         * cardinalities is updated and rebuilt, like with SPOP. */
+        for (j = 0, k = roaringLen(r); j < k; j++) {
+            v = roaringRandom(r);
+            assert(ref[v-TEST_BASE] && roaringRemove(r,v));
+            ref[v-TEST_BASE] = 0;
+            if (j % 3 == 0) {
+                w = testValue();
+                roaringAdd(r,w);
+                ref[w-TEST_BASE] = 1;
+            }
+        }
+        verify(r,ref);
+        roaringFree(r);
+
+        /* Every element is picked with the same probability. */
+        {
+            int64_t vals[] = {-65536, 0, 1, 2, 65536, 65537, 1LL<<40};
+            long counts[7] = {0};
+            int n = 7;
+
+            r = roaringNew();
+            for (k = 0; k < n; k++) roaringAdd(r,vals[k]);
+            for (j = 0; j < 700000; j++) {
+                v = roaringRandom(r);
+                for (k = 0; k < n && vals[k] != v; k++);
+                assert(k < n);
+                counts[k]++;
+            }
+            for (k = 0; k < n; k++)
+                assert(counts[k] > 90000 && counts[k] < 110000);
+            roaringFree(r);
+        }
+        printf("OK\n");
+    }
+
+    printf("Intersection and union against a reference: "); {
+        for (j = 0; j < 20; j++) {
+            r = randomRoaring(ref,rand() % 300000);
+            r2 = randomRoaring(ref2,rand() % 300000);
+            sets[0] = r;
+            sets[1] = r2;
+
+            res = roaringIntersect(sets,2);
+            for (k = 0; k < TEST_RANGE; k++)
+                assert(roaringFind(res,TEST_BASE+k) == (ref[k] && ref2[k]));
+            roaringFree(res);
+
+            res = roaringUnion(sets,2);
+            for (k = 0; k < TEST_RANGE; k++) {
+                assert(roaringFind(res,TEST_BASE+k) == (ref[k] || ref2[k]));
+                ref[k] |= ref2[k];
+            }
+            verify(res,ref);
+            roaringFree(res);
+            roaringFree(r);
+            roaringFree(r2);
+        }
+        printf("OK\n");
+    }
+
+    printf("Serialization: "); {
+        unsigned char *buf;
+        size_t len;
+
+        r = randomRoaring(ref,300000);
+        len = roaringSerializedLen(r);
+        buf = zmalloc(len);
+        roaringSerialize(r,buf);
+        r2 = roaringDeserialize(buf,len);
+        assert(r2 != NULL);
+        verify(r2,ref);
+        assert(roaringDeserialize(buf,len-1) == NULL);
+        /* Unsorted containers are rejected. */
+        if (r->len > 1) {
+            unsigned char *p = buf+sizeof(uint32_t);
+            int64_t key = INT64_MAX>>16;
+
+            memrev64ifbe(&key);
+            memcpy(p,&key,sizeof(key));
+            assert(roaringDeserialize(buf,len) == NULL);
+        }
+        zfree(buf);
+        roaringFree(r);
+        roaringFree(r2);
+        printf("OK\n");
+    }
+
+    printf("\nMemory for 1M values (roaring vs intset):\n"); {
+        struct { char *name; int64_t range; } dist[] = {
+            {"dense ids in [0,1.1M)", 1100000},
+            {"ids in [0,16M)", 16000000},
+            {"sparse ids in [0,4G)", 4000000000LL}
+        };
+        intset *is;
+
+        for (k = 0; k < 3; k++) {
+            r = roaringNew();
+            is = intsetNew();
+            while (roaringLen(r) < 1000000) {
+                v = ((((int64_t)rand()) << 31) ^ rand()) % dist[k].range;
+                roaringAdd(r,v);
+            }
+            /* Build the intset from the ordered elements, as it would be
+             * way too slow to add them in random order. */
+            {
+                roaringIterator it;
+                roaringInitIterator(r,&it);
+                while (roaringNext(&it,&v)) is = intsetAdd(is,v,NULL);
+            }
+            printf("  %-24s %6.2f vs %6.2f bytes per value\n", dist[k].name,
+                (double)roaringBytes(r)/roaringLen(r),
+                (double)intsetBlobLen(is)/intsetLen(is));
+            roaringFree(r);
+            zfree(is);
+        }
+    }
+
+    printf("\nSpeed with 1M values in [0,16M):\n"); {
+        int iter = 1000000;
+
+        r = roaringNew();
+        r2 = roaringNew();
+        start = usec();
+        while (roaringLen(r) < 1000000) roaringAdd(r,rand() % 16000000);
+        printf("  add:            %.3f usec/op\n",
+            (double)(usec()-start)/roaringLen(r));
+        while (roaringLen(r2) < 1000000) roaringAdd(r2,rand() % 16000000);
+
+        start = usec();
+        for (j = 0; j < iter; j++) sink += roaringFind(r,rand() % 16000000);
+        printf("  find:           %.3f usec/op\n",(double)(usec()-start)/iter);
+
+        sets[0] = r;
+        sets[1] = r2;
+        start = usec();
+        for (j = 0; j < 10; j++) {
+            res = roaringIntersect(sets,2);
+            sink += roaringLen(res);
+            roaringFree(res);
+        }
+        printf("  intersect 1M x 1M: %lld usec\n",(usec()-start)/10);
+        start = usec();
+        for (j = 0; j < 10; j++) {
+            res = roaringUnion(sets,2);
+            sink += roaringLen(res);
+            roaringFree(res);
+        }
+        printf("  union 1M + 1M:     %lld usec\n",(usec()-start)/10);
+
+        start = usec();
+        for (j = 0; j < iter; j++) sink += roaringRandom(r);
+        printf("  random:         %.3f usec/op\n",(double)(usec()-start)/iter);
+        roaringFree(r);
+        roaringFree(r2);
+    }
+
+    printf("\nRandom elements of 100k sparse values (i*65536):\n"); {
+        int iter = 1000000;
+
+        /* One container per value, the worst case to find the container
+         * of a given rank. */
+        r = roaringNew();
+        for (j = 0; j < 100000; j++) roaringAdd(r,j*65536);
+        start = usec();
+        for (j = 0; j < iter; j++) sink += roaringRandom(r);
+        printf("  random:         %.3f usec/op\n",(double)(usec()-start)/iter);
+
+        /* Removing a value deletes its container and invalidates the tree,
+         * adding it back creates the container again. */
+        start = usec();
+        for (j = 0; j < 1000; j++) {
+            v = roaringRandom(r);
+            roaringRemove(r,v);
+            roaringAdd(r,v);
+        }
+        printf("  random+remove+add: %.3f usec/op\n",
+            (double)(usec()-start)/1000);
+        roaringFree(r);
+    }
+    zfree(ref);
+    zfree(ref2);
+    return 0;
+}
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2014, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ROARING_H
+#define __ROARING_H
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * roaring是大的整数集合所使用的压缩编码。整数按高48位分到不同的container中,
+ * 每个container保存低16位: 值少时是有序的uint16_t数组, 值多时是65536位的位图。
+ * 具体解释参照.c文件中的注释。
+ */
+
+typedef struct roaringContainer {
+    int64_t key;        //值的高48位 (value >> 16)
+    uint32_t card;      //container中值的个数
+    uint32_t alloc;     //数组分配的元素个数, 位图时为0
+    void *data;         //有序的uint16_t数组, 或者1024个uint64_t的位图
+} roaringContainer;
+
+typedef struct roaring {
+    uint64_t card;                  //集合中元素个数
+    uint32_t len;                   //container个数
+    uint32_t alloc;                 //分配的container个数
+    roaringContainer *containers;   //按key排序的container
+    uint64_t *tree;                 //container基数的树状数组, 随机取元素时使用
+    int treevalid;                  //树状数组是否与container一致, 否则需要重建
+} roaring;
+
+typedef struct roaringIterator {
+    roaring *r;
+    uint32_t ci;        //当前container
+    uint32_t pos;       //数组中的下标, 或者位图中的位
+} roaringIterator;
+
+//创建一个新的roaring
+roaring *roaringNew(void);
+
+//释放roaring
+void roaringFree(roaring *r);
+
+//复制一个roaring
+roaring *roaringDup(roaring *r);
+
+//添加value, 成功添加返回1, 已经存在返回0
+int roaringAdd(roaring *r, int64_t value);
+
+//删除value, 成功删除返回1, 不存在返回0
+int roaringRemove(roaring *r, int64_t value);
+
+//value是否在集合中
+int roaringFind(roaring *r, int64_t value);
+
+//返回集合的元素个数
+uint64_t roaringLen(roaring *r);
+
+//随机取到一个元素, 集合不能为空
+int64_t roaringRandom(roaring *r);
+
+//返回roaring占用的内存大小
+size_t roaringBytes(roaring *r);
+
+//初始化迭代器, 从最小的元素开始
+void roaringInitIterator(roaring *r, roaringIterator *it);
+
+//将迭代器移动到第一个大于等于value的元素
+void roaringSeekIterator(roaringIterator *it, int64_t value);
+
+//取到迭代器的当前元素并移动到下一个, 没有元素时返回0
+int roaringNext(roaringIterator *it, int64_t *value);
+
+//返回所有集合的交集组成的新roaring
+roaring *roaringIntersect(roaring **sets, unsigned long setnum);
+
+//返回所有集合的并集组成的新roaring
+roaring *roaringUnion(roaring **sets, unsigned long setnum);
+
+//返回序列化后的字节数
+size_t roaringSerializedLen(roaring *r);
+
+//将roaring序列化到buf中, buf至少有roaringSerializedLen()字节
+void roaringSerialize(roaring *r, unsigned char *buf);
+
+//从buf中读出roaring, 格式错误时返回NULL
+roaring *roaringDeserialize(unsigned char *buf, size_t len);
+
+#endif /* __ROARING_H */
@@ -35,32 +35,74 @@
 
 #include <sys/types.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 typedef char *sds;
 
 
 //sds的结构体。一个sds是一个char*,直接指向字符串。
-//在sds指针前的内存是sdshdr结构体，保存len,free等信息
-struct sdshdr {
-    int len;    //sds的长度
-    int free;   //空闲的长度
-    char buf[]; //保存string的指针
+//在sds指针前的内存是sds的header，保存len,alloc等信息
+//header有四种，len和alloc分别使用8,16,32,64位，按照字符串的长度选择最小的一种
+//buf前的一个字节是flags，低3位保存header的类型，由此可以从sds找到header的开始
+
+/* The headers are packed so that the flags byte is always right before the
+ * string, whatever the header type. 'alloc' is the size of the buffer
+ * excluding the header and the null term. */
+struct __attribute__ ((__packed__)) sdshdr8 {
+    uint8_t len;            //sds的长度
+    uint8_t alloc;          //buf的大小, 不包括header和结尾的'\0'
+    unsigned char flags;    //低3位是header的类型
+    char buf[];             //保存string的指针
+};
+struct __attribute__ ((__packed__)) sdshdr16 {
+    uint16_t len;
+    uint16_t alloc;
+    unsigned char flags;
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr32 {
+    uint32_t len;
+    uint32_t alloc;
+    unsigned char flags;
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr64 {
+    uint64_t len;
+    uint64_t alloc;
+    unsigned char flags;
+    char buf[];
 };
 
+#define SDS_TYPE_8  0
+#define SDS_TYPE_16 1
+#define SDS_TYPE_32 2
+#define SDS_TYPE_64 3
+#define SDS_TYPE_MASK 7
+//从sds取到类型为T的header
+#define SDS_HDR(T,s) ((struct sdshdr##T *)((s)-(sizeof(struct sdshdr##T))))
+
 //取到sds的长度。
 static inline size_t sdslen(const sds s) {
-	//s是string开始的地方，s减去sizeof(struct sdshdr)后sh指向string对应sdshdr结构体
-    struct sdshdr *sh = (void*)(s-(sizeof(struct sdshdr)));
-    //返回sdshdr->len
-    return sh->len;
+    //s[-1]是flags，按照header的类型读取len
+    switch(s[-1]&SDS_TYPE_MASK) {
+    case SDS_TYPE_8: return SDS_HDR(8,s)->len;
+    case SDS_TYPE_16: return SDS_HDR(16,s)->len;
+    case SDS_TYPE_32: return SDS_HDR(32,s)->len;
+    case SDS_TYPE_64: return SDS_HDR(64,s)->len;
+    }
+    return 0;
 }
 
 //取到sds中多余的空间大小
 static inline size_t sdsavail(const sds s) {
-	//指向sds对应的sdshdr
-    struct sdshdr *sh = (void*)(s-(sizeof(struct sdshdr)));
-    //返回free字段
-    return sh->free;
+    //空闲的长度是alloc-len
+    switch(s[-1]&SDS_TYPE_MASK) {
+    case SDS_TYPE_8: return SDS_HDR(8,s)->alloc-SDS_HDR(8,s)->len;
+    case SDS_TYPE_16: return SDS_HDR(16,s)->alloc-SDS_HDR(16,s)->len;
+    case SDS_TYPE_32: return SDS_HDR(32,s)->alloc-SDS_HDR(32,s)->len;
+    case SDS_TYPE_64: return SDS_HDR(64,s)->alloc-SDS_HDR(64,s)->len;
+    }
+    return 0;
 }
 
 //创建一个长度为initlen，string内容与init指向字符串一样的的sds
@@ -157,8 +199,11 @@ sds sdsjoin(char **argv, int argc, char *sep);
 //为sds s的string内存增加addlen字节
 sds sdsMakeRoomFor(sds s, size_t addlen);
 
+//为sds s的string内存增加addlen字节, 不多分配额外的空间
+sds sdsMakeRoomForNonGreedy(sds s, size_t addlen);
+
 //将sds的长度增长incr
-void sdsIncrLen(sds s, int incr);
+void sdsIncrLen(sds s, ssize_t incr);
 
 //移除sds中的多余的内存
 sds sdsRemoveFreeSpace(sds s);
@@ -166,4 +211,7 @@ sds sdsRemoveFreeSpace(sds s);
 //返回sds占用的总内存大小
 size_t sdsAllocSize(sds s);
 
+//返回sds的header的开始地址, 即分配的内存的地址
+void *sdsAllocPtr(sds s);
+
 #endif
@@ -0,0 +1,531 @@
+/*
+ * Copyright (c) 2014, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+#include "bio.h"
+#include "endianconv.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+
+/* -----------------------------------------------------------------------------
+ * Fork-less snapshots
+ *
+ * When rdb-forkless-snapshot is enabled BGSAVE does not fork. The dataset is
+ * serialized in the RDB format by the main thread itself, a bucket at a time
+ * from a time event that never runs for more than about a millisecond, while
+ * a bio thread writes the produced buffers to the temp file and fsyncs it.
+ * The file is renamed into place once everything reached the disk.
+ *
+ * To obtain a point in time view while clients keep writing:
+ *
+ * 1) At start every db dictionary is pinned (its safe iterators counter is
+ *    incremented) so that incremental rehashing stops and every key stays in
+ *    the bucket where it was when the snapshot started. The cursor is just
+ *    (db, table, bucket) and a key is "visited" if its bucket precedes it.
+ *
+ * 2) Before a key not yet visited is modified, expired, deleted or has its
+ *    TTL changed, its current value (the pre-image) is serialized right away
+ *    and the key is remembered in a per db skip set.
+ *
+ * 3) Keys created after the start in a bucket the cursor will still visit
+ *    are added to the skip set as well, so they are not saved.
+ *
+ * The cursor ignores keys found in the skip set. Keys are never saved twice,
+ * so the RDB loader is unchanged. The price is the skip set (reported as
+ * rdb_forkless_tracked_keys in INFO) and the buffers waiting for the writer
+ * (rdb_forkless_pending_bytes), that are bounded by pausing the cursor.
+ * -------------------------------------------------------------------------- */
+
+#define REDIS_SNAPSHOT_STEP_USEC 1000       /* Max duration of a cursor step. */
+#define REDIS_SNAPSHOT_FLUSH_BYTES (1024*1024)  /* Hand buffers off at 1MB. */
+#define REDIS_SNAPSHOT_MAX_PENDING (1024*1024*64) /* Pause the cursor above. */
+
+#define SNAPSHOT_NONE 0         /* No snapshot in progress. */
+#define SNAPSHOT_ACTIVE 1       /* The cursor is walking the keyspace. */
+#define SNAPSHOT_SYNCING 2      /* Everything emitted, waiting for the fsync. */
+
+#define SNAPSHOT_JOB_WRITE 0
+#define SNAPSHOT_JOB_FSYNC 1
+#define SNAPSHOT_JOB_CLOSE 2
+
+/* State shared with the bio thread, protected by snapshot_mutex. It is freed
+ * by the main thread or by the close job, whichever comes last. */
+typedef struct snapshotWriter {
+    int fd;
+    int err;            /* First write / fsync errno, 0 if none. */
+    int done;           /* The close job was processed. */
+    int abandoned;      /* The main thread no longer cares about this file. */
+} snapshotWriter;
+
+typedef struct snapshotDb {
+    unsigned long size[2];  /* Hash tables sizes when the snapshot started. */
+    int pinned;             /* We still hold the iterators reference. */
+    dict *skip;             /* Keys the cursor must not save. */
+} snapshotDb;
+
+static struct {
+    int state;
+    char tmpfile[256];
+    char *filename;
+    snapshotWriter *writer;
+    rio rdb;                /* Buffer rio collecting the serialized data. */
+    int dbid;               /* Cursor: db, */
+    int table;              /* hash table, */
+    unsigned long idx;      /* and bucket. */
+    int lastdb;             /* Last SELECTDB emitted. */
+    long long now;          /* Start time, keys expired before it are skipped. */
+    snapshotDb *dbs;
+    long long timer_id;
+} ss = {SNAPSHOT_NONE,"",NULL,NULL,{0},0,0,0,-1,0,NULL,-1};
+
+static pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t snapshot_pending_bytes = 0;
+
+unsigned int dictSdsHash(const void *key);
+int dictSdsKeyCompare(void *privdata, const void *key1, const void *key2);
+void dictSdsDestructor(void *privdata, void *val);
+
+/* Skip set, keys are sds strings owned by the set. */
+static dictType snapshotSkipDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    NULL                        /* val destructor */
+};
+
+/* ---------------------------- Writer thread ------------------------------- */
+
+/* Called by the REDIS_BIO_SNAPSHOT_WRITE thread for every job queued by
+ * snapshotFlush() and snapshotFinish(). */
+//后台线程执行的写入、fsync和关闭操作
+void snapshotProcessJob(void *arg1, void *arg2, void *arg3) {
+    snapshotWriter *w = arg1;
+    sds buf = arg2;
+    long op = (long) arg3;
+    int skip, err = 0, freeit = 0;
+
+    pthread_mutex_lock(&snapshot_mutex);
+    skip = w->err || w->abandoned;
+    pthread_mutex_unlock(&snapshot_mutex);
+
+    if (op == SNAPSHOT_JOB_WRITE) {
+        size_t len = sdslen(buf), nwritten = 0;
+
+        while (!skip && nwritten < len) {
+            ssize_t n = write(w->fd,buf+nwritten,len-nwritten);
+
+            if (n == -1) {
+                if (errno == EINTR) continue;
+                err = errno;
+                break;
+            }
+            nwritten += n;
+        }
+        sdsfree(buf);
+        pthread_mutex_lock(&snapshot_mutex);
+        snapshot_pending_bytes -= len;
+        if (err && !w->err) w->err = err;
+        pthread_mutex_unlock(&snapshot_mutex);
+    } else if (op == SNAPSHOT_JOB_FSYNC) {
+        if (!skip && aof_fsync(w->fd) == -1) {
+            pthread_mutex_lock(&snapshot_mutex);
+            if (!w->err) w->err = errno;
+            pthread_mutex_unlock(&snapshot_mutex);
+        }
+    } else if (op == SNAPSHOT_JOB_CLOSE) {
+        close(w->fd);
+        pthread_mutex_lock(&snapshot_mutex);
+        w->done = 1;
+        freeit = w->abandoned;
+        pthread_mutex_unlock(&snapshot_mutex);
+        if (freeit) zfree(w);
+    }
+}
+
+/* Bytes produced by the cursor and not yet written by the bio thread. */
+size_t snapshotPendingBytes(void) {
+    size_t pending;
+
+    pthread_mutex_lock(&snapshot_mutex);
+    pending = snapshot_pending_bytes;
+    pthread_mutex_unlock(&snapshot_mutex);
+    return pending;
+}
+
+/* Queue the current buffer for writing if it is big enough, or in any case
+ * if 'force' is true. */
+static void snapshotFlush(int force) {
+    sds buf = ss.rdb.io.buffer.ptr;
+    size_t len = sdslen(buf);
+
+    if (len == 0 || (!force && len < REDIS_SNAPSHOT_FLUSH_BYTES)) return;
+    pthread_mutex_lock(&snapshot_mutex);
+    snapshot_pending_bytes += len;
+    if (snapshot_pending_bytes > server.stat_forkless_peak_pending)
+        server.stat_forkless_peak_pending = snapshot_pending_bytes;
+    pthread_mutex_unlock(&snapshot_mutex);
+    bioCreateBackgroundJob(REDIS_BIO_SNAPSHOT_WRITE,ss.writer,buf,
+        (void*)(long)SNAPSHOT_JOB_WRITE);
+    ss.rdb.io.buffer.ptr = sdsempty();
+    ss.rdb.io.buffer.pos = 0;
+}
+
+/* ------------------------------ Cursor ----------------------------------- */
+
+/* Serialize a key in the snapshot buffer, selecting its db if needed. */
+static void snapshotSaveKey(int dbid, sds keystr, robj *val) {
+    robj key;
+    long long expire;
+
+    if (ss.lastdb != dbid) {
+        rdbSaveType(&ss.rdb,REDIS_RDB_OPCODE_SELECTDB);
+        rdbSaveLen(&ss.rdb,dbid);
+        ss.lastdb = dbid;
+    }
+    initStaticStringObject(key,keystr);
+    expire = getExpire(server.db+dbid,&key);
+    if (rdbSaveKeyValuePair(&ss.rdb,&key,val,expire,ss.now) == 1)
+        server.stat_forkless_keys++;
+}
+
+/* Return the entry of 'key' if it exists and the cursor still has to reach
+ * it, NULL if the key is missing or if it is not part of what the cursor
+ * will save (already visited, or living in a table created after the start).
+ * The position is stable since the dictionary is pinned. */
+//如果key存在且尚未被游标访问，返回它的entry
+static dictEntry *snapshotPendingEntry(int dbid, sds key) {
+    snapshotDb *sd = ss.dbs+dbid;
+    dict *d = server.db[dbid].dict;
+    unsigned int h;
+    int table;
+
+    if (dbid < ss.dbid || dictSize(d) == 0) return NULL;
+    h = dictHashKey(d,key);
+    for (table = 0; table <= 1; table++) {
+        unsigned long idx;
+        dictEntry *he;
+
+        if (d->ht[table].size == 0) continue;
+        idx = h & d->ht[table].sizemask;
+        he = d->ht[table].table[idx];
+        while(he) {
+            if (dictCompareKeys(d,key,he->key)) {
+                if (sd->size[table] == 0) return NULL;
+                if (dbid == ss.dbid && (table < ss.table ||
+                    (table == ss.table && idx < ss.idx))) return NULL;
+                return he;
+            }
+            he = he->next;
+        }
+        if (!dictIsRehashing(d)) break;
+    }
+    return NULL;
+}
+
+static void snapshotSkipKey(int dbid, sds key) {
+    dict *skip = ss.dbs[dbid].skip;
+
+    if (dictFind(skip,key) == NULL) {
+        dictAdd(skip,sdsdup(key),NULL);
+        server.stat_forkless_tracked_keys++;
+    }
+}
+
+/* Called before 'key' is modified in any way: if the cursor did not save it
+ * yet, save its current value now. */
+//在key被修改之前调用，如果快照还没有保存该key，先保存它当前的值
+void snapshotKeyWillChange(redisDb *db, robj *key) {
+    dictEntry *de;
+
+    if (ss.state != SNAPSHOT_ACTIVE) return;
+    if ((de = snapshotPendingEntry(db->id,key->ptr)) == NULL) return;
+    if (dictFind(ss.dbs[db->id].skip,key->ptr) != NULL) return;
+    snapshotSaveKey(db->id,dictGetKey(de),dictGetVal(de));
+    snapshotSkipKey(db->id,key->ptr);
+    server.stat_forkless_preimages++;
+    snapshotFlush(0);
+}
+
+/* Called after 'key' was added: it did not exist when the snapshot started
+ * so the cursor must not save it. */
+//在key被添加之后调用，新的key不属于快照
+void snapshotKeyAdded(redisDb *db, robj *key) {
+    if (ss.state != SNAPSHOT_ACTIVE) return;
+    if (snapshotPendingEntry(db->id,key->ptr) == NULL) return;
+    snapshotSkipKey(db->id,key->ptr);
+}
+
+/* Unpin and release the state of every db. */
+static void snapshotReleaseDbs(void) {
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        if (ss.dbs[j].pinned) server.db[j].dict->iterators--;
+        dictRelease(ss.dbs[j].skip);
+    }
+    zfree(ss.dbs);
+    ss.dbs = NULL;
+}
+
+/* Release everything but the writer, that is handled by the callers. */
+static void snapshotReset(void) {
+    snapshotReleaseDbs();
+    sdsfree(ss.rdb.io.buffer.ptr);
+    ss.rdb.io.buffer.ptr = NULL;
+    zfree(ss.filename);
+    ss.filename = NULL;
+    ss.writer = NULL;
+    ss.state = SNAPSHOT_NONE;
+    server.rdb_forkless_in_progress = 0;
+    server.rdb_save_time_last = time(NULL)-server.rdb_save_time_start;
+    server.rdb_save_time_start = -1;
+}
+
+/* The cursor reached the end: terminate the file and ask the writer to
+ * fsync and close it. */
+static void snapshotFinish(void) {
+    uint64_t cksum;
+
+    rdbSaveType(&ss.rdb,REDIS_RDB_OPCODE_EOF);
+    cksum = ss.rdb.cksum;
+    memrev64ifbe(&cksum);
+    rioWrite(&ss.rdb,&cksum,8);
+    snapshotFlush(1);
+    bioCreateBackgroundJob(REDIS_BIO_SNAPSHOT_WRITE,ss.writer,NULL,
+        (void*)(long)SNAPSHOT_JOB_FSYNC);
+    bioCreateBackgroundJob(REDIS_BIO_SNAPSHOT_WRITE,ss.writer,NULL,
+        (void*)(long)SNAPSHOT_JOB_CLOSE);
+    ss.state = SNAPSHOT_SYNCING;
+}
+
+/* Advance the cursor for at most REDIS_SNAPSHOT_STEP_USEC microseconds,
+ * a bucket at a time. */
+//推进游标，每次最多执行REDIS_SNAPSHOT_STEP_USEC微秒
+static void snapshotStep(long long start) {
+    int buckets = 0;
+
+    while (ss.dbid < server.dbnum) {
+        snapshotDb *sd = ss.dbs+ss.dbid;
+        dict *d = server.db[ss.dbid].dict;
+        dictEntry *de;
+
+        if (ss.table == 2) {
+            /* This db is done, it can resume rehashing. */
+            d->iterators--;
+            sd->pinned = 0;
+            ss.dbid++;
+            ss.table = 0;
+            ss.idx = 0;
+            continue;
+        }
+        if (ss.idx >= sd->size[ss.table]) {
+            ss.table++;
+            ss.idx = 0;
+            continue;
+        }
+        redisAssert(d->ht[ss.table].size == sd->size[ss.table]);
+        de = d->ht[ss.table].table[ss.idx];
+        while(de) {
+            sds keystr = dictGetKey(de);
+
+            if (dictSize(sd->skip) == 0 || dictFind(sd->skip,keystr) == NULL)
+                snapshotSaveKey(ss.dbid,keystr,dictGetVal(de));
+            de = de->next;
+        }
+        ss.idx++;
+        if ((++buckets & 7) == 0) {
+            snapshotFlush(0);
+            if (ustime()-start > REDIS_SNAPSHOT_STEP_USEC) return;
+        }
+    }
+    snapshotFinish();
+}
+
+/* Stop the snapshot in progress, if any, removing the temp file. 'error'
+ * tells if this should be reported as a failed BGSAVE. */
+//终止正在进行的快照并删除临时文件
+void snapshotAbort(int error) {
+    int freeit;
+
+    if (ss.state == SNAPSHOT_NONE) return;
+    pthread_mutex_lock(&snapshot_mutex);
+    ss.writer->abandoned = 1;
+    freeit = ss.writer->done;
+    pthread_mutex_unlock(&snapshot_mutex);
+    if (freeit) {
+        zfree(ss.writer);
+    } else if (ss.state == SNAPSHOT_ACTIVE) {
+        bioCreateBackgroundJob(REDIS_BIO_SNAPSHOT_WRITE,ss.writer,NULL,
+            (void*)(long)SNAPSHOT_JOB_CLOSE);
+    }
+    unlink(ss.tmpfile);
+    if (error) server.lastbgsave_status = REDIS_ERR;
+    snapshotReset();
+}
+
+/* Rename the file into place once the writer closed it. */
+static void snapshotDone(void) {
+    int err = ss.writer->err;
+
+    zfree(ss.writer);
+    ss.writer = NULL;
+    if (!err && rename(ss.tmpfile,ss.filename) == -1) err = errno;
+    if (err) {
+        redisLog(REDIS_WARNING,"Background saving error (fork-less): %s",
+            strerror(err));
+        unlink(ss.tmpfile);
+        server.lastbgsave_status = REDIS_ERR;
+    } else {
+        redisLog(REDIS_NOTICE,
+            "Background saving terminated with success "
+            "(fork-less, %lld keys, %lld pre-images)",
+            server.stat_forkless_keys, server.stat_forkless_preimages);
+        server.dirty = server.dirty - server.dirty_before_bgsave;
+        server.lastsave = time(NULL);
+        server.lastbgsave_status = REDIS_OK;
+    }
+    snapshotReset();
+}
+
+static int snapshotCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+    long long start, elapsed;
+    int done, err;
+    REDIS_NOTUSED(eventLoop);
+    REDIS_NOTUSED(id);
+    REDIS_NOTUSED(clientData);
+
+    if (ss.state == SNAPSHOT_NONE) {
+        ss.timer_id = -1;
+        return AE_NOMORE;
+    }
+
+    pthread_mutex_lock(&snapshot_mutex);
+    done = ss.writer->done;
+    err = ss.writer->err;
+    pthread_mutex_unlock(&snapshot_mutex);
+
+    if (ss.state == SNAPSHOT_SYNCING) {
+        if (!done) return 1;
+        snapshotDone();
+        ss.timer_id = -1;
+        return AE_NOMORE;
+    }
+
+    if (err) {
+        redisLog(REDIS_WARNING,"Write error saving DB on disk (fork-less): %s",
+            strerror(err));
+        snapshotAbort(1);
+        ss.timer_id = -1;
+        return AE_NOMORE;
+    }
+
+    /* Let the writer catch up when too much data is waiting. */
+    if (snapshotPendingBytes() > REDIS_SNAPSHOT_MAX_PENDING) return 1;
+
+    start = ustime();
+    snapshotStep(start);
+    elapsed = ustime()-start;
+    if (elapsed > server.stat_forkless_max_step)
+        server.stat_forkless_max_step = elapsed;
+    /* Returning 0 would run us again in the same processTimeEvents() call,
+     * with no chance for the clients to be served in the meantime. */
+    return 1;
+}
+
+/* Start a fork-less snapshot to 'filename'. Return REDIS_ERR if one is
+ * already in progress or the temp file can't be created. */
+//开始一次不需要fork的快照
+int snapshotStart(char *filename) {
+    long long start = ustime();
+    char magic[10];
+    int fd, j;
+
+    if (ss.state != SNAPSHOT_NONE) return REDIS_ERR;
+
+    server.dirty_before_bgsave = server.dirty;
+    server.lastbgsave_try = time(NULL);
+
+    snprintf(ss.tmpfile,sizeof(ss.tmpfile),"temp-snapshot-%d.rdb",
+        (int) getpid());
+    fd = open(ss.tmpfile,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if (fd == -1) {
+        redisLog(REDIS_WARNING,"Failed opening .rdb for saving: %s",
+            strerror(errno));
+        server.lastbgsave_status = REDIS_ERR;
+        return REDIS_ERR;
+    }
+    ss.writer = zcalloc(sizeof(snapshotWriter));
+    ss.writer->fd = fd;
+    ss.filename = zstrdup(filename);
+
+    /* Pin every db: from now on keys don't move between buckets. */
+    ss.dbs = zcalloc(sizeof(snapshotDb)*server.dbnum);
+    for (j = 0; j < server.dbnum; j++) {
+        dict *d = server.db[j].dict;
+
+        ss.dbs[j].size[0] = d->ht[0].size;
+        ss.dbs[j].size[1] = d->ht[1].size;
+        ss.dbs[j].skip = dictCreate(&snapshotSkipDictType,NULL);
+        ss.dbs[j].pinned = 1;
+        d->iterators++;
+    }
+
+    rioInitWithBuffer(&ss.rdb,sdsempty());
+    if (server.rdb_checksum)
+        ss.rdb.update_cksum = rioGenericUpdateChecksum;
+    snprintf(magic,sizeof(magic),"REDIS%04d",REDIS_RDB_VERSION);
+    rioWrite(&ss.rdb,magic,9);
+    rdbSaveReplicationInfo(&ss.rdb);
+
+    ss.dbid = 0;
+    ss.table = 0;
+    ss.idx = 0;
+    ss.lastdb = -1;
+    ss.now = mstime();
+    ss.state = SNAPSHOT_ACTIVE;
+    if (ss.timer_id == -1) {
+        ss.timer_id = aeCreateTimeEvent(server.el,0,snapshotCron,NULL,NULL);
+        redisAssert(ss.timer_id != AE_ERR);
+    }
+
+    server.rdb_forkless_in_progress = 1;
+    server.rdb_save_time_start = time(NULL);
+    server.stat_forkless_snapshots++;
+    server.stat_forkless_keys = 0;
+    server.stat_forkless_preimages = 0;
+    server.stat_forkless_tracked_keys = 0;
+    server.stat_forkless_peak_pending = 0;
+    server.stat_forkless_max_step = 0;
+    server.stat_forkless_start_time = ustime()-start;
+    redisLog(REDIS_NOTICE,"Background saving started (fork-less snapshot)");
+    return REDIS_OK;
+}
@@ -296,9 +296,9 @@ void sortCommand(redisClient *c) {
     }
 
     /* Destructively convert encoded sorted sets for SORT. */
-    //如果是zset，将其用skiplist表示
-    if (sortval->type == REDIS_ZSET)
-        zsetConvert(sortval, REDIS_ENCODING_SKIPLIST);
+    //如果是zpack编码的zset，将其用skiplist或B+树表示
+    if (sortval->type == REDIS_ZSET && sortval->encoding == REDIS_ENCODING_ZPACK)
+        zsetConvert(sortval, server.zset_large_encoding);
 
     /* Objtain the length of the object to sort. */
     //取到key对应集合的长度
@@ -362,6 +362,26 @@ void sortCommand(redisClient *c) {
             j++;
         }
         setTypeReleaseIterator(si);
+    } else if (sortval->type == REDIS_ZSET && dontsort &&
+               sortval->encoding == REDIS_ENCODING_BTREE)
+    {
+        /* Same as below, the B+tree reaches the starting rank directly. */
+        zset *zs = sortval->ptr;
+        zbtreePos pos;
+        long zsetlen = zs->zbt->length;
+        int rangelen = vectorlen;
+
+        zbtreeGetElementByRank(zs->zbt,desc ? zsetlen-1-start : start,&pos);
+        while(rangelen--) {
+            redisAssertWithInfo(c,sortval,pos.leaf != NULL);
+            vector[j].obj = zbtreePosObj(&pos);
+            vector[j].u.score = 0;
+            vector[j].u.cmpobj = NULL;
+            j++;
+            if (desc) zbtreePrev(&pos); else zbtreeNext(&pos);
+        }
+        end -= start;
+        start = 0;
     } else if (sortval->type == REDIS_ZSET && dontsort) {
         /* Special handling for a sorted set, if 'dontsort' is true.
          * This makes sure we return elements in the sorted set original
@@ -521,8 +541,8 @@ void sortCommand(redisClient *c) {
             }
         }
     } else {
-    	//指定了store参数，创建一个ziplist保存结果
-        robj *sobj = createZiplistObject();
+    	//指定了store参数，创建一个listpack保存结果
+        robj *sobj = createListpackObject();
 
         /* STORE option specified, set the sorting result as a List object */
         for (j = start; j <= end; j++) {
@@ -35,20 +35,20 @@
  *----------------------------------------------------------------------------*/
 
 /* Check the length of a number of objects to see if we need to convert a
- * ziplist to a real hash. Note that we only check string encoded objects
+ * listpack to a real hash. Note that we only check string encoded objects
  * as their string length can be queried in constant time. */
- //检查是否需要将ziplist转换为hash table
+ //检查是否需要将listpack转换为hash table
 void hashTypeTryConversion(robj *o, robj **argv, int start, int end) {
     int i;
 
-    if (o->encoding != REDIS_ENCODING_ZIPLIST) return;
+    if (o->encoding != REDIS_ENCODING_LISTPACK) return;
 
     for (i = start; i <= end; i++) {
         if (argv[i]->encoding == REDIS_ENCODING_RAW &&
             sdslen(argv[i]->ptr) > server.hash_max_ziplist_value)
         {
 		    //当新的值的编码是raw，或者新的值的长度大于hash_max_ziplist_value
-			//将ziplist转换为hash table
+			//将listpack转换为hash table
             hashTypeConvert(o, REDIS_ENCODING_HT);
             break;
         }
@@ -64,10 +64,10 @@ void hashTypeTryObjectEncoding(robj *subject, robj **o1, robj **o2) {
     }
 }
 
-/* Get the value from a ziplist encoded hash, identified by field.
+/* Get the value from a listpack encoded hash, identified by field.
  * Returns -1 when the field cannot be found. */
-//从ziplist中取到field对应的value的entry的值
-int hashTypeGetFromZiplist(robj *o, robj *field,
+//从listpack中取到field对应的value的entry的值
+int hashTypeGetFromListpack(robj *o, robj *field,
                            unsigned char **vstr,
                            unsigned int *vlen,
                            long long *vll)
@@ -75,19 +75,19 @@ int hashTypeGetFromZiplist(robj *o, robj *field,
     unsigned char *zl, *fptr = NULL, *vptr = NULL;
     int ret;
 
-    redisAssert(o->encoding == REDIS_ENCODING_ZIPLIST);
+    redisAssert(o->encoding == REDIS_ENCODING_LISTPACK);
 
     field = getDecodedObject(field);
 
     zl = o->ptr;
-    fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+    fptr = lpIndex(zl, LP_HEAD);
     if (fptr != NULL) {
 	    //找到field(即key)所在的entry
-        fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+        fptr = lpFind(fptr, field->ptr, sdslen(field->ptr), 1);
         if (fptr != NULL) {
             /* Grab pointer to the value (fptr points to the field) */
 			//下一个entry是value的entry
-            vptr = ziplistNext(zl, fptr);
+            vptr = lpNext(zl, fptr);
             redisAssert(vptr != NULL);
         }
     }
@@ -96,7 +96,7 @@ int hashTypeGetFromZiplist(robj *o, robj *field,
 
     if (vptr != NULL) {
 	//取到value entry的值
-        ret = ziplistGet(vptr, vstr, vlen, vll);
+        ret = lpGet(vptr, vstr, vlen, vll);
         redisAssert(ret);
         return 0;
     }
@@ -128,12 +128,12 @@ int hashTypeGetFromHashTable(robj *o, robj *field, robj **value) {
 robj *hashTypeGetObject(robj *o, robj *field) {
     robj *value = NULL;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
-        //从ziplist找到value
-        if (hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll) == 0) {
+        //从listpack找到value
+        if (hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll) == 0) {
             if (vstr) {
                 value = createStringObject((char*)vstr, vlen);
             } else {
@@ -158,12 +158,12 @@ robj *hashTypeGetObject(robj *o, robj *field) {
  * exists, and 0 when it doesn't. */
  //检查给定的field是否存在在hash中
 int hashTypeExists(robj *o, robj *field) {
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        if (hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll) == 0) return 1;
+        if (hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll) == 0) return 1;
     } else if (o->encoding == REDIS_ENCODING_HT) {
         robj *aux;
 
@@ -182,46 +182,46 @@ int hashTypeExists(robj *o, robj *field) {
 int hashTypeSet(robj *o, robj *field, robj *value) {
     int update = 0;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl, *fptr, *vptr;
 
         field = getDecodedObject(field);
         value = getDecodedObject(value);
 
         zl = o->ptr;
-        fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+        fptr = lpIndex(zl, LP_HEAD);
         if (fptr != NULL) {
-            fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+            fptr = lpFind(fptr, field->ptr, sdslen(field->ptr), 1);
             if (fptr != NULL) {
-			//field已经存在在ziplist中
+			//field已经存在在listpack中
                 /* Grab pointer to the value (fptr points to the field) */
 				//取到值
-                vptr = ziplistNext(zl, fptr);
+                vptr = lpNext(zl, fptr);
                 redisAssert(vptr != NULL);
                 update = 1;
 
                 /* Delete value */
 				//删除值
-                zl = ziplistDelete(zl, &vptr);
+                zl = lpDelete(zl, &vptr);
 
                 /* Insert new value */
 				//添加新值
-                zl = ziplistInsert(zl, vptr, value->ptr, sdslen(value->ptr));
+                zl = lpInsert(zl, vptr, value->ptr, sdslen(value->ptr));
             }
         }
 
         if (!update) {
-            /* Push new field/value pair onto the tail of the ziplist */
-			//field不存在，将field和value添加到ziplist中
-            zl = ziplistPush(zl, field->ptr, sdslen(field->ptr), ZIPLIST_TAIL);
-            zl = ziplistPush(zl, value->ptr, sdslen(value->ptr), ZIPLIST_TAIL);
+            /* Push new field/value pair onto the tail of the listpack */
+			//field不存在，将field和value添加到listpack中
+            zl = lpPush(zl, field->ptr, sdslen(field->ptr), LP_TAIL);
+            zl = lpPush(zl, value->ptr, sdslen(value->ptr), LP_TAIL);
         }
         o->ptr = zl;
         decrRefCount(field);
         decrRefCount(value);
 
-        /* Check if the ziplist needs to be converted to a hash table */
-		//将ziplist转换为hash table当它元素数量大于阀值
+        /* Check if the listpack needs to be converted to a hash table */
+		//将listpack转换为hash table当它元素数量大于阀值
         if (hashTypeLength(o) > server.hash_max_ziplist_entries)
             hashTypeConvert(o, REDIS_ENCODING_HT);
     } else if (o->encoding == REDIS_ENCODING_HT) {
@@ -243,20 +243,20 @@ int hashTypeSet(robj *o, robj *field, robj *value) {
 int hashTypeDelete(robj *o, robj *field) {
     int deleted = 0;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl, *fptr;
 
         field = getDecodedObject(field);
 
         zl = o->ptr;
-        fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+        fptr = lpIndex(zl, LP_HEAD);
         if (fptr != NULL) {
-            fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+            fptr = lpFind(fptr, field->ptr, sdslen(field->ptr), 1);
             if (fptr != NULL) {
 			    //删除field
-                zl = ziplistDelete(zl,&fptr);
+                zl = lpDelete(zl,&fptr);
 				//删除value
-                zl = ziplistDelete(zl,&fptr);
+                zl = lpDelete(zl,&fptr);
                 o->ptr = zl;
                 deleted = 1;
             }
@@ -284,8 +284,8 @@ int hashTypeDelete(robj *o, robj *field) {
 unsigned long hashTypeLength(robj *o) {
     unsigned long length = ULONG_MAX;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        length = ziplistLen(o->ptr) / 2;
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
+        length = lpLength(o->ptr) / 2;
     } else if (o->encoding == REDIS_ENCODING_HT) {
         length = dictSize((dict*)o->ptr);
     } else {
@@ -301,7 +301,7 @@ hashTypeIterator *hashTypeInitIterator(robj *subject) {
     hi->subject = subject;
     hi->encoding = subject->encoding;
 
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         hi->fptr = NULL;
         hi->vptr = NULL;
     } else if (hi->encoding == REDIS_ENCODING_HT) {
@@ -325,7 +325,7 @@ void hashTypeReleaseIterator(hashTypeIterator *hi) {
  * could be found and REDIS_ERR when the iterator reaches the end. */
  //取到迭代器的当前键值对，并且指向下一个键值对
 int hashTypeNext(hashTypeIterator *hi) {
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl;
         unsigned char *fptr, *vptr;
 
@@ -336,16 +336,16 @@ int hashTypeNext(hashTypeIterator *hi) {
         if (fptr == NULL) {
             /* Initialize cursor */
             redisAssert(vptr == NULL);
-            fptr = ziplistIndex(zl, 0);
+            fptr = lpIndex(zl, 0);
         } else {
             /* Advance cursor */
             redisAssert(vptr != NULL);
-            fptr = ziplistNext(zl, vptr);
+            fptr = lpNext(zl, vptr);
         }
         if (fptr == NULL) return REDIS_ERR;
 
         /* Grab pointer to the value (fptr points to the field) */
-        vptr = ziplistNext(zl, fptr);
+        vptr = lpNext(zl, fptr);
         redisAssert(vptr != NULL);
 
         /* fptr, vptr now point to the first or next pair */
@@ -360,28 +360,28 @@ int hashTypeNext(hashTypeIterator *hi) {
 }
 
 /* Get the field or value at iterator cursor, for an iterator on a hash value
- * encoded as a ziplist. Prototype is similar to `hashTypeGetFromZiplist`. */
- //从ziplist取到当前迭代器指向的键值对的key或value的值
-void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
+ * encoded as a listpack. Prototype is similar to `hashTypeGetFromListpack`. */
+ //从listpack取到当前迭代器指向的键值对的key或value的值
+void hashTypeCurrentFromListpack(hashTypeIterator *hi, int what,
                                 unsigned char **vstr,
                                 unsigned int *vlen,
                                 long long *vll)
 {
     int ret;
 
-    redisAssert(hi->encoding == REDIS_ENCODING_ZIPLIST);
+    redisAssert(hi->encoding == REDIS_ENCODING_LISTPACK);
 
     if (what & REDIS_HASH_KEY) {
-        ret = ziplistGet(hi->fptr, vstr, vlen, vll);
+        ret = lpGet(hi->fptr, vstr, vlen, vll);
         redisAssert(ret);
     } else {
-        ret = ziplistGet(hi->vptr, vstr, vlen, vll);
+        ret = lpGet(hi->vptr, vstr, vlen, vll);
         redisAssert(ret);
     }
 }
 
 /* Get the field or value at iterator cursor, for an iterator on a hash value
- * encoded as a ziplist. Prototype is similar to `hashTypeGetFromHashTable`. */
+ * encoded as a listpack. Prototype is similar to `hashTypeGetFromHashTable`. */
 //从hash table取到当前迭代器指向的键值对的key或value的值
 void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst) {
     redisAssert(hi->encoding == REDIS_ENCODING_HT);
@@ -400,12 +400,12 @@ void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst) {
 robj *hashTypeCurrentObject(hashTypeIterator *hi, int what) {
     robj *dst;
 
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             dst = createStringObject((char*)vstr, vlen);
         } else {
@@ -439,11 +439,11 @@ robj *hashTypeLookupWriteOrCreate(redisClient *c, robj *key) {
     return o;
 }
 
-//将ziplist转换为hash table
+//将listpack转换为hash table
 void hashTypeConvertZiplist(robj *o, int enc) {
-    redisAssert(o->encoding == REDIS_ENCODING_ZIPLIST);
+    redisAssert(o->encoding == REDIS_ENCODING_LISTPACK);
 
-    if (enc == REDIS_ENCODING_ZIPLIST) {
+    if (enc == REDIS_ENCODING_LISTPACK) {
         /* Nothing to do... */
 
     } else if (enc == REDIS_ENCODING_HT) {
@@ -456,15 +456,15 @@ void hashTypeConvertZiplist(robj *o, int enc) {
 
         while (hashTypeNext(hi) != REDIS_ERR) {
             robj *field, *value;
-            //取到ziplist中的key, value并添加到dict中
+            //取到listpack中的key, value并添加到dict中
             field = hashTypeCurrentObject(hi, REDIS_HASH_KEY);
             field = tryObjectEncoding(field);
             value = hashTypeCurrentObject(hi, REDIS_HASH_VALUE);
             value = tryObjectEncoding(value);
             ret = dictAdd(dict, field, value);
             if (ret != DICT_OK) {
-                redisLogHexDump(REDIS_WARNING,"ziplist with dup elements dump",
-                    o->ptr,ziplistBlobLen(o->ptr));
+                redisLogHexDump(REDIS_WARNING,"listpack with dup elements dump",
+                    o->ptr,lpBytes(o->ptr));
                 redisAssert(ret == DICT_OK);
             }
         }
@@ -474,6 +474,42 @@ void hashTypeConvertZiplist(robj *o, int enc) {
 
         o->encoding = REDIS_ENCODING_HT;
         o->ptr = dict;
+        server.stat_encoding_upgrades++;
+
+    } else {
+        redisPanic("Unknown hash encoding");
+    }
+}
+
+//将hash table转换回listpack
+void hashTypeConvertHashTable(robj *o, int enc) {
+    redisAssert(o->encoding == REDIS_ENCODING_HT);
+
+    if (enc == REDIS_ENCODING_HT) {
+        /* Nothing to do... */
+
+    } else if (enc == REDIS_ENCODING_LISTPACK) {
+        unsigned char *zl = lpNew();
+        dictIterator *di;
+        dictEntry *de;
+
+        di = dictGetIterator(o->ptr);
+        while ((de = dictNext(di)) != NULL) {
+            robj *field = getDecodedObject(dictGetKey(de));
+            robj *value = getDecodedObject(dictGetVal(de));
+
+            //field和value依次添加到listpack的尾部
+            zl = lpPush(zl,field->ptr,sdslen(field->ptr),LP_TAIL);
+            zl = lpPush(zl,value->ptr,sdslen(value->ptr),LP_TAIL);
+            decrRefCount(field);
+            decrRefCount(value);
+        }
+        dictReleaseIterator(di);
+        dictRelease(o->ptr);
+
+        o->encoding = REDIS_ENCODING_LISTPACK;
+        o->ptr = zl;
+        server.stat_encoding_downgrades++;
 
     } else {
         redisPanic("Unknown hash encoding");
@@ -481,27 +517,74 @@ void hashTypeConvertZiplist(robj *o, int enc) {
 }
 
 void hashTypeConvert(robj *o, int enc) {
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         hashTypeConvertZiplist(o, enc);
     } else if (o->encoding == REDIS_ENCODING_HT) {
-        redisPanic("Not implemented");
+        hashTypeConvertHashTable(o, enc);
     } else {
         redisPanic("Unknown hash encoding");
     }
 }
 
+/* Convert a hash table back to a listpack once it shrank to 1/ratio of the
+ * listpack limits, see listTypeTryDowngrade(). Returns 1 if the hash was
+ * converted. */
+//hash缩小到listpack限制的1/ratio以下时, 将hash table转换回listpack
+int hashTypeTryDowngrade(robj *o, int ratio) {
+    dictIterator *di;
+    dictEntry *de;
+    int fits = 1;
+
+    if (o->encoding != REDIS_ENCODING_HT) return 0;
+    if (dictSize((dict*)o->ptr) > server.hash_max_ziplist_entries/ratio)
+        return 0;
+
+    //所有field和value的长度都不能超过hash_max_ziplist_value
+    di = dictGetIterator(o->ptr);
+    while (fits && (de = dictNext(di)) != NULL) {
+        if (stringObjectLen(dictGetKey(de)) > server.hash_max_ziplist_value ||
+            stringObjectLen(dictGetVal(de)) > server.hash_max_ziplist_value)
+            fits = 0;
+    }
+    dictReleaseIterator(di);
+    if (!fits) return 0;
+
+    hashTypeConvert(o,REDIS_ENCODING_LISTPACK);
+    return 1;
+}
+
+/* Return the length of the value of 'field' in 'o' if it is a hash table
+ * encoded hash small enough to be converted back to a listpack, 0 otherwise.
+ * The commands removing or overwriting the field pass it to
+ * tryObjectDowngrade(), so that the hash is converted back once the long
+ * value keeping it in the hash table is gone. */
+//hash小到可以转换回listpack时返回field对应值的长度, 否则返回0
+static size_t hashTypeDowngradeValueLength(robj *o, robj *field) {
+    robj *value;
+
+    if (!server.encoding_downgrade || o->encoding != REDIS_ENCODING_HT) return 0;
+    if (dictSize((dict*)o->ptr) >
+        server.hash_max_ziplist_entries/REDIS_DOWNGRADE_RATIO) return 0;
+    if (hashTypeGetFromHashTable(o,field,&value) < 0) return 0;
+    return stringObjectLen(value);
+}
+
 /*-----------------------------------------------------------------------------
  * Hash type commands
  *----------------------------------------------------------------------------*/
 //hset命令的实现
 void hsetCommand(redisClient *c) {
     int update;
+    size_t oldlen;
     robj *o;
 
     if ((o = hashTypeLookupWriteOrCreate(c,c->argv[1])) == NULL) return;
     hashTypeTryConversion(o,c->argv,2,3);
     hashTypeTryObjectEncoding(o,&c->argv[2], &c->argv[3]);
+    oldlen = hashTypeDowngradeValueLength(o,c->argv[2]);
     update = hashTypeSet(o,c->argv[2],c->argv[3]);
+    //覆盖了长的值时, 尝试转换回listpack
+    if (update) tryObjectDowngrade(o,hashTypeLength(o),oldlen);
     addReply(c, update ? shared.czero : shared.cone);
     signalModifiedKey(c->db,c->argv[1]);
     notifyKeyspaceEvent(REDIS_NOTIFY_HASH,"hset",c->argv[1],c->db->id);
@@ -531,6 +614,7 @@ void hsetnxCommand(redisClient *c) {
 //hmset命令的实现
 void hmsetCommand(redisClient *c) {
     int i;
+    size_t len, oldlen = 0;
     robj *o;
 
     if ((c->argc % 2) == 1) {
@@ -542,8 +626,11 @@ void hmsetCommand(redisClient *c) {
     hashTypeTryConversion(o,c->argv,2,c->argc-1);
     for (i = 2; i < c->argc; i += 2) {
         hashTypeTryObjectEncoding(o,&c->argv[i], &c->argv[i+1]);
+        len = hashTypeDowngradeValueLength(o,c->argv[i]);
+        if (len > oldlen) oldlen = len;
         hashTypeSet(o,c->argv[i],c->argv[i+1]);
     }
+    if (oldlen) tryObjectDowngrade(o,hashTypeLength(o),oldlen);
     addReply(c, shared.ok);
     signalModifiedKey(c->db,c->argv[1]);
     notifyKeyspaceEvent(REDIS_NOTIFY_HASH,"hset",c->argv[1],c->db->id);
@@ -635,12 +722,12 @@ static void addHashFieldToReply(redisClient *c, robj *o, robj *field) {
         return;
     }
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        ret = hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll);
+        ret = hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll);
         if (ret < 0) {
             addReply(c, shared.nullbulk);
         } else {
@@ -699,13 +786,19 @@ void hmgetCommand(redisClient *c) {
 void hdelCommand(redisClient *c) {
     robj *o;
     int j, deleted = 0, keyremoved = 0;
+    size_t len, removedlen = 0;
 
     if ((o = lookupKeyWriteOrReply(c,c->argv[1],shared.czero)) == NULL ||
         checkType(c,o,REDIS_HASH)) return;
 
     for (j = 2; j < c->argc; j++) {
+        len = hashTypeDowngradeValueLength(o,c->argv[j]);
         if (hashTypeDelete(o,c->argv[j])) {
             deleted++;
+            //记录被删除的最长的field或值
+            if (len > removedlen) removedlen = len;
+            len = stringObjectLen(c->argv[j]);
+            if (len > removedlen) removedlen = len;
             if (hashTypeLength(o) == 0) {
 			//hash为空，将其中db中删除
                 dbDelete(c->db,c->argv[1]);
@@ -720,6 +813,8 @@ void hdelCommand(redisClient *c) {
         if (keyremoved)
             notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,"del",c->argv[1],
                                 c->db->id);
+        else
+            tryObjectDowngrade(o,hashTypeLength(o)+deleted,removedlen);
         server.dirty += deleted;
     }
     addReplyLongLong(c,deleted);
@@ -736,12 +831,12 @@ void hlenCommand(redisClient *c) {
 
 //将迭代器当前指向键值对的值添加到响应中
 static void addHashIteratorCursorToReply(redisClient *c, hashTypeIterator *hi, int what) {
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             addReplyBulkCBuffer(c, vstr, vlen);
         } else {
@@ -819,7 +914,7 @@ void hexistsCommand(redisClient *c) {
 //hscan命令的实现
 void hscanCommand(redisClient *c) {
     robj *o;
-    unsigned long cursor;
+    unsigned long long cursor;
 
     if (parseScanCursorOrReply(c,c->argv[2],&cursor) == REDIS_ERR) return;
     if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.emptyscan)) == NULL ||
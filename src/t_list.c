@@ -34,17 +34,17 @@ void signalListAsReady(redisClient *c, robj *key);
 /*-----------------------------------------------------------------------------
  * List API
  *----------------------------------------------------------------------------*/
-//这是redis业务逻辑中使用的list的API接口。list的底层实现可以是ziplist或者adlist.
-//一开始使用ziplist,当新的元素大于ziplist所能容纳的值，或者ziplist的元素数量大于规定的值
-//就将ziplist转变成adlist。
+//这是redis业务逻辑中使用的list的API接口。list的底层实现可以是listpack或者adlist.
+//一开始使用listpack,当新的元素大于listpack所能容纳的值，或者listpack的元素数量大于规定的值
+//就将listpack转变成adlist。
 
 
-/* Check the argument length to see if it requires us to convert the ziplist
+/* Check the argument length to see if it requires us to convert the listpack
  * to a real list. Only check raw-encoded objects because integer encoded
  * objects are never too long. */
-//将ziplist转换为adlist如果ziplist中保存的值过长
+//将listpack转换为adlist如果listpack中保存的值过长
 void listTypeTryConversion(robj *subject, robj *value) {
-    if (subject->encoding != REDIS_ENCODING_ZIPLIST) return;
+    if (subject->encoding != REDIS_ENCODING_LISTPACK) return;
     if (value->encoding == REDIS_ENCODING_RAW &&
         sdslen(value->ptr) > server.list_max_ziplist_value)
             listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
@@ -57,18 +57,18 @@ void listTypeTryConversion(robj *subject, robj *value) {
  * the function takes care of it if needed. */
 //根据where的值在表头或者表尾插入新的元素
 void listTypePush(robj *subject, robj *value, int where) {
-    /* Check if we need to convert the ziplist */
+    /* Check if we need to convert the listpack */
     listTypeTryConversion(subject,value);
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST &&
-        ziplistLen(subject->ptr) >= server.list_max_ziplist_entries)
+    if (subject->encoding == REDIS_ENCODING_LISTPACK &&
+        lpLength(subject->ptr) >= server.list_max_ziplist_entries)
     	//ziplist的元素数量超过list_max_ziplist_entries时，将其转化为adlist
             listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
 
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {
-    	//将元素插入ziplist中
-        int pos = (where == REDIS_HEAD) ? ZIPLIST_HEAD : ZIPLIST_TAIL;
+    if (subject->encoding == REDIS_ENCODING_LISTPACK) {
+    	//将元素插入listpack中
+        int pos = (where == REDIS_HEAD) ? LP_HEAD : LP_TAIL;
         value = getDecodedObject(value);
-        subject->ptr = ziplistPush(subject->ptr,value->ptr,sdslen(value->ptr),pos);
+        subject->ptr = lpPush(subject->ptr,value->ptr,sdslen(value->ptr),pos);
         decrRefCount(value);
     } else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {
     	//将元素插入adlist中
@@ -86,22 +86,22 @@ void listTypePush(robj *subject, robj *value, int where) {
 //从表头或者表尾取出元素
 robj *listTypePop(robj *subject, int where) {
     robj *value = NULL;
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {
-    	//调用ziplist API取出值，并将该元素从中删除
+    if (subject->encoding == REDIS_ENCODING_LISTPACK) {
+    	//调用listpack API取出值，并将该元素从中删除
         unsigned char *p;
         unsigned char *vstr;
         unsigned int vlen;
         long long vlong;
         int pos = (where == REDIS_HEAD) ? 0 : -1;
-        p = ziplistIndex(subject->ptr,pos);
-        if (ziplistGet(p,&vstr,&vlen,&vlong)) {
+        p = lpIndex(subject->ptr,pos);
+        if (lpGet(p,&vstr,&vlen,&vlong)) {
             if (vstr) {
                 value = createStringObject((char*)vstr,vlen);
             } else {
                 value = createStringObjectFromLongLong(vlong);
             }
             /* We only need to delete an element when it exists */
-            subject->ptr = ziplistDelete(subject->ptr,&p);
+            subject->ptr = lpDelete(subject->ptr,&p);
         }
     } else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {
     	//调用adlist API取出值，并将该元素从中删除
@@ -125,8 +125,8 @@ robj *listTypePop(robj *subject, int where) {
 
 //list中元素的数量
 unsigned long listTypeLength(robj *subject) {
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {
-        return ziplistLen(subject->ptr);
+    if (subject->encoding == REDIS_ENCODING_LISTPACK) {
+        return lpLength(subject->ptr);
     } else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {
         return listLength((list*)subject->ptr);
     } else {
@@ -141,8 +141,8 @@ listTypeIterator *listTypeInitIterator(robj *subject, long index, unsigned char
     li->subject = subject;
     li->encoding = subject->encoding;
     li->direction = direction;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        li->zi = ziplistIndex(subject->ptr,index);
+    if (li->encoding == REDIS_ENCODING_LISTPACK) {
+        li->zi = lpIndex(subject->ptr,index);
     } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
         li->ln = listIndex(subject->ptr,index);
     } else {
@@ -166,13 +166,13 @@ int listTypeNext(listTypeIterator *li, listTypeEntry *entry) {
     redisAssert(li->subject->encoding == li->encoding);
 
     entry->li = li;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (li->encoding == REDIS_ENCODING_LISTPACK) {
         entry->zi = li->zi;
         if (entry->zi != NULL) {
             if (li->direction == REDIS_TAIL)
-                li->zi = ziplistNext(li->subject->ptr,li->zi);
+                li->zi = lpNext(li->subject->ptr,li->zi);
             else
-                li->zi = ziplistPrev(li->subject->ptr,li->zi);
+                li->zi = lpPrev(li->subject->ptr,li->zi);
             return 1;
         }
     } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
@@ -195,12 +195,12 @@ int listTypeNext(listTypeIterator *li, listTypeEntry *entry) {
 robj *listTypeGet(listTypeEntry *entry) {
     listTypeIterator *li = entry->li;
     robj *value = NULL;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (li->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr;
         unsigned int vlen;
         long long vlong;
         redisAssert(entry->zi != NULL);
-        if (ziplistGet(entry->zi,&vstr,&vlen,&vlong)) {
+        if (lpGet(entry->zi,&vstr,&vlen,&vlong)) {
             if (vstr) {
                 value = createStringObject((char*)vstr,vlen);
             } else {
@@ -220,23 +220,23 @@ robj *listTypeGet(listTypeEntry *entry) {
 //将value插入到entry所指元素的后面或者前面
 void listTypeInsert(listTypeEntry *entry, robj *value, int where) {
     robj *subject = entry->li->subject;
-    if (entry->li->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (entry->li->encoding == REDIS_ENCODING_LISTPACK) {
         value = getDecodedObject(value);
         if (where == REDIS_TAIL) {
         	//取到entry的下一个元素
-            unsigned char *next = ziplistNext(subject->ptr,entry->zi);
+            unsigned char *next = lpNext(subject->ptr,entry->zi);
 
             /* When we insert after the current element, but the current element
              * is the tail of the list, we need to do a push. */
             if (next == NULL) {
             	//空的话就将value插入到表尾
-                subject->ptr = ziplistPush(subject->ptr,value->ptr,sdslen(value->ptr),REDIS_TAIL);
+                subject->ptr = lpPush(subject->ptr,value->ptr,sdslen(value->ptr),REDIS_TAIL);
             } else {
             	//否则将value插入到next前，即entry后
-                subject->ptr = ziplistInsert(subject->ptr,next,value->ptr,sdslen(value->ptr));
+                subject->ptr = lpInsert(subject->ptr,next,value->ptr,sdslen(value->ptr));
             }
         } else {
-            subject->ptr = ziplistInsert(subject->ptr,entry->zi,value->ptr,sdslen(value->ptr));
+            subject->ptr = lpInsert(subject->ptr,entry->zi,value->ptr,sdslen(value->ptr));
         }
         decrRefCount(value);
     } else if (entry->li->encoding == REDIS_ENCODING_LINKEDLIST) {
@@ -255,9 +255,9 @@ void listTypeInsert(listTypeEntry *entry, robj *value, int where) {
 //比较entry指向元素的值与o中的值
 int listTypeEqual(listTypeEntry *entry, robj *o) {
     listTypeIterator *li = entry->li;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (li->encoding == REDIS_ENCODING_LISTPACK) {
         redisAssertWithInfo(NULL,o,o->encoding == REDIS_ENCODING_RAW);
-        return ziplistCompare(entry->zi,o->ptr,sdslen(o->ptr));
+        return lpCompare(entry->zi,o->ptr,sdslen(o->ptr));
     } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
         return equalStringObjects(o,listNodeValue(entry->ln));
     } else {
@@ -269,15 +269,15 @@ int listTypeEqual(listTypeEntry *entry, robj *o) {
 //删除entry指向的元素
 void listTypeDelete(listTypeEntry *entry) {
     listTypeIterator *li = entry->li;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (li->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *p = entry->zi;
-        li->subject->ptr = ziplistDelete(li->subject->ptr,&p);
+        li->subject->ptr = lpDelete(li->subject->ptr,&p);
 
         /* Update position of the iterator depending on the direction */
         if (li->direction == REDIS_TAIL)
             li->zi = p;
         else
-            li->zi = ziplistPrev(li->subject->ptr,p);
+            li->zi = lpPrev(li->subject->ptr,p);
     } else if (entry->li->encoding == REDIS_ENCODING_LINKEDLIST) {
         listNode *next;
         if (li->direction == REDIS_TAIL)
@@ -291,13 +291,14 @@ void listTypeDelete(listTypeEntry *entry) {
     }
 }
 
-//将ziplist转换为adlist
+//将listpack转换为adlist, 或者将adlist转换回listpack
 void listTypeConvert(robj *subject, int enc) {
     listTypeIterator *li;
     listTypeEntry entry;
     redisAssertWithInfo(NULL,subject,subject->type == REDIS_LIST);
 
-    if (enc == REDIS_ENCODING_LINKEDLIST) {
+    if (enc == REDIS_ENCODING_LINKEDLIST &&
+        subject->encoding == REDIS_ENCODING_LISTPACK) {
         list *l = listCreate();
         listSetFreeMethod(l,decrRefCountVoid);
 
@@ -309,11 +310,52 @@ void listTypeConvert(robj *subject, int enc) {
         subject->encoding = REDIS_ENCODING_LINKEDLIST;
         zfree(subject->ptr);
         subject->ptr = l;
+        server.stat_encoding_upgrades++;
+    } else if (enc == REDIS_ENCODING_LISTPACK &&
+               subject->encoding == REDIS_ENCODING_LINKEDLIST) {
+        unsigned char *lp = lpNew();
+        listIter iter;
+        listNode *ln;
+
+        listRewind(subject->ptr,&iter);
+        while ((ln = listNext(&iter)) != NULL) {
+            robj *value = getDecodedObject(listNodeValue(ln));
+            lp = lpPush(lp,value->ptr,sdslen(value->ptr),LP_TAIL);
+            decrRefCount(value);
+        }
+
+        listRelease(subject->ptr);
+        subject->encoding = REDIS_ENCODING_LISTPACK;
+        subject->ptr = lp;
+        server.stat_encoding_downgrades++;
     } else {
         redisPanic("Unsupported list conversion");
     }
 }
 
+/* Convert a linked list back to a listpack once it shrank to 1/ratio of the
+ * listpack limits. Commands removing elements call this with
+ * REDIS_DOWNGRADE_RATIO, so that a list oscillating around the limit does
+ * not get converted back and forth. Returns 1 if the list was converted. */
+//list缩小到listpack限制的1/ratio以下时, 将adlist转换回listpack
+int listTypeTryDowngrade(robj *subject, int ratio) {
+    listIter iter;
+    listNode *ln;
+
+    if (subject->encoding != REDIS_ENCODING_LINKEDLIST) return 0;
+    if (listLength((list*)subject->ptr) >
+        server.list_max_ziplist_entries/ratio) return 0;
+
+    //所有元素的长度都不能超过list_max_ziplist_value
+    listRewind(subject->ptr,&iter);
+    while ((ln = listNext(&iter)) != NULL) {
+        if (stringObjectLen(listNodeValue(ln)) > server.list_max_ziplist_value)
+            return 0;
+    }
+    listTypeConvert(subject,REDIS_ENCODING_LISTPACK);
+    return 1;
+}
+
 /*-----------------------------------------------------------------------------
  * List Commands
  *----------------------------------------------------------------------------*/
@@ -340,8 +382,8 @@ void pushGenericCommand(redisClient *c, int where) {
     for (j = 2; j < c->argc; j++) {
         c->argv[j] = tryObjectEncoding(c->argv[j]);
         if (!lobj) {
-        	//如果列表还不存在，则创建一个ziplist并将其添加到db中
-            lobj = createZiplistObject();
+        	//如果列表还不存在，则创建一个listpack并将其添加到db中
+            lobj = createListpackObject();
             dbAdd(c->db,c->argv[1],lobj);
         }
         listTypePush(lobj,c->argv[j],where);
@@ -384,7 +426,7 @@ void pushxGenericCommand(redisClient *c, robj *refval, robj *val, int where) {
          * convert the list inside the iterator. We don't want to loop over
          * the list twice (once to see if the value can be inserted and once
          * to do the actual insert), so we assume this value can be inserted
-         * and convert the ziplist to a regular list if necessary. */
+         * and convert the listpack to a regular list if necessary. */
         listTypeTryConversion(subject,val);
 
         /* Seek refval from head to tail */
@@ -399,9 +441,9 @@ void pushxGenericCommand(redisClient *c, robj *refval, robj *val, int where) {
         listTypeReleaseIterator(iter);
 
         if (inserted) {
-            /* Check if the length exceeds the ziplist length threshold. */
-            if (subject->encoding == REDIS_ENCODING_ZIPLIST &&
-                ziplistLen(subject->ptr) > server.list_max_ziplist_entries)
+            /* Check if the length exceeds the listpack length threshold. */
+            if (subject->encoding == REDIS_ENCODING_LISTPACK &&
+                lpLength(subject->ptr) > server.list_max_ziplist_entries)
                     listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
             signalModifiedKey(c->db,c->argv[1]);
             notifyKeyspaceEvent(REDIS_NOTIFY_LIST,"linsert",
@@ -465,13 +507,13 @@ void lindexCommand(redisClient *c) {
     if ((getLongFromObjectOrReply(c, c->argv[2], &index, NULL) != REDIS_OK))
         return;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *p;
         unsigned char *vstr;
         unsigned int vlen;
         long long vlong;
-        p = ziplistIndex(o->ptr,index);
-        if (ziplistGet(p,&vstr,&vlen,&vlong)) {
+        p = lpIndex(o->ptr,index);
+        if (lpGet(p,&vstr,&vlen,&vlong)) {
             if (vstr) {
                 value = createStringObject((char*)vstr,vlen);
             } else {
@@ -508,17 +550,17 @@ void lsetCommand(redisClient *c) {
         return;
 
     listTypeTryConversion(o,value);
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *p, *zl = o->ptr;
-        p = ziplistIndex(zl,index);
+        p = lpIndex(zl,index);
         if (p == NULL) {
             addReply(c,shared.outofrangeerr);
         } else {
         	//删掉原来的值
-            o->ptr = ziplistDelete(o->ptr,&p);
+            o->ptr = lpDelete(o->ptr,&p);
             value = getDecodedObject(value);
             //插入新的值
-            o->ptr = ziplistInsert(o->ptr,p,value->ptr,sdslen(value->ptr));
+            o->ptr = lpInsert(o->ptr,p,value->ptr,sdslen(value->ptr));
             decrRefCount(value);
             addReply(c,shared.ok);
             signalModifiedKey(c->db,c->argv[1]);
@@ -530,6 +572,8 @@ void lsetCommand(redisClient *c) {
         if (ln == NULL) {
             addReply(c,shared.outofrangeerr);
         } else {
+            size_t oldlen = stringObjectLen(listNodeValue(ln));
+
             decrRefCount((robj*)listNodeValue(ln));
             //对于adlist直接赋新值
             listNodeValue(ln) = value;
@@ -538,6 +582,7 @@ void lsetCommand(redisClient *c) {
             signalModifiedKey(c->db,c->argv[1]);
             notifyKeyspaceEvent(REDIS_NOTIFY_LIST,"lset",c->argv[1],c->db->id);
             server.dirty++;
+            tryObjectDowngrade(o,listTypeLength(o),oldlen);
         }
     } else {
         redisPanic("Unknown list encoding");
@@ -554,6 +599,7 @@ void popGenericCommand(redisClient *c, int where) {
         addReply(c,shared.nullbulk);
     } else {
         char *event = (where == REDIS_HEAD) ? "lpop" : "rpop";
+        size_t vlen = stringObjectLen(value);
 
         addReplyBulk(c,value);
         decrRefCount(value);
@@ -562,6 +608,8 @@ void popGenericCommand(redisClient *c, int where) {
             notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,"del",
                                 c->argv[1],c->db->id);
             dbDelete(c->db,c->argv[1]);
+        } else {
+            tryObjectDowngrade(o,listTypeLength(o)+1,vlen);
         }
         signalModifiedKey(c->db,c->argv[1]);
         server.dirty++;
@@ -608,21 +656,21 @@ void lrangeCommand(redisClient *c) {
 
     /* Return the result in form of a multi-bulk reply */
     addReplyMultiBulkLen(c,rangelen);
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *p = ziplistIndex(o->ptr,start);
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
+        unsigned char *p = lpIndex(o->ptr,start);
         unsigned char *vstr;
         unsigned int vlen;
         long long vlong;
 
         //取到从start到end的值
         while(rangelen--) {
-            ziplistGet(p,&vstr,&vlen,&vlong);
+            lpGet(p,&vstr,&vlen,&vlong);
             if (vstr) {
                 addReplyBulkCBuffer(c,vstr,vlen);
             } else {
                 addReplyBulkLongLong(c,vlong);
             }
-            p = ziplistNext(o->ptr,p);
+            p = lpNext(o->ptr,p);
         }
     } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
         listNode *ln;
@@ -638,7 +686,7 @@ void lrangeCommand(redisClient *c) {
             ln = ln->next;
         }
     } else {
-        redisPanic("List encoding is not LINKEDLIST nor ZIPLIST!");
+        redisPanic("List encoding is not LINKEDLIST nor LISTPACK!");
     }
 }
 
@@ -648,6 +696,7 @@ void ltrimCommand(redisClient *c) {
     long start, end, llen, j, ltrim, rtrim;
     list *list;
     listNode *ln;
+    size_t len, removedlen = 0;
 
     //取到start, end的值
     if ((getLongFromObjectOrReply(c, c->argv[2], &start, NULL) != REDIS_OK) ||
@@ -676,21 +725,25 @@ void ltrimCommand(redisClient *c) {
     }
 
     /* Remove list elements to perform the trim */
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
     	//删除从0开始的ltrim个元素，即0到start-1
-        o->ptr = ziplistDeleteRange(o->ptr,0,ltrim);
+        o->ptr = lpDeleteRange(o->ptr,0,ltrim);
         //删除从-rtrim开始的rtrim个元素，即从end+1 到 llen-1
-        o->ptr = ziplistDeleteRange(o->ptr,-rtrim,rtrim);
+        o->ptr = lpDeleteRange(o->ptr,-rtrim,rtrim);
     } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
         list = o->ptr;
         //删除0到start-1的元素
         for (j = 0; j < ltrim; j++) {
             ln = listFirst(list);
+            len = stringObjectLen(listNodeValue(ln));
+            if (len > removedlen) removedlen = len;
             listDelNode(list,ln);
         }
         //删除end+1 到 llen-1的元素
         for (j = 0; j < rtrim; j++) {
             ln = listLast(list);
+            len = stringObjectLen(listNodeValue(ln));
+            if (len > removedlen) removedlen = len;
             listDelNode(list,ln);
         }
     } else {
@@ -703,6 +756,8 @@ void ltrimCommand(redisClient *c) {
     if (listTypeLength(o) == 0) {
         dbDelete(c->db,c->argv[1]);
         notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,"del",c->argv[1],c->db->id);
+    } else {
+        tryObjectDowngrade(o,llen,removedlen);
     }
     signalModifiedKey(c->db,c->argv[1]);
     server.dirty++;
@@ -723,8 +778,8 @@ void lremCommand(redisClient *c) {
     subject = lookupKeyWriteOrReply(c,c->argv[1],shared.czero);
     if (subject == NULL || checkType(c,subject,REDIS_LIST)) return;
 
-    /* Make sure obj is raw when we're dealing with a ziplist */
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST)
+    /* Make sure obj is raw when we're dealing with a listpack */
+    if (subject->encoding == REDIS_ENCODING_LISTPACK)
         obj = getDecodedObject(obj);
 
     listTypeIterator *li;
@@ -746,10 +801,14 @@ void lremCommand(redisClient *c) {
     listTypeReleaseIterator(li);
 
     /* Clean up raw encoded object */
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST)
+    if (subject->encoding == REDIS_ENCODING_LISTPACK)
         decrRefCount(obj);
 
-    if (listTypeLength(subject) == 0) dbDelete(c->db,c->argv[1]);
+    if (listTypeLength(subject) == 0)
+        dbDelete(c->db,c->argv[1]);
+    else if (removed)
+        tryObjectDowngrade(subject,listTypeLength(subject)+removed,
+                           stringObjectLen(c->argv[3]));
     addReplyLongLong(c,removed);
     if (removed) signalModifiedKey(c->db,c->argv[1]);
 }
@@ -774,7 +833,7 @@ void rpoplpushHandlePush(redisClient *c, robj *dstkey, robj *dstobj, robj *value
     /* Create the list if the key does not exist */
     if (!dstobj) {
     	//如果目标list不存在则创建一个新的并加到db中
-        dstobj = createZiplistObject();
+        dstobj = createListpackObject();
         dbAdd(c->db,dstkey,dstobj);
         signalListAsReady(c,dstkey);
     }
@@ -798,9 +857,11 @@ void rpoplpushCommand(redisClient *c) {
     } else {
         robj *dobj = lookupKeyWrite(c->db,c->argv[2]);
         robj *touchedkey = c->argv[1];
+        size_t vlen;
 
         if (dobj && checkType(c,dobj,REDIS_LIST)) return;
         value = listTypePop(sobj,REDIS_TAIL);
+        vlen = stringObjectLen(value);
         /* We saved touched key, and protect it, since rpoplpushHandlePush
          * may change the client command argument vector (it does not
          * currently). */
@@ -816,6 +877,8 @@ void rpoplpushCommand(redisClient *c) {
             dbDelete(c->db,touchedkey);
             notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,"del",
                                 touchedkey,c->db->id);
+        } else {
+            tryObjectDowngrade(sobj,listTypeLength(sobj)+1,vlen);
         }
         signalModifiedKey(c->db,touchedkey);
         decrRefCount(touchedkey);
@@ -1074,6 +1137,8 @@ void handleClientsBlockedOnLists(void) {
             //取到这个ready的key的list
             robj *o = lookupKeyWrite(rl->db,rl->key);
             if (o != NULL && o->type == REDIS_LIST) {
+                unsigned long oldlen = listTypeLength(o);
+                size_t removedlen = 0;
                 dictEntry *de;
 
                 /* We serve clients in the same order they blocked for
@@ -1095,6 +1160,9 @@ void handleClientsBlockedOnLists(void) {
                         robj *value = listTypePop(o,where);
 
                         if (value) {
+                            size_t vlen = stringObjectLen(value);
+
+                            if (vlen > removedlen) removedlen = vlen;
                             /* Protect receiver->bpop.target, that will be
                              * freed by the next unblockClientWaitingData()
                              * call. */
@@ -1120,7 +1188,10 @@ void handleClientsBlockedOnLists(void) {
                     }
                 }
                 
-                if (listTypeLength(o) == 0) dbDelete(rl->db,rl->key);
+                if (listTypeLength(o) == 0)
+                    dbDelete(rl->db,rl->key);
+                else
+                    tryObjectDowngrade(o,oldlen,removedlen);
                 /* We don't call signalModifiedKey() as it was already called
                  * when an element was pushed on the list. */
             }
@@ -1175,8 +1246,10 @@ void blockingPopGenericCommand(redisClient *c, int where) {
                     /* Non empty list, this is like a non normal [LR]POP. */
                     char *event = (where == REDIS_HEAD) ? "lpop" : "rpop";
                     robj *value = listTypePop(o,where);
-                    redisAssert(value != NULL);
+                    size_t vlen;
 
+                    redisAssert(value != NULL);
+                    vlen = stringObjectLen(value);
                     addReplyMultiBulkLen(c,2);
                     addReplyBulk(c,c->argv[j]);
                     addReplyBulk(c,value);
@@ -1187,6 +1260,8 @@ void blockingPopGenericCommand(redisClient *c, int where) {
                         dbDelete(c->db,c->argv[j]);
                         notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,"del",
                                             c->argv[j],c->db->id);
+                    } else {
+                        tryObjectDowngrade(o,listTypeLength(o)+1,vlen);
                     }
                     signalModifiedKey(c->db,c->argv[j]);
                     server.dirty++;
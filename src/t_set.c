@@ -35,13 +35,58 @@
 
 void sunionDiffGenericCommand(redisClient *c, robj **setkeys, int setnum, robj *dstkey, int op);
 
+/* Return true if a set of 'size' elements, 'value' being one of them, is
+ * small enough to be encoded as a listpack. */
+//判断包含value的size个元素的set能否用listpack编码
+static int setTypeFitsListpack(unsigned long size, robj *value) {
+    return size <= server.set_max_listpack_entries &&
+           stringObjectLen(value) <= server.set_max_listpack_value;
+}
+
+/* Return the entry of the listpack encoded set 'lp' equal to 'value', or
+ * NULL if the element is not in the set. */
+//在listpack编码的set中找到与value相等的元素
+static unsigned char *setTypeListpackFind(unsigned char *lp, robj *value) {
+    if (value->encoding == REDIS_ENCODING_INT) {
+        char buf[REDIS_LONGSTR_SIZE];
+        int len = ll2string(buf,sizeof(buf),(long)value->ptr);
+
+        return lpFind(lpFirst(lp),(unsigned char*)buf,len,0);
+    }
+    return lpFind(lpFirst(lp),value->ptr,sdslen(value->ptr),0);
+}
+
+/* Append 'value' to the listpack encoded set 'lp', that must not already
+ * contain it. Returns the new listpack. */
+//将value添加到listpack的末尾
+static unsigned char *setTypeListpackPush(unsigned char *lp, robj *value) {
+    value = getDecodedObject(value);
+    lp = lpPush(lp,value->ptr,sdslen(value->ptr),LP_TAIL);
+    decrRefCount(value);
+    return lp;
+}
+
+/* Return a new string object with the value of the listpack entry 'p'. */
+//用listpack元素p的值创建一个string object
+static robj *setTypeListpackObject(unsigned char *p) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+
+    redisAssert(lpGet(p,&vstr,&vlen,&vll));
+    if (vstr) return createStringObject((char*)vstr,vlen);
+    return createStringObjectFromLongLong(vll);
+}
+
 /* Factory method to return a set that *can* hold "value". When the object has
- * an integer-encodable value, an intset will be returned. Otherwise a regular
- * hash table. */
-//创建一个set, 如果值可以表示为longlong,就创建intset,否则创建一个hash table
+ * an integer-encodable value, an intset will be returned. Otherwise a
+ * listpack if the value is short enough, or a regular hash table. */
+//创建一个set, 如果值可以表示为longlong,就创建intset,值足够短时创建listpack,否则创建一个hash table
 robj *setTypeCreate(robj *value) {
     if (isObjectRepresentableAsLongLong(value,NULL) == REDIS_OK)
         return createIntsetObject();
+    if (setTypeFitsListpack(1,value))
+        return createSetListpackObject();
     return createSetObject();
 }
 
@@ -60,13 +105,21 @@ int setTypeAdd(robj *subject, robj *value) {
             uint8_t success = 0;
             subject->ptr = intsetAdd(subject->ptr,llval,&success);
             if (success) {
-                /* Convert to regular set when the intset contains
-                 * too many entries. */
-            	//如果长度大于set_max_intset_entries，转化为hash table
+                /* Convert to the large integer set encoding (a regular set
+                 * or a roaring) when the intset contains too many entries. */
+            	//如果长度大于set_max_intset_entries，转化为hash table或roaring
                 if (intsetLen(subject->ptr) > server.set_max_intset_entries)
-                    setTypeConvert(subject,REDIS_ENCODING_HT);
+                    setTypeConvert(subject,server.set_large_int_encoding);
                 return 1;
             }
+        } else if (setTypeFitsListpack(intsetLen(subject->ptr)+1,value)) {
+            /* Failed to get integer from object, but the set is still small:
+             * convert to a listpack. The value is not integer encodable so
+             * it can't already be in the set. */
+            //值不能加到intset中, 但set还很小, 将intset转换为listpack
+            setTypeConvert(subject,REDIS_ENCODING_LISTPACK);
+            subject->ptr = setTypeListpackPush(subject->ptr,value);
+            return 1;
         } else {
         	//如果值不能加到intset中，将intset转换为hash table
             /* Failed to get integer from object, convert to regular set. */
@@ -79,6 +132,29 @@ int setTypeAdd(robj *subject, robj *value) {
             incrRefCount(value);
             return 1;
         }
+    } else if (subject->encoding == REDIS_ENCODING_LISTPACK) {
+        if (setTypeListpackFind(subject->ptr,value) != NULL) return 0;
+
+        //元素数量或者值的长度超过阀值时，将listpack转换为hash table
+        if (setTypeFitsListpack(lpLength(subject->ptr)+1,value)) {
+            subject->ptr = setTypeListpackPush(subject->ptr,value);
+        } else {
+            setTypeConvert(subject,REDIS_ENCODING_HT);
+            redisAssertWithInfo(NULL,value,dictAdd(subject->ptr,value,NULL) == DICT_OK);
+            incrRefCount(value);
+        }
+        return 1;
+    } else if (subject->encoding == REDIS_ENCODING_ROARING) {
+        if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK)
+            return roaringAdd(subject->ptr,llval);
+
+        /* Not an integer: convert to a regular set, where the value can't
+         * already be. */
+        //值不是整数时，将roaring转换为hash table
+        setTypeConvert(subject,REDIS_ENCODING_HT);
+        redisAssertWithInfo(NULL,value,dictAdd(subject->ptr,value,NULL) == DICT_OK);
+        incrRefCount(value);
+        return 1;
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -100,6 +176,16 @@ int setTypeRemove(robj *setobj, robj *value) {
             setobj->ptr = intsetRemove(setobj->ptr,llval,&success);
             if (success) return 1;
         }
+    } else if (setobj->encoding == REDIS_ENCODING_LISTPACK) {
+        unsigned char *p = setTypeListpackFind(setobj->ptr,value);
+
+        if (p != NULL) {
+            setobj->ptr = lpDelete(setobj->ptr,&p);
+            return 1;
+        }
+    } else if (setobj->encoding == REDIS_ENCODING_ROARING) {
+        if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK)
+            return roaringRemove(setobj->ptr,llval);
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -115,6 +201,11 @@ int setTypeIsMember(robj *subject, robj *value) {
         if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK) {
             return intsetFind((intset*)subject->ptr,llval);
         }
+    } else if (subject->encoding == REDIS_ENCODING_LISTPACK) {
+        return setTypeListpackFind(subject->ptr,value) != NULL;
+    } else if (subject->encoding == REDIS_ENCODING_ROARING) {
+        if (isObjectRepresentableAsLongLong(value,&llval) == REDIS_OK)
+            return roaringFind(subject->ptr,llval);
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -130,6 +221,11 @@ setTypeIterator *setTypeInitIterator(robj *subject) {
         si->di = dictGetIterator(subject->ptr);
     } else if (si->encoding == REDIS_ENCODING_INTSET) {
         si->ii = 0;
+    } else if (si->encoding == REDIS_ENCODING_LISTPACK) {
+        si->lpi = lpFirst(subject->ptr);
+        si->lpele = NULL;
+    } else if (si->encoding == REDIS_ENCODING_ROARING) {
+        roaringInitIterator(subject->ptr,&si->ri);
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -140,6 +236,8 @@ setTypeIterator *setTypeInitIterator(robj *subject) {
 void setTypeReleaseIterator(setTypeIterator *si) {
     if (si->encoding == REDIS_ENCODING_HT)
         dictReleaseIterator(si->di);
+    else if (si->encoding == REDIS_ENCODING_LISTPACK && si->lpele)
+        decrRefCount(si->lpele);
     zfree(si);
 }
 
@@ -151,6 +249,11 @@ void setTypeReleaseIterator(setTypeIterator *si) {
  * set object you are iterating, and will populate the appropriate pointer
  * (eobj) or (llobj) accordingly.
  *
+ * Elements of listpack encoded sets are returned as objects (eobj) owned by
+ * the iterator, that are valid until the next call. Elements of roaring
+ * encoded sets are integers: they are returned in (llobj) and the return
+ * value is REDIS_ENCODING_INTSET, as for intsets.
+ *
  * When there are no longer elements -1 is returned.
  * Returned objects ref count is not incremented, so this function is
  * copy on write friendly. */
@@ -163,6 +266,20 @@ int setTypeNext(setTypeIterator *si, robj **objele, int64_t *llele) {
     } else if (si->encoding == REDIS_ENCODING_INTSET) {
         if (!intsetGet(si->subject->ptr,si->ii++,llele))
             return -1;
+    } else if (si->encoding == REDIS_ENCODING_LISTPACK) {
+        //释放上一次返回的元素
+        if (si->lpele) {
+            decrRefCount(si->lpele);
+            si->lpele = NULL;
+        }
+        if (si->lpi == NULL) return -1;
+        si->lpele = setTypeListpackObject(si->lpi);
+        *objele = si->lpele;
+        si->lpi = lpNext(si->subject->ptr,si->lpi);
+    } else if (si->encoding == REDIS_ENCODING_ROARING) {
+        //roaring的元素和intset一样以整数返回
+        if (!roaringNext(&si->ri,llele)) return -1;
+        return REDIS_ENCODING_INTSET;
     }
     return si->encoding;
 }
@@ -187,6 +304,7 @@ robj *setTypeNextObject(setTypeIterator *si) {
         	//返回创建的新对象
             return createStringObjectFromLongLong(intele);
         case REDIS_ENCODING_HT:
+        case REDIS_ENCODING_LISTPACK:
         	//增加引用数
             incrRefCount(objele);
             return objele;
@@ -208,7 +326,10 @@ robj *setTypeNextObject(setTypeIterator *si) {
  *
  * When an object is returned (the set was a real set) the ref count
  * of the object is not incremented so this function can be considered
- * copy on write friendly. */
+ * copy on write friendly. The only exception are listpack encoded sets:
+ * the element is returned as a new object that the caller must release
+ * with decrRefCount(). Roaring encoded sets return an int64_t value and
+ * REDIS_ENCODING_INTSET, as intsets. */
 //随机返回set中的元素
 int setTypeRandomElement(robj *setobj, robj **objele, int64_t *llele) {
     if (setobj->encoding == REDIS_ENCODING_HT) {
@@ -216,6 +337,13 @@ int setTypeRandomElement(robj *setobj, robj **objele, int64_t *llele) {
         *objele = dictGetKey(de);
     } else if (setobj->encoding == REDIS_ENCODING_INTSET) {
         *llele = intsetRandom(setobj->ptr);
+    } else if (setobj->encoding == REDIS_ENCODING_LISTPACK) {
+        unsigned char *lp = setobj->ptr;
+
+        *objele = setTypeListpackObject(lpIndex(lp,random() % lpLength(lp)));
+    } else if (setobj->encoding == REDIS_ENCODING_ROARING) {
+        *llele = roaringRandom(setobj->ptr);
+        return REDIS_ENCODING_INTSET;
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -228,6 +356,10 @@ unsigned long setTypeSize(robj *subject) {
         return dictSize((dict*)subject->ptr);
     } else if (subject->encoding == REDIS_ENCODING_INTSET) {
         return intsetLen((intset*)subject->ptr);
+    } else if (subject->encoding == REDIS_ENCODING_LISTPACK) {
+        return lpLength(subject->ptr);
+    } else if (subject->encoding == REDIS_ENCODING_ROARING) {
+        return roaringLen(subject->ptr);
     } else {
         redisPanic("Unknown set encoding");
     }
@@ -235,40 +367,149 @@ unsigned long setTypeSize(robj *subject) {
 
 /* Convert the set to specified encoding. The resulting dict (when converting
  * to a hash table) is presized to hold the number of elements in the original
- * set. */
-//将intset转换为hash table
+ * set. Intsets can be converted to listpacks, roarings or hash tables,
+ * listpacks and roarings to hash tables. When a set shrinks the opposite
+ * conversions are used as well: hash tables and roarings back to intsets,
+ * hash tables back to listpacks. The caller must make sure the elements fit
+ * the target encoding. */
+//将intset转换为listpack, roaring或hash table, 或者将listpack或roaring转换为hash table
+//set缩小时也可以将hash table或roaring转换回intset, 将hash table转换回listpack
 void setTypeConvert(robj *setobj, int enc) {
     setTypeIterator *si;
+    int from = setobj->encoding;
     redisAssertWithInfo(NULL,setobj,setobj->type == REDIS_SET &&
-                             setobj->encoding == REDIS_ENCODING_INTSET);
+                             (from == REDIS_ENCODING_INTSET ||
+                              from == REDIS_ENCODING_LISTPACK ||
+                              from == REDIS_ENCODING_ROARING ||
+                              from == REDIS_ENCODING_HT));
 
-    if (enc == REDIS_ENCODING_HT) {
-        int64_t intele;
+    if (enc == REDIS_ENCODING_HT && from != REDIS_ENCODING_HT) {
         dict *d = dictCreate(&setDictType,NULL);
         robj *element;
 
         /* Presize the dict to avoid rehashing */
-        //将hash table的长度设为intset的长度
-        dictExpand(d,intsetLen(setobj->ptr));
+        //将hash table的长度设为原来set的长度
+        dictExpand(d,setTypeSize(setobj));
 
         /* To add the elements we extract integers and create redis objects */
         si = setTypeInitIterator(setobj);
-        while (setTypeNext(si,NULL,&intele) != -1) {
-        	//将intset中所有元素添加到hash table中
-            element = createStringObjectFromLongLong(intele);
+        while ((element = setTypeNextObject(si)) != NULL) {
+        	//将原来set中所有元素添加到hash table中
             redisAssertWithInfo(NULL,element,dictAdd(d,element,NULL) == DICT_OK);
         }
         setTypeReleaseIterator(si);
 
+        //释放intset, listpack或者roaring占用的内存
+        freeSetObject(setobj);
         setobj->encoding = REDIS_ENCODING_HT;
-        //释放intset占用的内存
-        zfree(setobj->ptr);
         setobj->ptr = d;
+        if (from != REDIS_ENCODING_ROARING) server.stat_encoding_upgrades++;
+    } else if (enc == REDIS_ENCODING_LISTPACK &&
+               (from == REDIS_ENCODING_INTSET || from == REDIS_ENCODING_HT)) {
+        unsigned char *lp = lpNew();
+        robj *element;
+
+        si = setTypeInitIterator(setobj);
+        while ((element = setTypeNextObject(si)) != NULL) {
+            lp = setTypeListpackPush(lp,element);
+            decrRefCount(element);
+        }
+        setTypeReleaseIterator(si);
+
+        freeSetObject(setobj);
+        setobj->encoding = REDIS_ENCODING_LISTPACK;
+        setobj->ptr = lp;
+        if (from == REDIS_ENCODING_HT) server.stat_encoding_downgrades++;
+    } else if (enc == REDIS_ENCODING_ROARING &&
+               from == REDIS_ENCODING_INTSET) {
+        roaring *r = roaringNew();
+        int64_t intele;
+
+        si = setTypeInitIterator(setobj);
+        while (setTypeNext(si,NULL,&intele) != -1) roaringAdd(r,intele);
+        setTypeReleaseIterator(si);
+
+        setobj->encoding = REDIS_ENCODING_ROARING;
+        zfree(setobj->ptr);
+        setobj->ptr = r;
+        server.stat_encoding_upgrades++;
+    } else if (enc == REDIS_ENCODING_INTSET &&
+               (from == REDIS_ENCODING_ROARING || from == REDIS_ENCODING_HT)) {
+        intset *is = intsetNew();
+        robj *element;
+        int64_t intele;
+        long long llval;
+        int encoding;
+
+        si = setTypeInitIterator(setobj);
+        while ((encoding = setTypeNext(si,&element,&intele)) != -1) {
+            //hash table中的元素必须都能表示为整数
+            if (encoding == REDIS_ENCODING_HT) {
+                redisAssertWithInfo(NULL,element,
+                    isObjectRepresentableAsLongLong(element,&llval) == REDIS_OK);
+                intele = llval;
+            }
+            is = intsetAdd(is,intele,NULL);
+        }
+        setTypeReleaseIterator(si);
+
+        freeSetObject(setobj);
+        setobj->encoding = REDIS_ENCODING_INTSET;
+        setobj->ptr = is;
+        server.stat_encoding_downgrades++;
     } else {
         redisPanic("Unsupported set conversion");
     }
 }
 
+/* Convert a hash table or roaring encoded set back to an intset or a
+ * listpack once it shrank to 1/ratio of the compact limits, see
+ * listTypeTryDowngrade(). Returns 1 if the set was converted. */
+//set缩小到紧凑编码限制的1/ratio以下时, 将其转换回intset或listpack
+int setTypeTryDowngrade(robj *setobj, int ratio) {
+    unsigned long size = setTypeSize(setobj);
+    dictIterator *di;
+    dictEntry *de;
+    int allint = 1, fits = 1;
+
+    if (setobj->encoding == REDIS_ENCODING_ROARING) {
+        if (size > server.set_max_intset_entries/ratio) return 0;
+        setTypeConvert(setobj,REDIS_ENCODING_INTSET);
+        return 1;
+    }
+    if (setobj->encoding != REDIS_ENCODING_HT) return 0;
+    if (size > server.set_max_intset_entries/ratio &&
+        size > server.set_max_listpack_entries/ratio) return 0;
+
+    //检查元素是否都是整数, 以及是否都足够短
+    di = dictGetIterator(setobj->ptr);
+    while ((allint || fits) && (de = dictNext(di)) != NULL) {
+        robj *element = dictGetKey(de);
+
+        if (allint &&
+            isObjectRepresentableAsLongLong(element,NULL) != REDIS_OK)
+            allint = 0;
+        if (fits &&
+            stringObjectLen(element) > server.set_max_listpack_value)
+            fits = 0;
+    }
+    dictReleaseIterator(di);
+
+    if (allint) {
+        /* Integer sets go back to the intset (or stay in the hash table),
+         * like setTypeAdd() would have created them. */
+        //整数组成的set只转换为intset
+        if (size > server.set_max_intset_entries/ratio) return 0;
+        setTypeConvert(setobj,REDIS_ENCODING_INTSET);
+        return 1;
+    }
+    if (fits && size <= server.set_max_listpack_entries/ratio) {
+        setTypeConvert(setobj,REDIS_ENCODING_LISTPACK);
+        return 1;
+    }
+    return 0;
+}
+
 
 //sadd命令的实现
 void saddCommand(redisClient *c) {
@@ -304,6 +545,7 @@ void saddCommand(redisClient *c) {
 void sremCommand(redisClient *c) {
     robj *set;
     int j, deleted = 0, keyremoved = 0;
+    size_t len, removedlen = 0;
 
     if ((set = lookupKeyWriteOrReply(c,c->argv[1],shared.czero)) == NULL ||
         checkType(c,set,REDIS_SET)) return;
@@ -312,6 +554,8 @@ void sremCommand(redisClient *c) {
     	//移除指定的值
         if (setTypeRemove(set,c->argv[j])) {
             deleted++;
+            len = stringObjectLen(c->argv[j]);
+            if (len > removedlen) removedlen = len;
             if (setTypeSize(set) == 0) {
             	//set已经为空时，从db删除它
                 dbDelete(c->db,c->argv[1]);
@@ -326,6 +570,8 @@ void sremCommand(redisClient *c) {
         if (keyremoved)
             notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,"del",c->argv[1],
                                 c->db->id);
+        else
+            tryObjectDowngrade(set,setTypeSize(set)+deleted,removedlen);
         server.dirty += deleted;
     }
     addReplyLongLong(c,deleted);
@@ -371,6 +617,8 @@ void smoveCommand(redisClient *c) {
     if (setTypeSize(srcset) == 0) {
         dbDelete(c->db,c->argv[1]);
         notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,"del",c->argv[1],c->db->id);
+    } else {
+        tryObjectDowngrade(srcset,setTypeSize(srcset)+1,stringObjectLen(ele));
     }
     signalModifiedKey(c->db,c->argv[1]);
     signalModifiedKey(c->db,c->argv[2]);
@@ -432,9 +680,13 @@ void spopCommand(redisClient *c) {
     //根据编码从set中删除
     if (encoding == REDIS_ENCODING_INTSET) {
         ele = createStringObjectFromLongLong(llele);
-        set->ptr = intsetRemove(set->ptr,llele,NULL);
+        if (set->encoding == REDIS_ENCODING_ROARING)
+            roaringRemove(set->ptr,llele);
+        else
+            set->ptr = intsetRemove(set->ptr,llele,NULL);
     } else {
-        incrRefCount(ele);
+        //listpack返回的已经是新的对象
+        if (encoding == REDIS_ENCODING_HT) incrRefCount(ele);
         setTypeRemove(set,ele);
     }
     notifyKeyspaceEvent(REDIS_NOTIFY_SET,"spop",c->argv[1],c->db->id);
@@ -451,6 +703,8 @@ void spopCommand(redisClient *c) {
     if (setTypeSize(set) == 0) {
         dbDelete(c->db,c->argv[1]);
         notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,"del",c->argv[1],c->db->id);
+    } else {
+        tryObjectDowngrade(set,setTypeSize(set)+1,stringObjectLen(ele));
     }
     signalModifiedKey(c->db,c->argv[1]);
     server.dirty++;
@@ -509,6 +763,7 @@ void srandmemberWithCountCommand(redisClient *c) {
                 addReplyBulkLongLong(c,llele);
             } else {
                 addReplyBulk(c,ele);
+                if (encoding == REDIS_ENCODING_LISTPACK) decrRefCount(ele);
             }
         }
         return;
@@ -583,6 +838,8 @@ void srandmemberWithCountCommand(redisClient *c) {
             encoding = setTypeRandomElement(set,&ele,&llele);
             if (encoding == REDIS_ENCODING_INTSET) {
                 ele = createStringObjectFromLongLong(llele);
+            } else if (encoding == REDIS_ENCODING_LISTPACK) {
+                /* Already a new object, owned by us. */
             } else if (ele->encoding == REDIS_ENCODING_RAW) {
                 ele = dupStringObject(ele);
             } else if (ele->encoding == REDIS_ENCODING_INT) {
@@ -637,7 +894,28 @@ void srandmemberCommand(redisClient *c) {
         addReplyBulkLongLong(c,llele);
     } else {
         addReplyBulk(c,ele);
+        if (encoding == REDIS_ENCODING_LISTPACK) decrRefCount(ele);
+    }
+}
+
+/* Return a set object with the integers of 'r', that is consumed. Results
+ * small enough are stored as intsets. */
+//用roaring创建一个set, 元素较少时转换为intset
+robj *setTypeFromRoaring(roaring *r) {
+    roaringIterator it;
+    int64_t intele;
+    robj *o;
+
+    if (roaringLen(r) > server.set_max_intset_entries) {
+        o = createObject(REDIS_SET,r);
+        o->encoding = REDIS_ENCODING_ROARING;
+        return o;
     }
+    o = createIntsetObject();
+    roaringInitIterator(r,&it);
+    while (roaringNext(&it,&intele)) o->ptr = intsetAdd(o->ptr,intele,NULL);
+    roaringFree(r);
+    return o;
 }
 
 //比较两个set的大小，s1大时返回正数。使用它的qsort是从小到大排序
@@ -707,6 +985,58 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
         dstset = createIntsetObject();
     }
 
+    /* When all the sets are intsets the intersection is computed directly
+     * on the sorted arrays, galloping over the larger sets, see
+     * intsetIntersect(). */
+    //所有集合都是intset时，直接在有序数组上计算交集
+    for (j = 0; j < setnum; j++)
+        if (sets[j]->encoding != REDIS_ENCODING_INTSET) break;
+    if (j == setnum) {
+        intset **is = zmalloc(sizeof(intset*)*setnum);
+        intset *res;
+        uint32_t i;
+
+        for (j = 0; j < setnum; j++) is[j] = sets[j]->ptr;
+        res = intsetIntersect(is,setnum);
+        zfree(is);
+        if (dstkey) {
+            zfree(dstset->ptr);
+            dstset->ptr = res;
+        } else {
+            for (i = 0; intsetGet(res,i,&intobj); i++)
+                addReplyBulkLongLong(c,intobj);
+            cardinality = intsetLen(res);
+            zfree(res);
+        }
+        goto done;
+    }
+
+    /* Same when all the sets are roarings: the intersection is computed a
+     * container at a time, see roaringIntersect(). */
+    //所有集合都是roaring时，逐个container计算交集
+    for (j = 0; j < setnum; j++)
+        if (sets[j]->encoding != REDIS_ENCODING_ROARING) break;
+    if (j == setnum) {
+        roaring **rs = zmalloc(sizeof(roaring*)*setnum);
+        roaring *res;
+
+        for (j = 0; j < setnum; j++) rs[j] = sets[j]->ptr;
+        res = roaringIntersect(rs,setnum);
+        zfree(rs);
+        if (dstkey) {
+            decrRefCount(dstset);
+            dstset = setTypeFromRoaring(res);
+        } else {
+            roaringIterator it;
+
+            roaringInitIterator(res,&it);
+            while (roaringNext(&it,&intobj)) addReplyBulkLongLong(c,intobj);
+            cardinality = roaringLen(res);
+            roaringFree(res);
+        }
+        goto done;
+    }
+
     /* Iterate all the elements of the first (smallest) set, and test
      * the element against all the other sets, if at least one set does
      * not include the element it is discarded */
@@ -722,10 +1052,15 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
                     !intsetFind((intset*)sets[j]->ptr,intobj))
                 {
                     break;
+                } else if (sets[j]->encoding == REDIS_ENCODING_ROARING &&
+                           !roaringFind(sets[j]->ptr,intobj))
+                {
+                    break;
                 /* in order to compare an integer with an object we
                  * have to use the generic function, creating an object
                  * for this */
-                } else if (sets[j]->encoding == REDIS_ENCODING_HT) {
+                } else if (sets[j]->encoding != REDIS_ENCODING_INTSET &&
+                           sets[j]->encoding != REDIS_ENCODING_ROARING) {
                     eleobj = createStringObjectFromLongLong(intobj);
                     if (!setTypeIsMember(sets[j],eleobj)) {
                         decrRefCount(eleobj);
@@ -733,7 +1068,7 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
                     }
                     decrRefCount(eleobj);
                 }
-            } else if (encoding == REDIS_ENCODING_HT) {
+            } else {
                 /* Optimization... if the source object is integer
                  * encoded AND the target set is an intset, we can get
                  * a much faster path. */
@@ -742,6 +1077,11 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
                     !intsetFind((intset*)sets[j]->ptr,(long)eleobj->ptr))
                 {
                     break;
+                } else if (eleobj->encoding == REDIS_ENCODING_INT &&
+                           sets[j]->encoding == REDIS_ENCODING_ROARING &&
+                           !roaringFind(sets[j]->ptr,(long)eleobj->ptr))
+                {
+                    break;
                 /* else... object to object check is easy as we use the
                  * type agnostic API here. */
                 } else if (!setTypeIsMember(sets[j],eleobj)) {
@@ -755,7 +1095,7 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
         if (j == setnum) {
             if (!dstkey) {
             	//dstkey不存在，添加元素到回应中
-                if (encoding == REDIS_ENCODING_HT)
+                if (encoding != REDIS_ENCODING_INTSET)
                     addReplyBulk(c,eleobj);
                 else
                     addReplyBulkLongLong(c,intobj);
@@ -774,6 +1114,7 @@ void sinterGenericCommand(redisClient *c, robj **setkeys, unsigned long setnum,
     }
     setTypeReleaseIterator(si);
 
+done:
     if (dstkey) {
         /* Store the resulting set into the target, if the intersection
          * is not an empty set. */
@@ -818,7 +1159,7 @@ void sunionDiffGenericCommand(redisClient *c, robj **setkeys, int setnum, robj *
     setTypeIterator *si;
     robj *ele, *dstset = NULL;
     int j, cardinality = 0;
-    int diff_algo = 1;
+    int diff_algo = 1, fastunion = 0;
 
     //取到所有key对应的set
     for (j = 0; j < setnum; j++) {
@@ -877,7 +1218,39 @@ void sunionDiffGenericCommand(redisClient *c, robj **setkeys, int setnum, robj *
      * this set object will be the resulting object to set into the target key*/
     dstset = createIntsetObject();
 
+    /* The union of roarings is computed a container at a time, then the
+     * elements of the intsets, if any, are added to the result. */
+    //所有集合都是roaring或intset且至少有一个roaring时，逐个container计算并集
     if (op == REDIS_OP_UNION) {
+        roaring **rs = zmalloc(sizeof(roaring*)*setnum);
+        int rnum = 0;
+
+        for (j = 0; j < setnum; j++) {
+            if (!sets[j] || sets[j]->encoding == REDIS_ENCODING_INTSET) continue;
+            if (sets[j]->encoding != REDIS_ENCODING_ROARING) break;
+            rs[rnum++] = sets[j]->ptr;
+        }
+        if (j == setnum && rnum) {
+            roaring *res = roaringUnion(rs,rnum);
+            int64_t intele;
+
+            for (j = 0; j < setnum; j++) {
+                if (!sets[j] || sets[j]->encoding != REDIS_ENCODING_INTSET)
+                    continue;
+                si = setTypeInitIterator(sets[j]);
+                while (setTypeNext(si,NULL,&intele) != -1)
+                    roaringAdd(res,intele);
+                setTypeReleaseIterator(si);
+            }
+            decrRefCount(dstset);
+            dstset = setTypeFromRoaring(res);
+            cardinality = setTypeSize(dstset);
+            fastunion = 1;
+        }
+        zfree(rs);
+    }
+
+    if (op == REDIS_OP_UNION && !fastunion) {
         /* Union is trivial, just add every element of every set to the
          * temporary set. */
     	//union操作只需要将所有set的元素都添加到dstset中
@@ -1005,7 +1378,7 @@ void sdiffstoreCommand(redisClient *c) {
 //sscan命令的实现
 void sscanCommand(redisClient *c) {
     robj *set;
-    unsigned long cursor;
+    unsigned long long cursor;
 
     if (parseScanCursorOrReply(c,c->argv[2],&cursor) == REDIS_ERR) return;
     if ((set = lookupKeyReadOrReply(c,c->argv[1],shared.emptyscan)) == NULL ||
@@ -187,6 +187,101 @@ zskiplistNode *zslInsert(zskiplist *zsl, double score, robj *obj) {
     return x;
 }
 
+/* Bulk construction of a skiplist from elements already sorted by score and
+ * member, as found in RDB files, in zpack encoded sorted sets, or in the
+ * sorted output of ZUNIONSTORE / ZINTERSTORE.
+ *
+ * Elements are appended at the tail: the last node of every level is
+ * remembered so the new node is linked without any search, and node levels
+ * are assigned deterministically from the rank (every 4th node gets level 2,
+ * every 16th node level 3, and so forth, like ZSKIPLIST_P) instead of calling
+ * random(). The result is a perfectly balanced skiplist built in linear time.
+ *
+ * If an element arrives out of order, the skiplist is fixed up and the
+ * remaining elements are inserted with zslInsert(), so the result is always
+ * correct. zslBulkFinish() must be called before the skiplist is used. */
+//从有序的元素批量构建skiplist：每次都追加到尾部，层数由rank决定而不是随机生成，
+//整个构建过程是线性的。遇到乱序的元素时退化为zslInsert()
+
+/* Start building 'zsl', that must be empty. */
+//开始批量构建，zsl必须为空
+void zslBulkInit(zslBulk *bulk, zskiplist *zsl) {
+    int j;
+
+    redisAssert(zsl->length == 0);
+    bulk->zsl = zsl;
+    bulk->sorted = 1;
+    for (j = 0; j < ZSKIPLIST_MAXLEVEL; j++) {
+        bulk->last[j] = zsl->header;
+        bulk->rank[j] = 0;
+    }
+}
+
+/* Level of the node with the given 1-based rank in a balanced skiplist. */
+//平衡的skiplist中，第rank个节点的层数
+static int zslBulkLevel(unsigned long rank) {
+    int level = 1;
+
+    while ((rank & 3) == 0 && level < ZSKIPLIST_MAXLEVEL) {
+        level++;
+        rank >>= 2;
+    }
+    return level;
+}
+
+/* Append a new element, that should be greater than all the elements already
+ * in the skiplist. Returns the new node like zslInsert(). */
+//在尾部追加元素，元素应该比skiplist中已有的元素都大
+zskiplistNode *zslBulkAppend(zslBulk *bulk, double score, robj *obj) {
+    zskiplist *zsl = bulk->zsl;
+    zskiplistNode *x;
+    unsigned long rank;
+    int i, level;
+
+    redisAssert(!isnan(score));
+    if (bulk->sorted && zsl->tail &&
+        (score < zsl->tail->score ||
+         (score == zsl->tail->score &&
+          compareStringObjects(obj,zsl->tail->obj) <= 0)))
+    {
+        /* Out of order: fix the spans and go on with plain inserts. */
+        //元素乱序，修正span后使用普通的插入
+        zslBulkFinish(bulk);
+    }
+    if (!bulk->sorted) return zslInsert(zsl,score,obj);
+
+    rank = zsl->length+1;
+    level = zslBulkLevel(rank);
+    if (level > zsl->level) zsl->level = level;
+    x = zslCreateNode(level,score,obj);
+    for (i = 0; i < level; i++) {
+        x->level[i].forward = NULL;
+        x->level[i].span = 0;
+        bulk->last[i]->level[i].forward = x;
+        bulk->last[i]->level[i].span = rank-bulk->rank[i];
+        bulk->last[i] = x;
+        bulk->rank[i] = rank;
+    }
+    x->backward = zsl->tail;
+    zsl->tail = x;
+    zsl->length++;
+    return x;
+}
+
+/* Complete the construction. The span of the last node of every level is
+ * set to the number of nodes after it, like zslInsert() does, so the
+ * skiplist can be modified as usual from now on. */
+//完成构建：设置每层最后一个节点的span，之后skiplist可以正常使用
+void zslBulkFinish(zslBulk *bulk) {
+    zskiplist *zsl = bulk->zsl;
+    int i;
+
+    if (!bulk->sorted) return;
+    for (i = 0; i < zsl->level; i++)
+        bulk->last[i]->level[i].span = zsl->length-bulk->rank[i];
+    bulk->sorted = 0;
+}
+
 /* Internal function used by zslDelete, zslDeleteByScore and zslDeleteByRank */
 //从skiplist中删除一个节点
 void zslDeleteNode(zskiplist *zsl, zskiplistNode *x, zskiplistNode **update) {
@@ -485,6 +580,29 @@ zskiplistNode* zslGetElementByRank(zskiplist *zsl, unsigned long rank) {
     return NULL;
 }
 
+/* Return the node that is 'offset' positions after 'ln', or before it when
+ * 'reverse' is true. NULL is returned when there is no such node, and a
+ * negative offset skips everything. Instead of following 'offset' pointers
+ * one by one, the rank of 'ln' is computed and the destination node is
+ * reached using the spans, so the cost is O(log(N)) whatever the offset. */
+//返回ln之后(reverse时为之前)第offset个节点，通过rank和span跳转，复杂度O(log(N))
+static zskiplistNode *zslSkipNodes(zskiplist *zsl, zskiplistNode *ln, long offset, int reverse) {
+    unsigned long rank;
+
+    if (offset == 0) return ln;
+    if (offset < 0) return NULL;
+
+    rank = zslGetRank(zsl,ln->score,ln->obj);
+    if (reverse) {
+        if ((unsigned long)offset >= rank) return NULL;
+        rank -= offset;
+    } else {
+        if ((unsigned long)offset > zsl->length-rank) return NULL;
+        rank += offset;
+    }
+    return zslGetElementByRank(zsl,rank);
+}
+
 /* Populate the rangespec according to the objects min and max. */
 //根据元素min,max的rank构造spec
 static int zslParseRange(robj *min, robj *max, zrangespec *spec) {
@@ -700,477 +818,803 @@ zskiplistNode *zslLastInLexRange(zskiplist *zsl, zlexrangespec *range) {
 }
 
 /*-----------------------------------------------------------------------------
- * Ziplist-backed sorted set API
+ * B+tree-backed sorted set API
  *----------------------------------------------------------------------------*/
-//基于ziplist的sorted set API
+//基于B+树的sorted set API。元素用从0开始的rank表示，找不到时返回-1
 
-//取到给定元素的score
-double zzlGetScore(unsigned char *sptr) {
-    unsigned char *vstr;
-    unsigned int vlen;
-    long long vlong;
-    char buf[128];
-    double score;
+/* Every node but the root is kept at least half full. The only exception is
+ * the last leaf: when elements are appended at the end of the sorted set, as
+ * it happens loading an RDB file or converting a zpack, a full leaf is not
+ * split in two halves but a new leaf is started, so that the leaves of
+ * a sorted set created in order are completely filled. */
+#define ZBTREE_LEAF_MIN (ZBTREE_LEAF_MAX/2)
+#define ZBTREE_INNER_MIN ((ZBTREE_INNER_MAX+1)/2)
 
-    redisAssert(sptr != NULL);
-    redisAssert(ziplistGet(sptr,&vstr,&vlen,&vlong));
+/* Compare two (score, member) keys, using the same order of the skiplist. */
+//比较两个(score, 成员)，先比较score，相同时再比较成员
+static int zbtreeKeyCompare(double s1, robj *o1, double s2, robj *o2) {
+    if (s1 < s2) return -1;
+    if (s1 > s2) return 1;
+    return compareStringObjects(o1,o2);
+}
 
-    if (vstr) {
-        memcpy(buf,vstr,vlen);
-        buf[vlen] = '\0';
-        score = strtod(buf,NULL);
-    } else {
-        score = vlong;
-    }
+//创建叶子节点
+static zbtreeLeaf *zbtreeCreateLeaf(void) {
+    zbtreeLeaf *l = zmalloc(sizeof(*l));
 
-    return score;
+    l->hdr.leaf = 1;
+    l->hdr.num = 0;
+    l->prev = l->next = NULL;
+    return l;
 }
 
-/* Return a ziplist element as a Redis string object.
- * This simple abstraction can be used to simplifies some code at the
- * cost of some performance. */
-//将ziplist中的元素以redis string返回
-robj *ziplistGetObject(unsigned char *sptr) {
-    unsigned char *vstr;
-    unsigned int vlen;
-    long long vlong;
+//创建内部节点
+static zbtreeInner *zbtreeCreateInner(void) {
+    zbtreeInner *in = zmalloc(sizeof(*in));
 
-    redisAssert(sptr != NULL);
-    redisAssert(ziplistGet(sptr,&vstr,&vlen,&vlong));
+    in->hdr.leaf = 0;
+    in->hdr.num = 0;
+    in->obj[0] = NULL;
+    return in;
+}
 
-    if (vstr) {
-        return createStringObject((char*)vstr,vlen);
-    } else {
-        return createStringObjectFromLongLong(vlong);
-    }
+/* Create a new B+tree, the root is an empty leaf. */
+//创建B+树，根节点是一个空的叶子节点
+zbtree *zbtreeCreate(void) {
+    zbtree *zbt = zmalloc(sizeof(*zbt));
+    zbtreeLeaf *l = zbtreeCreateLeaf();
+
+    zbt->root = (zbtreeNode*)l;
+    zbt->head = zbt->tail = l;
+    zbt->length = 0;
+    return zbt;
 }
 
-/* Compare element in sorted set with given element. */
-//比较ziplist中元素eptr与cstr的大小
-int zzlCompareElements(unsigned char *eptr, unsigned char *cstr, unsigned int clen) {
-    unsigned char *vstr;
-    unsigned int vlen;
-    long long vlong;
-    unsigned char vbuf[32];
-    int minlen, cmp;
+//释放节点以及它的子树，同时减少成员和分隔键的引用计数
+static void zbtreeFreeNode(zbtreeNode *n) {
+    int j;
 
-    redisAssert(ziplistGet(eptr,&vstr,&vlen,&vlong));
-    if (vstr == NULL) {
-        /* Store string representation of long long in buf. */
-        vlen = ll2string((char*)vbuf,sizeof(vbuf),vlong);
-        vstr = vbuf;
+    if (n->leaf) {
+        zbtreeLeaf *l = (zbtreeLeaf*)n;
+        for (j = 0; j < n->num; j++) decrRefCount(l->obj[j]);
+    } else {
+        zbtreeInner *in = (zbtreeInner*)n;
+        for (j = 0; j < n->num; j++) {
+            if (j) decrRefCount(in->obj[j]);
+            zbtreeFreeNode(in->child[j]);
+        }
     }
+    zfree(n);
+}
 
-    minlen = (vlen < clen) ? vlen : clen;
-    cmp = memcmp(vstr,cstr,minlen);
-    if (cmp == 0) return vlen-clen;
-    return cmp;
+//释放B+树
+void zbtreeFree(zbtree *zbt) {
+    zbtreeFreeNode(zbt->root);
+    zfree(zbt);
 }
 
-//取到ziplist中保存的zset元素数量
-unsigned int zzlLength(unsigned char *zl) {
-	//一个zset的元素需要两个ziplist元素，一个保存score，一个保存value
-    return ziplistLen(zl)/2;
+/* Return the number of elements stored in the subtree rooted at 'n'. */
+//子树中的元素个数
+static unsigned long zbtreeNodeSize(zbtreeNode *n) {
+    zbtreeInner *in = (zbtreeInner*)n;
+    unsigned long size = 0;
+    int j;
+
+    if (n->leaf) return n->num;
+    for (j = 0; j < n->num; j++) size += in->size[j];
+    return size;
 }
 
-/* Move to next entry based on the values in eptr and sptr. Both are set to
- * NULL when there is no next entry. */
-//分别取到ziplist中下一个保存score和value的元素
-void zzlNext(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
-    unsigned char *_eptr, *_sptr;
-    redisAssert(*eptr != NULL && *sptr != NULL);
+/* Return the child of 'in' where the key is stored or should be inserted:
+ * the last child with a separator <= key, or the first child. */
+//二分查找key所在的子节点
+static int zbtreeRoute(zbtreeInner *in, double score, robj *obj) {
+    int lo = 1, hi = in->hdr.num-1, i = 0;
 
-    _eptr = ziplistNext(zl,*sptr);
-    if (_eptr != NULL) {
-        _sptr = ziplistNext(zl,_eptr);
-        redisAssert(_sptr != NULL);
-    } else {
-        /* No next entry. */
-        _sptr = NULL;
+    while (lo <= hi) {
+        int mid = (lo+hi)/2;
+        if (zbtreeKeyCompare(in->score[mid],in->obj[mid],score,obj) <= 0) {
+            i = mid;
+            lo = mid+1;
+        } else {
+            hi = mid-1;
+        }
     }
-
-    *eptr = _eptr;
-    *sptr = _sptr;
+    return i;
 }
 
-/* Move to the previous entry based on the values in eptr and sptr. Both are
- * set to NULL when there is no next entry. */
-//分别取到ziplist中保存score，value的前一个元素
-void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
-    unsigned char *_eptr, *_sptr;
-    redisAssert(*eptr != NULL && *sptr != NULL);
+/* Return the slot of the first element of the leaf that is >= key. */
+//二分查找叶子节点中第一个大于等于key的位置
+static int zbtreeLeafSearch(zbtreeLeaf *l, double score, robj *obj) {
+    int lo = 0, hi = l->hdr.num;
+
+    while (lo < hi) {
+        int mid = (lo+hi)/2;
+        if (zbtreeKeyCompare(l->score[mid],l->obj[mid],score,obj) < 0)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Insert the element in the subtree rooted at 'n'. When the node is split,
+ * the new node (that is the right sibling of 'n') is returned, and its
+ * smallest key is stored in *sepscore and *sepobj with a new reference.
+ * Otherwise NULL is returned. */
+//在子树中插入元素。节点分裂时返回新的右兄弟节点，并通过sepscore,sepobj返回它的最小键
+static zbtreeNode *zbtreeInsertNode(zbtree *zbt, zbtreeNode *n, double score,
+                                    robj *obj, double *sepscore, robj **sepobj)
+{
+    if (n->leaf) {
+        zbtreeLeaf *l = (zbtreeLeaf*)n, *r = NULL;
+        int idx = zbtreeLeafSearch(l,score,obj);
+
+        /* Split a full leaf before inserting. */
+        //叶子节点已满，先分裂。在最后一个叶子的末尾追加时，原叶子保持满的状态
+        if (n->num == ZBTREE_LEAF_MAX) {
+            int split = (idx == n->num && l->next == NULL) ? n->num : n->num/2;
+
+            r = zbtreeCreateLeaf();
+            r->hdr.num = n->num-split;
+            memcpy(r->score,l->score+split,sizeof(double)*r->hdr.num);
+            memcpy(r->obj,l->obj+split,sizeof(robj*)*r->hdr.num);
+            n->num = split;
+
+            r->prev = l;
+            r->next = l->next;
+            if (l->next) l->next->prev = r; else zbt->tail = r;
+            l->next = r;
+
+            if (idx > split || split == ZBTREE_LEAF_MAX) {
+                l = r;
+                idx -= split;
+            }
+        }
+
+        memmove(l->score+idx+1,l->score+idx,sizeof(double)*(l->hdr.num-idx));
+        memmove(l->obj+idx+1,l->obj+idx,sizeof(robj*)*(l->hdr.num-idx));
+        l->score[idx] = score;
+        l->obj[idx] = obj;
+        l->hdr.num++;
+
+        if (r == NULL) return NULL;
+        *sepscore = r->score[0];
+        *sepobj = r->obj[0];
+        incrRefCount(r->obj[0]);
+        return (zbtreeNode*)r;
+    } else {
+        zbtreeInner *in = (zbtreeInner*)n, *r;
+        zbtreeNode *child;
+        double cscore;
+        robj *cobj;
+        int i = zbtreeRoute(in,score,obj), tail, mid;
+
+        in->size[i]++;
+        child = zbtreeInsertNode(zbt,in->child[i],score,obj,&cscore,&cobj);
+        if (child == NULL) return NULL;
+
+        /* The child was split, add the new node at its right. */
+        //子节点分裂了，将新节点添加到它的右边
+        i++;
+        tail = n->num-i;
+        memmove(in->size+i+1,in->size+i,sizeof(unsigned long)*tail);
+        memmove(in->score+i+1,in->score+i,sizeof(double)*tail);
+        memmove(in->obj+i+1,in->obj+i,sizeof(robj*)*tail);
+        memmove(in->child+i+1,in->child+i,sizeof(zbtreeNode*)*tail);
+        in->size[i] = zbtreeNodeSize(child);
+        in->size[i-1] -= in->size[i];
+        in->score[i] = cscore;
+        in->obj[i] = cobj;
+        in->child[i] = child;
+        n->num++;
+        if (n->num <= ZBTREE_INNER_MAX) return NULL;
+
+        /* Split the node in two halves. The separator of the first child
+         * of the new node moves to the parent. */
+        //内部节点超过容量，分裂成两半，新节点第一个子节点的分隔键上移到父节点
+        r = zbtreeCreateInner();
+        mid = n->num/2;
+        r->hdr.num = n->num-mid;
+        memcpy(r->size,in->size+mid,sizeof(unsigned long)*r->hdr.num);
+        memcpy(r->score,in->score+mid,sizeof(double)*r->hdr.num);
+        memcpy(r->obj,in->obj+mid,sizeof(robj*)*r->hdr.num);
+        memcpy(r->child,in->child+mid,sizeof(zbtreeNode*)*r->hdr.num);
+        n->num = mid;
+        *sepscore = r->score[0];
+        *sepobj = r->obj[0];
+        r->obj[0] = NULL;
+        return (zbtreeNode*)r;
+    }
+}
+
+/* Insert a new element in the B+tree. The element must not already be in the
+ * tree. The caller's reference to 'obj' is transferred to the tree, like it
+ * happens with zslInsert(). */
+//在B+树中插入元素，树持有调用者传入的obj引用
+void zbtreeInsert(zbtree *zbt, double score, robj *obj) {
+    zbtreeNode *r;
+    zbtreeInner *root;
+    double sepscore;
+    robj *sepobj;
+
+    r = zbtreeInsertNode(zbt,zbt->root,score,obj,&sepscore,&sepobj);
+    zbt->length++;
+    if (r == NULL) return;
+
+    /* The root was split, the tree grows by one level. */
+    //根节点分裂，树的高度加1
+    root = zbtreeCreateInner();
+    root->hdr.num = 2;
+    root->child[0] = zbt->root;
+    root->child[1] = r;
+    root->score[1] = sepscore;
+    root->obj[1] = sepobj;
+    root->size[1] = zbtreeNodeSize(r);
+    root->size[0] = zbt->length-root->size[1];
+    zbt->root = (zbtreeNode*)root;
+}
+
+/* Remove the entry at 'i' from the inner node. The reference held by its
+ * separator is not released. */
+//删除内部节点中第i个子节点的条目
+static void zbtreeInnerRemove(zbtreeInner *in, int i) {
+    int tail = in->hdr.num-i-1;
+
+    memmove(in->size+i,in->size+i+1,sizeof(unsigned long)*tail);
+    memmove(in->score+i,in->score+i+1,sizeof(double)*tail);
+    memmove(in->obj+i,in->obj+i+1,sizeof(robj*)*tail);
+    memmove(in->child+i,in->child+i+1,sizeof(zbtreeNode*)*tail);
+    in->hdr.num--;
+}
+
+/* Rebalance the children 'i' and 'i+1' of 'in', one of them being under the
+ * minimum fill. When they fit in a single node the right one is merged into
+ * the left one, otherwise their entries are split evenly between them. */
+//重新平衡两个相邻的子节点：能放进一个节点就合并，否则平均分配
+static void zbtreeRebalance(zbtree *zbt, zbtreeInner *in, int i) {
+    zbtreeNode *ln = in->child[i], *rn = in->child[i+1];
+    int total = ln->num+rn->num, lnum, j;
+
+    if (ln->leaf) {
+        zbtreeLeaf *l = (zbtreeLeaf*)ln, *r = (zbtreeLeaf*)rn;
+
+        /* The separator of the right leaf is dropped or replaced. */
+        decrRefCount(in->obj[i+1]);
+        if (total <= ZBTREE_LEAF_MAX) {
+            memcpy(l->score+ln->num,r->score,sizeof(double)*rn->num);
+            memcpy(l->obj+ln->num,r->obj,sizeof(robj*)*rn->num);
+            ln->num = total;
+            l->next = r->next;
+            if (r->next) r->next->prev = l; else zbt->tail = l;
+            zfree(r);
+            in->size[i] += in->size[i+1];
+            zbtreeInnerRemove(in,i+1);
+            return;
+        }
+
+        lnum = total/2;
+        if (ln->num > lnum) {
+            /* Move the last elements of the left leaf to the right one. */
+            int move = ln->num-lnum;
+            memmove(r->score+move,r->score,sizeof(double)*rn->num);
+            memmove(r->obj+move,r->obj,sizeof(robj*)*rn->num);
+            memcpy(r->score,l->score+lnum,sizeof(double)*move);
+            memcpy(r->obj,l->obj+lnum,sizeof(robj*)*move);
+        } else {
+            /* Move the first elements of the right leaf to the left one. */
+            int move = lnum-ln->num;
+            memcpy(l->score+ln->num,r->score,sizeof(double)*move);
+            memcpy(l->obj+ln->num,r->obj,sizeof(robj*)*move);
+            memmove(r->score,r->score+move,sizeof(double)*(rn->num-move));
+            memmove(r->obj,r->obj+move,sizeof(robj*)*(rn->num-move));
+        }
+        ln->num = lnum;
+        rn->num = total-lnum;
+        in->size[i] = lnum;
+        in->size[i+1] = total-lnum;
+        in->score[i+1] = r->score[0];
+        in->obj[i+1] = r->obj[0];
+        incrRefCount(r->obj[0]);
+    } else {
+        zbtreeInner *l = (zbtreeInner*)ln, *r = (zbtreeInner*)rn;
+        unsigned long size[ZBTREE_INNER_MAX*2];
+        double score[ZBTREE_INNER_MAX*2];
+        robj *obj[ZBTREE_INNER_MAX*2];
+        zbtreeNode *child[ZBTREE_INNER_MAX*2];
+
+        /* Concatenate the entries of the two nodes: the separator of the
+         * first child of the right node is the one stored in the parent. */
+        //将两个节点的条目拼接起来，右节点第一个子节点的分隔键来自父节点
+        memcpy(size,l->size,sizeof(unsigned long)*ln->num);
+        memcpy(score,l->score,sizeof(double)*ln->num);
+        memcpy(obj,l->obj,sizeof(robj*)*ln->num);
+        memcpy(child,l->child,sizeof(zbtreeNode*)*ln->num);
+        memcpy(size+ln->num,r->size,sizeof(unsigned long)*rn->num);
+        memcpy(score+ln->num,r->score,sizeof(double)*rn->num);
+        memcpy(obj+ln->num,r->obj,sizeof(robj*)*rn->num);
+        memcpy(child+ln->num,r->child,sizeof(zbtreeNode*)*rn->num);
+        score[ln->num] = in->score[i+1];
+        obj[ln->num] = in->obj[i+1];
+
+        lnum = (total <= ZBTREE_INNER_MAX) ? total : total/2;
+        memcpy(l->size,size,sizeof(unsigned long)*lnum);
+        memcpy(l->score,score,sizeof(double)*lnum);
+        memcpy(l->obj,obj,sizeof(robj*)*lnum);
+        memcpy(l->child,child,sizeof(zbtreeNode*)*lnum);
+        ln->num = lnum;
+
+        if (lnum == total) {
+            zfree(r);
+            in->size[i] += in->size[i+1];
+            zbtreeInnerRemove(in,i+1);
+            return;
+        }
 
-    _sptr = ziplistPrev(zl,*eptr);
-    if (_sptr != NULL) {
-        _eptr = ziplistPrev(zl,_sptr);
-        redisAssert(_eptr != NULL);
+        rn->num = total-lnum;
+        memcpy(r->size,size+lnum,sizeof(unsigned long)*rn->num);
+        memcpy(r->score,score+lnum,sizeof(double)*rn->num);
+        memcpy(r->obj,obj+lnum,sizeof(robj*)*rn->num);
+        memcpy(r->child,child+lnum,sizeof(zbtreeNode*)*rn->num);
+        in->score[i+1] = r->score[0];
+        in->obj[i+1] = r->obj[0];
+        r->obj[0] = NULL;
+        in->size[i] = 0;
+        for (j = 0; j < lnum; j++) in->size[i] += size[j];
+        in->size[i+1] = zbtreeNodeSize(rn);
+    }
+}
+
+/* Delete up to 'count' elements starting at the 0-based 'rank' inside the
+ * subtree rooted at 'n'. Only elements of a single leaf are removed, and
+ * their number is returned. When 'dict' is not NULL the elements are also
+ * removed from the dictionary. */
+//从子树中删除从rank开始的最多count个元素，只删除一个叶子中的元素，返回删除的数量
+static unsigned long zbtreeDeleteFromNode(zbtree *zbt, zbtreeNode *n,
+    unsigned long rank, unsigned long count, dict *dict)
+{
+    if (n->leaf) {
+        zbtreeLeaf *l = (zbtreeLeaf*)n;
+        unsigned long j, num = n->num-rank;
+
+        if (num > count) num = count;
+        for (j = rank; j < rank+num; j++) {
+            if (dict) dictDelete(dict,l->obj[j]);
+            decrRefCount(l->obj[j]);
+        }
+        memmove(l->score+rank,l->score+rank+num,sizeof(double)*(n->num-rank-num));
+        memmove(l->obj+rank,l->obj+rank+num,sizeof(robj*)*(n->num-rank-num));
+        n->num -= num;
+        return num;
     } else {
-        /* No previous entry. */
-        _eptr = NULL;
+        zbtreeInner *in = (zbtreeInner*)n;
+        zbtreeNode *child;
+        unsigned long deleted;
+        int i = 0;
+
+        while (rank >= in->size[i]) rank -= in->size[i++];
+        child = in->child[i];
+        deleted = zbtreeDeleteFromNode(zbt,child,rank,count,dict);
+        in->size[i] -= deleted;
+
+        /* Fix the child if it is now under the minimum fill. */
+        //子节点元素过少时，与相邻的兄弟节点重新平衡
+        if (n->num > 1 &&
+            child->num < (child->leaf ? ZBTREE_LEAF_MIN : ZBTREE_INNER_MIN))
+            zbtreeRebalance(zbt,in,i > 0 ? i-1 : i);
+        return deleted;
+    }
+}
+
+/* Delete all the elements with rank between start and end from the B+tree.
+ * Start and end are 0-based and inclusive, and must be valid ranks. The
+ * elements are removed leaf by leaf, so the cost is O(log(N)) for every
+ * leaf touched plus the number of removed elements. */
+//删除rank在start和end之间的元素(从0开始，包含start和end)，逐个叶子批量删除
+unsigned long zbtreeDeleteRangeByRank(zbtree *zbt, unsigned long start, unsigned long end, dict *dict) {
+    unsigned long removed = 0, count = end-start+1, deleted;
+
+    while (removed < count) {
+        deleted = zbtreeDeleteFromNode(zbt,zbt->root,start,count-removed,dict);
+        redisAssert(deleted != 0);
+        zbt->length -= deleted;
+        removed += deleted;
+
+        /* An inner root with a single child is removed. */
+        //根节点只有一个子节点时，树的高度减1
+        while (!zbt->root->leaf && zbt->root->num == 1) {
+            zbtreeInner *root = (zbtreeInner*)zbt->root;
+            zbt->root = root->child[0];
+            zfree(root);
+        }
     }
+    return removed;
+}
+
+/* Find the 0-based rank of the element with the given score and member.
+ * Returns -1 when the element is not in the tree. */
+//找到元素的rank(从0开始)，不存在时返回-1
+long zbtreeGetRank(zbtree *zbt, double score, robj *obj) {
+    zbtreeNode *n = zbt->root;
+    zbtreeLeaf *l;
+    unsigned long rank = 0;
+    int i, j;
 
-    *eptr = _eptr;
-    *sptr = _sptr;
+    while (!n->leaf) {
+        zbtreeInner *in = (zbtreeInner*)n;
+        i = zbtreeRoute(in,score,obj);
+        for (j = 0; j < i; j++) rank += in->size[j];
+        n = in->child[i];
+    }
+    l = (zbtreeLeaf*)n;
+    i = zbtreeLeafSearch(l,score,obj);
+    if (i == n->num || zbtreeKeyCompare(l->score[i],l->obj[i],score,obj) != 0)
+        return -1;
+    return rank+i;
 }
 
-/* Returns if there is a part of the zset is in range. Should only be used
- * internally by zzlFirstInRange and zzlLastInRange. */
-//返回1如果zset中元素值的范围与range范围有交集(注：不代表一定要元素的值在range中)
-int zzlIsInRange(unsigned char *zl, zrangespec *range) {
-    unsigned char *p;
-    double score;
+/* Delete an element with matching score/object from the B+tree. Returns 1 if
+ * the element was found and deleted, 0 otherwise. */
+//从B+树中删除元素
+int zbtreeDelete(zbtree *zbt, double score, robj *obj) {
+    long rank = zbtreeGetRank(zbt,score,obj);
 
-    /* Test for ranges that will always be empty. */
-    if (range->min > range->max ||
-            (range->min == range->max && (range->minex || range->maxex)))
-        return 0;
+    if (rank == -1) return 0;
+    zbtreeDeleteRangeByRank(zbt,rank,rank,NULL);
+    return 1;
+}
 
-    p = ziplistIndex(zl,-1); /* Last score. */
-    if (p == NULL) return 0; /* Empty sorted set */
-    score = zzlGetScore(p);
-    //最大值比range min小，返回0
-    if (!zslValueGteMin(score,range))
-        return 0;
+/* Set 'pos' to the element at the 0-based 'rank', that must be valid. */
+//根据子树的元素个数找到rank处的元素
+void zbtreeGetElementByRank(zbtree *zbt, unsigned long rank, zbtreePos *pos) {
+    zbtreeNode *n = zbt->root;
+    int i;
 
-    p = ziplistIndex(zl,1); /* First score. */
-    redisAssert(p != NULL);
-    score = zzlGetScore(p);
-    //最小值表range max大，返回0
-    if (!zslValueLteMax(score,range))
-        return 0;
+    while (!n->leaf) {
+        zbtreeInner *in = (zbtreeInner*)n;
+        for (i = 0; rank >= in->size[i]; i++) rank -= in->size[i];
+        n = in->child[i];
+    }
+    pos->leaf = (zbtreeLeaf*)n;
+    pos->idx = rank;
+}
 
-    return 1;
+//移动到下一个元素
+void zbtreeNext(zbtreePos *pos) {
+    if (++pos->idx == pos->leaf->hdr.num) {
+        pos->leaf = pos->leaf->next;
+        pos->idx = 0;
+    }
 }
 
-/* Find pointer to the first element contained in the specified range.
- * Returns NULL when no element is contained in the range. */
-//好的zset中第一个在range中的元素
-unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec *range) {
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
-    double score;
+//移动到前一个元素
+void zbtreePrev(zbtreePos *pos) {
+    if (pos->idx-- == 0) {
+        pos->leaf = pos->leaf->prev;
+        if (pos->leaf) pos->idx = pos->leaf->hdr.num-1;
+    }
+}
 
-    /* If everything is out of range, return early. */
-    if (!zzlIsInRange(zl,range)) return NULL;
+/* Predicate used to search the B+tree. It must be false for a (possibly
+ * empty) prefix of the sorted set and true for the rest. */
+typedef int (*zbtreeMatchProc)(double score, robj *obj, void *spec);
 
-    while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
-        redisAssert(sptr != NULL);
+//score大于等于最小值
+static int zbtreeScoreGteMin(double score, robj *obj, void *spec) {
+    REDIS_NOTUSED(obj);
+    return zslValueGteMin(score,spec);
+}
 
-        score = zzlGetScore(sptr);
-        if (zslValueGteMin(score,range)) {
-            /* Check if score <= max. */
-        	//当前元素的score比最小值大，最大值小，那就是第一个在range中元素
-            if (zslValueLteMax(score,range))
-                return eptr;
-            return NULL;
-        }
+//score大于最大值
+static int zbtreeScoreGtMax(double score, robj *obj, void *spec) {
+    REDIS_NOTUSED(obj);
+    return !zslValueLteMax(score,spec);
+}
 
-        /* Move to next element. */
-        eptr = ziplistNext(zl,sptr);
-    }
+//成员大于等于最小的字符串
+static int zbtreeLexGteMin(double score, robj *obj, void *spec) {
+    REDIS_NOTUSED(score);
+    return zslLexValueGteMin(obj,spec);
+}
 
-    return NULL;
+//成员大于最大的字符串
+static int zbtreeLexGtMax(double score, robj *obj, void *spec) {
+    REDIS_NOTUSED(score);
+    return !zslLexValueLteMax(obj,spec);
 }
 
-/* Find pointer to the last element contained in the specified range.
- * Returns NULL when no element is contained in the range. */
-//找到zset中最后一个在range中的元素
-unsigned char *zzlLastInRange(unsigned char *zl, zrangespec *range) {
-    unsigned char *eptr = ziplistIndex(zl,-2), *sptr;
-    double score;
+/* Return the 0-based rank of the first element matching 'match', and set
+ * 'pos' to it. When no element matches, the length of the tree is returned
+ * and pos->leaf is set to NULL. Separators are lower bounds of the keys of
+ * their subtree, so we descend into the last child whose separator does not
+ * match: the first match is inside it, or it is the first element after it. */
+//找到第一个满足match的元素，返回它的rank
+static unsigned long zbtreeFirstMatch(zbtree *zbt, zbtreeMatchProc match,
+                                      void *spec, zbtreePos *pos)
+{
+    zbtreeNode *n = zbt->root;
+    zbtreeLeaf *l;
+    unsigned long rank = 0;
+    int lo, hi, i, j;
 
-    /* If everything is out of range, return early. */
-    if (!zzlIsInRange(zl,range)) return NULL;
-
-    while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
-        redisAssert(sptr != NULL);
-
-        score = zzlGetScore(sptr);
-        if (zslValueLteMax(score,range)) {
-            /* Check if score >= min. */
-        	//小于最大值，大于最小值则返回元素
-            if (zslValueGteMin(score,range))
-                return eptr;
-            return NULL;
-        }
-
-        /* Move to previous element by moving to the score of previous element.
-         * When this returns NULL, we know there also is no element. */
-        sptr = ziplistPrev(zl,eptr);
-        if (sptr != NULL)
-            redisAssert((eptr = ziplistPrev(zl,sptr)) != NULL);
-        else
-            eptr = NULL;
+    while (!n->leaf) {
+        zbtreeInner *in = (zbtreeInner*)n;
+
+        lo = 1, hi = n->num-1, i = 0;
+        while (lo <= hi) {
+            int mid = (lo+hi)/2;
+            if (!match(in->score[mid],in->obj[mid],spec)) {
+                i = mid;
+                lo = mid+1;
+            } else {
+                hi = mid-1;
+            }
+        }
+        for (j = 0; j < i; j++) rank += in->size[j];
+        n = in->child[i];
     }
 
-    return NULL;
+    l = (zbtreeLeaf*)n;
+    lo = 0, hi = n->num;
+    while (lo < hi) {
+        int mid = (lo+hi)/2;
+        if (!match(l->score[mid],l->obj[mid],spec))
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    pos->leaf = l;
+    pos->idx = lo;
+    if (lo == n->num) {
+        pos->leaf = l->next;
+        pos->idx = 0;
+    }
+    return rank+lo;
+}
+
+/* Set 'pos' to the last element not matching 'match', given the rank of the
+ * first matching element and its position. Returns the rank of the element,
+ * or -1 if every element matches. */
+//取到第一个满足match的元素之前的那个元素
+static long zbtreeLastNotMatching(zbtree *zbt, unsigned long rank, zbtreePos *pos) {
+    if (rank == 0) return -1;
+    if (pos->leaf == NULL) {
+        pos->leaf = zbt->tail;
+        pos->idx = zbt->tail->hdr.num-1;
+    } else {
+        zbtreePrev(pos);
+    }
+    return rank-1;
 }
 
-//ziplist中p指向元素是否大于range中最小值
-static int zzlLexValueGteMin(unsigned char *p, zlexrangespec *spec) {
-    robj *value = ziplistGetObject(p);
-    int res = zslLexValueGteMin(value,spec);
-    decrRefCount(value);
-    return res;
+/* Find the first element contained in the specified range, storing its
+ * position in 'pos'. Returns its 0-based rank, or -1 when no element is
+ * contained in the range. */
+//找到第一个在range中的元素
+long zbtreeFirstInRange(zbtree *zbt, zrangespec *range, zbtreePos *pos) {
+    unsigned long rank = zbtreeFirstMatch(zbt,zbtreeScoreGteMin,range,pos);
+
+    if (pos->leaf == NULL || !zslValueLteMax(zbtreePosScore(pos),range))
+        return -1;
+    return rank;
 }
 
-//ziplist中p指向元素是否小于range中最大值
-static int zzlLexValueLteMax(unsigned char *p, zlexrangespec *spec) {
-    robj *value = ziplistGetObject(p);
-    int res = zslLexValueLteMax(value,spec);
-    decrRefCount(value);
-    return res;
+/* Find the last element contained in the specified range, storing its
+ * position in 'pos'. Returns its 0-based rank, or -1 when no element is
+ * contained in the range. */
+//找到最后一个在range中的元素
+long zbtreeLastInRange(zbtree *zbt, zrangespec *range, zbtreePos *pos) {
+    unsigned long first = zbtreeFirstMatch(zbt,zbtreeScoreGtMax,range,pos);
+    long rank = zbtreeLastNotMatching(zbt,first,pos);
+
+    if (rank == -1 || !zslValueGteMin(zbtreePosScore(pos),range))
+        return -1;
+    return rank;
 }
 
-/* Returns if there is a part of the zset is in range. Should only be used
- * internally by zzlFirstInRange and zzlLastInRange. */
-//返回1如果zset中元素值的范围与range范围有交集，用lex序做比较((注：不代表一定要元素的值在range中))
-int zzlIsInLexRange(unsigned char *zl, zlexrangespec *range) {
-    unsigned char *p;
+/* Find the first element contained in the specified lex range. */
+//找到第一个在lex range中的元素
+long zbtreeFirstInLexRange(zbtree *zbt, zlexrangespec *range, zbtreePos *pos) {
+    unsigned long rank = zbtreeFirstMatch(zbt,zbtreeLexGteMin,range,pos);
 
-    /* Test for ranges that will always be empty. */
-    if (compareStringObjectsForLexRange(range->min,range->max) > 1 ||
-            (compareStringObjects(range->min,range->max) == 0 &&
-            (range->minex || range->maxex)))
-        return 0;
+    if (pos->leaf == NULL || !zslLexValueLteMax(zbtreePosObj(pos),range))
+        return -1;
+    return rank;
+}
 
-    p = ziplistIndex(zl,-2); /* Last element. */
-    if (p == NULL) return 0;
-    //最大元素小于最小值
-    if (!zzlLexValueGteMin(p,range))
-        return 0;
+/* Find the last element contained in the specified lex range. */
+//找到最后一个在lex range中的元素
+long zbtreeLastInLexRange(zbtree *zbt, zlexrangespec *range, zbtreePos *pos) {
+    unsigned long first = zbtreeFirstMatch(zbt,zbtreeLexGtMax,range,pos);
+    long rank = zbtreeLastNotMatching(zbt,first,pos);
 
-    p = ziplistIndex(zl,0); /* First element. */
-    redisAssert(p != NULL);
-    //最小元素小于最大值
-    if (!zzlLexValueLteMax(p,range))
-        return 0;
+    if (rank == -1 || !zslLexValueGteMin(zbtreePosObj(pos),range))
+        return -1;
+    return rank;
+}
 
-    return 1;
+/* Delete all the elements with score between min and max from the B+tree.
+ * The range is located with two O(log(N)) searches and removed by rank. */
+//删除score在range中的元素
+unsigned long zbtreeDeleteRangeByScore(zbtree *zbt, zrangespec *range, dict *dict) {
+    zbtreePos pos;
+    long first, last;
+
+    if ((first = zbtreeFirstInRange(zbt,range,&pos)) == -1) return 0;
+    last = zbtreeLastInRange(zbt,range,&pos);
+    return zbtreeDeleteRangeByRank(zbt,first,last,dict);
 }
 
-/* Find pointer to the first element contained in the specified lex range.
- * Returns NULL when no element is contained in the range. */
-//zset中第一个在range中的元素，用lex序比较
-unsigned char *zzlFirstInLexRange(unsigned char *zl, zlexrangespec *range) {
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+/* Delete all the elements within the lex range from the B+tree. */
+//删除在lex range中的元素
+unsigned long zbtreeDeleteRangeByLex(zbtree *zbt, zlexrangespec *range, dict *dict) {
+    zbtreePos pos;
+    long first, last;
 
-    /* If everything is out of range, return early. */
-    if (!zzlIsInLexRange(zl,range)) return NULL;
+    if ((first = zbtreeFirstInLexRange(zbt,range,&pos)) == -1) return 0;
+    last = zbtreeLastInLexRange(zbt,range,&pos);
+    if (last < first) return 0;
+    return zbtreeDeleteRangeByRank(zbt,first,last,dict);
+}
 
-    while (eptr != NULL) {
-        if (zzlLexValueGteMin(eptr,range)) {
-            /* Check if score <= max. */
-            if (zzlLexValueLteMax(eptr,range))
-                return eptr;
-            return NULL;
-        }
+/*-----------------------------------------------------------------------------
+ * Zpack-backed sorted set API
+ *----------------------------------------------------------------------------*/
+//基于zpack的sorted set API。元素用从0开始的rank表示，找不到时返回-1
 
-        /* Move to next element. */
-        sptr = ziplistNext(zl,eptr); /* This element score. Skip it. */
-        redisAssert(sptr != NULL);
-        eptr = ziplistNext(zl,sptr); /* Next element. */
-    }
+/* Return the member of the element at 'rank' as a Redis string object.
+ * This simple abstraction can be used to simplifies some code at the
+ * cost of some performance. */
+//将rank处元素的成员以redis string返回
+robj *zzlGetObject(unsigned char *zl, unsigned long rank) {
+    unsigned char *vstr;
+    unsigned int vlen;
 
-    return NULL;
+    vstr = zpGetMember(zl,rank,&vlen);
+    return createStringObject((char*)vstr,vlen);
 }
 
-/* Find pointer to the last element contained in the specified lex range.
- * Returns NULL when no element is contained in the range. */
-//找到zset中最后一个在range中的元素，用lex序比较
-unsigned char *zzlLastInLexRange(unsigned char *zl, zlexrangespec *range) {
-    unsigned char *eptr = ziplistIndex(zl,-2), *sptr;
+//取到zpack中保存的zset元素数量
+unsigned int zzlLength(unsigned char *zl) {
+    return zpLength(zl);
+}
 
-    /* If everything is out of range, return early. */
-    if (!zzlIsInLexRange(zl,range)) return NULL;
+/* Find the rank of the first element contained in the specified range.
+ * Returns -1 when no element is contained in the range. The scores column
+ * is ordered, so this is a binary search. */
+//二分查找zset中第一个在range中的元素
+long zzlFirstInRange(unsigned char *zl, zrangespec *range) {
+    unsigned long rank = zpScoreRank(zl,range->min,range->minex);
 
-    while (eptr != NULL) {
-        if (zzlLexValueLteMax(eptr,range)) {
-            /* Check if score >= min. */
-            if (zzlLexValueGteMin(eptr,range))
-                return eptr;
-            return NULL;
-        }
+    //第一个大于最小值的元素也要小于最大值
+    if (rank == zpLength(zl) || !zslValueLteMax(zpGetScore(zl,rank),range))
+        return -1;
+    return rank;
+}
 
-        /* Move to previous element by moving to the score of previous element.
-         * When this returns NULL, we know there also is no element. */
-        sptr = ziplistPrev(zl,eptr);
-        if (sptr != NULL)
-            redisAssert((eptr = ziplistPrev(zl,sptr)) != NULL);
-        else
-            eptr = NULL;
-    }
+/* Find the rank of the last element contained in the specified range.
+ * Returns -1 when no element is contained in the range. */
+//二分查找zset中最后一个在range中的元素
+long zzlLastInRange(unsigned char *zl, zrangespec *range) {
+    unsigned long rank = zpScoreRank(zl,range->max,!range->maxex);
 
-    return NULL;
+    //rank是第一个大于最大值的元素，它前一个元素也要大于最小值
+    if (rank == 0 || !zslValueGteMin(zpGetScore(zl,rank-1),range))
+        return -1;
+    return rank-1;
 }
 
-//找到zset中值与ele一样的元素
-unsigned char *zzlFind(unsigned char *zl, robj *ele, double *score) {
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+//zpack中rank处的成员是否大于range中最小值
+static int zzlLexValueGteMin(unsigned char *zl, unsigned long rank, zlexrangespec *spec) {
+    robj *value = zzlGetObject(zl,rank);
+    int res = zslLexValueGteMin(value,spec);
+    decrRefCount(value);
+    return res;
+}
 
-    ele = getDecodedObject(ele);
-    while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
-        redisAssertWithInfo(NULL,ele,sptr != NULL);
+//zpack中rank处的成员是否小于range中最大值
+static int zzlLexValueLteMax(unsigned char *zl, unsigned long rank, zlexrangespec *spec) {
+    robj *value = zzlGetObject(zl,rank);
+    int res = zslLexValueLteMax(value,spec);
+    decrRefCount(value);
+    return res;
+}
 
-        if (ziplistCompare(eptr,ele->ptr,sdslen(ele->ptr))) {
-            /* Matching element, pull out score. */
-            if (score != NULL) *score = zzlGetScore(sptr);
-            decrRefCount(ele);
-            return eptr;
-        }
+/* Find the rank of the first element contained in the specified lex range.
+ * Returns -1 when no element is contained in the range. Like for the
+ * skiplist, lex ranges assume all the elements have the same score, so the
+ * members are ordered and a binary search can be used. */
+//二分查找zset中第一个在range中的元素，用lex序比较
+long zzlFirstInLexRange(unsigned char *zl, zlexrangespec *range) {
+    unsigned long lo = 0, hi = zpLength(zl), mid;
 
-        /* Move to next element. */
-        eptr = ziplistNext(zl,sptr);
+    while (lo < hi) {
+        mid = lo+(hi-lo)/2;
+        if (zzlLexValueGteMin(zl,mid,range))
+            hi = mid;
+        else
+            lo = mid+1;
     }
-
-    decrRefCount(ele);
-    return NULL;
+    if (lo == zpLength(zl) || !zzlLexValueLteMax(zl,lo,range)) return -1;
+    return lo;
 }
 
-/* Delete (element,score) pair from ziplist. Use local copy of eptr because we
- * don't want to modify the one given as argument. */
-//从zset中删除值为eptr的元素
-unsigned char *zzlDelete(unsigned char *zl, unsigned char *eptr) {
-    unsigned char *p = eptr;
+/* Find the rank of the last element contained in the specified lex range.
+ * Returns -1 when no element is contained in the range. */
+//二分查找zset中最后一个在range中的元素，用lex序比较
+long zzlLastInLexRange(unsigned char *zl, zlexrangespec *range) {
+    unsigned long lo = 0, hi = zpLength(zl), mid;
 
-    /* TODO: add function to ziplist API to delete N elements from offset. */
-    //删除ziplist中保存值的元素
-    zl = ziplistDelete(zl,&p);
-    //删除ziplist中保存score的元素
-    zl = ziplistDelete(zl,&p);
-    return zl;
+    while (lo < hi) {
+        mid = lo+(hi-lo)/2;
+        if (zzlLexValueLteMax(zl,mid,range))
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    if (lo == 0 || !zzlLexValueGteMin(zl,lo-1,range)) return -1;
+    return lo-1;
 }
 
-//在zset中eptr元素前插入新元素
-unsigned char *zzlInsertAt(unsigned char *zl, unsigned char *eptr, robj *ele, double score) {
-    unsigned char *sptr;
-    char scorebuf[128];
-    int scorelen;
-    size_t offset;
-
-    redisAssertWithInfo(NULL,ele,ele->encoding == REDIS_ENCODING_RAW);
-    scorelen = d2string(scorebuf,sizeof(scorebuf),score);
-    if (eptr == NULL) {
-    	//eptr为空则添加到表尾
-        zl = ziplistPush(zl,ele->ptr,sdslen(ele->ptr),ZIPLIST_TAIL);
-        zl = ziplistPush(zl,(unsigned char*)scorebuf,scorelen,ZIPLIST_TAIL);
-    } else {
-        /* Keep offset relative to zl, as it might be re-allocated. */
-        offset = eptr-zl;
-        //将保存值的元素插入到eptr前面
-        zl = ziplistInsert(zl,eptr,ele->ptr,sdslen(ele->ptr));
-        //eptr现在指向新插入的值
-        eptr = zl+offset;
+/* Find the rank of the element 'ele', storing its score in '*score' when
+ * not NULL. Returns -1 when the element is not found. */
+//找到zset中值与ele一样的元素
+long zzlFind(unsigned char *zl, robj *ele, double *score) {
+    long rank;
 
-        /* Insert score after the element. */
-        //取到eptr下一个元素sptr，将score的元素插入到sptr前面，即eptr后面
-        redisAssertWithInfo(NULL,ele,(sptr = ziplistNext(zl,eptr)) != NULL);
-        zl = ziplistInsert(zl,sptr,(unsigned char*)scorebuf,scorelen);
-    }
+    ele = getDecodedObject(ele);
+    rank = zpFind(zl,ele->ptr,sdslen(ele->ptr));
+    if (rank != -1 && score != NULL) *score = zpGetScore(zl,rank);
+    decrRefCount(ele);
+    return rank;
+}
 
-    return zl;
+/* Delete the element at 'rank'. */
+//从zset中删除rank处的元素
+unsigned char *zzlDelete(unsigned char *zl, unsigned long rank) {
+    return zpDeleteRange(zl,rank,1);
 }
 
-/* Insert (element,score) pair in ziplist. This function assumes the element is
- * not yet present in the list. */
+/* Insert (element,score) pair in the zpack. This function assumes the
+ * element is not yet present. */
 //往zset中插入一个新元素
 unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score) {
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
-    double s;
+    unsigned long rank;
 
     ele = getDecodedObject(ele);
-    while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
-        redisAssertWithInfo(NULL,ele,sptr != NULL);
-        s = zzlGetScore(sptr);
-
-        if (s > score) {
-            /* First element with score larger than score for element to be
-             * inserted. This means we should take its spot in the list to
-             * maintain ordering. */
-            zl = zzlInsertAt(zl,eptr,ele,score);
-            break;
-        } else if (s == score) {
-            /* Ensure lexicographical ordering for elements. */
-        	//score一样，用lex序比较元素的值
-            if (zzlCompareElements(eptr,ele->ptr,sdslen(ele->ptr)) > 0) {
-                zl = zzlInsertAt(zl,eptr,ele,score);
-                break;
-            }
-        }
-
-        /* Move to next element. */
-        eptr = ziplistNext(zl,sptr);
-    }
-
-    /* Push on tail of list when it was not yet inserted. */
-    if (eptr == NULL)
-        zl = zzlInsertAt(zl,NULL,ele,score);
-
+    rank = zpInsertRank(zl,score,ele->ptr,sdslen(ele->ptr));
+    zl = zpInsert(zl,rank,ele->ptr,sdslen(ele->ptr),score);
     decrRefCount(ele);
     return zl;
 }
 
 //从zset中删除score在range中的元素
 unsigned char *zzlDeleteRangeByScore(unsigned char *zl, zrangespec *range, unsigned long *deleted) {
-    unsigned char *eptr, *sptr;
-    double score;
-    unsigned long num = 0;
+    long first, last;
 
     if (deleted != NULL) *deleted = 0;
 
-    //取到第一个在range中的元素
-    eptr = zzlFirstInRange(zl,range);
-    if (eptr == NULL) return zl;
-
-    /* When the tail of the ziplist is deleted, eptr will point to the sentinel
-     * byte and ziplistNext will return NULL. */
-    while ((sptr = ziplistNext(zl,eptr)) != NULL) {
-        score = zzlGetScore(sptr);
-        if (zslValueLteMax(score,range)) {
-            /* Delete both the element and the score. */
-            zl = ziplistDelete(zl,&eptr);
-            zl = ziplistDelete(zl,&eptr);
-            num++;
-        } else {
-            /* No longer in range. */
-            break;
-        }
-    }
+    //取到第一个和最后一个在range中的元素
+    if ((first = zzlFirstInRange(zl,range)) == -1) return zl;
+    last = zzlLastInRange(zl,range);
+    redisAssert(last >= first);
 
-    if (deleted != NULL) *deleted = num;
-    return zl;
+    if (deleted != NULL) *deleted = last-first+1;
+    return zpDeleteRange(zl,first,last-first+1);
 }
 
 //删除在range中的元素，比较元素的值的lex序
 unsigned char *zzlDeleteRangeByLex(unsigned char *zl, zlexrangespec *range, unsigned long *deleted) {
-    unsigned char *eptr, *sptr;
-    unsigned long num = 0;
+    long first, last;
 
     if (deleted != NULL) *deleted = 0;
 
-    //取到第一个在range中的元素
-    eptr = zzlFirstInLexRange(zl,range);
-    if (eptr == NULL) return zl;
-
-    /* When the tail of the ziplist is deleted, eptr will point to the sentinel
-     * byte and ziplistNext will return NULL. */
-    while ((sptr = ziplistNext(zl,eptr)) != NULL) {
-        if (zzlLexValueLteMax(eptr,range)) {
-            /* Delete both the element and the score. */
-            zl = ziplistDelete(zl,&eptr);
-            zl = ziplistDelete(zl,&eptr);
-            num++;
-        } else {
-            /* No longer in range. */
-            break;
-        }
-    }
+    if ((first = zzlFirstInLexRange(zl,range)) == -1) return zl;
+    last = zzlLastInLexRange(zl,range);
+    if (last < first) return zl;
 
-    if (deleted != NULL) *deleted = num;
-    return zl;
+    if (deleted != NULL) *deleted = last-first+1;
+    return zpDeleteRange(zl,first,last-first+1);
 }
 
 /* Delete all the elements with rank between start and end from the skiplist.
@@ -1179,9 +1623,7 @@ unsigned char *zzlDeleteRangeByLex(unsigned char *zl, zlexrangespec *range, unsi
 unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsigned int end, unsigned long *deleted) {
     unsigned int num = (end-start)+1;
     if (deleted) *deleted = num;
-    //因为ziplist用两个元素表示zset中一个元素，所以start与end要乘以2
-    zl = ziplistDeleteRange(zl,2*(start-1),2*num);
-    return zl;
+    return zpDeleteRange(zl,start-1,num);
 }
 
 /*-----------------------------------------------------------------------------
@@ -1190,77 +1632,129 @@ unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsig
 //zset中元素个数
 unsigned int zsetLength(robj *zobj) {
     int length = -1;
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_ZPACK) {
         length = zzlLength(zobj->ptr);
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
         length = ((zset*)zobj->ptr)->zsl->length;
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        length = ((zset*)zobj->ptr)->zbt->length;
     } else {
         redisPanic("Unknown sorted set encoding");
     }
     return length;
 }
 
+/* Add an element that is not already a member to a sorted set encoded as a
+ * skiplist or as a B+tree. Both the ordered structure and the dictionary get
+ * a new reference to 'ele', the caller's reference is not used. */
+//向skiplist或B+树编码的zset中添加一个不存在的元素，同时更新有序结构和dict
+void zsetAddNew(robj *zobj, double score, robj *ele) {
+    zset *zs = zobj->ptr;
+
+    if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+        zskiplistNode *znode;
+
+        znode = zslInsert(zs->zsl,score,ele);
+        incrRefCount(ele); /* Inserted in skiplist. */
+        redisAssertWithInfo(NULL,ele,dictAdd(zs->dict,ele,&znode->score) == DICT_OK);
+        incrRefCount(ele); /* Added to dictionary. */
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        dictEntry *de;
+
+        zbtreeInsert(zs->zbt,score,ele);
+        incrRefCount(ele); /* Inserted in the B+tree. */
+        de = dictAddRaw(zs->dict,ele);
+        redisAssertWithInfo(NULL,ele,de != NULL);
+        dictSetDoubleVal(de,score);
+        incrRefCount(ele); /* Added to dictionary. */
+    } else {
+        redisPanic("Unknown sorted set encoding");
+    }
+}
+
+/* Like zsetAddNew(), but the elements are expected to be added in order, so
+ * a skiplist is built in linear time with zslBulkAppend(). The B+tree has no
+ * need of a special path, since appends already keep its leaves full.
+ * zsetBulkFinish() must be called before the sorted set is used. */
+//与zsetAddNew()相同，但元素按顺序添加，skiplist编码时使用批量构建
+void zsetBulkInit(robj *zobj, zslBulk *bulk) {
+    if (zobj->encoding == REDIS_ENCODING_SKIPLIST)
+        zslBulkInit(bulk,((zset*)zobj->ptr)->zsl);
+}
+
+void zsetBulkAdd(robj *zobj, zslBulk *bulk, double score, robj *ele) {
+    if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+        zset *zs = zobj->ptr;
+        zskiplistNode *znode;
+
+        znode = zslBulkAppend(bulk,score,ele);
+        incrRefCount(ele); /* Inserted in skiplist. */
+        redisAssertWithInfo(NULL,ele,dictAdd(zs->dict,ele,&znode->score) == DICT_OK);
+        incrRefCount(ele); /* Added to dictionary. */
+    } else {
+        zsetAddNew(zobj,score,ele);
+    }
+}
+
+void zsetBulkFinish(robj *zobj, zslBulk *bulk) {
+    if (zobj->encoding == REDIS_ENCODING_SKIPLIST)
+        zslBulkFinish(bulk);
+}
+
 //将zset的底层数据结构转换为encoding指定的类型
 void zsetConvert(robj *zobj, int encoding) {
     zset *zs;
-    zskiplistNode *node, *next;
     robj *ele;
     double score;
 
     if (zobj->encoding == encoding) return;
 
-    //将ziplist转换为skiplist
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    //将zpack转换为skiplist或者B+树
+    if (zobj->encoding == REDIS_ENCODING_ZPACK) {
         unsigned char *zl = zobj->ptr;
-        unsigned char *eptr, *sptr;
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
+        unsigned long rank, len = zpLength(zl);
+        zslBulk bulk;
 
-        if (encoding != REDIS_ENCODING_SKIPLIST)
+        if (encoding != REDIS_ENCODING_SKIPLIST &&
+            encoding != REDIS_ENCODING_BTREE)
             redisPanic("Unknown target encoding");
 
         zs = zmalloc(sizeof(*zs));
         zs->dict = dictCreate(&zsetDictType,NULL);
-        zs->zsl = zslCreate();
-
-        eptr = ziplistIndex(zl,0);
-        redisAssertWithInfo(NULL,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
-        redisAssertWithInfo(NULL,zobj,sptr != NULL);
-
-        while (eptr != NULL) {
-        	//取到score
-            score = zzlGetScore(sptr);
-            //取到value
-            redisAssertWithInfo(NULL,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
-            if (vstr == NULL)
-                ele = createStringObjectFromLongLong(vlong);
-            else
-                ele = createStringObject((char*)vstr,vlen);
-
-            /* Has incremented refcount since it was just created. */
-            //在skiplist中添加元素
-            node = zslInsert(zs->zsl,score,ele);
-            //在dict中添加元素
-            redisAssertWithInfo(NULL,zobj,dictAdd(zs->dict,ele,&node->score) == DICT_OK);
-            incrRefCount(ele); /* Added to dictionary. */
-            zzlNext(zl,&eptr,&sptr);
+        zs->zsl = (encoding == REDIS_ENCODING_SKIPLIST) ? zslCreate() : NULL;
+        zs->zbt = (encoding == REDIS_ENCODING_BTREE) ? zbtreeCreate() : NULL;
+        zobj->ptr = zs;
+        zobj->encoding = encoding;
+
+        /* The zpack is ordered, so the elements are just appended. */
+        //zpack是有序的，直接批量追加元素
+        zsetBulkInit(zobj,&bulk);
+        for (rank = 0; rank < len; rank++) {
+            //取到score和value
+            score = zpGetScore(zl,rank);
+            ele = zzlGetObject(zl,rank);
+
+            //在有序结构和dict中添加元素
+            zsetBulkAdd(zobj,&bulk,score,ele);
+            decrRefCount(ele);
         }
+        zsetBulkFinish(zobj,&bulk);
 
-        zfree(zobj->ptr);
-        zobj->ptr = zs;
-        zobj->encoding = REDIS_ENCODING_SKIPLIST;
+        zfree(zl);
+        server.stat_encoding_upgrades++;
     }
-    //将skiplist转换为ziplist
+    //将skiplist转换为zpack
     else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
-        unsigned char *zl = ziplistNew();
+        unsigned char *zl = zpNew();
+        unsigned long rank = 0;
+        zskiplistNode *node, *next;
 
-        if (encoding != REDIS_ENCODING_ZIPLIST)
+        if (encoding != REDIS_ENCODING_ZPACK)
             redisPanic("Unknown target encoding");
 
         /* Approach similar to zslFree(), since we want to free the skiplist at
-         * the same time as creating the ziplist. */
+         * the same time as creating the zpack. The skiplist is already
+         * ordered, so every element is appended. */
         zs = zobj->ptr;
         dictRelease(zs->dict);
         node = zs->zsl->header->level[0].forward;
@@ -1269,7 +1763,7 @@ void zsetConvert(robj *zobj, int encoding) {
 
         while (node) {
             ele = getDecodedObject(node->obj);
-            zl = zzlInsertAt(zl,NULL,ele,node->score);
+            zl = zpInsert(zl,rank++,ele->ptr,sdslen(ele->ptr),node->score);
             decrRefCount(ele);
 
             next = node->level[0].forward;
@@ -1279,12 +1773,66 @@ void zsetConvert(robj *zobj, int encoding) {
 
         zfree(zs);
         zobj->ptr = zl;
-        zobj->encoding = REDIS_ENCODING_ZIPLIST;
+        zobj->encoding = REDIS_ENCODING_ZPACK;
+        server.stat_encoding_downgrades++;
+    }
+    //将B+树转换为zpack
+    else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        unsigned char *zl = zpNew();
+        unsigned long rank = 0;
+        zbtreeLeaf *l;
+        int j;
+
+        if (encoding != REDIS_ENCODING_ZPACK)
+            redisPanic("Unknown target encoding");
+
+        /* Walk the leaves in order, every element is appended. */
+        zs = zobj->ptr;
+        for (l = zs->zbt->head; l != NULL; l = l->next) {
+            for (j = 0; j < l->hdr.num; j++) {
+                ele = getDecodedObject(l->obj[j]);
+                zl = zpInsert(zl,rank++,ele->ptr,sdslen(ele->ptr),l->score[j]);
+                decrRefCount(ele);
+            }
+        }
+
+        dictRelease(zs->dict);
+        zbtreeFree(zs->zbt);
+        zfree(zs);
+        zobj->ptr = zl;
+        zobj->encoding = REDIS_ENCODING_ZPACK;
+        server.stat_encoding_downgrades++;
     } else {
         redisPanic("Unknown sorted set encoding");
     }
 }
 
+/* Convert a skiplist or B+tree encoded sorted set back to a zpack once it
+ * shrank to 1/ratio of the zpack limits, see listTypeTryDowngrade().
+ * Returns 1 if the sorted set was converted. */
+//zset缩小到zpack限制的1/ratio以下时, 将skiplist或B+树转换回zpack
+int zsetTryDowngrade(robj *zobj, int ratio) {
+    dictIterator *di;
+    dictEntry *de;
+    int fits = 1;
+
+    if (zobj->encoding != REDIS_ENCODING_SKIPLIST &&
+        zobj->encoding != REDIS_ENCODING_BTREE) return 0;
+    if (zsetLength(zobj) > server.zset_max_ziplist_entries/ratio) return 0;
+
+    //所有元素的长度都不能超过zset_max_ziplist_value
+    di = dictGetIterator(((zset*)zobj->ptr)->dict);
+    while (fits && (de = dictNext(di)) != NULL) {
+        if (stringObjectLen(dictGetKey(de)) > server.zset_max_ziplist_value)
+            fits = 0;
+    }
+    dictReleaseIterator(di);
+    if (!fits) return 0;
+
+    zsetConvert(zobj,REDIS_ENCODING_ZPACK);
+    return 1;
+}
+
 /*-----------------------------------------------------------------------------
  * Sorted set commands 
  *----------------------------------------------------------------------------*/
@@ -1322,11 +1870,11 @@ void zaddGenericCommand(redisClient *c, int incr) {
         if (server.zset_max_ziplist_entries == 0 ||
             server.zset_max_ziplist_value < sdslen(c->argv[3]->ptr))
         {
-        	//如果zset_max_ziplist_entries为0或者ziplist无法存放元素的值，使用skiplist
-            zobj = createZsetObject();
+        	//如果zset_max_ziplist_entries为0或者ziplist无法存放元素的值，使用skiplist或B+树
+            zobj = createZsetLargeObject();
         } else {
-        	//使用ziplist
-            zobj = createZsetZiplistObject();
+        	//使用zpack
+            zobj = createZsetZpackObject();
         }
         dbAdd(c->db,key,zobj);
     } else {
@@ -1339,12 +1887,12 @@ void zaddGenericCommand(redisClient *c, int incr) {
     for (j = 0; j < elements; j++) {
         score = scores[j];
 
-        if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
-            unsigned char *eptr;
+        if (zobj->encoding == REDIS_ENCODING_ZPACK) {
+            long rank;
 
-            /* Prefer non-encoded element when dealing with ziplists. */
+            /* Prefer non-encoded element when dealing with zpacks. */
             ele = c->argv[3+j*2];
-            if ((eptr = zzlFind(zobj->ptr,ele,&curscore)) != NULL) {
+            if ((rank = zzlFind(zobj->ptr,ele,&curscore)) != -1) {
             	//在zset中找到元素，取到score
                 if (incr) {
                     score += curscore;
@@ -1358,7 +1906,7 @@ void zaddGenericCommand(redisClient *c, int incr) {
                 /* Remove and re-insert when score changed. */
                 if (score != curscore) {
                 	//score改变了，删除原来的元素，插入新score的元素
-                    zobj->ptr = zzlDelete(zobj->ptr,eptr);
+                    zobj->ptr = zzlDelete(zobj->ptr,rank);
                     zobj->ptr = zzlInsert(zobj->ptr,ele,score);
                     server.dirty++;
                     updated++;
@@ -1369,11 +1917,11 @@ void zaddGenericCommand(redisClient *c, int incr) {
             	//找不到元素，直接添加新元素
                 zobj->ptr = zzlInsert(zobj->ptr,ele,score);
                 if (zzlLength(zobj->ptr) > server.zset_max_ziplist_entries)
-                	//ziplist元素数量大于zset_max_ziplist_entries，转换为skiplist
-                    zsetConvert(zobj,REDIS_ENCODING_SKIPLIST);
+                	//ziplist元素数量大于zset_max_ziplist_entries，转换为skiplist或B+树
+                    zsetConvert(zobj,server.zset_large_encoding);
                 if (sdslen(ele->ptr) > server.zset_max_ziplist_value)
-                	//ziplist无法保存新元素的值，转换为skiplist
-                    zsetConvert(zobj,REDIS_ENCODING_SKIPLIST);
+                	//元素的值大于zset_max_ziplist_value，转换为skiplist或B+树
+                    zsetConvert(zobj,server.zset_large_encoding);
                 server.dirty++;
                 added++;
             }
@@ -1414,10 +1962,42 @@ void zaddGenericCommand(redisClient *c, int incr) {
                 }
             } else {
             	//元素尚不存在，添加到skiplist和dict中
-                znode = zslInsert(zs->zsl,score,ele);
-                incrRefCount(ele); /* Inserted in skiplist. */
-                redisAssertWithInfo(c,NULL,dictAdd(zs->dict,ele,&znode->score) == DICT_OK);
-                incrRefCount(ele); /* Added to dictionary. */
+                zsetAddNew(zobj,score,ele);
+                server.dirty++;
+                added++;
+            }
+        } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+            zset *zs = zobj->ptr;
+            dictEntry *de;
+
+            ele = c->argv[3+j*2] = tryObjectEncoding(c->argv[3+j*2]);
+            de = dictFind(zs->dict,ele);
+            if (de != NULL) {
+            	//元素已经存在与zset中，score保存在dictEntry中
+                curobj = dictGetKey(de);
+                curscore = dictGetDoubleVal(de);
+
+                if (incr) {
+                    score += curscore;
+                    if (isnan(score)) {
+                        addReplyError(c,nanerr);
+                        goto cleanup;
+                    }
+                }
+
+                /* Remove and re-insert when score changed. The dictionary
+                 * still has a reference to the key object. */
+                if (score != curscore) {
+                    redisAssertWithInfo(c,curobj,zbtreeDelete(zs->zbt,curscore,curobj));
+                    zbtreeInsert(zs->zbt,score,curobj);
+                    incrRefCount(curobj); /* Re-inserted in the B+tree. */
+                    dictSetDoubleVal(de,score);
+                    server.dirty++;
+                    updated++;
+                }
+            } else {
+            	//元素尚不存在，添加到B+树和dict中
+                zsetAddNew(zobj,score,ele);
                 server.dirty++;
                 added++;
             }
@@ -1454,17 +2034,18 @@ void zremCommand(redisClient *c) {
     robj *key = c->argv[1];
     robj *zobj;
     int deleted = 0, keyremoved = 0, j;
+    size_t len, removedlen = 0;
 
     if ((zobj = lookupKeyWriteOrReply(c,key,shared.czero)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *eptr;
+    if (zobj->encoding == REDIS_ENCODING_ZPACK) {
+        long rank;
 
         for (j = 2; j < c->argc; j++) {
-            if ((eptr = zzlFind(zobj->ptr,c->argv[j],NULL)) != NULL) {
+            if ((rank = zzlFind(zobj->ptr,c->argv[j],NULL)) != -1) {
                 deleted++;
-                zobj->ptr = zzlDelete(zobj->ptr,eptr);
+                zobj->ptr = zzlDelete(zobj->ptr,rank);
                 if (zzlLength(zobj->ptr) == 0) {
                 	//zset为空，从db删除它
                     dbDelete(c->db,key);
@@ -1484,6 +2065,8 @@ void zremCommand(redisClient *c) {
             de = dictFind(zs->dict,c->argv[j]);
             if (de != NULL) {
                 deleted++;
+                len = stringObjectLen(c->argv[j]);
+                if (len > removedlen) removedlen = len;
 
                 /* Delete from the skiplist */
                 score = *(double*)dictGetVal(de);
@@ -1503,6 +2086,29 @@ void zremCommand(redisClient *c) {
                 }
             }
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        dictEntry *de;
+
+        for (j = 2; j < c->argc; j++) {
+            de = dictFind(zs->dict,c->argv[j]);
+            if (de != NULL) {
+                deleted++;
+                len = stringObjectLen(c->argv[j]);
+                if (len > removedlen) removedlen = len;
+
+                /* Delete from the B+tree, then from the hash table. */
+                redisAssertWithInfo(c,c->argv[j],
+                    zbtreeDelete(zs->zbt,dictGetDoubleVal(de),c->argv[j]));
+                dictDelete(zs->dict,c->argv[j]);
+                if (htNeedsResize(zs->dict)) dictResize(zs->dict);
+                if (dictSize(zs->dict) == 0) {
+                    dbDelete(c->db,key);
+                    keyremoved = 1;
+                    break;
+                }
+            }
+        }
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -1511,6 +2117,8 @@ void zremCommand(redisClient *c) {
         notifyKeyspaceEvent(REDIS_NOTIFY_ZSET,"zrem",key,c->db->id);
         if (keyremoved)
             notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,"del",key,c->db->id);
+        else
+            tryObjectDowngrade(zobj,zsetLength(zobj)+deleted,removedlen);
         signalModifiedKey(c->db,key);
         server.dirty += deleted;
     }
@@ -1572,11 +2180,11 @@ void zremrangeGenericCommand(redisClient *c, int rangetype) {
     }
 
     /* Step 3: Perform the range deletion operation. */
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_ZPACK) {
         switch(rangetype) {
         case ZRANGE_RANK:
-        	//因为ziplist的函数会操作内存（重新分配内存），所以ziplist内存位置会改变
-        	//因为相关的函数需要返回新的ziplist的内存地址。其他想要改变的变量通过指针作为参数传递
+        	//因为zpack的函数会操作内存（重新分配内存），所以zpack内存位置会改变
+        	//因为相关的函数需要返回新的zpack的内存地址。其他想要改变的变量通过指针作为参数传递
             zobj->ptr = zzlDeleteRangeByRank(zobj->ptr,start+1,end+1,&deleted);
             break;
         case ZRANGE_SCORE:
@@ -1594,7 +2202,7 @@ void zremrangeGenericCommand(redisClient *c, int rangetype) {
         zset *zs = zobj->ptr;
         switch(rangetype) {
         case ZRANGE_RANK:
-        	//与ziplist不同，对于使用struct的数据结构，内存位置不变。
+        	//与zpack不同，对于使用struct的数据结构，内存位置不变。
             deleted = zslDeleteRangeByRank(zs->zsl,start+1,end+1,zs->dict);
             break;
         case ZRANGE_SCORE:
@@ -1609,6 +2217,24 @@ void zremrangeGenericCommand(redisClient *c, int rangetype) {
             dbDelete(c->db,key);
             keyremoved = 1;
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        switch(rangetype) {
+        case ZRANGE_RANK:
+            deleted = zbtreeDeleteRangeByRank(zs->zbt,start,end,zs->dict);
+            break;
+        case ZRANGE_SCORE:
+            deleted = zbtreeDeleteRangeByScore(zs->zbt,&range,zs->dict);
+            break;
+        case ZRANGE_LEX:
+            deleted = zbtreeDeleteRangeByLex(zs->zbt,&lexrange,zs->dict);
+            break;
+        }
+        if (htNeedsResize(zs->dict)) dictResize(zs->dict);
+        if (dictSize(zs->dict) == 0) {
+            dbDelete(c->db,key);
+            keyremoved = 1;
+        }
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -1620,6 +2246,8 @@ void zremrangeGenericCommand(redisClient *c, int rangetype) {
         notifyKeyspaceEvent(REDIS_NOTIFY_ZSET,event[rangetype],key,c->db->id);
         if (keyremoved)
             notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,"del",key,c->db->id);
+        else
+            tryObjectDowngrade(zobj,zsetLength(zobj)+deleted,0);
     }
     server.dirty += deleted;
     addReplyLongLong(c,deleted);
@@ -1664,20 +2292,32 @@ typedef struct {
                 dictIterator *di;
                 dictEntry *de;
             } ht;
+            //listpack的迭代器
+            struct {
+                unsigned char *lp;
+                unsigned char *p;
+            } lp;
+            //roaring的迭代器
+            roaringIterator ro;
         } set;
 
         /* Sorted set iterators. */
         union _iterzset {
-        	//ziplist的迭代器
+        	//zpack的迭代器
             struct {
                 unsigned char *zl;
-                unsigned char *eptr, *sptr;
+                unsigned long rank;
             } zl;
             //skiplist的迭代器
             struct {
                 zset *zs;
                 zskiplistNode *node;
             } sl;
+            //B+树的迭代器
+            struct {
+                zset *zs;
+                zbtreePos pos;
+            } bt;
         } zset;
     } iter;
 } zsetopsrc;
@@ -1721,21 +2361,27 @@ void zuiInitIterator(zsetopsrc *op) {
             it->ht.dict = op->subject->ptr;
             it->ht.di = dictGetIterator(op->subject->ptr);
             it->ht.de = dictNext(it->ht.di);
+        } else if (op->encoding == REDIS_ENCODING_LISTPACK) {
+            it->lp.lp = op->subject->ptr;
+            it->lp.p = lpFirst(it->lp.lp);
+        } else if (op->encoding == REDIS_ENCODING_ROARING) {
+            roaringInitIterator(op->subject->ptr,&it->ro);
         } else {
             redisPanic("Unknown set encoding");
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_ZPACK) {
             it->zl.zl = op->subject->ptr;
-            it->zl.eptr = ziplistIndex(it->zl.zl,0);
-            if (it->zl.eptr != NULL) {
-                it->zl.sptr = ziplistNext(it->zl.zl,it->zl.eptr);
-                redisAssert(it->zl.sptr != NULL);
-            }
+            it->zl.rank = 0;
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
             it->sl.zs = op->subject->ptr;
             it->sl.node = it->sl.zs->zsl->header->level[0].forward;
+        } else if (op->encoding == REDIS_ENCODING_BTREE) {
+            it->bt.zs = op->subject->ptr;
+            it->bt.pos.leaf = it->bt.zs->zbt->head;
+            it->bt.pos.idx = 0;
+            if (it->bt.pos.leaf->hdr.num == 0) it->bt.pos.leaf = NULL;
         } else {
             redisPanic("Unknown sorted set encoding");
         }
@@ -1751,7 +2397,9 @@ void zuiClearIterator(zsetopsrc *op) {
 
     if (op->type == REDIS_SET) {
         iterset *it = &op->iter.set;
-        if (op->encoding == REDIS_ENCODING_INTSET) {
+        if (op->encoding == REDIS_ENCODING_INTSET ||
+            op->encoding == REDIS_ENCODING_LISTPACK ||
+            op->encoding == REDIS_ENCODING_ROARING) {
             REDIS_NOTUSED(it); /* skip */
         } else if (op->encoding == REDIS_ENCODING_HT) {
             dictReleaseIterator(it->ht.di);
@@ -1760,9 +2408,10 @@ void zuiClearIterator(zsetopsrc *op) {
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_ZPACK) {
             REDIS_NOTUSED(it); /* skip */
-        } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
+        } else if (op->encoding == REDIS_ENCODING_SKIPLIST ||
+                   op->encoding == REDIS_ENCODING_BTREE) {
             REDIS_NOTUSED(it); /* skip */
         } else {
             redisPanic("Unknown sorted set encoding");
@@ -1784,15 +2433,22 @@ int zuiLength(zsetopsrc *op) {
         } else if (op->encoding == REDIS_ENCODING_HT) {
             dict *ht = op->subject->ptr;
             return dictSize(ht);
+        } else if (op->encoding == REDIS_ENCODING_LISTPACK) {
+            return lpLength(op->subject->ptr);
+        } else if (op->encoding == REDIS_ENCODING_ROARING) {
+            return roaringLen(op->subject->ptr);
         } else {
             redisPanic("Unknown set encoding");
         }
     } else if (op->type == REDIS_ZSET) {
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_ZPACK) {
             return zzlLength(op->subject->ptr);
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
             zset *zs = op->subject->ptr;
             return zs->zsl->length;
+        } else if (op->encoding == REDIS_ENCODING_BTREE) {
+            zset *zs = op->subject->ptr;
+            return zs->zbt->length;
         } else {
             redisPanic("Unknown sorted set encoding");
         }
@@ -1834,20 +2490,36 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
 
             /* Move to next element. */
             it->ht.de = dictNext(it->ht.di);
+        } else if (op->encoding == REDIS_ENCODING_LISTPACK) {
+            if (it->lp.p == NULL)
+                return 0;
+            /* Integer entries are returned in val->ell, see
+             * zuiLongLongFromValue(). */
+            lpGet(it->lp.p,&val->estr,&val->elen,&val->ell);
+            val->score = 1.0;
+
+            /* Move to next element. */
+            it->lp.p = lpNext(it->lp.lp,it->lp.p);
+        } else if (op->encoding == REDIS_ENCODING_ROARING) {
+            int64_t ell;
+
+            if (!roaringNext(&it->ro,&ell))
+                return 0;
+            val->ell = ell;
+            val->score = 1.0;
         } else {
             redisPanic("Unknown set encoding");
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
-            /* No need to check both, but better be explicit. */
-            if (it->zl.eptr == NULL || it->zl.sptr == NULL)
+        if (op->encoding == REDIS_ENCODING_ZPACK) {
+            if (it->zl.rank >= zpLength(it->zl.zl))
                 return 0;
-            redisAssert(ziplistGet(it->zl.eptr,&val->estr,&val->elen,&val->ell));
-            val->score = zzlGetScore(it->zl.sptr);
+            val->estr = zpGetMember(it->zl.zl,it->zl.rank,&val->elen);
+            val->score = zpGetScore(it->zl.zl,it->zl.rank);
 
             /* Move to next element. */
-            zzlNext(it->zl.zl,&it->zl.eptr,&it->zl.sptr);
+            it->zl.rank++;
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
             if (it->sl.node == NULL)
                 return 0;
@@ -1856,6 +2528,14 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
 
             /* Move to next element. */
             it->sl.node = it->sl.node->level[0].forward;
+        } else if (op->encoding == REDIS_ENCODING_BTREE) {
+            if (it->bt.pos.leaf == NULL)
+                return 0;
+            val->ele = zbtreePosObj(&it->bt.pos);
+            val->score = zbtreePosScore(&it->bt.pos);
+
+            /* Move to next element. */
+            zbtreeNext(&it->bt.pos);
         } else {
             redisPanic("Unknown sorted set encoding");
         }
@@ -1951,14 +2631,32 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
             } else {
                 return 0;
             }
+        } else if (op->encoding == REDIS_ENCODING_LISTPACK) {
+            unsigned char *lp = op->subject->ptr;
+            zuiBufferFromValue(val);
+            if (lpFind(lpFirst(lp),val->estr,val->elen,0) != NULL) {
+                *score = 1.0;
+                return 1;
+            } else {
+                return 0;
+            }
+        } else if (op->encoding == REDIS_ENCODING_ROARING) {
+            if (zuiLongLongFromValue(val) &&
+                roaringFind(op->subject->ptr,val->ell))
+            {
+                *score = 1.0;
+                return 1;
+            } else {
+                return 0;
+            }
         } else {
             redisPanic("Unknown set encoding");
         }
     } else if (op->type == REDIS_ZSET) {
         zuiObjectFromValue(val);
 
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
-            if (zzlFind(op->subject->ptr,val->ele,score) != NULL) {
+        if (op->encoding == REDIS_ENCODING_ZPACK) {
+            if (zzlFind(op->subject->ptr,val->ele,score) != -1) {
                 /* Score is already set by zzlFind. */
                 return 1;
             } else {
@@ -1973,6 +2671,15 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
             } else {
                 return 0;
             }
+        } else if (op->encoding == REDIS_ENCODING_BTREE) {
+            zset *zs = op->subject->ptr;
+            dictEntry *de;
+            if ((de = dictFind(zs->dict,val->ele)) != NULL) {
+                *score = dictGetDoubleVal(de);
+                return 1;
+            } else {
+                return 0;
+            }
         } else {
             redisPanic("Unknown sorted set encoding");
         }
@@ -2009,33 +2716,164 @@ inline static void zunionInterAggregate(double *target, double val, int aggregat
     }
 }
 
-//通用函数，为zunionstore/zinterstore命令调用
-void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
+/* Compare two entries of the destination dictionary by score and member,
+ * that is, in the order of the sorted set. */
+//按score和成员比较两个dict条目，即zset中的顺序
+static int zunionInterCompareEntries(const void *p1, const void *p2) {
+    dictEntry *e1 = *(dictEntry**)p1, *e2 = *(dictEntry**)p2;
+    double s1 = dictGetDoubleVal(e1), s2 = dictGetDoubleVal(e2);
+
+    if (s1 < s2) return -1;
+    if (s1 > s2) return 1;
+    return compareStringObjects(dictGetKey(e1),dictGetKey(e2));
+}
+
+/* The result of ZUNIONSTORE / ZINTERSTORE is computed in the dictionary of
+ * the destination alone, with the scores stored inside the dictionary
+ * entries. Once all the elements are known the entries are sorted and the
+ * elements appended in order to the skiplist (or B+tree), which is much
+ * faster than inserting them one by one in random order. */
+//结果先只保存在目标zset的dict中(score直接保存在dict条目里)，最后排序后按顺序追加到skiplist(或B+树)中
+static void zunionInterBuildIndex(robj *dstobj) {
+    zset *zs = dstobj->ptr;
+    unsigned long j, len = dictSize(zs->dict);
+    dictEntry **entries, *de;
+    dictIterator *di;
+    zslBulk bulk;
+
+    if (len == 0) return;
+    entries = zmalloc(sizeof(dictEntry*)*len);
+    di = dictGetIterator(zs->dict);
+    for (j = 0; (de = dictNext(di)) != NULL; j++) entries[j] = de;
+    dictReleaseIterator(di);
+    qsort(entries,len,sizeof(dictEntry*),zunionInterCompareEntries);
+
+    if (dstobj->encoding == REDIS_ENCODING_SKIPLIST) {
+        zskiplistNode *znode;
+
+        zslBulkInit(&bulk,zs->zsl);
+        for (j = 0; j < len; j++) {
+            de = entries[j];
+            znode = zslBulkAppend(&bulk,dictGetDoubleVal(de),dictGetKey(de));
+            incrRefCount(dictGetKey(de)); /* Inserted in skiplist. */
+            dictSetVal(zs->dict,de,&znode->score);
+        }
+        zslBulkFinish(&bulk);
+    } else if (dstobj->encoding == REDIS_ENCODING_BTREE) {
+        /* The B+tree keeps the scores in the dictionary entries. */
+        for (j = 0; j < len; j++) {
+            de = entries[j];
+            zbtreeInsert(zs->zbt,dictGetDoubleVal(de),dictGetKey(de));
+            incrRefCount(dictGetKey(de)); /* Inserted in the B+tree. */
+        }
+    } else {
+        redisPanic("Unknown sorted set encoding");
+    }
+    zfree(entries);
+}
+
+/* Reply to ZUNION / ZINTER with the elements of the result, in order. */
+//以有序的方式回复zunion/zinter的结果
+static void zunionInterReply(redisClient *c, robj *zobj, int withscores) {
+    zset *zs = zobj->ptr;
+    unsigned long len = zsetLength(zobj);
+
+    addReplyMultiBulkLen(c,withscores ? len*2 : len);
+    if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+        zskiplistNode *ln;
+
+        for (ln = zs->zsl->header->level[0].forward; ln; ln = ln->level[0].forward) {
+            addReplyBulk(c,ln->obj);
+            if (withscores) addReplyDouble(c,ln->score);
+        }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zbtreeLeaf *l;
+        int j;
+
+        for (l = zs->zbt->head; l != NULL; l = l->next) {
+            for (j = 0; j < l->hdr.num; j++) {
+                addReplyBulk(c,l->obj[j]);
+                if (withscores) addReplyDouble(c,l->score[j]);
+            }
+        }
+    } else {
+        redisPanic("Unknown sorted set encoding");
+    }
+}
+
+/* Lookup the 'setnum' input keys starting at argv[j] and fill 'src'.
+ * Returns REDIS_ERR after replying with an error when a key holds a value
+ * that is neither a set nor a sorted set. */
+//在db中查找输入的key，类型不是set或zset时回复错误并返回REDIS_ERR
+static int zunionInterLookupSources(redisClient *c, zsetopsrc *src, long setnum,
+                                    int j, int write)
+{
+    long i;
+
+    for (i = 0; i < setnum; i++, j++) {
+        robj *obj = write ? lookupKeyWrite(c->db,c->argv[j]) :
+                            lookupKeyRead(c->db,c->argv[j]);
+        if (obj != NULL) {
+            if (obj->type != REDIS_ZSET && obj->type != REDIS_SET) {
+            	//key对应的类型不是set,zset则报错
+                addReply(c,shared.wrongtypeerr);
+                return REDIS_ERR;
+            }
+
+            src[i].subject = obj;
+            src[i].type = obj->type;
+            src[i].encoding = obj->encoding;
+        } else {
+            src[i].subject = NULL;
+        }
+
+        /* Default all weights to 1. */
+        src[i].weight = 1.0;
+    }
+    return REDIS_OK;
+}
+
+/* Generic implementation of ZUNIONSTORE / ZINTERSTORE, and of ZUNION /
+ * ZINTER when 'dstkey' is NULL: in this case the result is not stored but
+ * returned to the client. 'numkeysIndex' is the index of the numkeys
+ * argument, followed by the input keys.
+ *
+ * Every input of a union is scanned just once. An element seen for the first
+ * time is added to the dictionary of the result with its weighted score, and
+ * the scores found in the next inputs are aggregated into the same dictionary
+ * entry. Inputs are processed in the same order the old implementation used
+ * to probe them, so the aggregation order and the results are the same, but
+ * there is no lookup in every other input for every element. The
+ * intersection streams the smallest input, probing the others until a miss. */
+//zunionstore/zinterstore的通用实现，dstkey为NULL时(zunion/zinter)不保存结果而是直接回复给客户端。
+//并集操作中每个输入集合只遍历一次，元素的score直接聚合到结果dict的条目中
+void zunionInterGenericCommand(redisClient *c, robj *dstkey, int numkeysIndex, int op) {
     int i, j;
     long setnum;
     int aggregate = REDIS_AGGR_SUM;
+    int withscores = 0;
     zsetopsrc *src;
     zsetopval zval;
     robj *tmp;
     unsigned int maxelelen = 0;
     robj *dstobj;
     zset *dstzset;
-    zskiplistNode *znode;
+    dictEntry *de;
     int touched = 0;
 
     /* expect setnum input keys to be given */
-    if ((getLongFromObjectOrReply(c, c->argv[2], &setnum, NULL) != REDIS_OK))
+    if ((getLongFromObjectOrReply(c, c->argv[numkeysIndex], &setnum, NULL) != REDIS_OK))
         return;
 
     if (setnum < 1) {
-        addReplyError(c,
-            "at least 1 input key is needed for ZUNIONSTORE/ZINTERSTORE");
+        addReplyErrorFormat(c,
+            "at least 1 input key is needed for %s", c->cmd->name);
         return;
     }
 
     /* test if the expected number of keys would overflow */
     //给定的set的数量与给定的key数量不一样
-    if (setnum > c->argc-3) {
+    if (setnum > c->argc-(numkeysIndex+1)) {
         addReply(c,shared.syntaxerr);
         return;
     }
@@ -2043,26 +2881,12 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
     /* read keys to be used for input */
     src = zcalloc(sizeof(zsetopsrc) * setnum);
     //根据给定的key在db找到对应的set
-    for (i = 0, j = 3; i < setnum; i++, j++) {
-        robj *obj = lookupKeyWrite(c->db,c->argv[j]);
-        if (obj != NULL) {
-            if (obj->type != REDIS_ZSET && obj->type != REDIS_SET) {
-            	//key对应的类型不是set,zset则报错
-                zfree(src);
-                addReply(c,shared.wrongtypeerr);
-                return;
-            }
-
-            src[i].subject = obj;
-            src[i].type = obj->type;
-            src[i].encoding = obj->encoding;
-        } else {
-            src[i].subject = NULL;
-        }
-
-        /* Default all weights to 1. */
-        src[i].weight = 1.0;
+    j = numkeysIndex+1;
+    if (zunionInterLookupSources(c,src,setnum,j,dstkey != NULL) == REDIS_ERR) {
+        zfree(src);
+        return;
     }
+    j += setnum;
 
     /* parse optional extra arguments */
     //解析其他参数
@@ -2098,6 +2922,12 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
                     return;
                 }
                 j++; remaining--;
+            }
+            //zunion/zinter可以带withscores参数
+            else if (remaining >= 1 && dstkey == NULL &&
+                     !strcasecmp(c->argv[j]->ptr,"withscores")) {
+                j++; remaining--;
+                withscores = 1;
             } else {
                 zfree(src);
                 addReply(c,shared.syntaxerr);
@@ -2111,7 +2941,7 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
     //跟据set元素数量大小排序
     qsort(src,setnum,sizeof(zsetopsrc),zuiCompareByCardinality);
 
-    dstobj = createZsetObject();
+    dstobj = createZsetLargeObject();
     dstzset = dstobj->ptr;
     memset(&zval, 0, sizeof(zval));
 
@@ -2148,12 +2978,11 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
                 /* Only continue when present in every input. */
                 //该元素存在于所有集合中
                 if (j == setnum) {
-                	//将元素插入到zset中的skiplist和dict中
+                	//将元素插入到zset的dict中，score保存在dict条目里
                     tmp = zuiObjectFromValue(&zval);
-                    znode = zslInsert(dstzset->zsl,score,tmp);
-                    incrRefCount(tmp); /* added to skiplist */
-                    dictAdd(dstzset->dict,tmp,&znode->score);
-                    incrRefCount(tmp); /* added to dictionary */
+                    de = dictAddRaw(dstzset->dict,tmp);
+                    incrRefCount(tmp); /* Added to dictionary. */
+                    dictSetDoubleVal(de,score);
 
                     if (tmp->encoding == REDIS_ENCODING_RAW)
                         if (sdslen(tmp->ptr) > maxelelen)
@@ -2173,48 +3002,45 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
             while (zuiNext(&src[i],&zval)) {
                 double score, value;
 
-                /* Skip an element that when already processed */
-                //该元素已经存在与zset中，跳过后续步骤
-                if (dictFind(dstzset->dict,zuiObjectFromValue(&zval)) != NULL)
-                    continue;
-
-                /* Initialize score */
-                score = src[i].weight * zval.score;
-                if (isnan(score)) score = 0;
+                value = zval.score*src[i].weight;
+                tmp = zuiObjectFromValue(&zval);
+                de = dictFind(dstzset->dict,tmp);
+                if (de == NULL) {
+                    /* First time the element is seen: initialize score. */
+                	//第一次遇到该元素，插入到zset的dict中，score保存在dict条目里
+                    if (isnan(value)) value = 0;
+                    de = dictAddRaw(dstzset->dict,tmp);
+                    incrRefCount(tmp); /* Added to dictionary. */
+                    dictSetDoubleVal(de,value);
 
-                /* We need to check only next sets to see if this element
-                 * exists, since we process every element just one time so
-                 * it can't exist in a previous set (otherwise it would be
-                 * already processed). */
-                //与后面的集合根据aggregate得到该元素的score值
-                for (j = (i+1); j < setnum; j++) {
-                    /* It is not safe to access the zset we are
-                     * iterating, so explicitly check for equal object. */
-                    if(src[j].subject == src[i].subject) {
-                        value = zval.score*src[j].weight;
-                        zunionInterAggregate(&score,value,aggregate);
-                    } else if (zuiFind(&src[j],&zval,&value)) {
-                        value *= src[j].weight;
-                        zunionInterAggregate(&score,value,aggregate);
-                    }
+                    if (tmp->encoding == REDIS_ENCODING_RAW)
+                        if (sdslen(tmp->ptr) > maxelelen)
+                            maxelelen = sdslen(tmp->ptr);
+                } else {
+                    /* Already added by a previous input: aggregate. */
+                	//之前的集合中已经有该元素，根据aggregate聚合score
+                    score = dictGetDoubleVal(de);
+                    zunionInterAggregate(&score,value,aggregate);
+                    dictSetDoubleVal(de,score);
                 }
-
-                //插入到zset中的dict和skiplist中
-                tmp = zuiObjectFromValue(&zval);
-                znode = zslInsert(dstzset->zsl,score,tmp);
-                incrRefCount(zval.ele); /* added to skiplist */
-                dictAdd(dstzset->dict,tmp,&znode->score);
-                incrRefCount(zval.ele); /* added to dictionary */
-
-                if (tmp->encoding == REDIS_ENCODING_RAW)
-                    if (sdslen(tmp->ptr) > maxelelen)
-                        maxelelen = sdslen(tmp->ptr);
             }
             zuiClearIterator(&src[i]);
         }
     } else {
         redisPanic("Unknown operator");
     }
+    zunionInterBuildIndex(dstobj);
+
+    //zunion/zinter直接回复结果，不保存
+    if (dstkey == NULL) {
+        if (zsetLength(dstobj))
+            zunionInterReply(c,dstobj,withscores);
+        else
+            addReply(c,shared.emptymultibulk);
+        decrRefCount(dstobj);
+        zfree(src);
+        return;
+    }
 
     //删除原来dstkey对应的set
     if (dbDelete(c->db,dstkey)) {
@@ -2222,12 +3048,12 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
         touched = 1;
         server.dirty++;
     }
-    if (dstzset->zsl->length) {
-        /* Convert to ziplist when in limits. */
-    	//如果可以，将skiplist转换为ziplist
-        if (dstzset->zsl->length <= server.zset_max_ziplist_entries &&
+    if (zsetLength(dstobj)) {
+        /* Convert to zpack when in limits. */
+    	//如果可以，将skiplist转换为zpack
+        if (zsetLength(dstobj) <= server.zset_max_ziplist_entries &&
             maxelelen <= server.zset_max_ziplist_value)
-                zsetConvert(dstobj,REDIS_ENCODING_ZIPLIST);
+                zsetConvert(dstobj,REDIS_ENCODING_ZPACK);
 
         dbAdd(c->db,dstkey,dstobj);
         addReplyLongLong(c,zsetLength(dstobj));
@@ -2247,12 +3073,92 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
 
 //zunionstore命令的实现
 void zunionstoreCommand(redisClient *c) {
-    zunionInterGenericCommand(c,c->argv[1], REDIS_OP_UNION);
+    zunionInterGenericCommand(c,c->argv[1],2,REDIS_OP_UNION);
 }
 
 //zintersrore命令的实现
 void zinterstoreCommand(redisClient *c) {
-    zunionInterGenericCommand(c,c->argv[1], REDIS_OP_INTER);
+    zunionInterGenericCommand(c,c->argv[1],2,REDIS_OP_INTER);
+}
+
+//zunion命令的实现
+void zunionCommand(redisClient *c) {
+    zunionInterGenericCommand(c,NULL,1,REDIS_OP_UNION);
+}
+
+//zinter命令的实现
+void zinterCommand(redisClient *c) {
+    zunionInterGenericCommand(c,NULL,1,REDIS_OP_INTER);
+}
+
+/* ZINTERCARD numkeys key [key ...] [LIMIT limit]
+ *
+ * Returns the cardinality of the intersection without materializing it: the
+ * smallest input is streamed and every element is counted when found in all
+ * the other inputs, so no memory is used. With a LIMIT greater than zero the
+ * scan stops as soon as 'limit' elements were counted. */
+//zintercard命令的实现：只计算交集的元素数量，不构建结果，有LIMIT时数量达到limit就停止
+void zinterCardCommand(redisClient *c) {
+    long setnum, limit = 0, count = 0;
+    zsetopsrc *src;
+    zsetopval zval;
+    int i, j;
+
+    if ((getLongFromObjectOrReply(c, c->argv[1], &setnum, NULL) != REDIS_OK))
+        return;
+
+    if (setnum < 1) {
+        addReplyError(c,"at least 1 input key is needed for ZINTERCARD");
+        return;
+    }
+
+    if (setnum > c->argc-2) {
+        addReply(c,shared.syntaxerr);
+        return;
+    }
+
+    /* Parse the optional LIMIT argument. */
+    j = 2+setnum;
+    if (j < c->argc) {
+        if (c->argc-j == 2 && !strcasecmp(c->argv[j]->ptr,"limit")) {
+            if (getLongFromObjectOrReply(c,c->argv[j+1],&limit,NULL) != REDIS_OK)
+                return;
+            if (limit < 0) {
+                addReplyError(c,"LIMIT can't be negative");
+                return;
+            }
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+    }
+
+    src = zcalloc(sizeof(zsetopsrc) * setnum);
+    if (zunionInterLookupSources(c,src,setnum,2,0) == REDIS_ERR) {
+        zfree(src);
+        return;
+    }
+    qsort(src,setnum,sizeof(zsetopsrc),zuiCompareByCardinality);
+    memset(&zval, 0, sizeof(zval));
+
+    if (zuiLength(&src[0]) > 0) {
+        zuiInitIterator(&src[0]);
+        while (zuiNext(&src[0],&zval)) {
+            double value;
+
+            //检查该元素是否存在于其他集合中
+            for (i = 1; i < setnum; i++) {
+                if (src[i].subject != src[0].subject &&
+                    !zuiFind(&src[i],&zval,&value)) break;
+            }
+            if (i == setnum && ++count == limit) break;
+        }
+        /* Release the element object the iteration may have created. */
+        if (zval.flags & OPVAL_DIRTY_ROBJ) decrRefCount(zval.ele);
+        zuiClearIterator(&src[0]);
+    }
+    addReplyLongLong(c,count);
+    zfree(src);
 }
 
 //通用函数，为zrange/zrevrange命令调用
@@ -2298,38 +3204,22 @@ void zrangeGenericCommand(redisClient *c, int reverse) {
     /* Return the result in form of a multi-bulk reply */
     addReplyMultiBulkLen(c, withscores ? (rangelen*2) : rangelen);
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_ZPACK) {
         unsigned char *zl = zobj->ptr;
-        unsigned char *eptr, *sptr;
         unsigned char *vstr;
         unsigned int vlen;
-        long long vlong;
-
-        //取到第一个元素
-        if (reverse)
-            eptr = ziplistIndex(zl,-2-(2*start));
-        else
-            eptr = ziplistIndex(zl,2*start);
+        long rank;
 
-        redisAssertWithInfo(c,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        //取到第一个元素, zpack中按rank取元素是O(1)的
+        rank = reverse ? llen-1-start : start;
 
-        //去接下来的rangelen个元素
+        //取接下来的rangelen个元素
         while (rangelen--) {
-            redisAssertWithInfo(c,zobj,eptr != NULL && sptr != NULL);
-            redisAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
-            if (vstr == NULL)
-                addReplyBulkLongLong(c,vlong);
-            else
-                addReplyBulkCBuffer(c,vstr,vlen);
-
+            vstr = zpGetMember(zl,rank,&vlen);
+            addReplyBulkCBuffer(c,vstr,vlen);
             if (withscores)
-                addReplyDouble(c,zzlGetScore(sptr));
-
-            if (reverse)
-                zzlPrev(zl,&eptr,&sptr);
-            else
-                zzlNext(zl,&eptr,&sptr);
+                addReplyDouble(c,zpGetScore(zl,rank));
+            rank += reverse ? -1 : 1;
         }
 
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
@@ -2359,6 +3249,21 @@ void zrangeGenericCommand(redisClient *c, int reverse) {
                 addReplyDouble(c,ln->score);
             ln = reverse ? ln->backward : ln->level[0].forward;
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreePos pos;
+
+        //按rank找到第一个元素，O(log(N))
+        zbtreeGetElementByRank(zs->zbt,reverse ? llen-1-start : start,&pos);
+
+        //取接下来的rangelen个元素
+        while(rangelen--) {
+            redisAssertWithInfo(c,zobj,pos.leaf != NULL);
+            addReplyBulk(c,zbtreePosObj(&pos));
+            if (withscores)
+                addReplyDouble(c,zbtreePosScore(&pos));
+            if (reverse) zbtreePrev(&pos); else zbtreeNext(&pos);
+        }
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -2429,51 +3334,46 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
     if ((zobj = lookupKeyReadOrReply(c,key,shared.emptymultibulk)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_ZPACK) {
         unsigned char *zl = zobj->ptr;
-        unsigned char *eptr, *sptr;
+        long rank, len = zpLength(zl);
         unsigned char *vstr;
         unsigned int vlen;
-        long long vlong;
         double score;
 
         /* If reversed, get the last node in range as starting point. */
         //取到第一个或者最后一个在range中的元素
         if (reverse) {
-            eptr = zzlLastInRange(zl,&range);
+            rank = zzlLastInRange(zl,&range);
         } else {
-            eptr = zzlFirstInRange(zl,&range);
+            rank = zzlFirstInRange(zl,&range);
         }
 
         /* No "first" element in the specified interval. */
-        if (eptr == NULL) {
+        if (rank == -1) {
             addReply(c, shared.emptymultibulk);
             return;
         }
 
-        /* Get score pointer for the first element. */
-        redisAssertWithInfo(c,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
-
         /* We don't know in advance how many matching elements there are in the
          * list, so we push this object that will represent the multi-bulk
          * length in the output buffer, and will "fix" it later */
         replylen = addDeferredMultiBulkLength(c);
 
-        /* If there is an offset, just traverse the number of elements without
-         * checking the score because that is done in the next loop. */
-        //先移动offset位置
-        while (eptr && offset--) {
-            if (reverse) {
-                zzlPrev(zl,&eptr,&sptr);
-            } else {
-                zzlNext(zl,&eptr,&sptr);
-            }
-        }
+        /* If there is an offset, just jump over the elements without checking
+         * the score because that is done in the next loop. A negative offset
+         * skips everything, like for the skiplist. */
+        //直接跳过offset个元素
+        if (offset < 0)
+            rank = -1;
+        else if (reverse)
+            rank = (offset <= rank) ? rank-offset : -1;
+        else
+            rank = (offset < len-rank) ? rank+offset : -1;
 
         //取到limit个元素
-        while (eptr && limit--) {
-            score = zzlGetScore(sptr);
+        while (rank >= 0 && rank < len && limit--) {
+            score = zpGetScore(zl,rank);
 
             /* Abort when the node is no longer in range. */
             if (reverse) {
@@ -2484,28 +3384,16 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
                 if (!zslValueLteMax(score,&range)) break;
             }
 
-            /* We know the element exists, so ziplistGet should always succeed */
-            redisAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
-
             rangelen++;
-            if (vstr == NULL) {
-                addReplyBulkLongLong(c,vlong);
-            } else {
-                addReplyBulkCBuffer(c,vstr,vlen);
-            }
+            vstr = zpGetMember(zl,rank,&vlen);
+            addReplyBulkCBuffer(c,vstr,vlen);
 
             if (withscores) {
                 addReplyDouble(c,score);
             }
 
             /* Move to next node */
-            if (reverse) {
-            	//往前移动
-                zzlPrev(zl,&eptr,&sptr);
-            } else {
-            	//往后移动
-                zzlNext(zl,&eptr,&sptr);
-            }
+            rank += reverse ? -1 : 1;
         }
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
@@ -2531,16 +3419,10 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
          * length in the output buffer, and will "fix" it later */
         replylen = addDeferredMultiBulkLength(c);
 
-        /* If there is an offset, just traverse the number of elements without
-         * checking the score because that is done in the next loop. */
-        //先移动offset个元素
-        while (ln && offset--) {
-            if (reverse) {
-                ln = ln->backward;
-            } else {
-                ln = ln->level[0].forward;
-            }
-        }
+        /* If there is an offset, just jump over the elements without checking
+         * the score because that is done in the next loop. */
+        //利用rank直接跳过offset个元素
+        ln = zslSkipNodes(zsl,ln,offset,reverse);
 
         //取limit个元素
         while (ln && limit--) {
@@ -2569,6 +3451,62 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
                 ln = ln->level[0].forward;
             }
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreePos pos;
+        long rank, len = zs->zbt->length;
+        double score;
+
+        /* If reversed, get the last node in range as starting point. */
+        //取到第一个或者最后一个在range中的元素
+        if (reverse) {
+            rank = zbtreeLastInRange(zs->zbt,&range,&pos);
+        } else {
+            rank = zbtreeFirstInRange(zs->zbt,&range,&pos);
+        }
+
+        /* No "first" element in the specified interval. */
+        if (rank == -1) {
+            addReply(c, shared.emptymultibulk);
+            return;
+        }
+
+        replylen = addDeferredMultiBulkLength(c);
+
+        /* The offset is applied to the rank, and the element is located
+         * again in O(log(N)) when it is not zero. */
+        //根据rank跳过offset个元素
+        if (offset < 0)
+            rank = -1;
+        else if (reverse)
+            rank = (offset <= rank) ? rank-offset : -1;
+        else
+            rank = (offset < len-rank) ? rank+offset : -1;
+        if (rank != -1 && offset > 0)
+            zbtreeGetElementByRank(zs->zbt,rank,&pos);
+        if (rank == -1) pos.leaf = NULL;
+
+        //取到limit个元素
+        while (pos.leaf && limit--) {
+            score = zbtreePosScore(&pos);
+
+            /* Abort when the node is no longer in range. */
+            if (reverse) {
+                if (!zslValueGteMin(score,&range)) break;
+            } else {
+                if (!zslValueLteMax(score,&range)) break;
+            }
+
+            rangelen++;
+            addReplyBulk(c,zbtreePosObj(&pos));
+
+            if (withscores) {
+                addReplyDouble(c,score);
+            }
+
+            /* Move to next node */
+            if (reverse) zbtreePrev(&pos); else zbtreeNext(&pos);
+        }
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -2608,41 +3546,18 @@ void zcountCommand(redisClient *c) {
     if ((zobj = lookupKeyReadOrReply(c, key, shared.czero)) == NULL ||
         checkType(c, zobj, REDIS_ZSET)) return;
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_ZPACK) {
         unsigned char *zl = zobj->ptr;
-        unsigned char *eptr, *sptr;
-        double score;
-
-        /* Use the first element in range as the starting point */
-        //以第一个在range中的元素作为起始点
-        eptr = zzlFirstInRange(zl,&range);
-
-        /* No "first" element */
-        if (eptr == NULL) {
-            addReply(c, shared.czero);
-            return;
-        }
+        long first, last;
 
-        /* First element is in range */
-        sptr = ziplistNext(zl,eptr);
-        score = zzlGetScore(sptr);
-        redisAssertWithInfo(c,zobj,zslValueLteMax(score,&range));
-
-        /* Iterate over elements in range */
-        //遍历在range中的元素
-        while (eptr) {
-            score = zzlGetScore(sptr);
-
-            /* Abort when the node is no longer in range. */
-            //大于最大值，跳出
-            if (!zslValueLteMax(score,&range)) {
-            	//
-                break;
-            } else {
-            	//count加一
-                count++;
-                zzlNext(zl,&eptr,&sptr);
-            }
+        /* The count is the distance between the ranks of the first and the
+         * last element in range, both found with a binary search. */
+        //第一个和最后一个在range中的元素的rank之差
+        first = zzlFirstInRange(zl,&range);
+        if (first != -1) {
+            last = zzlLastInRange(zl,&range);
+            redisAssertWithInfo(c,zobj,last >= first);
+            count = last-first+1;
         }
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
@@ -2671,6 +3586,20 @@ void zcountCommand(redisClient *c) {
                 count -= (zsl->length - rank);
             }
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreePos pos;
+        long first, last;
+
+        /* Ranks are computed while searching, so this is just the distance
+         * between the first and the last element in range. */
+        //第一个和最后一个在range中的元素的rank之差
+        first = zbtreeFirstInRange(zs->zbt,&range,&pos);
+        if (first != -1) {
+            last = zbtreeLastInRange(zs->zbt,&range,&pos);
+            redisAssertWithInfo(c,zobj,last >= first);
+            count = last-first+1;
+        }
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -2700,33 +3629,14 @@ void zlexcountCommand(redisClient *c) {
         return;
     }
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_ZPACK) {
         unsigned char *zl = zobj->ptr;
-        unsigned char *eptr, *sptr;
-
-        /* Use the first element in range as the starting point */
-        eptr = zzlFirstInLexRange(zl,&range);
-
-        /* No "first" element */
-        if (eptr == NULL) {
-            zslFreeLexRange(&range);
-            addReply(c, shared.czero);
-            return;
-        }
+        long first, last;
 
-        /* First element is in range */
-        sptr = ziplistNext(zl,eptr);
-        redisAssertWithInfo(c,zobj,zzlLexValueLteMax(eptr,&range));
-
-        /* Iterate over elements in range */
-        while (eptr) {
-            /* Abort when the node is no longer in range. */
-            if (!zzlLexValueLteMax(eptr,&range)) {
-                break;
-            } else {
-                count++;
-                zzlNext(zl,&eptr,&sptr);
-            }
+        first = zzlFirstInLexRange(zl,&range);
+        if (first != -1) {
+            last = zzlLastInLexRange(zl,&range);
+            if (last >= first) count = last-first+1;
         }
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
@@ -2751,6 +3661,16 @@ void zlexcountCommand(redisClient *c) {
                 count -= (zsl->length - rank);
             }
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreePos pos;
+        long first, last;
+
+        first = zbtreeFirstInLexRange(zs->zbt,&range,&pos);
+        if (first != -1) {
+            last = zbtreeLastInLexRange(zs->zbt,&range,&pos);
+            if (last >= first) count = last-first+1;
+        }
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -2814,77 +3734,60 @@ void genericZrangebylexCommand(redisClient *c, int reverse) {
         return;
     }
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_ZPACK) {
         unsigned char *zl = zobj->ptr;
-        unsigned char *eptr, *sptr;
+        long rank, len = zpLength(zl);
         unsigned char *vstr;
         unsigned int vlen;
-        long long vlong;
 
         /* If reversed, get the last node in range as starting point. */
         //取到第一个或者最后一个在range的元素作为起始点
         if (reverse) {
-            eptr = zzlLastInLexRange(zl,&range);
+            rank = zzlLastInLexRange(zl,&range);
         } else {
-            eptr = zzlFirstInLexRange(zl,&range);
+            rank = zzlFirstInLexRange(zl,&range);
         }
 
         /* No "first" element in the specified interval. */
-        if (eptr == NULL) {
+        if (rank == -1) {
             addReply(c, shared.emptymultibulk);
             zslFreeLexRange(&range);
             return;
         }
 
-        /* Get score pointer for the first element. */
-        redisAssertWithInfo(c,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
-
         /* We don't know in advance how many matching elements there are in the
          * list, so we push this object that will represent the multi-bulk
          * length in the output buffer, and will "fix" it later */
         replylen = addDeferredMultiBulkLength(c);
 
-        /* If there is an offset, just traverse the number of elements without
-         * checking the score because that is done in the next loop. */
-        //跳过offset个元素
-        while (eptr && offset--) {
-            if (reverse) {
-                zzlPrev(zl,&eptr,&sptr);
-            } else {
-                zzlNext(zl,&eptr,&sptr);
-            }
-        }
+        /* If there is an offset, just jump over the elements without checking
+         * the range because that is done in the next loop. */
+        //直接跳过offset个元素
+        if (offset < 0)
+            rank = -1;
+        else if (reverse)
+            rank = (offset <= rank) ? rank-offset : -1;
+        else
+            rank = (offset < len-rank) ? rank+offset : -1;
 
-        //取到limit个函数
-        while (eptr && limit--) {
+        //取到limit个元素
+        while (rank >= 0 && rank < len && limit--) {
             /* Abort when the node is no longer in range. */
             if (reverse) {
             	//往前移动，小于最小值跳出
-                if (!zzlLexValueGteMin(eptr,&range)) break;
+                if (!zzlLexValueGteMin(zl,rank,&range)) break;
             } else {
             	//往后移动，大于最大值跳出
-                if (!zzlLexValueLteMax(eptr,&range)) break;
+                if (!zzlLexValueLteMax(zl,rank,&range)) break;
             }
 
-            /* We know the element exists, so ziplistGet should always
-             * succeed. */
-            redisAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
-
             rangelen++;
-            if (vstr == NULL) {
-                addReplyBulkLongLong(c,vlong);
-            } else {
-                addReplyBulkCBuffer(c,vstr,vlen);
-            }
+            vstr = zpGetMember(zl,rank,&vlen);
+            addReplyBulkCBuffer(c,vstr,vlen);
 
             /* Move to next node */
             //取到下一个元素
-            if (reverse) {
-                zzlPrev(zl,&eptr,&sptr);
-            } else {
-                zzlNext(zl,&eptr,&sptr);
-            }
+            rank += reverse ? -1 : 1;
         }
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
@@ -2911,16 +3814,10 @@ void genericZrangebylexCommand(redisClient *c, int reverse) {
          * length in the output buffer, and will "fix" it later */
         replylen = addDeferredMultiBulkLength(c);
 
-        /* If there is an offset, just traverse the number of elements without
-         * checking the score because that is done in the next loop. */
-        //跳过offset个元素
-        while (ln && offset--) {
-            if (reverse) {
-                ln = ln->backward;
-            } else {
-                ln = ln->level[0].forward;
-            }
-        }
+        /* If there is an offset, just jump over the elements without checking
+         * the range because that is done in the next loop. */
+        //利用rank直接跳过offset个元素
+        ln = zslSkipNodes(zsl,ln,offset,reverse);
 
         //取到limit个元素
         while (ln && limit--) {
@@ -2941,6 +3838,55 @@ void genericZrangebylexCommand(redisClient *c, int reverse) {
                 ln = ln->level[0].forward;
             }
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreePos pos;
+        long rank, len = zs->zbt->length;
+
+        /* If reversed, get the last node in range as starting point. */
+        //取到第一个或者最后一个在range的元素作为起始点
+        if (reverse) {
+            rank = zbtreeLastInLexRange(zs->zbt,&range,&pos);
+        } else {
+            rank = zbtreeFirstInLexRange(zs->zbt,&range,&pos);
+        }
+
+        /* No "first" element in the specified interval. */
+        if (rank == -1) {
+            addReply(c, shared.emptymultibulk);
+            zslFreeLexRange(&range);
+            return;
+        }
+
+        replylen = addDeferredMultiBulkLength(c);
+
+        /* The offset is applied to the rank, see ZRANGEBYSCORE. */
+        //根据rank跳过offset个元素
+        if (offset < 0)
+            rank = -1;
+        else if (reverse)
+            rank = (offset <= rank) ? rank-offset : -1;
+        else
+            rank = (offset < len-rank) ? rank+offset : -1;
+        if (rank != -1 && offset > 0)
+            zbtreeGetElementByRank(zs->zbt,rank,&pos);
+        if (rank == -1) pos.leaf = NULL;
+
+        //取到limit个元素
+        while (pos.leaf && limit--) {
+            /* Abort when the node is no longer in range. */
+            if (reverse) {
+                if (!zslLexValueGteMin(zbtreePosObj(&pos),&range)) break;
+            } else {
+                if (!zslLexValueLteMax(zbtreePosObj(&pos),&range)) break;
+            }
+
+            rangelen++;
+            addReplyBulk(c,zbtreePosObj(&pos));
+
+            /* Move to next node */
+            if (reverse) zbtreePrev(&pos); else zbtreeNext(&pos);
+        }
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -2979,8 +3925,8 @@ void zscoreCommand(redisClient *c) {
     if ((zobj = lookupKeyReadOrReply(c,key,shared.nullbulk)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
-        if (zzlFind(zobj->ptr,c->argv[2],&score) != NULL)
+    if (zobj->encoding == REDIS_ENCODING_ZPACK) {
+        if (zzlFind(zobj->ptr,c->argv[2],&score) != -1)
             addReplyDouble(c,score);
         else
             addReply(c,shared.nullbulk);
@@ -2996,6 +3942,17 @@ void zscoreCommand(redisClient *c) {
         } else {
             addReply(c,shared.nullbulk);
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        dictEntry *de;
+
+        //B+树编码时score直接保存在dictEntry中
+        c->argv[2] = tryObjectEncoding(c->argv[2]);
+        de = dictFind(zs->dict,c->argv[2]);
+        if (de != NULL)
+            addReplyDouble(c,dictGetDoubleVal(de));
+        else
+            addReply(c,shared.nullbulk);
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -3014,30 +3971,16 @@ void zrankGenericCommand(redisClient *c, int reverse) {
     llen = zsetLength(zobj);
 
     redisAssertWithInfo(c,ele,ele->encoding == REDIS_ENCODING_RAW);
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *zl = zobj->ptr;
-        unsigned char *eptr, *sptr;
-
-        eptr = ziplistIndex(zl,0);
-        redisAssertWithInfo(c,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
-        redisAssertWithInfo(c,zobj,sptr != NULL);
+    if (zobj->encoding == REDIS_ENCODING_ZPACK) {
+        long zrank;
 
-        rank = 1;
-        //遍历ziplist
-        while(eptr != NULL) {
-        	//找到值一样的则跳出
-            if (ziplistCompare(eptr,ele->ptr,sdslen(ele->ptr)))
-                break;
-            rank++;
-            zzlNext(zl,&eptr,&sptr);
-        }
-
-        if (eptr != NULL) {
+        //zpack中按成员查找直接得到rank
+        zrank = zzlFind(zobj->ptr,ele,NULL);
+        if (zrank != -1) {
             if (reverse)
-                addReplyLongLong(c,llen-rank);
+                addReplyLongLong(c,llen-1-zrank);
             else
-                addReplyLongLong(c,rank-1);
+                addReplyLongLong(c,zrank);
         } else {
             addReply(c,shared.nullbulk);
         }
@@ -3060,6 +4003,24 @@ void zrankGenericCommand(redisClient *c, int reverse) {
         } else {
             addReply(c,shared.nullbulk);
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        dictEntry *de;
+        long zrank;
+
+        //先从dict中取到score，再在B+树中计算rank
+        ele = c->argv[2] = tryObjectEncoding(c->argv[2]);
+        de = dictFind(zs->dict,ele);
+        if (de != NULL) {
+            zrank = zbtreeGetRank(zs->zbt,dictGetDoubleVal(de),ele);
+            redisAssertWithInfo(c,ele,zrank != -1); /* Existing elements always have a rank. */
+            if (reverse)
+                addReplyLongLong(c,llen-1-zrank);
+            else
+                addReplyLongLong(c,zrank);
+        } else {
+            addReply(c,shared.nullbulk);
+        }
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -3078,7 +4039,7 @@ void zrevrankCommand(redisClient *c) {
 //zscan命令的实现
 void zscanCommand(redisClient *c) {
     robj *o;
-    unsigned long cursor;
+    unsigned long long cursor;
 
     if (parseScanCursorOrReply(c,c->argv[2],&cursor) == REDIS_ERR) return;
     if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.emptyscan)) == NULL ||
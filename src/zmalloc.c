@@ -44,6 +44,10 @@ void zlibc_free(void *ptr) {
 #include "config.h"
 #include "zmalloc.h"
 
+#if !defined(HAVE_MALLOC_SIZE) && defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
 //PREFIX_SIZE是每次分配内存时额外分配的大小，用来保存当次内存分配的大小
 #ifdef HAVE_MALLOC_SIZE
 #define PREFIX_SIZE (0)
@@ -197,6 +201,22 @@ size_t zmalloc_size(void *ptr) {
 }
 #endif
 
+/* Return the number of bytes of the allocation 'ptr' the caller can use.
+ * Allocators round the requested sizes up to their size classes, so this
+ * can be more than what was requested: callers growing a buffer can use
+ * the difference instead of wasting it. Without an allocator API to query
+ * we fall back to the requested size. */
+//返回ptr指向的内存中可以使用的大小, 分配器会将请求的大小向上取整到size class
+size_t zmalloc_usable(void *ptr) {
+#ifdef HAVE_MALLOC_SIZE
+    return zmalloc_size(ptr);
+#elif defined(__GLIBC__)
+    return malloc_usable_size((char*)ptr-PREFIX_SIZE)-PREFIX_SIZE;
+#else
+    return *((size_t*)((char*)ptr-PREFIX_SIZE));
+#endif
+}
+
 void zfree(void *ptr) {
 #ifndef HAVE_MALLOC_SIZE
     void *realptr;
@@ -0,0 +1,591 @@
+/* The zpack is the compact encoding of small sorted sets. It replaces the
+ * listpack of (member,score) pairs previously used for this purpose: in a
+ * listpack every lookup is a linear scan decoding one entry after the other
+ * (and parsing the score of every entry from its string form), so ZSCORE,
+ * ZRANK, ZRANGE with an offset and every score range seek were O(N) and the
+ * compact threshold had to stay small.
+ *
+ * The zpack stores scores and member offsets in fixed width columns, so the
+ * element with a given rank is accessed in O(1) and the first element of a
+ * score range is located with a binary search. A third column holds the
+ * ranks sorted by member, so that a member is located with a binary search
+ * as well. Inserting and deleting are still O(N) since memory is moved, like
+ * in every other single allocation encoding.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * ZPACK OVERALL LAYOUT:
+ * <total-bytes><count><scores><offsets><order><members>
+ *
+ * <total-bytes> is a 32 bit unsigned integer holding the number of bytes
+ * used by the zpack, header included.
+ *
+ * <count> is a 32 bit unsigned integer holding the number of elements.
+ *
+ * <scores> are <count> doubles, one per element, in rank order. Elements
+ * are ordered by score and then by member, exactly like in the skiplist.
+ *
+ * <offsets> are <count> 32 bit unsigned integers, the offset of the member
+ * of every element from the start of <members>, in rank order. The length
+ * of a member is the distance to the next offset, or to the end of the
+ * zpack for the last element.
+ *
+ * <order> are <count> 32 bit unsigned integers, the ranks of the elements
+ * sorted by member (memcmp() order, shorter member first on ties).
+ *
+ * <members> are the member strings, in rank order, without separators.
+ *
+ * All the integers and doubles are stored in little endian byte order. Every
+ * element uses 16 bytes plus the length of its member.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2014, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "zmalloc.h"
+#include "endianconv.h"
+#include "zpack.h"
+#include "redisassert.h"
+
+#define ZP_HDR_SIZE 8       /* 32 bit total len + 32 bit number of elements. */
+#define ZP_ENTRY_SIZE 16    /* Score, member offset and member order. */
+
+/* Start of every column given the number of elements 'n'. */
+#define zpScores(zp) ((zp)+ZP_HDR_SIZE)
+#define zpOffsets(zp,n) ((zp)+ZP_HDR_SIZE+8*(n))
+#define zpOrder(zp,n) ((zp)+ZP_HDR_SIZE+12*(n))
+#define zpMembers(zp,n) ((zp)+ZP_HDR_SIZE+16*(n))
+
+//读取p处保存的32位整数
+static uint32_t zpGetU32(unsigned char *p) {
+    uint32_t v;
+    memcpy(&v,p,sizeof(v));
+    memrev32ifbe(&v);
+    return v;
+}
+
+//将32位整数v保存到p处
+static void zpSetU32(unsigned char *p, uint32_t v) {
+    memrev32ifbe(&v);
+    memcpy(p,&v,sizeof(v));
+}
+
+#define zpGetTotalBytes(zp) zpGetU32(zp)
+#define zpGetCount(zp) zpGetU32((zp)+4)
+
+/* Offset of the member of the element at 'rank' inside the members area. */
+//取到rank处元素的成员在members区域中的偏移量
+static uint32_t zpMemberOffset(unsigned char *zp, unsigned long n, unsigned long rank) {
+    if (rank == n) return zpGetTotalBytes(zp)-ZP_HDR_SIZE-ZP_ENTRY_SIZE*n;
+    return zpGetU32(zpOffsets(zp,n)+4*rank);
+}
+
+/* Compare two members, with the same ordering of compareStringObjects(). */
+//比较两个成员的大小
+static int zpCompareMembers(unsigned char *a, unsigned int alen, unsigned char *b, unsigned int blen) {
+    unsigned int minlen = (alen < blen) ? alen : blen;
+    int cmp = memcmp(a,b,minlen);
+
+    if (cmp == 0) return (alen > blen) - (alen < blen);
+    return cmp;
+}
+
+/* Binary search of the member 's' in the order column. Returns 1 when the
+ * member is found. In both cases '*pos' is set to the position in the order
+ * column where the member is, or should be inserted. */
+//在order列中二分查找成员s, pos为s所在或者应该插入的位置
+static int zpSearchOrder(unsigned char *zp, unsigned char *s, unsigned int len, unsigned long *pos) {
+    unsigned long n = zpGetCount(zp), lo = 0, hi = n, mid;
+    unsigned char *order = zpOrder(zp,n), *m;
+    unsigned int mlen;
+    int cmp = 1;
+
+    while (lo < hi) {
+        mid = lo+(hi-lo)/2;
+        m = zpGetMember(zp,zpGetU32(order+4*mid),&mlen);
+        if (zpCompareMembers(m,mlen,s,len) < 0)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    if (lo < n) {
+        m = zpGetMember(zp,zpGetU32(order+4*lo),&mlen);
+        cmp = zpCompareMembers(m,mlen,s,len);
+    }
+    *pos = lo;
+    return cmp == 0;
+}
+
+/* Create a new empty zpack. */
+//创建一个新的zpack
+unsigned char *zpNew(void) {
+    unsigned char *zp = zmalloc(ZP_HDR_SIZE);
+
+    zpSetU32(zp,ZP_HDR_SIZE);
+    zpSetU32(zp+4,0);
+    return zp;
+}
+
+/* Return the number of elements. */
+//返回zpack中元素个数
+unsigned long zpLength(unsigned char *zp) {
+    return zpGetCount(zp);
+}
+
+/* Return the total number of bytes used by the zpack. */
+//返回zpack占用内存大小
+size_t zpBytes(unsigned char *zp) {
+    return zpGetTotalBytes(zp);
+}
+
+/* Return the score of the element at 'rank'. */
+//取到rank处元素的score
+double zpGetScore(unsigned char *zp, unsigned long rank) {
+    double score;
+
+    memcpy(&score,zpScores(zp)+8*rank,sizeof(score));
+    memrev64ifbe(&score);
+    return score;
+}
+
+/* Return a pointer to the member of the element at 'rank', storing its
+ * length in '*len'. The pointer is valid until the zpack is modified. */
+//取到rank处元素的成员，在zpack被修改前有效
+unsigned char *zpGetMember(unsigned char *zp, unsigned long rank, unsigned int *len) {
+    unsigned long n = zpGetCount(zp);
+    uint32_t off = zpMemberOffset(zp,n,rank);
+
+    *len = zpMemberOffset(zp,n,rank+1)-off;
+    return zpMembers(zp,n)+off;
+}
+
+/* Return the rank of the first element with a score >= 'score', or > 'score'
+ * when 'exclusive' is true. Returns the number of elements when there is no
+ * such element. */
+//二分查找第一个score大于等于score(exclusive为1时大于)的元素
+unsigned long zpScoreRank(unsigned char *zp, double score, int exclusive) {
+    unsigned long lo = 0, hi = zpGetCount(zp), mid;
+    double s;
+
+    while (lo < hi) {
+        mid = lo+(hi-lo)/2;
+        s = zpGetScore(zp,mid);
+        if (exclusive ? (s <= score) : (s < score))
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Return the rank the new element (score,s) should be inserted at in order
+ * to keep the elements ordered by score and member. */
+//二分查找新元素(score,s)应该插入的位置
+unsigned long zpInsertRank(unsigned char *zp, double score, unsigned char *s, unsigned int len) {
+    unsigned long lo = zpScoreRank(zp,score,0), hi = zpScoreRank(zp,score,1), mid;
+    unsigned char *m;
+    unsigned int mlen;
+
+    /* Elements in [lo,hi) have the same score: order them by member. */
+    while (lo < hi) {
+        mid = lo+(hi-lo)/2;
+        m = zpGetMember(zp,mid,&mlen);
+        if (zpCompareMembers(m,mlen,s,len) < 0)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Return the rank of the element with member 's', or -1 if not found. */
+//按成员查找元素，返回rank, 找不到返回-1
+long zpFind(unsigned char *zp, unsigned char *s, unsigned int len) {
+    unsigned long pos;
+
+    if (!zpSearchOrder(zp,s,len,&pos)) return -1;
+    return zpGetU32(zpOrder(zp,zpGetCount(zp))+4*pos);
+}
+
+/* Insert the element (score,s) at 'rank'. The caller must make sure the
+ * member is not already present and the rank keeps the zpack ordered (see
+ * zpInsertRank). */
+//在rank处插入新元素
+unsigned char *zpInsert(unsigned char *zp, unsigned long rank, unsigned char *s, unsigned int len, double score) {
+    unsigned long n = zpGetCount(zp), pos, j;
+    size_t bytes = zpGetTotalBytes(zp);
+    uint32_t off, heap, v;
+    unsigned char *p;
+
+    assert(rank <= n);
+    zpSearchOrder(zp,s,len,&pos);
+    off = zpMemberOffset(zp,n,rank);
+    heap = zpMemberOffset(zp,n,n);
+
+    zp = zrealloc(zp,bytes+ZP_ENTRY_SIZE+len);
+
+    /* Every column moves forward, so move them from the last to the first
+     * one: the destination of a column never overlaps a column that still
+     * needs to be moved. */
+    //列从后往前移动，保证不会覆盖尚未移动的列
+    p = zpMembers(zp,n+1);
+    memmove(p+off+len,zpMembers(zp,n)+off,heap-off);
+    memmove(p,zpMembers(zp,n),off);
+    memcpy(p+off,s,len);
+
+    p = zpOrder(zp,n+1);
+    memmove(p+4*(pos+1),zpOrder(zp,n)+4*pos,4*(n-pos));
+    memmove(p,zpOrder(zp,n),4*pos);
+    for (j = 0; j <= n; j++) {
+        if (j == pos) continue;
+        v = zpGetU32(p+4*j);
+        if (v >= rank) zpSetU32(p+4*j,v+1);
+    }
+    zpSetU32(p+4*pos,rank);
+
+    p = zpOffsets(zp,n+1);
+    memmove(p+4*(rank+1),zpOffsets(zp,n)+4*rank,4*(n-rank));
+    memmove(p,zpOffsets(zp,n),4*rank);
+    for (j = rank+1; j <= n; j++)
+        zpSetU32(p+4*j,zpGetU32(p+4*j)+len);
+    zpSetU32(p+4*rank,off);
+
+    p = zpScores(zp);
+    memmove(p+8*(rank+1),p+8*rank,8*(n-rank));
+    memrev64ifbe(&score);
+    memcpy(p+8*rank,&score,sizeof(score));
+
+    zpSetU32(zp,bytes+ZP_ENTRY_SIZE+len);
+    zpSetU32(zp+4,n+1);
+    return zp;
+}
+
+/* Delete 'num' elements starting at 'rank'. */
+//删除rank处开始的num个元素
+unsigned char *zpDeleteRange(unsigned char *zp, unsigned long rank, unsigned long num) {
+    unsigned long n = zpGetCount(zp), m, j, w;
+    size_t bytes = zpGetTotalBytes(zp);
+    uint32_t off, end, heap, len, v;
+    unsigned char *p, *src;
+
+    if (rank >= n || num == 0) return zp;
+    if (num > n-rank) num = n-rank;
+    m = n-num;
+    off = zpMemberOffset(zp,n,rank);
+    end = zpMemberOffset(zp,n,rank+num);
+    heap = zpMemberOffset(zp,n,n);
+    len = end-off;
+
+    /* Every column moves backward, so move them from the first to the last
+     * one. Entries are copied one by one in increasing order, and the
+     * destination of an entry is never after its source. */
+    //列从前往后移动
+    p = zpScores(zp);
+    memmove(p+8*rank,p+8*(rank+num),8*(n-rank-num));
+
+    p = zpOffsets(zp,m);
+    src = zpOffsets(zp,n);
+    memmove(p,src,4*rank);
+    for (j = rank; j < m; j++)
+        zpSetU32(p+4*j,zpGetU32(src+4*(j+num))-len);
+
+    p = zpOrder(zp,m);
+    src = zpOrder(zp,n);
+    for (j = 0, w = 0; j < n; j++) {
+        v = zpGetU32(src+4*j);
+        if (v >= rank && v < rank+num) continue;
+        if (v >= rank+num) v -= num;
+        zpSetU32(p+4*w,v);
+        w++;
+    }
+
+    p = zpMembers(zp,m);
+    src = zpMembers(zp,n);
+    memmove(p,src,off);
+    memmove(p+off,src+end,heap-end);
+
+    bytes -= ZP_ENTRY_SIZE*num+len;
+    zpSetU32(zp,bytes);
+    zpSetU32(zp+4,m);
+    return zrealloc(zp,bytes);
+}
+
+#ifdef ZPACK_TEST_MAIN
+#include <sys/time.h>
+#include <time.h>
+#include "listpack.h"
+#include "util.h"
+
+/* Self test of the zpack against a sorted array holding the same elements,
+ * followed by a comparison with the listpack layout previously used for
+ * small sorted sets. Build with make zpack-benchmark. */
+
+void _redisAssert(char *estr, char *file, int line) {
+    fprintf(stderr,"=== ASSERTION FAILED ===\n==> %s:%d '%s' is not true\n",
+        file,line,estr);
+    exit(1);
+}
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+#define TEST_MAX 2000
+
+static volatile long long sink; /* Keeps the benchmark loops alive. */
+
+typedef struct {
+    double score;
+    char member[64];
+    unsigned int len;
+} testElement;
+
+static testElement model[TEST_MAX];
+static unsigned long modellen;
+
+static int elementCompare(testElement *a, testElement *b) {
+    if (a->score != b->score) return (a->score < b->score) ? -1 : 1;
+    return zpCompareMembers((unsigned char*)a->member,a->len,
+                            (unsigned char*)b->member,b->len);
+}
+
+/* Check the zpack against the model. */
+static void verify(unsigned char *zp) {
+    unsigned long j, k;
+    unsigned char *m;
+    unsigned int len;
+
+    assert(zpLength(zp) == modellen);
+    for (j = 0; j < modellen; j++) {
+        assert(zpGetScore(zp,j) == model[j].score);
+        m = zpGetMember(zp,j,&len);
+        assert(len == model[j].len && memcmp(m,model[j].member,len) == 0);
+        assert(zpFind(zp,(unsigned char*)model[j].member,model[j].len) == (long)j);
+        for (k = 0; k < modellen && model[k].score < model[j].score; k++);
+        assert(zpScoreRank(zp,model[j].score,0) == k);
+        for (; k < modellen && model[k].score <= model[j].score; k++);
+        assert(zpScoreRank(zp,model[j].score,1) == k);
+    }
+    assert(zpFind(zp,(unsigned char*)"missing",7) == -1);
+}
+
+static void stressTest(int iterations) {
+    unsigned char *zp = zpNew();
+    testElement e;
+    unsigned long j, k, n;
+    int i;
+
+    modellen = 0;
+    for (i = 0; i < iterations; i++) {
+        int op = rand() % 3;
+
+        if (modellen == TEST_MAX) op = 1;
+        switch(op) {
+        case 0: /* Insert a new member. */
+            e.score = rand() % 50;
+            e.len = sprintf(e.member,"%d",rand() % 100000);
+            if (rand() % 3 == 0) e.len = 0; /* Empty member. */
+            if (zpFind(zp,(unsigned char*)e.member,e.len) != -1) break;
+            k = zpInsertRank(zp,e.score,(unsigned char*)e.member,e.len);
+            for (j = 0; j < modellen && elementCompare(&model[j],&e) < 0; j++);
+            assert(j == k);
+            zp = zpInsert(zp,k,(unsigned char*)e.member,e.len,e.score);
+            memmove(model+k+1,model+k,sizeof(testElement)*(modellen-k));
+            model[k] = e;
+            modellen++;
+            break;
+        case 1: /* Delete one element. */
+            if (!modellen) break;
+            k = rand() % modellen;
+            zp = zpDeleteRange(zp,k,1);
+            memmove(model+k,model+k+1,sizeof(testElement)*(modellen-k-1));
+            modellen--;
+            break;
+        case 2: /* Delete a range. */
+            if (!modellen || rand() % 10) break;
+            k = rand() % modellen;
+            n = rand() % 5;
+            if (n > modellen-k) n = modellen-k;
+            zp = zpDeleteRange(zp,k,n);
+            memmove(model+k,model+k+n,sizeof(testElement)*(modellen-k-n));
+            modellen -= n;
+            break;
+        }
+        if (i % 200 == 0) verify(zp);
+    }
+    verify(zp);
+    zfree(zp);
+}
+
+/* The (member,score) listpack lookups used before the zpack. */
+static double lpScore(unsigned char *p) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+    char buf[128];
+
+    lpGet(p,&vstr,&vlen,&vll);
+    if (vstr == NULL) return vll;
+    memcpy(buf,vstr,vlen);
+    buf[vlen] = '\0';
+    return strtod(buf,NULL);
+}
+
+static unsigned char *lpFindMember(unsigned char *lp, char *s, unsigned int len) {
+    unsigned char *p = lpFirst(lp);
+
+    while (p != NULL) {
+        if (lpCompare(p,(unsigned char*)s,len)) return p;
+        p = lpNext(lp,lpNext(lp,p));
+    }
+    return NULL;
+}
+
+static unsigned char *lpFirstScore(unsigned char *lp, double min) {
+    unsigned char *p = lpFirst(lp);
+
+    while (p != NULL) {
+        unsigned char *sptr = lpNext(lp,p);
+        if (lpScore(sptr) >= min) return p;
+        p = lpNext(lp,sptr);
+    }
+    return NULL;
+}
+
+/* Leaderboard like sorted set of 'num' elements: member lookup (ZSCORE,
+ * ZRANK), score range seek (ZRANGEBYSCORE, ZCOUNT), rank access (ZRANGE)
+ * and insert + delete (ZADD updating a score). */
+static void benchLookup(int num, int iterations) {
+    unsigned char *lp = lpNew(), *zp = zpNew(), *p;
+    char member[32], score[32];
+    unsigned int mlen, slen, len;
+    long long start, t[8];
+    int j, k;
+
+    for (j = 0; j < num; j++) {
+        mlen = sprintf(member,"player:%d",j);
+        slen = d2string(score,sizeof(score),j*1.5);
+        lp = lpPush(lp,(unsigned char*)member,mlen,LP_TAIL);
+        lp = lpPush(lp,(unsigned char*)score,slen,LP_TAIL);
+        zp = zpInsert(zp,j,(unsigned char*)member,mlen,j*1.5);
+    }
+
+    start = usec();
+    for (j = 0; j < iterations; j++) {
+        mlen = sprintf(member,"player:%d",rand()%num);
+        p = lpFindMember(lp,member,mlen);
+        sink += lpScore(lpNext(lp,p));
+    }
+    t[0] = usec()-start;
+    start = usec();
+    for (j = 0; j < iterations; j++) {
+        mlen = sprintf(member,"player:%d",rand()%num);
+        sink += zpGetScore(zp,zpFind(zp,(unsigned char*)member,mlen));
+    }
+    t[1] = usec()-start;
+
+    start = usec();
+    for (j = 0; j < iterations; j++)
+        sink += (long long)lpFirstScore(lp,(rand()%num)*1.5);
+    t[2] = usec()-start;
+    start = usec();
+    for (j = 0; j < iterations; j++)
+        sink += zpScoreRank(zp,(rand()%num)*1.5,0);
+    t[3] = usec()-start;
+
+    start = usec();
+    for (j = 0; j < iterations; j++)
+        sink += (long long)lpIndex(lp,2*(rand()%num));
+    t[4] = usec()-start;
+    start = usec();
+    for (j = 0; j < iterations; j++)
+        sink += (long long)zpGetMember(zp,rand()%num,&len);
+    t[5] = usec()-start;
+
+    start = usec();
+    for (j = 0; j < iterations; j++) {
+        k = rand()%num;
+        mlen = sprintf(member,"player:%d",k);
+        p = lpFindMember(lp,member,mlen);
+        lp = lpDeleteRange(lp,2*k,2);
+        slen = d2string(score,sizeof(score),k*1.5);
+        p = lpIndex(lp,2*k);
+        if (p == NULL) {
+            lp = lpPush(lp,(unsigned char*)member,mlen,LP_TAIL);
+            lp = lpPush(lp,(unsigned char*)score,slen,LP_TAIL);
+        } else {
+            size_t off = p-lp;
+            lp = lpInsert(lp,p,(unsigned char*)score,slen);
+            lp = lpInsert(lp,lp+off,(unsigned char*)member,mlen);
+        }
+    }
+    t[6] = usec()-start;
+    start = usec();
+    for (j = 0; j < iterations; j++) {
+        k = rand()%num;
+        mlen = sprintf(member,"player:%d",k);
+        zp = zpDeleteRange(zp,zpFind(zp,(unsigned char*)member,mlen),1);
+        zp = zpInsert(zp,zpInsertRank(zp,k*1.5,(unsigned char*)member,mlen),
+                      (unsigned char*)member,mlen,k*1.5);
+    }
+    t[7] = usec()-start;
+
+    printf("%5d elements (listpack %zu bytes, zpack %zu bytes), usec/op listpack vs zpack:\n"
+           "      find member %7.3f %7.3f | score seek %7.3f %7.3f | "
+           "by rank %7.3f %7.3f | delete+insert %7.3f %7.3f\n",
+           num,lpBytes(lp),zpBytes(zp),
+           (double)t[0]/iterations,(double)t[1]/iterations,
+           (double)t[2]/iterations,(double)t[3]/iterations,
+           (double)t[4]/iterations,(double)t[5]/iterations,
+           (double)t[6]/iterations,(double)t[7]/iterations);
+    zfree(lp);
+    zfree(zp);
+}
+
+int main(int argc, char **argv) {
+    /* If an argument is given, use it as the random seed. */
+    srand(argc == 2 ? atoi(argv[1]) : time(NULL));
+
+    printf("Stress test: ");
+    fflush(stdout);
+    stressTest(20000);
+    printf("OK\n");
+
+    benchLookup(128,100000);
+    benchLookup(1024,20000);
+    benchLookup(4096,5000);
+    return 0;
+}
+#endif
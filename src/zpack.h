@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2014, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _ZPACK_H
+#define _ZPACK_H
+
+#include <stddef.h>
+
+/**
+ * zpack是小的sorted set所使用的紧凑编码。score和成员偏移量保存在定长的列中,
+ * 所以按rank取元素是O(1), 按score查找范围和按成员查找都是二分查找。
+ * rank从0开始, 按(score,成员)排序, 与skiplist的顺序一致。具体解释参照.c文件中的注释。
+ */
+
+//创建一个新的zpack
+unsigned char *zpNew(void);
+
+//返回zpack中元素个数
+unsigned long zpLength(unsigned char *zp);
+
+//返回zpack占用内存大小
+size_t zpBytes(unsigned char *zp);
+
+//取到rank处元素的score
+double zpGetScore(unsigned char *zp, unsigned long rank);
+
+//取到rank处元素的成员，长度保存在len中
+unsigned char *zpGetMember(unsigned char *zp, unsigned long rank, unsigned int *len);
+
+//在rank处插入新元素，调用者保证顺序正确
+unsigned char *zpInsert(unsigned char *zp, unsigned long rank, unsigned char *s, unsigned int len, double score);
+
+//删除rank处开始的num个元素
+unsigned char *zpDeleteRange(unsigned char *zp, unsigned long rank, unsigned long num);
+
+//按成员查找元素，返回rank, 找不到返回-1
+long zpFind(unsigned char *zp, unsigned char *s, unsigned int len);
+
+//第一个score大于等于score（exclusive为1时大于）的元素的rank
+unsigned long zpScoreRank(unsigned char *zp, double score, int exclusive);
+
+//新元素(score,s)应该插入的rank
+unsigned long zpInsertRank(unsigned char *zp, double score, unsigned char *s, unsigned int len);
+
+#endif /* _ZPACK_H */
@@ -134,10 +134,123 @@ tags {"aof"} {
         }
     }
 
+    ## Test arguments bigger than the loading buffer and many commands
+    set big [string repeat abcdefghij 300000]
+    create_aof {
+        append_to_aof [formatCommand set big $big]
+        for {set j 0} {$j < 10000} {incr j} {
+            append_to_aof [formatCommand rpush list $j]
+        }
+        append_to_aof [formatCommand append big end]
+    }
+
+    start_server_aof [list dir $server_path] {
+        test "AOF with big arguments: Dataset should be loaded" {
+            set client [redis [dict get $srv host] [dict get $srv port]]
+            assert_equal "${big}end" [$client get big]
+            assert_equal 10000 [$client llen list]
+            assert_equal 9999 [$client lindex list -1]
+        }
+
+        test "AOF with big arguments: Loading stats are reported" {
+            set client [redis [dict get $srv host] [dict get $srv port]]
+            set info [$client info persistence]
+            assert_match "*loading_last_duration_ms:*" $info
+            assert_match "*loading_last_rate_mbps:*" $info
+        }
+    }
+
     start_server {overrides {appendonly {yes} appendfilename {appendonly.aof}}} {
         test {Redis should not try to convert DEL into EXPIREAT for EXPIRE -1} {
             r set x 10
             r expire x -1
         }
     }
+
+    foreach fsync {everysec always} {
+        start_server [list overrides [list appendonly yes appendfilename appendonly.aof aof-threaded-write yes appendfsync $fsync]] {
+            test "AOF threaded write with appendfsync $fsync: reload preserves the dataset" {
+                for {set j 0} {$j < 1000} {incr j} {
+                    r set key:$j [randstring 0 64 alpha]
+                    r rpush list $j
+                }
+                set d1 [r debug digest]
+                r debug loadaof
+                set d2 [r debug digest]
+                assert_equal $d1 $d2
+                assert {[s aof_writer_batches] > 0}
+                assert_equal 0 [s aof_writer_pending_bytes]
+            }
+
+            test "AOF threaded write with appendfsync $fsync: rewrite switches file" {
+                r bgrewriteaof
+                waitForBgrewriteaof r
+                r set after-rewrite 1
+                set d1 [r debug digest]
+                r debug loadaof
+                assert_equal $d1 [r debug digest]
+            }
+        }
+    }
+
+    ## Test the multi part AOF tracked by a manifest
+    create_aof {
+        append_to_aof [formatCommand set foo hello]
+        append_to_aof [formatCommand rpush list a b c]
+    }
+
+    start_server_aof [list dir $server_path aof-use-manifest yes] {
+        set client [redis [dict get $srv host] [dict get $srv port]]
+
+        test "AOF manifest: a plain AOF is adopted as base file" {
+            assert_equal "hello" [$client get foo]
+            assert_equal 3 [$client llen list]
+            assert_equal "appendonly.aof" [status $client aof_manifest_base]
+            assert [file exists $server_path/appendonly.aof.manifest]
+            assert [file exists $server_path/appendonly.aof.1.incr.aof]
+        }
+
+        test "AOF manifest: rewrite produces a new base and drops old files" {
+            $client set bar world
+            $client bgrewriteaof
+            wait_for_condition 50 100 {
+                [status $client aof_rewrite_in_progress] eq 0
+            } else {
+                fail "AOF rewrite did not terminate"
+            }
+            $client set after-rewrite 1
+            assert_equal "appendonly.aof.2.base.aof" [status $client aof_manifest_base]
+            assert_equal 1 [status $client aof_manifest_incr_files]
+            wait_for_condition 50 100 {
+                ![file exists $server_path/appendonly.aof] &&
+                ![file exists $server_path/appendonly.aof.1.incr.aof]
+            } else {
+                fail "Old AOF files were not removed"
+            }
+            set d1 [$client debug digest]
+            $client debug loadaof
+            assert_equal $d1 [$client debug digest]
+        }
+
+        test "AOF manifest: redis-check-aof validates the whole set" {
+            set result [exec src/redis-check-aof $server_path/appendonly.aof.manifest]
+            assert_match "*AOF manifest is valid*" $result
+        }
+    }
+
+    start_server_aof [list dir $server_path aof-use-manifest yes] {
+        test "AOF manifest: base and incremental files are loaded at startup" {
+            set client [redis [dict get $srv host] [dict get $srv port]]
+            wait_for_condition 50 100 {
+                [catch {$client ping}] == 0
+            } else {
+                fail "Loading the AOF did not terminate"
+            }
+            assert_equal "hello" [$client get foo]
+            assert_equal "world" [$client get bar]
+            assert_equal 1 [$client get after-rewrite]
+            assert_equal 3 [$client llen list]
+        }
+    }
+    foreach f [glob -nocomplain $server_path/appendonly.aof*] {file delete $f}
 }
@@ -96,3 +96,113 @@ start_server_and_kill_it [list "dir" $server_path] {
         }
     }
 }
+
+set server_path [tmpdir "server.rdb-cow-test"]
+
+start_server [list overrides [list "dir" $server_path]] {
+    test {BGSAVE child reports its copy-on-write size} {
+        r debug populate 10000
+        r bgsave
+        waitForBgsave r
+        wait_for_condition 50 100 {
+            [s rdb_bgsave_in_progress] == 0 && [s rdb_last_cow_size] > 0
+        } else {
+            fail "The BGSAVE child did not report its COW size"
+        }
+        assert_equal 0 [s current_cow_size]
+    }
+
+    test {COW aware mode can be toggled at runtime} {
+        r config set cow-aware-child no
+        assert_equal {cow-aware-child no} [r config get cow-aware-child]
+        r bgsave
+        waitForBgsave r
+        r config set cow-aware-child yes
+        r debug reload
+        r dbsize
+    } {10000}
+}
+
+set server_path [tmpdir "server.rdb-forkless-test"]
+
+start_server [list overrides [list "dir" $server_path "save" "" "rdb-forkless-snapshot" "yes"]] {
+    test {Fork-less BGSAVE saves a point in time snapshot} {
+        r debug populate 200000
+        r set counter 0
+        r expire key:10 1000
+        set digest [r debug digest]
+        r bgsave
+        set j 0
+        while {[s rdb_bgsave_in_progress] && $j < 100000} {
+            for {set k 0} {$k < 20} {incr k; incr j} {
+                set key key:[randomInt 200000]
+                switch [randomInt 5] {
+                    0 {r del $key}
+                    1 {r append $key xyz}
+                    2 {r expire $key 100}
+                    3 {r set new:$j $j}
+                    4 {r incr counter}
+                }
+            }
+        }
+        waitForBgsave r
+        assert_equal ok [s rdb_last_bgsave_status]
+        assert {[s rdb_forkless_preimages] > 0}
+        assert_equal 0 [s rdb_forkless_pending_bytes]
+        # Load the snapshot in another server: the same dir can't be shared
+        # since it also holds the log file.
+        set load_path [tmpdir "server.rdb-forkless-load"]
+        file copy -force [file join $server_path dump.rdb] $load_path
+        start_server [list overrides [list "dir" $load_path]] {
+            assert_equal $digest [r debug digest]
+        }
+    }
+
+    test {Fork-less snapshot is aborted by FLUSHALL} {
+        r bgsave
+        r flushall
+        assert_equal 0 [s rdb_bgsave_in_progress]
+        r set foo bar
+        r bgsave
+        waitForBgsave r
+        r debug reload
+        r get foo
+    } {bar}
+}
+
+set server_path [tmpdir "server.rdb-lazy-test"]
+
+start_server [list overrides [list "dir" $server_path]] {
+    test {Lazily loaded RDB serves the same dataset} {
+        r debug populate 1000
+        r rpush mylist a b c
+        r sadd myset 1 2 3
+        r sadd mybigset foo bar
+        r zadd myzset 1 a 2 b
+        r hmset myhash f1 v1 f2 v2
+        r set mykey foo px 1000000
+        set digest [r debug digest]
+        r save
+        set load_path [tmpdir "server.rdb-lazy-load"]
+        file copy -force [file join $server_path dump.rdb] $load_path
+        start_server [list overrides [list "dir" $load_path "rdb-lazy-load" "yes"]] {
+            assert_equal 1006 [s rdb_lazy_keys]
+            assert_equal $digest [r debug digest]
+            assert_encoding lazy myzset
+            assert_equal {a 1 b 2} [r zrange myzset 0 -1 withscores]
+            assert_encoding zpack myzset
+            assert {[r pttl mykey] > 0}
+            assert_equal 1004 [s rdb_lazy_keys]
+            assert_equal 2 [s rdb_lazy_loaded]
+
+            # Values never accessed are saved from the mapped file.
+            r hset myhash f3 v3
+            set digest [r debug digest]
+            r bgsave
+            waitForBgsave r
+            r debug reload
+            assert_equal $digest [r debug digest]
+            assert_equal 0 [s rdb_lazy_keys]
+        }
+    }
+}
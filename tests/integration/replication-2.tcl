@@ -23,5 +23,21 @@ start_server {tags {"repl"}} {
             }
             assert_equal [r debug digest] [r -1 debug digest]
         }
+
+        test {Replication buffer memory is bounded by the backlog size} {
+            r config set repl-backlog-size 65536
+            set payload [string repeat x 1000]
+            for {set j 0} {$j < 2000} {incr j} {
+                r set key:$j $payload
+            }
+            wait_for_condition 50 100 {
+                [r debug digest] eq [r -1 debug digest]
+            } else {
+                fail "Slave not in sync with master"
+            }
+            assert {[s repl_backlog_histlen] >= 65536}
+            assert {[s repl_buffer_memory] < 65536*2}
+            assert {[s repl_buffer_blocks] > 1}
+        }
     }
 }
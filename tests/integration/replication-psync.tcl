@@ -103,3 +103,106 @@ test_psync {ok after delay} 3 100000000 3600 3 {
 test_psync {backlog expired} 3 100000000 1 3 {
     assert {[s -1 sync_partial_err] > 0}
 }
+
+start_server {tags {"repl"}} {
+    set master [srv 0 client]
+    set master_host [srv 0 host]
+    set master_port [srv 0 port]
+
+    start_server {} {
+        set slave [srv 0 client]
+
+        test {Slave restarted from its RDB can partially resync} {
+            $slave slaveof $master_host $master_port
+            wait_for_condition 50 100 {
+                [status $slave master_link_status] eq {up}
+            } else {
+                fail "Replication not started."
+            }
+            $master select 9
+            for {set j 0} {$j < 100} {incr j} {
+                $master set key:$j $j
+            }
+            wait_for_condition 50 100 {
+                [$master debug digest] eq [$slave debug digest]
+            } else {
+                fail "Slave not in sync with master"
+            }
+            $slave save
+
+            # Start a new slave from a copy of the RDB saved above: it
+            # should continue from the saved offset.
+            set load_path [tmpdir "server.repl-restart"]
+            file copy -force [file join [lindex [$slave config get dir] 1] \
+                dump.rdb] $load_path
+            set full_syncs [status $master sync_full]
+            start_server [list overrides [list dir $load_path \
+                slaveof "$master_host $master_port"]] {
+                set restarted [srv 0 client]
+                wait_for_condition 50 100 {
+                    [status $restarted master_link_status] eq {up}
+                } else {
+                    fail "Restarted slave did not connect"
+                }
+                for {set j 0} {$j < 100} {incr j} {
+                    $master incr key:$j
+                }
+                wait_for_condition 50 100 {
+                    [$master debug digest] eq [$restarted debug digest]
+                } else {
+                    fail "Restarted slave not in sync with master"
+                }
+                assert_equal $full_syncs [status $master sync_full]
+                assert {[status $master sync_partial_ok] >= 1}
+            }
+        }
+    }
+}
+
+start_server {tags {"repl"}} {
+    set master [srv 0 client]
+    set master_host [srv 0 host]
+    set master_port [srv 0 port]
+
+    start_server {} {
+        set slave [srv 0 client]
+
+        test {Partial resync served from the disk backlog} {
+            $master config set repl-backlog-size 16384
+            $master config set repl-backlog-disk-size 10000000
+            $slave slaveof $master_host $master_port
+            wait_for_condition 50 100 {
+                [status $slave master_link_status] eq {up}
+            } else {
+                fail "Replication not started."
+            }
+            set full_syncs [status $master sync_full]
+            set partial_syncs [status $master sync_partial_ok]
+
+            # Keep the slave disconnected while the master writes much
+            # more than the memory backlog can hold.
+            set rd [redis_deferring_client]
+            $rd multi
+            $rd client kill $master_host:$master_port
+            $rd debug sleep 2
+            $rd exec
+            after 200
+            set payload [string repeat x 1000]
+            for {set j 0} {$j < 500} {incr j} {
+                $master set key:$j $payload
+            }
+            for {set j 0} {$j < 4} {incr j} { $rd read }
+            $rd close
+
+            wait_for_condition 50 100 {
+                [$master debug digest] eq [$slave debug digest]
+            } else {
+                fail "Slave not in sync with master"
+            }
+            assert {[status $master repl_backlog_disk_histlen] > 0}
+            assert_equal $full_syncs [status $master sync_full]
+            assert_equal [expr {$partial_syncs+1}] \
+                [status $master sync_partial_ok]
+        }
+    }
+}
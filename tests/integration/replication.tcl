@@ -162,3 +162,35 @@ start_server {tags {"repl"}} {
         }
     }
 }
+
+start_server {tags {"repl"}} {
+    set master [srv 0 client]
+    set master_host [srv 0 host]
+    set master_port [srv 0 port]
+
+    start_server {} {
+        set slave [srv 0 client]
+
+        test {RDB transfer to slaves respects the rate limit} {
+            # Random data, so that the RDB file is not compressed.
+            set payload [randstring 1000 1000 alpha]
+            for {set j 0} {$j < 1000} {incr j} {
+                $master set key:$j $payload
+            }
+            $master config set repl-transfer-slave-rate-limit 400000
+            set start [clock milliseconds]
+            $slave slaveof $master_host $master_port
+            wait_for_condition 100 100 {
+                [status $slave master_link_status] eq {up}
+            } else {
+                fail "Replication not started."
+            }
+            set elapsed [expr {[clock milliseconds]-$start}]
+            set sent [status $master repl_transfer_bytes]
+            # About 1MB at 400k/sec can't take less than two seconds.
+            assert {$sent > 1000000}
+            assert {$elapsed >= $sent*1000/400000 - 500}
+            assert_equal [$master debug digest] [$slave debug digest]
+        }
+    }
+}
@@ -15,10 +15,10 @@ start_server {tags {"aofrw"}} {
     }
 
     foreach d {string int} {
-        foreach e {ziplist linkedlist} {
+        foreach e {listpack linkedlist} {
             test "AOF rewrite of list with $e encoding, $d data" {
                 r flushall
-                if {$e eq {ziplist}} {set len 10} else {set len 1000}
+                if {$e eq {listpack}} {set len 10} else {set len 1000}
                 for {set j 0} {$j < $len} {incr j} {
                     if {$d eq {string}} {
                         set data [randstring 0 16 alpha]
@@ -41,10 +41,13 @@ start_server {tags {"aofrw"}} {
     }
 
     foreach d {string int} {
-        foreach e {intset hashtable} {
+        foreach e {intset listpack hashtable roaring} {
             test "AOF rewrite of set with $e encoding, $d data" {
                 r flushall
-                if {$e eq {intset}} {set len 10} else {set len 1000}
+                if {$e eq {roaring}} {
+                    r config set set-large-int-encoding roaring
+                }
+                if {$e eq {intset} || $e eq {listpack}} {set len 10} else {set len 1000}
                 for {set j 0} {$j < $len} {incr j} {
                     if {$d eq {string}} {
                         set data [randstring 0 16 alpha]
@@ -53,7 +56,9 @@ start_server {tags {"aofrw"}} {
                     }
                     r sadd key $data
                 }
-                if {$d ne {string}} {
+                # Listpack sets of integers need at least one string.
+                if {$e eq {listpack}} {r sadd key foo}
+                if {$d ne {string} || $e eq {listpack}} {
                     assert_equal [r object encoding key] $e
                 }
                 set d1 [r debug digest]
@@ -64,15 +69,16 @@ start_server {tags {"aofrw"}} {
                 if {$d1 ne $d2} {
                     error "assertion:$d1 is not equal to $d2"
                 }
+                r config set set-large-int-encoding hashtable
             }
         }
     }
 
     foreach d {string int} {
-        foreach e {ziplist hashtable} {
+        foreach e {listpack hashtable} {
             test "AOF rewrite of hash with $e encoding, $d data" {
                 r flushall
-                if {$e eq {ziplist}} {set len 10} else {set len 1000}
+                if {$e eq {listpack}} {set len 10} else {set len 1000}
                 for {set j 0} {$j < $len} {incr j} {
                     if {$d eq {string}} {
                         set data [randstring 0 16 alpha]
@@ -95,10 +101,10 @@ start_server {tags {"aofrw"}} {
     }
 
     foreach d {string int} {
-        foreach e {ziplist skiplist} {
+        foreach e {zpack skiplist} {
             test "AOF rewrite of zset with $e encoding, $d data" {
                 r flushall
-                if {$e eq {ziplist}} {set len 10} else {set len 1000}
+                if {$e eq {zpack}} {set len 10} else {set len 1000}
                 for {set j 0} {$j < $len} {incr j} {
                     if {$d eq {string}} {
                         set data [randstring 0 16 alpha]
@@ -30,3 +30,24 @@ start_server {tags {"memefficiency"}} {
         }
     }
 }
+
+start_server {tags {"memefficiency"}} {
+    proc sdslen_field {key field} {
+        set info [r debug sdslen $key]
+        regexp "$field:(\[0-9\]+)" $info - value
+        return $value
+    }
+
+    test "Appended strings use the allocator slack as free space" {
+        r del foo
+        for {set j 0} {$j < 1000} {incr j} {
+            r append foo [string repeat x 10]
+        }
+        set len [sdslen_field foo val_sds_len]
+        set avail [sdslen_field foo val_sds_avail]
+        set alloc [sdslen_field foo val_zmalloc]
+        assert_equal 10000 $len
+        # Only the header and the null terminator are left unused.
+        assert {$alloc-$len-$avail <= 10}
+    }
+}
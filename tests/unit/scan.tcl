@@ -53,7 +53,7 @@ start_server {tags {"scan"}} {
         assert_equal 100 [llength $keys]
     }
 
-    foreach enc {intset hashtable} {
+    foreach enc {intset listpack hashtable} {
         test "SSCAN with encoding $enc" {
             # Create the Set
             r del set
@@ -62,8 +62,13 @@ start_server {tags {"scan"}} {
             } else {
                 set prefix "ele:"
             }
+            if {$enc eq {hashtable}} {
+                set count 200
+            } else {
+                set count 100
+            }
             set elements {}
-            for {set j 0} {$j < 100} {incr j} {
+            for {set j 0} {$j < $count} {incr j} {
                 lappend elements ${prefix}${j}
             }
             r sadd set {*}$elements
@@ -83,15 +88,77 @@ start_server {tags {"scan"}} {
             }
 
             set keys [lsort -unique $keys]
-            assert_equal 100 [llength $keys]
+            assert_equal $count [llength $keys]
+        }
+    }
+
+    test "SSCAN with encoding roaring" {
+        r config set set-large-int-encoding roaring
+        r del set
+        # Dense and sparse chunks, negative and extreme values.
+        set elements {-9223372036854775808 -70000 -1 9223372036854775807}
+        for {set j 0} {$j < 5000} {incr j} {
+            lappend elements $j [expr {$j*1000003}]
+        }
+        r sadd set {*}$elements
+        assert_encoding roaring set
+
+        set cur 0
+        set keys {}
+        while 1 {
+            set res [r sscan set $cur count 100]
+            set cur [lindex $res 0]
+            set k [lindex $res 1]
+            assert {[llength $k] <= 100}
+            lappend keys {*}$k
+            if {$cur == 0} break
         }
+
+        # Roarings are scanned in order, every element is returned once.
+        assert_equal [lsort -integer -unique $elements] $keys
+        r config set set-large-int-encoding hashtable
+    }
+
+    test "SSCAN of a roaring with cursors wider than 32 bits" {
+        r config set set-large-int-encoding roaring
+        r del set
+        # The low 32 bits of every element are zero.
+        set elements {}
+        for {set j 1} {$j <= 600} {incr j} {
+            lappend elements [expr {$j*4294967296}]
+        }
+        r sadd set {*}$elements
+        assert_encoding roaring set
+
+        set cur 0
+        set keys {}
+        while 1 {
+            set res [r sscan set $cur count 50]
+            set cur [lindex $res 0]
+            if {$cur != 0} {assert {$cur > 4294967295}}
+            lappend keys {*}[lindex $res 1]
+            if {$cur == 0} break
+        }
+        assert_equal [lsort -integer $elements] $keys
+        r config set set-large-int-encoding hashtable
+    }
+
+    test "SSCAN of a roaring with MATCH" {
+        r config set set-large-int-encoding roaring
+        r del set
+        for {set j 0} {$j < 1000} {incr j} { r sadd set $j }
+        assert_encoding roaring set
+        set res [r sscan set 0 count 1000 match 99*]
+        assert_equal 0 [lindex $res 0]
+        assert_equal {99 990 991 992 993 994 995 996 997 998 999} [lindex $res 1]
+        r config set set-large-int-encoding hashtable
     }
 
-    foreach enc {ziplist hashtable} {
+    foreach enc {listpack hashtable} {
         test "HSCAN with encoding $enc" {
             # Create the Hash
             r del hash
-            if {$enc eq {ziplist}} {
+            if {$enc eq {listpack}} {
                 set count 30
             } else {
                 set count 1000
@@ -127,11 +194,11 @@ start_server {tags {"scan"}} {
         }
     }
 
-    foreach enc {ziplist skiplist} {
+    foreach enc {zpack skiplist} {
         test "ZSCAN with encoding $enc" {
             # Create the Sorted Set
             r del zset
-            if {$enc eq {ziplist}} {
+            if {$enc eq {zpack}} {
                 set count 30
             } else {
                 set count 1000
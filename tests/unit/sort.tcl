@@ -36,7 +36,7 @@ start_server {
     }
 
     foreach {num cmd enc title} {
-        16 lpush ziplist "Ziplist"
+        16 lpush listpack "Listpack"
         1000 lpush linkedlist "Linked list"
         10000 lpush linkedlist "Big Linked list"
         16 sadd intset "Intset"
@@ -85,14 +85,14 @@ start_server {
         r sort tosort BY weight_* store sort-res
         assert_equal $result [r lrange sort-res 0 -1]
         assert_equal 16 [r llen sort-res]
-        assert_encoding ziplist sort-res
+        assert_encoding listpack sort-res
     }
 
     test "SORT BY hash field STORE" {
         r sort tosort BY wobj_*->weight store sort-res
         assert_equal $result [r lrange sort-res 0 -1]
         assert_equal 16 [r llen sort-res]
-        assert_encoding ziplist sort-res
+        assert_encoding listpack sort-res
     }
 
     test "SORT DESC" {
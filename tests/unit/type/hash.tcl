@@ -14,8 +14,8 @@ start_server {tags {"hash"}} {
         list [r hlen smallhash]
     } {8}
 
-    test {Is the small hash encoded with a ziplist?} {
-        assert_encoding ziplist smallhash
+    test {Is the small hash encoded with a listpack?} {
+        assert_encoding listpack smallhash
     }
 
     test {HSET/HLEN - Big hash creation} {
@@ -33,7 +33,7 @@ start_server {tags {"hash"}} {
         list [r hlen bighash]
     } {1024}
 
-    test {Is the big hash encoded with a ziplist?} {
+    test {Is the big hash encoded with a listpack?} {
         assert_encoding hashtable bighash
     }
 
@@ -252,7 +252,7 @@ start_server {tags {"hash"}} {
         lappend rv [r hexists bighash nokey]
     } {1 0 1 0}
 
-    test {Is a ziplist encoded Hash promoted on big payload?} {
+    test {Is a listpack encoded Hash promoted on big payload?} {
         r hset smallhash foo [string repeat a 1024]
         r debug object smallhash
     } {*hashtable*}
@@ -390,7 +390,7 @@ start_server {tags {"hash"}} {
         lappend rv [string match "ERR*not*float*" $bigerr]
     } {1 1}
 
-    test {Hash ziplist regression test for large keys} {
+    test {Hash listpack regression test for large keys} {
         r hset hash kkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkk a
         r hset hash kkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkk b
         r hget hash kkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkk
@@ -457,7 +457,62 @@ start_server {tags {"hash"}} {
         }
     }
 
-    test {Stress test the hash ziplist -> hashtable encoding conversion} {
+    test {Hash shrinking below half the listpack limit is converted back} {
+        r config set hash-max-ziplist-entries 16
+        r del myhash
+        for {set i 0} {$i < 20} {incr i} {
+            r hset myhash field$i $i
+        }
+        assert_encoding hashtable myhash
+        # Still above half the limit: no conversion.
+        for {set i 0} {$i < 10} {incr i} {
+            r hdel myhash field$i
+        }
+        assert_encoding hashtable myhash
+        r hdel myhash field10 field11
+        assert_encoding listpack myhash
+        assert_equal {12 13 14 15 16 17 18 19} [lsort -integer [r hvals myhash]]
+        r config set hash-max-ziplist-entries 512
+    }
+
+    test {Hash with big values is not converted back} {
+        r config set encoding-downgrade yes
+        r del myhash
+        r hmset myhash a 1 b [string repeat x 100]
+        assert_encoding hashtable myhash
+        r hdel myhash a
+        assert_encoding hashtable myhash
+        r hset myhash c 1
+        assert_encoding hashtable myhash
+        r debug reencode
+        assert_encoding hashtable myhash
+        r hget myhash c
+    } {1}
+
+    test {Hash is converted back when the big value is deleted} {
+        r del myhash
+        r hmset myhash a 1 b 2 c 3
+        r hset myhash big [string repeat x 100]
+        assert_encoding hashtable myhash
+        r hdel myhash big
+        assert_encoding listpack myhash
+        lsort [r hkeys myhash]
+    } {a b c}
+
+    test {Hash is converted back when the big value is overwritten} {
+        r del myhash
+        r hmset myhash a 1 big [string repeat x 100]
+        assert_encoding hashtable myhash
+        r hset myhash big 2
+        assert_encoding listpack myhash
+        r hmset myhash big [string repeat x 100]
+        assert_encoding hashtable myhash
+        r hmset myhash a 3 big 4
+        assert_encoding listpack myhash
+        list [r hget myhash a] [r hget myhash big]
+    } {3 4}
+
+    test {Stress test the hash listpack -> hashtable encoding conversion} {
         r config set hash-max-ziplist-entries 32
         for {set j 0} {$j < 100} {incr j} {
             r del myhash
@@ -7,7 +7,7 @@ start_server {
 } {
     source "tests/unit/type/list-common.tcl"
 
-    test {LPUSH, RPUSH, LLENGTH, LINDEX, LPOP - ziplist} {
+    test {LPUSH, RPUSH, LLENGTH, LINDEX, LPOP - listpack} {
         # first lpush then rpush
         assert_equal 1 [r lpush myziplist1 a]
         assert_equal 2 [r rpush myziplist1 b]
@@ -19,7 +19,7 @@ start_server {
         assert_equal {} [r lindex myziplist2 3]
         assert_equal c [r rpop myziplist1]
         assert_equal a [r lpop myziplist1]
-        assert_encoding ziplist myziplist1
+        assert_encoding listpack myziplist1
 
         # first rpush then lpush
         assert_equal 1 [r rpush myziplist2 a]
@@ -32,7 +32,7 @@ start_server {
         assert_equal {} [r lindex myziplist2 3]
         assert_equal a [r rpop myziplist2]
         assert_equal c [r lpop myziplist2]
-        assert_encoding ziplist myziplist2
+        assert_encoding listpack myziplist2
     }
 
     test {LPUSH, RPUSH, LLENGTH, LINDEX, LPOP - regular list} {
@@ -74,7 +74,7 @@ start_server {
         assert_equal {d c b a 0 1 2 3} [r lrange mylist 0 -1]
     }
 
-    test {DEL a list - ziplist} {
+    test {DEL a list - listpack} {
         assert_equal 1 [r del myziplist2]
         assert_equal 0 [r exists myziplist2]
         assert_equal 0 [r llen myziplist2]
@@ -86,10 +86,10 @@ start_server {
         assert_equal 0 [r llen mylist2]
     }
 
-    proc create_ziplist {key entries} {
+    proc create_listpack {key entries} {
         r del $key
         foreach entry $entries { r rpush $key $entry }
-        assert_encoding ziplist $key
+        assert_encoding listpack $key
     }
 
     proc create_linkedlist {key entries} {
@@ -524,55 +524,55 @@ start_server {
         set e
     } {*ERR*syntax*error*}
 
-    test {LPUSHX, RPUSHX convert from ziplist to list} {
+    test {LPUSHX, RPUSHX convert from listpack to list} {
         set large $largevalue(linkedlist)
 
         # convert when a large value is pushed
-        create_ziplist xlist a
+        create_listpack xlist a
         assert_equal 2 [r rpushx xlist $large]
         assert_encoding linkedlist xlist
-        create_ziplist xlist a
+        create_listpack xlist a
         assert_equal 2 [r lpushx xlist $large]
         assert_encoding linkedlist xlist
 
         # convert when the length threshold is exceeded
-        create_ziplist xlist [lrepeat 256 a]
+        create_listpack xlist [lrepeat 256 a]
         assert_equal 257 [r rpushx xlist b]
         assert_encoding linkedlist xlist
-        create_ziplist xlist [lrepeat 256 a]
+        create_listpack xlist [lrepeat 256 a]
         assert_equal 257 [r lpushx xlist b]
         assert_encoding linkedlist xlist
     }
 
-    test {LINSERT convert from ziplist to list} {
+    test {LINSERT convert from listpack to list} {
         set large $largevalue(linkedlist)
 
         # convert when a large value is inserted
-        create_ziplist xlist a
+        create_listpack xlist a
         assert_equal 2 [r linsert xlist before a $large]
         assert_encoding linkedlist xlist
-        create_ziplist xlist a
+        create_listpack xlist a
         assert_equal 2 [r linsert xlist after a $large]
         assert_encoding linkedlist xlist
 
         # convert when the length threshold is exceeded
-        create_ziplist xlist [lrepeat 256 a]
+        create_listpack xlist [lrepeat 256 a]
         assert_equal 257 [r linsert xlist before a a]
         assert_encoding linkedlist xlist
-        create_ziplist xlist [lrepeat 256 a]
+        create_listpack xlist [lrepeat 256 a]
         assert_equal 257 [r linsert xlist after a a]
         assert_encoding linkedlist xlist
 
         # don't convert when the value could not be inserted
-        create_ziplist xlist [lrepeat 256 a]
+        create_listpack xlist [lrepeat 256 a]
         assert_equal -1 [r linsert xlist before foo a]
-        assert_encoding ziplist xlist
-        create_ziplist xlist [lrepeat 256 a]
+        assert_encoding listpack xlist
+        create_listpack xlist [lrepeat 256 a]
         assert_equal -1 [r linsert xlist after foo a]
-        assert_encoding ziplist xlist
+        assert_encoding listpack xlist
     }
 
-    foreach {type num} {ziplist 250 linkedlist 500} {
+    foreach {type num} {listpack 250 linkedlist 500} {
         proc check_numbered_list_consistency {key} {
             set len [r llen $key]
             for {set i 0} {$i < $len} {incr i} {
@@ -646,7 +646,7 @@ start_server {
             assert_equal c [r rpoplpush mylist1 mylist2]
             assert_equal "a $large" [r lrange mylist1 0 -1]
             assert_equal "c d" [r lrange mylist2 0 -1]
-            assert_encoding ziplist mylist2
+            assert_encoding listpack mylist2
         }
 
         test "RPOPLPUSH with the same list as src and dst - $type" {
@@ -690,7 +690,7 @@ start_server {
     }
 
     test {RPOPLPUSH against non list dst key} {
-        create_ziplist srclist {a b c d}
+        create_listpack srclist {a b c d}
         r set dstlist x
         assert_error WRONGTYPE* {r rpoplpush srclist dstlist}
         assert_type string dstlist
@@ -722,7 +722,7 @@ start_server {
         assert_error WRONGTYPE* {r rpop notalist}
     }
 
-    foreach {type num} {ziplist 250 linkedlist 500} {
+    foreach {type num} {listpack 250 linkedlist 500} {
         test "Mass RPOP/LPOP - $type" {
             r del mylist
             set sum1 0
@@ -857,6 +857,53 @@ start_server {
         }
     }
 
+    test {Linked list shrinking below half the listpack limit is converted back} {
+        create_linkedlist xlist [lrepeat 300 a]
+        r ltrim xlist 0 199
+        assert_encoding linkedlist xlist
+        r ltrim xlist 0 127
+        assert_encoding listpack xlist
+        assert_equal 128 [r llen xlist]
+
+        # Values too long for a listpack prevent the conversion.
+        create_linkedlist xlist [concat [lrepeat 200 a] $largevalue(linkedlist)]
+        r ltrim xlist 1 -1
+        assert_encoding linkedlist xlist
+        r ltrim xlist 100 -1
+        assert_encoding linkedlist xlist
+    }
+
+    test {Removing the long value converts a small list back} {
+        # The conversion attempted when the list crossed the threshold
+        # failed, removing short values does not attempt it again.
+        create_linkedlist xlist [concat $largevalue(linkedlist) [lrepeat 200 a]]
+        r ltrim xlist 0 99
+        assert_encoding linkedlist xlist
+        r rpop xlist
+        assert_encoding linkedlist xlist
+        r lpop xlist
+        assert_encoding listpack xlist
+        r llen xlist
+    } {98}
+
+    test {Overwriting the long value converts a small list back} {
+        create_linkedlist xlist [list a $largevalue(linkedlist) c]
+        r lset xlist 1 b
+        assert_encoding listpack xlist
+        r lrange xlist 0 -1
+    } {a b c}
+
+    test {No conversion back when encoding-downgrade is disabled} {
+        r config set encoding-downgrade no
+        create_linkedlist xlist [lrepeat 300 a]
+        r ltrim xlist 0 9
+        assert_encoding linkedlist xlist
+        r config set encoding-downgrade yes
+        assert {[r debug reencode] >= 1}
+        assert_encoding listpack xlist
+        r lrange xlist 0 -1
+    } [lrepeat 10 a]
+
     test "Regression for bug 593 - chaining BRPOPLPUSH with other blocking cmds" {
         set rd1 [redis_deferring_client]
         set rd2 [redis_deferring_client]
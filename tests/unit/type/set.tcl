@@ -2,6 +2,8 @@ start_server {
     tags {"set"}
     overrides {
         "set-max-intset-entries" 512
+        "set-max-listpack-entries" 128
+        "set-max-listpack-value" 32
     }
 } {
     proc create_set {key entries} {
@@ -9,16 +11,42 @@ start_server {
         foreach entry $entries { r sadd $key $entry }
     }
 
-    test {SADD, SCARD, SISMEMBER, SMEMBERS basics - regular set} {
-        create_set myset {foo}
-        assert_encoding hashtable myset
-        assert_equal 1 [r sadd myset bar]
-        assert_equal 0 [r sadd myset bar]
-        assert_equal 2 [r scard myset]
-        assert_equal 1 [r sismember myset foo]
-        assert_equal 1 [r sismember myset bar]
-        assert_equal 0 [r sismember myset bla]
-        assert_equal {bar foo} [lsort [r smembers myset]]
+    # Sets of strings below the limits are encoded as listpacks, setting the
+    # limit to zero forces small sets to use a hash table.
+    proc use_listpack {type} {
+        if {$type eq {hashtable}} {
+            r config set set-max-listpack-entries 0
+        } else {
+            r config set set-max-listpack-entries 128
+        }
+    }
+
+    # Integer sets bigger than set-max-intset-entries are encoded as roarings
+    # when enabled, lowering the limit to 1 makes small sets roarings too.
+    proc use_roaring {type} {
+        if {$type eq {roaring}} {
+            r config set set-max-intset-entries 1
+            r config set set-large-int-encoding roaring
+        } else {
+            r config set set-max-intset-entries 512
+            r config set set-large-int-encoding hashtable
+        }
+    }
+
+    foreach {type} {listpack hashtable} {
+        test "SADD, SCARD, SISMEMBER, SMEMBERS basics - $type" {
+            use_listpack $type
+            create_set myset {foo}
+            assert_encoding $type myset
+            assert_equal 1 [r sadd myset bar]
+            assert_equal 0 [r sadd myset bar]
+            assert_equal 2 [r scard myset]
+            assert_equal 1 [r sismember myset foo]
+            assert_equal 1 [r sismember myset bar]
+            assert_equal 0 [r sismember myset bla]
+            assert_equal {bar foo} [lsort [r smembers myset]]
+            use_listpack listpack
+        }
     }
 
     test {SADD, SCARD, SISMEMBER, SMEMBERS basics - intset} {
@@ -42,15 +70,61 @@ start_server {
         create_set myset {1 2 3}
         assert_encoding intset myset
         assert_equal 1 [r sadd myset a]
+        assert_encoding listpack myset
+        assert_equal 0 [r sadd myset 2]
+        assert_equal {1 2 3 a} [lsort [r smembers myset]]
+    }
+
+    test "SADD a non-integer against a large intset" {
+        r del myset
+        for {set i 0} {$i < 200} {incr i} { r sadd myset $i }
+        assert_encoding intset myset
+        assert_equal 1 [r sadd myset a]
         assert_encoding hashtable myset
+        assert_equal 201 [r scard myset]
     }
 
     test "SADD an integer larger than 64 bits" {
         create_set myset {213244124402402314402033402}
-        assert_encoding hashtable myset
+        assert_encoding listpack myset
         assert_equal 1 [r sismember myset 213244124402402314402033402]
     }
 
+    test "SADD overflows the maximum allowed elements in a listpack" {
+        r del myset
+        for {set i 0} {$i < 128} {incr i} { r sadd myset "e$i" }
+        assert_encoding listpack myset
+        assert_equal 1 [r sadd myset e128]
+        assert_encoding hashtable myset
+        assert_equal 129 [r scard myset]
+    }
+
+    test "SADD of a value too long for a listpack" {
+        create_set myset {a b c}
+        assert_encoding listpack myset
+        set long [string repeat x 33]
+        assert_equal 1 [r sadd myset $long]
+        assert_encoding hashtable myset
+        assert_equal 1 [r sismember myset $long]
+        create_set myset [list $long]
+        assert_encoding hashtable myset
+    }
+
+    test "Listpack sets with integer and string elements" {
+        create_set myset {a 1 -5 9223372036854775807 0x10}
+        assert_encoding listpack myset
+        assert_equal 0 [r sadd myset 1 -5 a]
+        assert_equal 1 [r sismember myset 9223372036854775807]
+        assert_equal 1 [r sismember myset 0x10]
+        assert_equal 0 [r sismember myset 16]
+        assert_equal 1 [r srem myset -5 2]
+        assert_equal [lsort {a 1 9223372036854775807 0x10}] [lsort [r smembers myset]]
+        create_set myset2 {1 2 3}
+        assert_equal {1} [r sinter myset myset2]
+        assert_equal {1} [r sinter myset2 myset]
+        assert_equal {0x10 9223372036854775807 a} [lsort [r sdiff myset myset2]]
+    }
+
     test "SADD overflows the maximum allowed integers in an intset" {
         r del myset
         for {set i 0} {$i < 512} {incr i} { r sadd myset $i }
@@ -59,6 +133,138 @@ start_server {
         assert_encoding hashtable myset
     }
 
+    test "SADD overflows an intset into a roaring" {
+        r config set set-large-int-encoding roaring
+        r del myset
+        for {set i 0} {$i < 512} {incr i} { r sadd myset $i }
+        assert_encoding intset myset
+        assert_equal 1 [r sadd myset 100000]
+        assert_encoding roaring myset
+        assert_equal 513 [r scard myset]
+        assert_equal 0 [r sadd myset 100000]
+        assert_equal 1 [r sismember myset 100000]
+        assert_equal 1 [r sismember myset 511]
+        assert_equal 0 [r sismember myset 512]
+        assert_equal 0 [r sismember myset foo]
+        assert_equal 1 [r srem myset 0 foo 512]
+        assert_equal 512 [r scard myset]
+        r config set set-large-int-encoding hashtable
+    }
+
+    test "SADD a non-integer against a roaring" {
+        use_roaring roaring
+        create_set myset {1 2 3}
+        assert_encoding roaring myset
+        assert_equal 1 [r sadd myset a]
+        assert_encoding hashtable myset
+        assert_equal {1 2 3 a} [lsort [r smembers myset]]
+        use_roaring intset
+    }
+
+    test "Roarings with dense and sparse chunks" {
+        r config set set-large-int-encoding roaring
+        r del myset
+        set members {-9223372036854775808 -65537 -65536 -1 9223372036854775807}
+        for {set i 0} {$i < 6000} {incr i} {
+            lappend members $i [expr {$i*65536+7}]
+        }
+        r sadd myset {*}$members
+        assert_encoding roaring myset
+        set members [lsort -integer -unique $members]
+        assert_equal [llength $members] [r scard myset]
+        assert_equal $members [lsort -integer [r smembers myset]]
+        foreach e {-9223372036854775808 -65537 -1 9223372036854775807 5999} {
+            assert_equal 1 [r sismember myset $e]
+        }
+        assert_equal 0 [r sismember myset 6000]
+        assert_equal 0 [r sismember myset -2]
+
+        # Shrink the dense chunk below half of the array limit and back.
+        for {set i 0} {$i < 4000} {incr i} { r srem myset $i }
+        assert_equal [expr {[llength $members]-4000}] [r scard myset]
+        assert_equal 0 [r sismember myset 3999]
+        assert_equal 1 [r sismember myset 4000]
+        for {set i 0} {$i < 4000} {incr i} { r sadd myset $i }
+        assert_equal $members [lsort -integer [r smembers myset]]
+
+        set digest [r debug digest]
+        r debug reload
+        assert_encoding roaring myset
+        assert_equal $digest [r debug digest]
+        r config set set-large-int-encoding hashtable
+    }
+
+    test "Roarings are loaded as regular sets when disabled" {
+        r config set set-large-int-encoding roaring
+        r del myset
+        for {set i 0} {$i < 1000} {incr i} { r sadd myset $i }
+        assert_encoding roaring myset
+        r config set set-large-int-encoding hashtable
+        r debug reload
+        assert_encoding hashtable myset
+        assert_equal 1000 [r scard myset]
+        r config set set-large-int-encoding roaring
+        r debug reload
+        assert_encoding roaring myset
+        assert_equal 1000 [r scard myset]
+        r config set set-large-int-encoding hashtable
+    }
+
+    test "SINTER and SUNION of roarings and intsets" {
+        r config set set-large-int-encoding roaring
+        r del r1 r2 i1 res
+        for {set i 0} {$i < 3000} {incr i} {
+            r sadd r1 [expr {$i*3}]
+            r sadd r2 [expr {$i*5}]
+        }
+        r sadd i1 0 15 30 31 -1
+        assert_encoding roaring r1
+        assert_encoding roaring r2
+        assert_encoding intset i1
+        assert_equal {0 15 30} [lsort -integer [r sinter r1 r2 i1]]
+        assert_equal 3 [r sinterstore res r1 i1 r2]
+        assert_encoding intset res
+        assert_equal 600 [r sinterstore res r1 r2]
+        assert_encoding roaring res
+        assert_equal 600 [r scard res]
+        assert_equal [expr {3000+3000-600+2}] [r sunionstore res r1 nokey i1 r2]
+        assert_encoding roaring res
+        assert_equal 1 [r sismember res 31]
+        assert_equal 1 [r sismember res -1]
+        assert_equal 2400 [llength [r sdiff r1 r2 i1]]
+        r config set set-large-int-encoding hashtable
+    }
+
+    foreach {type} {hashtable roaring} {
+        test "Integer $type shrinking below half the limit becomes an intset" {
+            r config set set-max-intset-entries 64
+            r config set set-large-int-encoding $type
+            r del myset
+            for {set i 0} {$i < 100} {incr i} { r sadd myset $i }
+            assert_encoding $type myset
+            for {set i 0} {$i < 60} {incr i} { r srem myset $i }
+            assert_encoding $type myset
+            r srem myset 60 61 62 63 64 65 66 67
+            assert_encoding intset myset
+            assert_equal 32 [r scard myset]
+            assert_equal 68 [lindex [lsort -integer [r smembers myset]] 0]
+            r config set set-max-intset-entries 512
+            r config set set-large-int-encoding hashtable
+        }
+    }
+
+    test "Set of strings shrinking below half the limit becomes a listpack" {
+        create_set myset {}
+        for {set i 0} {$i < 200} {incr i} { r sadd myset "e$i" }
+        assert_encoding hashtable myset
+        r spop myset
+        while {[r scard myset] > 64} { r spop myset }
+        assert_encoding listpack myset
+        r smove myset otherset [lindex [r smembers myset] 0]
+        assert_encoding listpack myset
+        assert_equal 63 [r scard myset]
+    }
+
     test {Variadic SADD} {
         r del myset
         assert_equal 3 [r sadd myset a b c]
@@ -67,23 +273,28 @@ start_server {
     }
 
     test "Set encoding after DEBUG RELOAD" {
-        r del myintset myhashset mylargeintset
+        r del myintset myhashset mylargeintset mylistpackset
         for {set i 0} {$i <  100} {incr i} { r sadd myintset $i }
         for {set i 0} {$i < 1280} {incr i} { r sadd mylargeintset $i }
         for {set i 0} {$i <  256} {incr i} { r sadd myhashset [format "i%03d" $i] }
+        for {set i 0} {$i <   50} {incr i} { r sadd mylistpackset [format "i%03d" $i] $i }
         assert_encoding intset myintset
         assert_encoding hashtable mylargeintset
         assert_encoding hashtable myhashset
+        assert_encoding listpack mylistpackset
+        set digest [r debug digest]
 
         r debug reload
         assert_encoding intset myintset
         assert_encoding hashtable mylargeintset
         assert_encoding hashtable myhashset
+        assert_encoding listpack mylistpackset
+        assert_equal $digest [r debug digest]
     }
 
-    test {SREM basics - regular set} {
+    test {SREM basics - listpack} {
         create_set myset {foo bar ciao}
-        assert_encoding hashtable myset
+        assert_encoding listpack myset
         assert_equal 0 [r srem myset qux]
         assert_equal 1 [r srem myset foo]
         assert_equal {bar ciao} [lsort [r smembers myset]]
@@ -111,7 +322,15 @@ start_server {
         r srem myset 1 2 3 4 5 6 7 8
     } {3}
 
-    foreach {type} {hashtable intset} {
+    foreach {type} {hashtable intset listpack roaring} {
+        # The generated sets have about 200 elements, raise the limit so that
+        # they can be encoded as listpacks.
+        if {$type eq {listpack}} {
+            r config set set-max-listpack-entries 512
+        } else {
+            use_listpack $type
+        }
+        use_roaring $type
         for {set i 1} {$i <= 5} {incr i} {
             r del [format "set%d" $i]
         }
@@ -132,7 +351,7 @@ start_server {
         # while the tests are running -- an extra element is added to every
         # set that determines its encoding.
         set large 200
-        if {$type eq "hashtable"} {
+        if {$type ne "intset" && $type ne "roaring"} {
             set large foo
         }
 
@@ -205,6 +424,9 @@ start_server {
             }
             assert_equal {1 2 3 4} [lsort [r smembers setres]]
         }
+
+        use_listpack listpack
+        use_roaring intset
     }
 
     test "SDIFF with first set empty" {
@@ -269,10 +491,39 @@ start_server {
         r sadd set2 1 2 3 a
         r srem set2 a
         assert_encoding intset set1
-        assert_encoding hashtable set2
+        assert_encoding listpack set2
         lsort [r sinter set1 set2]
     } {1 2 3}
 
+    test "SINTER of intsets with different sizes and encodings" {
+        r del set1 set2 set3
+        set range {100 100000 10000000000}
+        for {set i 0} {$i < 3} {incr i} {
+            # Elements of the three encodings, and both signs.
+            set max [lindex $range $i]
+            for {set j 0} {$j < [expr {10*($i+1)*($i+1)}]} {incr j} {
+                set ele [expr {[randomInt $max]*([randomInt 2] ? 1 : -1)}]
+                r sadd set1 $ele
+                r sadd set2 $ele
+                r sadd set3 $ele
+            }
+        }
+        for {set j 0} {$j < 300} {incr j} {
+            r sadd set2 [expr {[randomInt 100000]-50000}]
+            r sadd set3 [randomInt 100]
+        }
+        assert_encoding intset set1
+        assert_encoding intset set2
+        assert_encoding intset set3
+        set expected [lsort -integer [r smembers set1]]
+        assert_equal $expected [lsort -integer [r sinter set1 set2 set3]]
+        assert_equal $expected [lsort -integer [r sinter set3 set1 set2 set1]]
+        assert_equal [llength $expected] [r sinterstore setres set2 set3 set1]
+        assert_encoding intset setres
+        assert_equal $expected [lsort -integer [r smembers setres]]
+        assert_equal {} [r sinter set1 set2 set3 noset]
+    }
+
     test "SINTERSTORE against non existing keys should delete dstkey" {
         r set setres xxx
         assert_equal 0 [r sinterstore setres foo111 bar222]
@@ -285,15 +536,21 @@ start_server {
         assert_equal 0 [r exists setres]
     }
 
-    foreach {type contents} {hashtable {a b c} intset {1 2 3}} {
+    foreach {type contents} {hashtable {a b c} listpack {a b c} intset {1 2 3} roaring {1 2 3}} {
         test "SPOP basics - $type" {
+            use_listpack $type
+            use_roaring $type
             create_set myset $contents
             assert_encoding $type myset
             assert_equal $contents [lsort [list [r spop myset] [r spop myset] [r spop myset]]]
             assert_equal 0 [r scard myset]
+            use_listpack listpack
+            use_roaring intset
         }
 
         test "SRANDMEMBER - $type" {
+            use_listpack $type
+            use_roaring $type
             create_set myset $contents
             unset -nocomplain myset
             array set myset {}
@@ -301,6 +558,8 @@ start_server {
                 set myset([r srandmember myset]) 1
             }
             assert_equal $contents [lsort [array names myset]]
+            use_listpack listpack
+            use_roaring intset
         }
     }
 
@@ -318,15 +577,33 @@ start_server {
             KIMBERLY DEBORAH JESSICA SHIRLEY CYNTHIA ANGELA MELISSA
             BRENDA AMY ANNA REBECCA VIRGINIA KATHLEEN
         }
+        listpack {
+            1 5 10 50 125 50000 33959417 4775547 65434162
+            12098459 427716 483706 2726473884 72615637475
+            MARY PATRICIA LINDA BARBARA ELIZABETH JENNIFER MARIA
+            SUSAN MARGARET DOROTHY LISA NANCY KAREN BETTY HELEN
+            SANDRA DONNA CAROL RUTH SHARON MICHELLE LAURA SARAH
+            KIMBERLY DEBORAH JESSICA SHIRLEY CYNTHIA ANGELA MELISSA
+            BRENDA AMY ANNA REBECCA VIRGINIA KATHLEEN
+        }
         intset {
             0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19
             20 21 22 23 24 25 26 27 28 29
             30 31 32 33 34 35 36 37 38 39
             40 41 42 43 44 45 46 47 48 49
         }
+        roaring {
+            0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19
+            20 21 22 23 24 25 26 27 28 29
+            30 31 32 33 34 35 36 37 38 39
+            40 41 42 43 44 45 46 47 48 49
+        }
     } {
         test "SRANDMEMBER with <count> - $type" {
+            use_listpack $type
+            use_roaring $type
             create_set myset $contents
+            assert_encoding $type myset
             unset -nocomplain myset
             array set myset {}
             foreach ele [r smembers myset] {
@@ -413,6 +690,8 @@ start_server {
                 }
                 assert {$iterations != 0}
             }
+            use_listpack listpack
+            use_roaring intset
         }
     }
 
@@ -420,17 +699,17 @@ start_server {
         r del myset3 myset4
         create_set myset1 {1 a b}
         create_set myset2 {2 3 4}
-        assert_encoding hashtable myset1
+        assert_encoding listpack myset1
         assert_encoding intset myset2
     }
 
-    test "SMOVE basics - from regular set to intset" {
+    test "SMOVE basics - from listpack to intset" {
         # move a non-integer element to an intset should convert encoding
         setup_move
         assert_equal 1 [r smove myset1 myset2 a]
         assert_equal {1 b} [lsort [r smembers myset1]]
         assert_equal {2 3 4 a} [lsort [r smembers myset2]]
-        assert_encoding hashtable myset2
+        assert_encoding listpack myset2
 
         # move an integer element should not convert the encoding
         setup_move
@@ -440,7 +719,7 @@ start_server {
         assert_encoding intset myset2
     }
 
-    test "SMOVE basics - from intset to regular set" {
+    test "SMOVE basics - from intset to listpack" {
         setup_move
         assert_equal 1 [r smove myset2 myset1 2]
         assert_equal {1 2 a b} [lsort [r smembers myset1]]
@@ -460,12 +739,12 @@ start_server {
         assert_equal {2 3 4} [lsort [r smembers myset2]]
     }
 
-    test "SMOVE from regular set to non existing destination set" {
+    test "SMOVE from listpack to non existing destination set" {
         setup_move
         assert_equal 1 [r smove myset1 myset3 a]
         assert_equal {1 b} [lsort [r smembers myset1]]
         assert_equal {a} [lsort [r smembers myset3]]
-        assert_encoding hashtable myset3
+        assert_encoding listpack myset3
     }
 
     test "SMOVE from intset to non existing destination set" {
@@ -7,12 +7,17 @@ start_server {tags {"zset"}} {
     }
 
     proc basics {encoding} {
-        if {$encoding == "ziplist"} {
+        if {$encoding == "zpack"} {
             r config set zset-max-ziplist-entries 128
             r config set zset-max-ziplist-value 64
         } elseif {$encoding == "skiplist"} {
             r config set zset-max-ziplist-entries 0
             r config set zset-max-ziplist-value 0
+            r config set zset-large-encoding skiplist
+        } elseif {$encoding == "btree"} {
+            r config set zset-max-ziplist-entries 0
+            r config set zset-max-ziplist-value 0
+            r config set zset-large-encoding btree
         } else {
             puts "Unknown sorted set encoding"
             exit
@@ -290,6 +295,20 @@ start_server {tags {"zset"}} {
             assert_equal {d 3 c 2} [r zrevrangebyscore zset 5 2 LIMIT 2 3 WITHSCORES]
         }
 
+        test "ZRANGEBYSCORE with LIMIT offsets at the edges - $encoding" {
+            create_default_zset
+            assert_equal {f}     [r zrangebyscore zset 0 10 LIMIT 4 10]
+            assert_equal {}      [r zrangebyscore zset 0 10 LIMIT 5 10]
+            assert_equal {g}     [r zrangebyscore zset -inf +inf LIMIT 6 10]
+            assert_equal {}      [r zrangebyscore zset -inf +inf LIMIT 7 10]
+            assert_equal {b}     [r zrevrangebyscore zset 10 0 LIMIT 4 10]
+            assert_equal {}      [r zrevrangebyscore zset 10 0 LIMIT 5 10]
+            assert_equal {a}     [r zrevrangebyscore zset +inf -inf LIMIT 6 10]
+            assert_equal {}      [r zrevrangebyscore zset +inf -inf LIMIT 7 10]
+            assert_equal {}      [r zrangebyscore zset -inf +inf LIMIT -1 10]
+            assert_equal {}      [r zrevrangebyscore zset +inf -inf LIMIT -1 10]
+        }
+
         test "ZRANGEBYSCORE with non-value min or max" {
             assert_error "*not*float*" {r zrangebyscore fooz str 1}
             assert_error "*not*float*" {r zrangebyscore fooz 1 str}
@@ -344,6 +363,19 @@ start_server {tags {"zset"}} {
             assert_equal {omega hill great foo} [r zrevrangebylex zset + \[d LIMIT 0 4]
         }
 
+        test "ZRANGEBYLEX with LIMIT offsets at the edges - $encoding" {
+            create_default_lex_zset
+            assert_equal {down} [r zrangebylex zset \[bar \[down LIMIT 2 10]
+            assert_equal {} [r zrangebylex zset \[bar \[down LIMIT 3 10]
+            assert_equal {omega} [r zrangebylex zset - + LIMIT 8 10]
+            assert_equal {} [r zrangebylex zset - + LIMIT 9 10]
+            assert_equal {bar} [r zrevrangebylex zset \[down \[bar LIMIT 2 10]
+            assert_equal {} [r zrevrangebylex zset \[down \[bar LIMIT 3 10]
+            assert_equal {alpha} [r zrevrangebylex zset + - LIMIT 8 10]
+            assert_equal {} [r zrevrangebylex zset + - LIMIT 9 10]
+            assert_equal {} [r zrangebylex zset - + LIMIT -1 10]
+        }
+
         test "ZRANGEBYLEX with invalid lex range specifiers" {
             assert_error "*not*string*" {r zrangebylex fooz foo bar}
             assert_error "*not*string*" {r zrangebylex fooz \[foo bar}
@@ -527,6 +559,34 @@ start_server {tags {"zset"}} {
             assert_equal {b 2 c 3} [r zrange zsetc 0 -1 withscores]
         }
 
+        test "ZUNION and ZINTER return the result without storing it - $encoding" {
+            r del zsetc
+            assert_equal {a b d c} [r zunion 2 zseta zsetb]
+            assert_equal {a 2 b 7 d 9 c 12} \
+                [r zunion 2 zseta zsetb weights 2 3 withscores]
+            assert_equal {a 1 b 1 c 2 d 3} \
+                [r zunion 2 zseta zsetb aggregate min withscores]
+            assert_equal {b 3 c 5} [r zinter 2 zseta zsetb withscores]
+            assert_equal {b 2 c 3} [r zinter 2 zseta zsetb aggregate max withscores]
+            assert_equal {} [r zinter 2 zseta nokey]
+            assert_equal {} [r zunion 1 nokey]
+            assert_equal 0 [r exists zsetc]
+            assert_error "*syntax*" {r zunion 2 zseta}
+            assert_error "*syntax*" {r zunionstore zsetc 2 zseta zsetb withscores}
+        }
+
+        test "ZINTERCARD basics - $encoding" {
+            assert_equal 2 [r zintercard 2 zseta zsetb]
+            assert_equal 3 [r zintercard 1 zseta]
+            assert_equal 1 [r zintercard 2 zseta zsetb limit 1]
+            assert_equal 2 [r zintercard 2 zseta zsetb limit 0]
+            assert_equal 2 [r zintercard 2 zseta zsetb limit 10]
+            assert_equal 3 [r zintercard 2 zseta seta]
+            assert_equal 0 [r zintercard 2 zseta nokey]
+            assert_error "*negative*" {r zintercard 1 zseta limit -1}
+            assert_error "*syntax*" {r zintercard 3 zseta zsetb}
+        }
+
         foreach cmd {ZUNIONSTORE ZINTERSTORE} {
             test "$cmd with +inf/-inf scores - $encoding" {
                 r del zsetinf1 zsetinf2
@@ -564,8 +624,10 @@ start_server {tags {"zset"}} {
         }
     }
 
-    basics ziplist
+    basics zpack
     basics skiplist
+    basics btree
+    r config set zset-large-encoding skiplist
 
     test {ZINTERSTORE regression with two sets, intset+hashtable} {
         r del seta setb setc
@@ -580,7 +642,7 @@ start_server {tags {"zset"}} {
         r zrange out 0 -1 withscores
     } {neginf 0}
 
-    test {ZINTERSTORE #516 regression, mixed sets and ziplist zsets} {
+    test {ZINTERSTORE #516 regression, mixed sets and zpack zsets} {
         r sadd one 100 101 102 103
         r sadd two 100 200 201 202
         r zadd three 1 500 1 501 1 502 1 503 1 100
@@ -589,7 +651,7 @@ start_server {tags {"zset"}} {
     } {100}
 
     proc stressers {encoding} {
-        if {$encoding == "ziplist"} {
+        if {$encoding == "zpack"} {
             # Little extra to allow proper fuzzing in the sorting stresser
             r config set zset-max-ziplist-entries 256
             r config set zset-max-ziplist-value 64
@@ -597,7 +659,14 @@ start_server {tags {"zset"}} {
         } elseif {$encoding == "skiplist"} {
             r config set zset-max-ziplist-entries 0
             r config set zset-max-ziplist-value 0
+            r config set zset-large-encoding skiplist
             if {$::accurate} {set elements 1000} else {set elements 100}
+        } elseif {$encoding == "btree"} {
+            # Enough elements to have more than a few leaves
+            r config set zset-max-ziplist-entries 0
+            r config set zset-max-ziplist-value 0
+            r config set zset-large-encoding btree
+            if {$::accurate} {set elements 5000} else {set elements 500}
         } else {
             puts "Unknown sorted set encoding"
             exit
@@ -913,10 +982,204 @@ start_server {tags {"zset"}} {
             }
             assert_equal {} $err
         }
+
+        test "ZSETs built in bulk stay consistent after updates - $encoding" {
+            r del zsrc zdst zinter
+            for {set j 0} {$j < $elements} {incr j} {
+                r zadd zsrc [expr {[randomInt 100]/4.0}] $j
+            }
+            # ZUNIONSTORE / ZINTERSTORE output and RDB loading append the
+            # elements in order instead of inserting them one by one.
+            r zunionstore zdst 1 zsrc
+            r zinterstore zinter 2 zsrc zdst weights 1 0
+            r debug reload
+            assert_encoding $encoding zdst
+            assert_equal [r zrange zsrc 0 -1 withscores] \
+                         [r zrange zdst 0 -1 withscores]
+            assert_equal [r zrange zsrc 0 -1] [r zrange zinter 0 -1]
+            for {set j 0} {$j < 500} {incr j} {
+                set ele [randomInt [expr {$elements*2}]]
+                if {rand() < .3} {
+                    assert_equal [r zrem zsrc $ele] [r zrem zdst $ele]
+                } else {
+                    set score [expr {[randomInt 100]/4.0}]
+                    r zadd zsrc $score $ele
+                    r zadd zdst $score $ele
+                }
+                set index [randomInt [r zcard zdst]]
+                set ele [lindex [r zrange zdst $index $index] 0]
+                assert_equal $index [r zrank zdst $ele]
+            }
+            assert_equal [r zrange zsrc 0 -1 withscores] \
+                         [r zrange zdst 0 -1 withscores]
+        }
     }
 
     tags {"slow"} {
-        stressers ziplist
+        stressers zpack
         stressers skiplist
+        stressers btree
+        r config set zset-large-encoding skiplist
+    }
+
+    test {Large zpack zset: lookups match the skiplist encoding} {
+        r del zbig zbigsl
+        r config set zset-max-ziplist-entries 0
+        r zadd zbigsl 0 m0
+        r config set zset-max-ziplist-entries 4000
+        r config set zset-max-ziplist-value 64
+        for {set j 0} {$j < 3000} {incr j} {
+            set score [expr {[randomInt 500]/2.0}]
+            r zadd zbig $score m$j
+            r zadd zbigsl $score m$j
+        }
+        assert_encoding zpack zbig
+        assert_encoding skiplist zbigsl
+        for {set j 0} {$j < 100} {incr j} {
+            set ele m[randomInt 3000]
+            set min [randomInt 250]
+            set max [expr {$min+[randomInt 20]}]
+            set off [randomInt 200]
+            assert_equal [r zscore zbigsl $ele] [r zscore zbig $ele]
+            assert_equal [r zrank zbigsl $ele] [r zrank zbig $ele]
+            assert_equal [r zrevrank zbigsl $ele] [r zrevrank zbig $ele]
+            assert_equal [r zcount zbigsl ($min $max] [r zcount zbig ($min $max]
+            assert_equal [r zrangebyscore zbigsl $min ($max limit $off 5] \
+                         [r zrangebyscore zbig $min ($max limit $off 5]
+            assert_equal [r zrevrangebyscore zbigsl $max $min limit $off 5] \
+                         [r zrevrangebyscore zbig $max $min limit $off 5]
+            assert_equal [r zrange zbigsl $off [expr {$off+3}] withscores] \
+                         [r zrange zbig $off [expr {$off+3}] withscores]
+        }
+        assert_equal [r zremrangebyscore zbigsl 10 (20] \
+                     [r zremrangebyscore zbig 10 (20]
+        assert_equal [r zrange zbigsl 0 -1 withscores] \
+                     [r zrange zbig 0 -1 withscores]
+        r config set zset-max-ziplist-entries 128
+    }
+
+    test {Large btree zset: updates and range deletions match the skiplist} {
+        r del zbt zsl
+        r config set zset-max-ziplist-entries 0
+        r config set zset-large-encoding btree
+        for {set j 0} {$j < 6000} {incr j} {
+            set score [randomInt 1000]
+            r zadd zbt $score m$j
+            r zadd zsl $score m$j
+        }
+        r config set zset-large-encoding skiplist
+        r del zsl
+        for {set j 0} {$j < 6000} {incr j} {
+            r zadd zsl [r zscore zbt m$j] m$j
+        }
+        assert_encoding btree zbt
+        assert_encoding skiplist zsl
+        for {set j 0} {$j < 200} {incr j} {
+            set ele m[randomInt 6000]
+            set score [randomInt 1000]
+            assert_equal [r zadd zsl $score $ele] [r zadd zbt $score $ele]
+            assert_equal [r zincrby zsl 1 m$j] [r zincrby zbt 1 m$j]
+            set ele m[randomInt 6000]
+            assert_equal [r zrem zsl $ele] [r zrem zbt $ele]
+            set ele m[randomInt 6000]
+            assert_equal [r zrank zsl $ele] [r zrank zbt $ele]
+            assert_equal [r zrevrank zsl $ele] [r zrevrank zbt $ele]
+            set min [randomInt 1000]
+            set max [expr {$min+[randomInt 50]}]
+            set off [randomInt 100]
+            assert_equal [r zcount zsl $min ($max] [r zcount zbt $min ($max]
+            assert_equal [r zrangebyscore zsl $min $max withscores limit $off 5] \
+                         [r zrangebyscore zbt $min $max withscores limit $off 5]
+            assert_equal [r zrevrangebyscore zsl $max ($min limit $off 5] \
+                         [r zrevrangebyscore zbt $max ($min limit $off 5]
+            set start [randomInt 6000]
+            assert_equal [r zrange zsl $start [expr {$start+3}] withscores] \
+                         [r zrange zbt $start [expr {$start+3}] withscores]
+            assert_equal [r zrevrange zsl $start [expr {$start+3}]] \
+                         [r zrevrange zbt $start [expr {$start+3}]]
+        }
+        # Large range deletions empty whole leaves at once.
+        assert_equal [r zremrangebyscore zsl 100 (400] \
+                     [r zremrangebyscore zbt 100 (400]
+        assert_equal [r zremrangebyrank zsl 10 1500] \
+                     [r zremrangebyrank zbt 10 1500]
+        assert_equal [r zremrangebyrank zsl -1000 -2] \
+                     [r zremrangebyrank zbt -1000 -2]
+        assert_equal [r zrange zsl 0 -1 withscores] [r zrange zbt 0 -1 withscores]
+        assert_equal [r zrevrange zsl 0 -1] [r zrevrange zbt 0 -1]
+        assert_equal [r zrangebyscore zsl -inf +inf limit 500 50] \
+                     [r zrangebyscore zbt -inf +inf limit 500 50]
+        set digest [r debug digest]
+        r config set zset-large-encoding btree
+        r debug reload
+        assert_encoding btree zsl
+        assert_equal $digest [r debug digest]
+        assert_equal [r zrange zsl 0 -1 withscores] [r zrange zbt 0 -1 withscores]
+        r config set zset-large-encoding skiplist
     }
+
+    test {Large btree zset: lex ranges} {
+        r del zbt
+        r config set zset-large-encoding btree
+        set members {}
+        for {set j 0} {$j < 3000} {incr j} {
+            lappend members [randstring 1 8 alpha]
+        }
+        foreach m $members {r zadd zbt 0 $m}
+        assert_encoding btree zbt
+        set sorted [lsort -unique $members]
+        assert_equal $sorted [r zrangebylex zbt - +]
+        for {set j 0} {$j < 50} {incr j} {
+            set min [lindex $sorted [randomInt [llength $sorted]]]
+            set max [lindex $sorted [randomInt [llength $sorted]]]
+            set res [r zrangebylex zbt \[$min \[$max]
+            set exp {}
+            foreach m $sorted {
+                if {[string compare $m $min] >= 0 && [string compare $m $max] <= 0} {lappend exp $m}
+            }
+            assert_equal $exp $res
+            assert_equal [llength $exp] [r zlexcount zbt \[$min \[$max]
+            assert_equal [lrange $exp 3 5] [r zrangebylex zbt \[$min \[$max limit 3 3]
+            assert_equal [lrange [lreverse $exp] 2 3] \
+                         [r zrevrangebylex zbt \[$max \[$min limit 2 2]
+        }
+        set first [lindex $sorted 100]
+        set last [lindex $sorted 2000]
+        assert_equal 1901 [r zremrangebylex zbt \[$first \[$last]
+        assert_equal [concat [lrange $sorted 0 99] [lrange $sorted 2001 end]] \
+                     [r zrangebylex zbt - +]
+        r config set zset-large-encoding skiplist
+    }
+
+    foreach encoding {skiplist btree} {
+        test "Large $encoding zset shrinking below half the limit becomes a zpack" {
+            r config set zset-max-ziplist-entries 32
+            r config set zset-large-encoding $encoding
+            r del zs
+            for {set i 0} {$i < 100} {incr i} { r zadd zs $i m$i }
+            assert_encoding $encoding zs
+            r zremrangebyrank zs 0 49
+            assert_encoding $encoding zs
+            r zremrangebyscore zs 50 80
+            assert_encoding $encoding zs
+            r zrem zs m81 m82 m83
+            assert_encoding zpack zs
+            assert_equal {m84 84} [r zrange zs 0 0 withscores]
+            assert_equal 16 [r zcard zs]
+            r config set zset-max-ziplist-entries 128
+            r config set zset-large-encoding skiplist
+        }
+    }
+
+    test {Encoding conversions are counted in INFO} {
+        r config resetstat
+        r config set zset-max-ziplist-entries 4
+        r del zs
+        r zadd zs 1 a 2 b 3 c 4 d 5 e
+        assert_encoding skiplist zs
+        r zrem zs a b c
+        assert_encoding zpack zs
+        r config set zset-max-ziplist-entries 128
+        list [status r encoding_upgrades] [status r encoding_downgrades]
+    } {1 1}
 }
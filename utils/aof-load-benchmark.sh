@@ -0,0 +1,50 @@
+#!/bin/sh
+# Measure the AOF loading throughput: an AOF with a mix of string, list,
+# hash and counter updates is generated, then loaded at startup, and the
+# loading_last_* fields of INFO persistence are reported.
+#
+# Usage: ./utils/aof-load-benchmark.sh [commands] [port]
+# Run from the root of the source tree after "make".
+
+COMMANDS=${1:-1000000}
+PORT=${2:-7777}
+DIR=$(mktemp -d /tmp/redis-aof-benchmark.XXXXXX)
+CLI="src/redis-cli -p $PORT"
+
+# Generate the AOF writing the commands in the protocol format directly.
+awk -v n=$COMMANDS 'BEGIN {
+    for (i = 0; i < n; i++) {
+        r = i % 4
+        if (r == 0) {
+            k = "key:" i; v = sprintf("%0" (10+i%90) "d", i)
+            printf "*3\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$%d\r\n%s\r\n", \
+                length(k), k, length(v), v
+        } else if (r == 1) {
+            k = "list:" (i%1000); v = "item:" i
+            printf "*3\r\n$5\r\nRPUSH\r\n$%d\r\n%s\r\n$%d\r\n%s\r\n", \
+                length(k), k, length(v), v
+        } else if (r == 2) {
+            k = "hash:" (i%5000); f = "f" i; v = "val" i
+            printf "*4\r\n$4\r\nHSET\r\n$%d\r\n%s\r\n$%d\r\n%s\r\n$%d\r\n%s\r\n", \
+                length(k), k, length(f), f, length(v), v
+        } else {
+            k = "counter:" (i%10000)
+            printf "*2\r\n$4\r\nINCR\r\n$%d\r\n%s\r\n", length(k), k
+        }
+    }
+}' > $DIR/appendonly.aof
+echo "AOF size: $(wc -c < $DIR/appendonly.aof) bytes"
+
+for RUN in 1 2 3
+do
+    src/redis-server --port $PORT --save "" --dir $DIR --appendonly yes \
+        > $DIR/redis.log 2>&1 &
+    while ! $CLI ping 2>/dev/null | grep -q PONG
+    do
+        sleep 0.1
+    done
+    $CLI info persistence | grep loading_last | tr -d '\r'
+    $CLI shutdown nosave > /dev/null
+    sleep 1
+done
+rm -rf $DIR
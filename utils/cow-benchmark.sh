@@ -0,0 +1,40 @@
+#!/bin/sh
+# Measure the memory duplicated by copy-on-write during a BGSAVE while the
+# main hash table is rehashing and the server serves read traffic, with
+# cow-aware-child enabled and disabled.
+#
+# Usage: ./utils/cow-benchmark.sh [keys] [port]
+# Run from the root of the source tree after "make".
+
+KEYS=${1:-1048576}
+PORT=${2:-7777}
+DIR=$(mktemp -d /tmp/redis-cow-benchmark.XXXXXX)
+CLI="src/redis-cli -p $PORT"
+
+for MODE in no yes
+do
+    rm -f $DIR/dump.rdb
+    src/redis-server --port $PORT --save "" --dir $DIR \
+        --cow-aware-child $MODE > $DIR/redis-$MODE.log 2>&1 &
+    sleep 1
+
+    # Populate the dataset, then add one more key so that the main hash
+    # table starts rehashing right before the child is forked.
+    $CLI debug populate $KEYS > /dev/null
+    $CLI set cow-benchmark-trigger 1 > /dev/null
+    $CLI bgsave > /dev/null
+
+    # Every lookup performs a rehashing step unless cow-aware-child is set.
+    src/redis-benchmark -p $PORT -t get -n $(($KEYS*2)) -r $KEYS -P 32 -q \
+        > /dev/null
+
+    while $CLI info persistence | grep -q "rdb_bgsave_in_progress:1"
+    do
+        sleep 0.1
+    done
+    COW=$($CLI info persistence | grep rdb_last_cow_size | tr -d '\r')
+    echo "cow-aware-child $MODE: ${COW#*:} bytes of copy-on-write"
+    $CLI shutdown nosave > /dev/null
+    sleep 1
+done
+rm -rf $DIR
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Measure the page latency of ZRANGEBYSCORE / ZRANGEBYLEX with LIMIT at
+# growing offsets: a sorted set with the requested number of elements is
+# created, then pages of 10 elements are requested at every offset with
+# redis-benchmark. With O(log(N)) offsets the throughput should be about the
+# same whatever the offset.
+#
+# Usage: ./utils/zrange-offset-benchmark.sh [elements] [port]
+# Run from the root of the source tree after "make".
+
+ELEMENTS=${1:-1000000}
+PORT=${2:-7777}
+DIR=$(mktemp -d /tmp/redis-zrange-benchmark.XXXXXX)
+CLI="src/redis-cli -p $PORT"
+BENCH="src/redis-benchmark -p $PORT -q -n 20000"
+
+src/redis-server --port $PORT --save "" --dir $DIR > $DIR/redis.log 2>&1 &
+while ! $CLI ping 2>/dev/null | grep -q PONG
+do
+    sleep 0.1
+done
+
+# Scores are all different in "zs", all zero in "zl" for the lex ranges.
+$CLI eval "for i=1,tonumber(ARGV[1]) do
+               redis.call('zadd','zs',i,'member:'..i)
+               redis.call('zadd','zl',0,string.format('member:%010d',i))
+           end" 0 $ELEMENTS > /dev/null
+echo "$($CLI zcard zs) elements, $($CLI object encoding zs) encoding"
+
+for OFFSET in 0 10 1000 100000 $(($ELEMENTS-10))
+do
+    echo "offset $OFFSET"
+    $BENCH zrangebyscore zs -inf +inf limit $OFFSET 10
+    $BENCH zrevrangebyscore zs +inf -inf limit $OFFSET 10
+    $BENCH zrangebylex zl - + limit $OFFSET 10
+    $BENCH zrevrangebylex zl + - limit $OFFSET 10
+done
+
+$CLI shutdown nosave > /dev/null
+rm -rf $DIR